@@ -0,0 +1,114 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include <glm/glm.hpp>
+
+#include "learnopengl/animdata.h"
+#include "learnopengl/bone.h"
+#include "learnopengl/assimp_glm_helpers.h"
+#include "learnopengl/asset_io_system.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+using namespace std;
+
+// a node of the scene hierarchy, flattened so a pose can be evaluated with one loop instead of a recursion
+struct AnimationNode {
+    string name;
+    glm::mat4 transformation; // local bind pose transform, used when the clip doesn't animate the node
+    int parent;               // index into Animation::nodes, -1 for the root. Parents always come before their children.
+    int bone;                 // index into Animation::bones, -1 if the clip has no keys for the node
+    int boneId;               // index into the bone palette, -1 if no vertex is bound to the node
+    glm::mat4 offset;         // BoneInfo::offset of the palette entry
+};
+
+// one animation clip of a skinned model, together with the skeleton it drives
+class Animation
+{
+public:
+    string name;
+    float duration;       // in ticks
+    float ticksPerSecond;
+    vector<Bone> bones;
+    vector<AnimationNode> nodes;
+    glm::mat4 globalInverseTransform;
+
+    // reads the clip with the given index from a scene that was already imported, e.g. by Model.
+    // boneInfoMap is the model's map from bone names to palette entries.
+    Animation(const aiScene *scene, unsigned int index, const map<string, BoneInfo> &boneInfoMap)
+    {
+        load(scene, index, boneInfoMap);
+    }
+
+    // reads a clip from a separate animation file that uses the same bone names as the model
+    Animation(const string &animationPath, const map<string, BoneInfo> &boneInfoMap, unsigned int index = 0) : duration(0.0f), ticksPerSecond(25.0f), globalInverseTransform(1.0f)
+    {
+        Assimp::Importer importer;
+        importer.SetIOHandler(new AssetIOSystem());
+        const aiScene *scene = importer.ReadFile(animationPath, 0);
+        if (!scene || !scene->mRootNode || index >= scene->mNumAnimations)
+        {
+            cout << "ERROR::ANIMATION:: no animation " << index << " in " << animationPath << " " << importer.GetErrorString() << endl;
+            return;
+        }
+        load(scene, index, boneInfoMap);
+    }
+
+    // takes the palette entries and offsets of the nodes from boneInfoMap again, after the model was reloaded
+    void UpdateBones(const map<string, BoneInfo> &boneInfoMap)
+    {
+        for (unsigned int i = 0; i < nodes.size(); i++)
+        {
+            map<string, BoneInfo>::const_iterator info = boneInfoMap.find(nodes[i].name);
+            nodes[i].boneId = info != boneInfoMap.end() ? info->second.id : -1;
+            nodes[i].offset = info != boneInfoMap.end() ? info->second.offset : glm::mat4(1.0f);
+        }
+    }
+
+private:
+    void load(const aiScene *scene, unsigned int index, const map<string, BoneInfo> &boneInfoMap)
+    {
+        const aiAnimation *animation = scene->mAnimations[index];
+        name = animation->mName.C_Str();
+        duration = (float)animation->mDuration;
+        // files without a tick rate are sampled at 25 ticks per second, like assimp's own viewer does
+        ticksPerSecond = animation->mTicksPerSecond > 0.0 ? (float)animation->mTicksPerSecond : 25.0f;
+        globalInverseTransform = glm::inverse(AssimpGLMHelpers::ConvertMatrixToGLMFormat(scene->mRootNode->mTransformation));
+
+        map<string, int> channels;
+        for (unsigned int i = 0; i < animation->mNumChannels; i++)
+        {
+            const aiNodeAnim *channel = animation->mChannels[i];
+            channels[channel->mNodeName.C_Str()] = (int)bones.size();
+            bones.push_back(Bone(channel->mNodeName.C_Str(), channel));
+        }
+
+        nodes.clear();
+        readHierarchy(scene->mRootNode, -1, channels, boneInfoMap);
+    }
+
+    // appends the node and its children in depth first order
+    void readHierarchy(const aiNode *src, int parent, const map<string, int> &channels, const map<string, BoneInfo> &boneInfoMap)
+    {
+        AnimationNode node;
+        node.name = src->mName.C_Str();
+        node.transformation = AssimpGLMHelpers::ConvertMatrixToGLMFormat(src->mTransformation);
+        node.parent = parent;
+        map<string, int>::const_iterator channel = channels.find(node.name);
+        node.bone = channel != channels.end() ? channel->second : -1;
+        map<string, BoneInfo>::const_iterator info = boneInfoMap.find(node.name);
+        node.boneId = info != boneInfoMap.end() ? info->second.id : -1;
+        node.offset = info != boneInfoMap.end() ? info->second.offset : glm::mat4(1.0f);
+
+        int self = (int)nodes.size();
+        nodes.push_back(node);
+        for (unsigned int i = 0; i < src->mNumChildren; i++)
+            readHierarchy(src->mChildren[i], self, channels, boneInfoMap);
+    }
+};
+#endif
@@ -0,0 +1,16 @@
+#ifndef ANIMDATA_H
+#define ANIMDATA_H
+
+#include <glm/glm.hpp>
+
+// must match the array size of the Bones uniform block in resources/shader/prelude.vs
+#define MAX_BONES 100
+
+// a bone of a skinned model
+struct BoneInfo {
+    // index into the bone palette
+    int id;
+    // transforms a vertex from model space into the bind pose space of the bone
+    glm::mat4 offset;
+};
+#endif
@@ -0,0 +1,331 @@
+#ifndef ASSET_ARCHIVE_H
+#define ASSET_ARCHIVE_H
+
+#include "learnopengl/mapped_file.h"
+// build with HAVE_LZ4 and link lz4 to compress archive entries, and to read archives with compressed entries
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+using namespace std;
+
+#define ASSET_ARCHIVE_VERSION 2
+// small entries start on this boundary, so their data is aligned for any type it holds
+#define ASSET_ARCHIVE_ALIGNMENT 16
+// entries of at least a page start on a page, so they don't share pages with their neighbours and could be mapped
+// on their own
+#define ASSET_ARCHIVE_PAGE 4096
+
+enum AssetCompression {
+    ASSET_STORED = 0,
+    ASSET_LZ4 = 1
+};
+
+// a file in the archive, with the size and time of the file it was packed from
+struct AssetEntry {
+    unsigned long long offset;
+    unsigned long long storedSize;   // bytes in the archive
+    unsigned long long size;         // bytes of the file
+    long long modified;
+    unsigned long long contentHash;  // FNV-1a of the file, equal files share their data
+    AssetCompression compression;
+
+    AssetEntry() : offset(0), storedSize(0), size(0), modified(0), contentHash(0), compression(ASSET_STORED)
+    {
+    }
+};
+
+// a file to pack, stored under name
+struct AssetInput {
+    string name;
+    FileView data;
+    long long modified;
+
+    AssetInput() : modified(0)
+    {
+    }
+};
+
+struct AssetPackStats {
+    unsigned int files;
+    unsigned int deduplicated;  // files sharing the data of an equal one
+    unsigned int compressed;    // files stored LZ4 compressed
+    size_t bytes;               // size of the files
+    size_t archiveBytes;        // size of the archive
+
+    AssetPackStats() : files(0), deduplicated(0), compressed(0), bytes(0), archiveBytes(0)
+    {
+    }
+};
+
+// One file holding many, in little endian:
+//   header:  "ASSETPAK", uint32 version, uint32 entry count, uint32 slot count, uint32 0, uint64 index offset
+//   data:    the entries, aligned, each distinct content once
+//   index:   uint32 slots, a hash table of the paths with linear probing, entry number + 1 or 0 when empty;
+//            64 byte entries: uint64 path hash, content hash, offset, stored size, size, int64 modification time,
+//            uint32 path offset, path length, compression, 0; then the paths
+// The archive is mapped as a whole. Opening it only checks the header, a lookup hashes the path and probes the
+// slots in place, so nothing is read or built up front however many files it holds. Stored entries are views
+// into the mapping, LZ4 entries are decompressed on every open.
+class AssetArchive
+{
+public:
+    AssetArchive() : entryCount(0), slotCount(0), index(nullptr)
+    {
+    }
+
+    // maps the archive and checks its header, false if it isn't a readable archive
+    bool Open(const string &path)
+    {
+        shared_ptr<MappedFile> file = MappedFile::Open(path);
+        if (!file || file->Size() < headerSize)
+            return false;
+        const unsigned char *data = file->Data();
+        if (memcmp(data, "ASSETPAK", 8) != 0 || read32(data + 8) != ASSET_ARCHIVE_VERSION)
+            return false;
+        unsigned int entries = read32(data + 12), slots = read32(data + 16);
+        unsigned long long indexOffset = read64(data + 24);
+        if (slots == 0 || (slots & (slots - 1)) != 0 || entries >= slots
+            || indexOffset + (unsigned long long)slots * 4 + (unsigned long long)entries * entrySize > file->Size())
+            return false;
+        mapping = file;
+        entryCount = entries;
+        slotCount = slots;
+        index = data + indexOffset;
+        return true;
+    }
+
+    // the entry packed under path (after FileSystem::Normalize), false if there is none
+    bool Find(const string &path, AssetEntry &entry) const
+    {
+        if (!mapping)
+            return false;
+        unsigned long long hash = Hash((const unsigned char *)path.data(), path.size());
+        const unsigned char *records = index + (size_t)slotCount * 4;
+        const unsigned char *strings = records + (size_t)entryCount * entrySize;
+        size_t stringsSize = mapping->Data() + mapping->Size() - strings;
+        for (unsigned int probe = 0; probe < slotCount; probe++)
+        {
+            unsigned int slot = read32(index + (((unsigned int)hash + probe) & (slotCount - 1)) * 4);
+            if (slot == 0 || slot > entryCount)
+                return false;
+            const unsigned char *record = records + (size_t)(slot - 1) * entrySize;
+            unsigned int pathOffset = read32(record + 48), pathLength = read32(record + 52);
+            if (read64(record) != hash || pathLength != path.size() || (size_t)pathOffset + pathLength > stringsSize
+                || memcmp(strings + pathOffset, path.data(), pathLength) != 0)
+                continue;
+            entry.contentHash = read64(record + 8);
+            entry.offset = read64(record + 16);
+            entry.storedSize = read64(record + 24);
+            entry.size = read64(record + 32);
+            entry.modified = (long long)read64(record + 40);
+            entry.compression = (AssetCompression)read32(record + 56);
+            return entry.offset + entry.storedSize <= mapping->Size();
+        }
+        return false;
+    }
+
+    // the contents of an entry, not Valid() if it can't be decompressed
+    FileView View(const AssetEntry &entry) const
+    {
+        if (entry.compression == ASSET_STORED)
+            return FileView(mapping, (size_t)entry.offset, (size_t)entry.size);
+#ifdef HAVE_LZ4
+        if (entry.compression == ASSET_LZ4)
+        {
+            shared_ptr<vector<unsigned char> > buffer(new vector<unsigned char>((size_t)entry.size));
+            int size = LZ4_decompress_safe((const char *)mapping->Data() + entry.offset, (char *)buffer->data(), (int)entry.storedSize, (int)entry.size);
+            if (size == (int)entry.size)
+                return FileView(buffer);
+        }
+#endif
+        std::cout << "ERROR::ASSET_ARCHIVE:: can't decompress an entry" << std::endl;
+        return FileView();
+    }
+
+    unsigned int Count() const
+    {
+        return entryCount;
+    }
+
+    // 64 bit FNV-1a, of the paths and the contents
+    static unsigned long long Hash(const unsigned char *data, size_t size)
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ data[i]) * 1099511628211ULL;
+        return hash;
+    }
+
+    // writes the files into an archive at path. Files with equal contents are stored once; with compress (and
+    // HAVE_LZ4) every file is tried with LZ4 HC and kept compressed if that saves an eighth. Returns false if the
+    // archive can't be written.
+    static bool Pack(const string &path, const vector<AssetInput> &files, bool compress, AssetPackStats &stats)
+    {
+        ofstream out(path.c_str(), ios::binary | ios::trunc);
+        if (!out)
+        {
+            std::cout << "ERROR::ASSET_ARCHIVE:: can't write " << path << std::endl;
+            return false;
+        }
+        vector<unsigned char> header(headerSize, 0);
+        out.write((const char *)header.data(), header.size());
+        unsigned long long position = headerSize;
+
+        vector<AssetEntry> entries(files.size());
+        unordered_multimap<unsigned long long, unsigned int> stored;
+        for (unsigned int i = 0; i < files.size(); i++)
+        {
+            const FileView &data = files[i].data;
+            AssetEntry &entry = entries[i];
+            entry.size = data.size;
+            entry.modified = files[i].modified;
+            entry.contentHash = Hash(data.data, data.size);
+            stats.files++;
+            stats.bytes += data.size;
+
+            // content addressed: a file equal to one already stored points at its data
+            bool shared = false;
+            typedef unordered_multimap<unsigned long long, unsigned int>::iterator Match;
+            pair<Match, Match> matches = stored.equal_range(entry.contentHash);
+            for (Match it = matches.first; it != matches.second && !shared; ++it)
+            {
+                const FileView &other = files[it->second].data;
+                if (other.size == data.size && memcmp(other.data, data.data, data.size) == 0)
+                {
+                    entry.offset = entries[it->second].offset;
+                    entry.storedSize = entries[it->second].storedSize;
+                    entry.compression = entries[it->second].compression;
+                    shared = true;
+                }
+            }
+            if (shared)
+            {
+                stats.deduplicated++;
+                continue;
+            }
+            stored.insert(make_pair(entry.contentHash, i));
+
+            const unsigned char *bytes = data.data;
+            entry.storedSize = data.size;
+#ifdef HAVE_LZ4
+            vector<unsigned char> compressed;
+            if (compress && data.size > 0 && data.size < 0x7E000000)
+            {
+                compressed.resize(LZ4_compressBound((int)data.size));
+                int size = LZ4_compress_HC((const char *)data.data, (char *)compressed.data(), (int)data.size, (int)compressed.size(), LZ4HC_CLEVEL_MAX);
+                if (size > 0 && (size_t)size <= data.size - data.size / 8)
+                {
+                    bytes = compressed.data();
+                    entry.storedSize = size;
+                    entry.compression = ASSET_LZ4;
+                    stats.compressed++;
+                }
+            }
+#else
+            (void)compress;
+#endif
+            unsigned long long alignment = entry.storedSize >= ASSET_ARCHIVE_PAGE ? ASSET_ARCHIVE_PAGE : ASSET_ARCHIVE_ALIGNMENT;
+            unsigned long long aligned = (position + alignment - 1) / alignment * alignment;
+            vector<char> padding((size_t)(aligned - position), 0);
+            out.write(padding.data(), padding.size());
+            out.write((const char *)bytes, (streamsize)entry.storedSize);
+            entry.offset = aligned;
+            position = aligned + entry.storedSize;
+        }
+
+        // the hash table at most half full, so probe sequences stay short
+        unsigned int slots = 1;
+        while (slots < 2 * files.size() + 1)
+            slots *= 2;
+        vector<unsigned int> table(slots, 0);
+        vector<unsigned char> records, strings;
+        for (unsigned int i = 0; i < files.size(); i++)
+        {
+            unsigned long long hash = Hash((const unsigned char *)files[i].name.data(), files[i].name.size());
+            unsigned int slot = (unsigned int)hash & (slots - 1);
+            while (table[slot] != 0)
+                slot = (slot + 1) & (slots - 1);
+            table[slot] = i + 1;
+            const AssetEntry &entry = entries[i];
+            append64(records, hash);
+            append64(records, entry.contentHash);
+            append64(records, entry.offset);
+            append64(records, entry.storedSize);
+            append64(records, entry.size);
+            append64(records, (unsigned long long)entry.modified);
+            append32(records, (unsigned int)strings.size());
+            append32(records, (unsigned int)files[i].name.size());
+            append32(records, entry.compression);
+            append32(records, 0);
+            strings.insert(strings.end(), files[i].name.begin(), files[i].name.end());
+        }
+        vector<unsigned char> index;
+        for (unsigned int i = 0; i < slots; i++)
+            append32(index, table[i]);
+        index.insert(index.end(), records.begin(), records.end());
+        index.insert(index.end(), strings.begin(), strings.end());
+        unsigned long long indexOffset = (position + ASSET_ARCHIVE_ALIGNMENT - 1) / ASSET_ARCHIVE_ALIGNMENT * ASSET_ARCHIVE_ALIGNMENT;
+        vector<char> padding((size_t)(indexOffset - position), 0);
+        out.write(padding.data(), padding.size());
+        out.write((const char *)index.data(), index.size());
+
+        header.clear();
+        header.insert(header.end(), "ASSETPAK", "ASSETPAK" + 8);
+        append32(header, ASSET_ARCHIVE_VERSION);
+        append32(header, (unsigned int)files.size());
+        append32(header, slots);
+        append32(header, 0);
+        append64(header, indexOffset);
+        out.seekp(0);
+        out.write((const char *)header.data(), header.size());
+        out.close();
+        if (!out)
+        {
+            std::cout << "ERROR::ASSET_ARCHIVE:: can't write " << path << std::endl;
+            return false;
+        }
+        stats.archiveBytes = (size_t)(indexOffset + index.size());
+        return true;
+    }
+
+private:
+    static const unsigned int headerSize = 32;
+    static const unsigned int entrySize = 64;
+
+    shared_ptr<MappedFile> mapping;
+    unsigned int entryCount, slotCount;
+    const unsigned char *index;
+
+    static unsigned int read32(const unsigned char *p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+    }
+
+    static unsigned long long read64(const unsigned char *p)
+    {
+        return read32(p) | ((unsigned long long)read32(p + 4) << 32);
+    }
+
+    static void append32(vector<unsigned char> &out, unsigned int value)
+    {
+        for (unsigned int i = 0; i < 4; i++)
+            out.push_back((unsigned char)(value >> (8 * i)));
+    }
+
+    static void append64(vector<unsigned char> &out, unsigned long long value)
+    {
+        append32(out, (unsigned int)value);
+        append32(out, (unsigned int)(value >> 32));
+    }
+};
+#endif
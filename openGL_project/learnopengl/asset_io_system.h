@@ -0,0 +1,116 @@
+#ifndef ASSET_IO_SYSTEM_H
+#define ASSET_IO_SYSTEM_H
+
+#include <assimp/IOSystem.hpp>
+#include <assimp/IOStream.hpp>
+
+#include "learnopengl/file_system.h"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+// read-only Assimp stream over a FileView, reads copy straight out of the mapping
+class AssetIOStream : public Assimp::IOStream
+{
+public:
+    AssetIOStream(const FileView &view) : view(view), position(0)
+    {
+    }
+
+    size_t Read(void *buffer, size_t size, size_t count) override
+    {
+        if (size == 0)
+            return 0;
+        count = min(count, (view.size - position) / size);
+        memcpy(buffer, view.data + position, size * count);
+        position += size * count;
+        return count;
+    }
+
+    size_t Write(const void *, size_t, size_t) override
+    {
+        return 0;
+    }
+
+    // like fseek, except that the offset counts backwards from the end for aiOrigin_END
+    aiReturn Seek(size_t offset, aiOrigin origin) override
+    {
+        size_t target;
+        if (origin == aiOrigin_SET)
+            target = offset;
+        else if (origin == aiOrigin_CUR)
+            target = position + offset;
+        else if (offset <= view.size)
+            target = view.size - offset;
+        else
+            return aiReturn_FAILURE;
+        if (target > view.size)
+            return aiReturn_FAILURE;
+        position = target;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override
+    {
+        return position;
+    }
+
+    size_t FileSize() const override
+    {
+        return view.size;
+    }
+
+    void Flush() override
+    {
+    }
+
+private:
+    FileView view;
+    size_t position;
+};
+
+// Lets Assimp read models, and the files they reference like OBJ material libraries, through FileSystem. Hand
+// one to Importer::SetIOHandler, which takes ownership. The paths of the files it opened are appended to opened,
+// if given, so the importer's caller knows everything the model was built from.
+class AssetIOSystem : public Assimp::IOSystem
+{
+public:
+    AssetIOSystem(vector<string> *opened = nullptr) : opened(opened)
+    {
+    }
+
+    bool Exists(const char *file) const override
+    {
+        return FileSystem::Exists(file);
+    }
+
+    char getOsSeparator() const override
+    {
+        return '/';
+    }
+
+    // nullptr for anything but reading
+    Assimp::IOStream *Open(const char *file, const char *mode = "rb") override
+    {
+        if (strchr(mode, 'w') || strchr(mode, 'a'))
+            return nullptr;
+        FileView view = FileSystem::Open(file);
+        if (!view.Valid())
+            return nullptr;
+        if (opened && find(opened->begin(), opened->end(), FileSystem::Normalize(file)) == opened->end())
+            opened->push_back(FileSystem::Normalize(file));
+        return new AssetIOStream(view);
+    }
+
+    void Close(Assimp::IOStream *file) override
+    {
+        delete file;
+    }
+
+private:
+    vector<string> *opened;
+};
+#endif
@@ -0,0 +1,145 @@
+#ifndef ASSET_PACKER_H
+#define ASSET_PACKER_H
+
+#include "learnopengl/texture.h"
+#include "learnopengl/asset_archive.h"
+#include "learnopengl/file_system.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cctype>
+#include <cstdio>
+#include <iostream>
+using namespace std;
+
+// Builds the asset archive of a directory (--pack), with the assets cooked for the runtime:
+// - images are replaced by the KTX2 texture cache a desktop driver loads with the current texture settings: BC1
+//   or BC3 by alpha, BC7 with the high preset, RGBA8 with --raw-textures. No image is decoded or encoded at
+//   startup; a driver without those formats decodes the blocks instead (see TextureLoader::Read).
+// - shaders lose their comments, with the lines kept so compile errors still point at the right line,
+// - authoring files the runtime never reads (.max) are left out,
+// - everything else, the OBJ models and their material libraries, is packed as it is.
+// The archive deduplicates equal files and, built with HAVE_LZ4, compresses entries that shrink by an eighth.
+class AssetPacker
+{
+public:
+    static bool Pack(const string &archive, const string &directory)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        vector<string> files;
+        ListFiles(directory, files);
+        sort(files.begin(), files.end());
+
+        // the caches of the images, built again next to them, and everything that isn't an image or a cache
+        vector<string> packed, images;
+        for (unsigned int i = 0; i < files.size(); i++)
+            if (isImage(files[i]))
+                images.push_back(files[i]);
+            else if (!endsWith(files[i], ".max") && files[i].find(".cache.ktx2") == string::npos)
+                packed.push_back(files[i]);
+        TextureLoader::Precompress(images, TextureLoader::Settings().quality);
+        for (unsigned int i = 0; i < images.size(); i++)
+            packed.push_back(cacheFile(images[i]));
+        sort(packed.begin(), packed.end());
+
+        vector<AssetInput> inputs;
+        for (unsigned int i = 0; i < packed.size(); i++)
+        {
+            AssetInput input;
+            input.name = FileSystem::Normalize(packed[i]);
+            shared_ptr<MappedFile> file = MappedFile::Open(packed[i]);
+            long long size;
+            if (!file || !StatFile(packed[i], size, input.modified))
+            {
+                std::cout << "ERROR::ASSET_PACKER:: can't read " << packed[i] << std::endl;
+                return false;
+            }
+            input.data = FileView(file, 0, file->Size());
+            if (isShader(packed[i]))
+                input.data = stripComments(input.data);
+            inputs.push_back(input);
+        }
+
+        AssetPackStats stats;
+        if (!AssetArchive::Pack(archive, inputs, true, stats))
+            return false;
+        float ms = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+        printf("ASSET_PACKER:: %s: %u files (%u images cooked), %u deduplicated, %u LZ4 compressed, %.1f MB into %.1f MB, %.0f ms\n", archive.c_str(),
+            stats.files, (unsigned int)images.size(), stats.deduplicated, stats.compressed, stats.bytes / (1024.0f * 1024.0f), stats.archiveBytes / (1024.0f * 1024.0f), ms);
+        return true;
+    }
+
+private:
+    static bool endsWith(const string &path, const char *suffix)
+    {
+        size_t length = strlen(suffix);
+        if (path.size() < length)
+            return false;
+        for (size_t i = 0; i < length; i++)
+            if (tolower((unsigned char)path[path.size() - length + i]) != suffix[i])
+                return false;
+        return true;
+    }
+
+    static bool isImage(const string &path)
+    {
+        return endsWith(path, ".jpg") || endsWith(path, ".jpeg") || endsWith(path, ".png") || endsWith(path, ".tga") || endsWith(path, ".bmp");
+    }
+
+    static bool isShader(const string &path)
+    {
+        return endsWith(path, ".vs") || endsWith(path, ".fs") || endsWith(path, ".gs") || endsWith(path, ".glsl");
+    }
+
+    // the cache of image Read picks on a driver with BC1, BC3 and BC7, the RGBA8 one tells if it has alpha
+    static string cacheFile(const string &image)
+    {
+        TextureLevels levels;
+        if (!TextureLoader::Settings().compress)
+            return TextureLoader::CacheFile(image, levels);
+        Ktx2Image header;
+        bool alpha = Ktx2::Read(TextureLoader::CacheFile(image, levels), header, false) && header.keyValues["TextureAlpha"] == "1";
+        levels.compressed = true;
+        levels.format = TextureLoader::Settings().quality == COMPRESSION_HIGH ? BLOCK_BC7 : alpha ? BLOCK_BC3 : BLOCK_BC1;
+        return TextureLoader::CacheFile(image, levels);
+    }
+
+    // the source without // and /* */ comments or trailing blanks; newlines are kept, also inside comments
+    static FileView stripComments(const FileView &source)
+    {
+        shared_ptr<vector<unsigned char> > code(new vector<unsigned char>());
+        code->reserve(source.size);
+        const unsigned char *text = source.data;
+        for (size_t i = 0; i < source.size; i++)
+        {
+            if (text[i] == '/' && i + 1 < source.size && text[i + 1] == '/')
+            {
+                while (i + 1 < source.size && text[i + 1] != '\n')
+                    i++;
+            }
+            else if (text[i] == '/' && i + 1 < source.size && text[i + 1] == '*')
+            {
+                for (i += 2; i < source.size && !(text[i] == '*' && i + 1 < source.size && text[i + 1] == '/'); i++)
+                    if (text[i] == '\n')
+                        code->push_back('\n');
+                i++;
+                // the comment separated tokens
+                code->push_back(' ');
+            }
+            else
+            {
+                if (text[i] == '\n' || text[i] == '\r')
+                    while (!code->empty() && (code->back() == ' ' || code->back() == '\t'))
+                        code->pop_back();
+                code->push_back(text[i]);
+            }
+        }
+        while (!code->empty() && (code->back() == ' ' || code->back() == '\t'))
+            code->pop_back();
+        return FileView(code);
+    }
+};
+#endif
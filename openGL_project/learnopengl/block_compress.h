@@ -0,0 +1,1049 @@
+#ifndef BLOCK_COMPRESS_H
+#define BLOCK_COMPRESS_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+using namespace std;
+
+// Like the transform kernel, the nearest-palette search picks its instruction set at compile time: SSE on every
+// x64 build, scalar code everywhere else. Define BLOCK_COMPRESS_SCALAR to force the scalar path.
+#if !defined(BLOCK_COMPRESS_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define BLOCK_COMPRESS_SSE
+#include <xmmintrin.h>
+#endif
+
+// GPU block formats the encoder writes. All of them store 4x4 pixel blocks.
+enum BlockFormat {
+    BLOCK_BC1,        // RGB, 8 bytes per block (DXT1)
+    BLOCK_BC3,        // RGBA, BC1 color plus an interpolated alpha block, 16 bytes (DXT5)
+    BLOCK_BC7,        // RGBA, mode 6 only: one endpoint pair with 7 bits and a p-bit per channel, 16 bytes
+    BLOCK_ETC2_RGB,   // RGB, the ETC1 compatible individual and differential modes, 8 bytes
+    BLOCK_ETC2_RGBA,  // RGBA, an EAC alpha block followed by the ETC2 color block, 16 bytes
+    BLOCK_FORMAT_COUNT
+};
+
+// how hard the encoder searches, the presets trade encoding time for quality
+enum CompressionQuality {
+    COMPRESSION_FAST,    // endpoints from the principal axis, no refinement
+    COMPRESSION_NORMAL,  // a few least squares refinement passes
+    COMPRESSION_HIGH     // more passes, every p-bit combination and a wider ETC base color search
+};
+
+inline unsigned int BlockBytes(BlockFormat format)
+{
+    return format == BLOCK_BC1 || format == BLOCK_ETC2_RGB ? 8 : 16;
+}
+
+inline bool BlockHasAlpha(BlockFormat format)
+{
+    return format == BLOCK_BC3 || format == BLOCK_BC7 || format == BLOCK_ETC2_RGBA;
+}
+
+inline const char *BlockFormatName(BlockFormat format)
+{
+    switch (format)
+    {
+    case BLOCK_BC1: return "bc1";
+    case BLOCK_BC3: return "bc3";
+    case BLOCK_BC7: return "bc7";
+    case BLOCK_ETC2_RGB: return "etc2";
+    default: return "etc2a";
+    }
+}
+
+inline GLenum BlockInternalFormat(BlockFormat format)
+{
+    switch (format)
+    {
+    case BLOCK_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BLOCK_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BLOCK_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    case BLOCK_ETC2_RGB: return GL_COMPRESSED_RGB8_ETC2;
+    default: return GL_COMPRESSED_RGBA8_ETC2_EAC;
+    }
+}
+
+// Block compression encoders and decoders on RGBA8 images. The encoders fit a line through the colors of a block
+// (its principal axis), place the endpoints on it and assign every pixel its nearest palette entry, optionally
+// refining the endpoints by least squares. Images are split into rows of blocks that are encoded on all cores.
+// Decoding is the fallback for drivers without the format, so it only has to understand what the encoders
+// write: BC7 blocks other than mode 6 and the ETC2 T, H and planar modes decode to magenta.
+class BlockCompressor
+{
+public:
+    static unsigned int BlocksAcross(unsigned int size)
+    {
+        return (size + 3) / 4;
+    }
+
+    static size_t CompressedSize(BlockFormat format, unsigned int width, unsigned int height)
+    {
+        return (size_t)BlocksAcross(width) * BlocksAcross(height) * BlockBytes(format);
+    }
+
+    // encodes a width x height RGBA8 image, out must hold CompressedSize bytes. Blocks hanging over the right or
+    // bottom edge repeat the last column or row.
+    static void Compress(BlockFormat format, CompressionQuality quality, const unsigned char *rgba, unsigned int width, unsigned int height, unsigned char *out)
+    {
+        unsigned int blocksX = BlocksAcross(width), blocksY = BlocksAcross(height);
+        unsigned int blockBytes = BlockBytes(format);
+        forEachRow(blocksY, [&](unsigned int by)
+        {
+            unsigned char *dst = out + (size_t)by * blocksX * blockBytes;
+            for (unsigned int bx = 0; bx < blocksX; bx++, dst += blockBytes)
+            {
+                BlockPixels px;
+                gather(rgba, width, height, bx, by, px);
+                EncodeBlock(format, quality, px, dst);
+            }
+        });
+    }
+
+    // decodes CompressedSize bytes back to a width x height RGBA8 image
+    static void Decompress(BlockFormat format, const unsigned char *blocks, unsigned int width, unsigned int height, unsigned char *rgba)
+    {
+        unsigned int blocksX = BlocksAcross(width), blocksY = BlocksAcross(height);
+        unsigned int blockBytes = BlockBytes(format);
+        for (unsigned int by = 0; by < blocksY; by++)
+            for (unsigned int bx = 0; bx < blocksX; bx++)
+            {
+                unsigned char texels[64];
+                DecodeBlock(format, blocks + ((size_t)by * blocksX + bx) * blockBytes, texels);
+                for (unsigned int y = 0; y < 4 && by * 4 + y < height; y++)
+                    for (unsigned int x = 0; x < 4 && bx * 4 + x < width; x++)
+                        memcpy(rgba + (((size_t)(by * 4 + y) * width) + bx * 4 + x) * 4, texels + (y * 4 + x) * 4, 4);
+            }
+    }
+
+    // pixels of one block as structure of arrays, pixel i is at x = i % 4, y = i / 4
+    struct BlockPixels {
+        float r[16], g[16], b[16], a[16];
+    };
+
+    static void EncodeBlock(BlockFormat format, CompressionQuality quality, const BlockPixels &px, unsigned char *out)
+    {
+        switch (format)
+        {
+        case BLOCK_BC1:
+            encodeBC1(px, quality, out);
+            break;
+        case BLOCK_BC3:
+            encodeAlphaBC3(px, quality, out);
+            encodeBC1(px, quality, out + 8);
+            break;
+        case BLOCK_BC7:
+            encodeBC7(px, quality, out);
+            break;
+        case BLOCK_ETC2_RGB:
+            encodeETC(px, quality, out);
+            break;
+        default:
+            encodeAlphaEAC(px, quality, out);
+            encodeETC(px, quality, out + 8);
+            break;
+        }
+    }
+
+    // writes the 16 RGBA8 texels of a block, row by row
+    static void DecodeBlock(BlockFormat format, const unsigned char *block, unsigned char texels[64])
+    {
+        switch (format)
+        {
+        case BLOCK_BC1:
+            decodeBC1(block, texels, true);
+            break;
+        case BLOCK_BC3:
+            decodeBC1(block + 8, texels, false);
+            decodeAlphaBC3(block, texels);
+            break;
+        case BLOCK_BC7:
+            decodeBC7(block, texels);
+            break;
+        case BLOCK_ETC2_RGB:
+            decodeETC(block, texels);
+            break;
+        default:
+            decodeETC(block + 8, texels);
+            decodeAlphaEAC(block, texels);
+            break;
+        }
+    }
+
+private:
+    // runs fn(row) for every row of blocks, spread over the cores
+    template <typename Fn>
+    static void forEachRow(unsigned int rows, const Fn &fn)
+    {
+        unsigned int threadCount = min(max(1u, thread::hardware_concurrency()), max(1u, rows / 4));
+        atomic<unsigned int> next(0);
+        auto work = [&]()
+        {
+            for (unsigned int row = next++; row < rows; row = next++)
+                fn(row);
+        };
+        vector<thread> threads;
+        for (unsigned int i = 1; i < threadCount; i++)
+            threads.push_back(thread(work));
+        work();
+        for (unsigned int i = 0; i < threads.size(); i++)
+            threads[i].join();
+    }
+
+    static void gather(const unsigned char *rgba, unsigned int width, unsigned int height, unsigned int bx, unsigned int by, BlockPixels &px)
+    {
+        for (unsigned int y = 0; y < 4; y++)
+            for (unsigned int x = 0; x < 4; x++)
+            {
+                unsigned int sx = min(bx * 4 + x, width - 1), sy = min(by * 4 + y, height - 1);
+                const unsigned char *p = rgba + ((size_t)sy * width + sx) * 4;
+                unsigned int i = y * 4 + x;
+                px.r[i] = p[0];
+                px.g[i] = p[1];
+                px.b[i] = p[2];
+                px.a[i] = p[3];
+            }
+    }
+
+    // for every pixel the index of the nearest of count palette entries (RGB, or RGBA with alpha), returns the
+    // summed squared error. This is where the encoders spend their time.
+    static float fitIndices(const BlockPixels &px, const float (*palette)[4], unsigned int count, bool alpha, unsigned char indices[16])
+    {
+        float error = 0.0f;
+#if defined(BLOCK_COMPRESS_SSE)
+        __m128 alphaMask = alpha ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : _mm_setzero_ps();
+        for (unsigned int i = 0; i < 16; i += 4)
+        {
+            __m128 r = _mm_loadu_ps(px.r + i), g = _mm_loadu_ps(px.g + i), b = _mm_loadu_ps(px.b + i), a = _mm_loadu_ps(px.a + i);
+            __m128 best = _mm_set1_ps(1e30f), bestIndex = _mm_setzero_ps();
+            for (unsigned int k = 0; k < count; k++)
+            {
+                __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[k][0]));
+                __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[k][1]));
+                __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[k][2]));
+                __m128 da = _mm_and_ps(_mm_sub_ps(a, _mm_set1_ps(palette[k][3])), alphaMask);
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_add_ps(_mm_mul_ps(db, db), _mm_mul_ps(da, da)));
+                __m128 closer = _mm_cmplt_ps(d, best);
+                best = _mm_min_ps(best, d);
+                bestIndex = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float)k)), _mm_andnot_ps(closer, bestIndex));
+            }
+            float lanes[4], laneIndices[4];
+            _mm_storeu_ps(lanes, best);
+            _mm_storeu_ps(laneIndices, bestIndex);
+            for (unsigned int j = 0; j < 4; j++)
+            {
+                error += lanes[j];
+                indices[i + j] = (unsigned char)laneIndices[j];
+            }
+        }
+#else
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            float best = 1e30f;
+            unsigned char bestIndex = 0;
+            for (unsigned int k = 0; k < count; k++)
+            {
+                float dr = px.r[i] - palette[k][0], dg = px.g[i] - palette[k][1], db = px.b[i] - palette[k][2];
+                float da = alpha ? px.a[i] - palette[k][3] : 0.0f;
+                float d = dr * dr + dg * dg + db * db + da * da;
+                if (d < best)
+                {
+                    best = d;
+                    bestIndex = (unsigned char)k;
+                }
+            }
+            error += best;
+            indices[i] = bestIndex;
+        }
+#endif
+        return error;
+    }
+
+    // mean and principal axis of the block's colors (channels 3 or 4), by power iteration on the covariance
+    static void principalAxis(const BlockPixels &px, unsigned int channels, float mean[4], float axis[4])
+    {
+        const float *c[4] = { px.r, px.g, px.b, px.a };
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            mean[k] = 0.0f;
+            if (k < channels)
+                for (unsigned int i = 0; i < 16; i++)
+                    mean[k] += c[k][i];
+            mean[k] /= 16.0f;
+        }
+        float cov[4][4] = {};
+        for (unsigned int i = 0; i < 16; i++)
+            for (unsigned int j = 0; j < channels; j++)
+                for (unsigned int k = j; k < channels; k++)
+                    cov[j][k] += (c[j][i] - mean[j]) * (c[k][i] - mean[k]);
+        for (unsigned int j = 0; j < channels; j++)
+            for (unsigned int k = 0; k < j; k++)
+                cov[j][k] = cov[k][j];
+        // start on the diagonal of the bounding box, which is never orthogonal to the axis of a real gradient
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            float lo = 255.0f, hi = 0.0f;
+            if (k < channels)
+                for (unsigned int i = 0; i < 16; i++)
+                {
+                    lo = min(lo, c[k][i]);
+                    hi = max(hi, c[k][i]);
+                }
+            axis[k] = k < channels ? hi - lo : 0.0f;
+        }
+        for (unsigned int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[4] = {};
+            for (unsigned int j = 0; j < channels; j++)
+                for (unsigned int k = 0; k < channels; k++)
+                    next[j] += cov[j][k] * axis[k];
+            float length = 0.0f;
+            for (unsigned int k = 0; k < channels; k++)
+                length = max(length, fabs(next[k]));
+            if (length < 1e-6f)
+                break;
+            for (unsigned int k = 0; k < channels; k++)
+                axis[k] = next[k] / length;
+        }
+        float length = 0.0f;
+        for (unsigned int k = 0; k < channels; k++)
+            length += axis[k] * axis[k];
+        length = sqrt(length);
+        for (unsigned int k = 0; k < 4; k++)
+            axis[k] = length > 1e-6f && k < channels ? axis[k] / length : 0.0f;
+    }
+
+    // endpoints at the extreme projections of the block on its principal axis
+    static void axisEndpoints(const BlockPixels &px, unsigned int channels, float e0[4], float e1[4])
+    {
+        float mean[4], axis[4];
+        principalAxis(px, channels, mean, axis);
+        float lo = 0.0f, hi = 0.0f;
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            float t = (px.r[i] - mean[0]) * axis[0] + (px.g[i] - mean[1]) * axis[1] + (px.b[i] - mean[2]) * axis[2] + (px.a[i] - mean[3]) * axis[3];
+            lo = min(lo, t);
+            hi = max(hi, t);
+        }
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            e0[k] = min(max(mean[k] + axis[k] * hi, 0.0f), 255.0f);
+            e1[k] = min(max(mean[k] + axis[k] * lo, 0.0f), 255.0f);
+        }
+        if (channels < 4)
+            e0[3] = e1[3] = 255.0f;
+    }
+
+    // least squares endpoints for fixed indices: pixel i is weights[indices[i]] * e0 + (1 - weights[...]) * e1.
+    // Returns false when the indices don't span a line (all pixels use the same weight).
+    static bool refineEndpoints(const BlockPixels &px, const unsigned char indices[16], const float *weights, float e0[4], float e1[4])
+    {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[4] = {}, bx[4] = {};
+        const float *c[4] = { px.r, px.g, px.b, px.a };
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            float wa = weights[indices[i]], wb = 1.0f - wa;
+            aa += wa * wa;
+            ab += wa * wb;
+            bb += wb * wb;
+            for (unsigned int k = 0; k < 4; k++)
+            {
+                ax[k] += wa * c[k][i];
+                bx[k] += wb * c[k][i];
+            }
+        }
+        float det = aa * bb - ab * ab;
+        if (fabs(det) < 1e-6f)
+            return false;
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            e0[k] = min(max((ax[k] * bb - bx[k] * ab) / det, 0.0f), 255.0f);
+            e1[k] = min(max((bx[k] * aa - ax[k] * ab) / det, 0.0f), 255.0f);
+        }
+        return true;
+    }
+
+    static unsigned int refinePasses(CompressionQuality quality)
+    {
+        return quality == COMPRESSION_FAST ? 0 : quality == COMPRESSION_NORMAL ? 2 : 6;
+    }
+
+    // BC1 ---------------------------------------------------------------------------------------------------------
+
+    static unsigned short to565(const float c[4])
+    {
+        unsigned int r = (unsigned int)(c[0] * 31.0f / 255.0f + 0.5f);
+        unsigned int g = (unsigned int)(c[1] * 63.0f / 255.0f + 0.5f);
+        unsigned int b = (unsigned int)(c[2] * 31.0f / 255.0f + 0.5f);
+        return (unsigned short)((r << 11) | (g << 5) | b);
+    }
+
+    static void from565(unsigned short c, float out[4])
+    {
+        unsigned int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        out[0] = (float)((r << 3) | (r >> 2));
+        out[1] = (float)((g << 2) | (g >> 4));
+        out[2] = (float)((b << 3) | (b >> 2));
+        out[3] = 255.0f;
+    }
+
+    // always the four color mode, as BC3 requires: c0 > c1 and indices 0, 1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+    static void encodeBC1(const BlockPixels &px, CompressionQuality quality, unsigned char *out)
+    {
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float e0[4], e1[4];
+        axisEndpoints(px, 3, e0, e1);
+
+        float bestError = 1e30f;
+        unsigned short best0 = 0, best1 = 0;
+        unsigned char bestIndices[16] = {};
+        for (unsigned int pass = 0; pass <= refinePasses(quality); pass++)
+        {
+            unsigned short c0 = to565(e0), c1 = to565(e1);
+            unsigned char indices[16] = {};
+            float error;
+            if (c0 == c1)
+            {
+                // one color, and c0 == c1 would select the three color mode; index 0 is c0 in both
+                float palette[1][4];
+                from565(c0, palette[0]);
+                error = fitIndices(px, palette, 1, false, indices);
+            }
+            else
+            {
+                if (c0 < c1)
+                    swap(c0, c1);
+                float palette[4][4];
+                from565(c0, palette[0]);
+                from565(c1, palette[1]);
+                for (unsigned int k = 0; k < 4; k++)
+                {
+                    palette[2][k] = (2.0f * palette[0][k] + palette[1][k]) / 3.0f;
+                    palette[3][k] = (palette[0][k] + 2.0f * palette[1][k]) / 3.0f;
+                }
+                error = fitIndices(px, palette, 4, false, indices);
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                best0 = c0;
+                best1 = c1;
+                memcpy(bestIndices, indices, 16);
+            }
+            if (error == 0.0f || c0 == c1 || !refineEndpoints(px, indices, weights, e0, e1))
+                break;
+        }
+        out[0] = (unsigned char)(best0 & 255);
+        out[1] = (unsigned char)(best0 >> 8);
+        out[2] = (unsigned char)(best1 & 255);
+        out[3] = (unsigned char)(best1 >> 8);
+        unsigned int bits = 0;
+        for (unsigned int i = 0; i < 16; i++)
+            bits |= (unsigned int)bestIndices[i] << (2 * i);
+        for (unsigned int i = 0; i < 4; i++)
+            out[4 + i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    static void decodeBC1(const unsigned char *block, unsigned char texels[64], bool threeColorMode)
+    {
+        unsigned short c0 = (unsigned short)(block[0] | (block[1] << 8)), c1 = (unsigned short)(block[2] | (block[3] << 8));
+        float palette[4][4];
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            if (c0 > c1 || !threeColorMode)
+            {
+                palette[2][k] = (2.0f * palette[0][k] + palette[1][k]) / 3.0f;
+                palette[3][k] = (palette[0][k] + 2.0f * palette[1][k]) / 3.0f;
+            }
+            else
+            {
+                palette[2][k] = (palette[0][k] + palette[1][k]) / 2.0f;
+                palette[3][k] = 0.0f;
+            }
+        }
+        palette[2][3] = 255.0f;
+        palette[3][3] = c0 > c1 || !threeColorMode ? 255.0f : 0.0f;
+        unsigned int bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned int)block[7] << 24);
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            unsigned int index = (bits >> (2 * i)) & 3;
+            for (unsigned int k = 0; k < 4; k++)
+                texels[i * 4 + k] = (unsigned char)(palette[index][k] + 0.5f);
+        }
+    }
+
+    // BC3 alpha ---------------------------------------------------------------------------------------------------
+
+    static void alphaPaletteBC3(unsigned int a0, unsigned int a1, float palette[8])
+    {
+        palette[0] = (float)a0;
+        palette[1] = (float)a1;
+        if (a0 > a1)
+            for (unsigned int i = 2; i < 8; i++)
+                palette[i] = (float)(((8 - i) * a0 + (i - 1) * a1) / 7);
+        else
+        {
+            for (unsigned int i = 2; i < 6; i++)
+                palette[i] = (float)(((6 - i) * a0 + (i - 1) * a1) / 5);
+            palette[6] = 0.0f;
+            palette[7] = 255.0f;
+        }
+    }
+
+    // eight value mode between the extremes of the block, the higher presets also try endpoints moved inwards
+    static void encodeAlphaBC3(const BlockPixels &px, CompressionQuality quality, unsigned char *out)
+    {
+        unsigned int lo = 255, hi = 0;
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            lo = min(lo, (unsigned int)px.a[i]);
+            hi = max(hi, (unsigned int)px.a[i]);
+        }
+        unsigned int insets = quality == COMPRESSION_FAST ? 1 : quality == COMPRESSION_NORMAL ? 3 : 6;
+        float bestError = 1e30f;
+        unsigned int bestA0 = hi, bestA1 = lo;
+        unsigned char bestIndices[16] = {};
+        for (unsigned int inset = 0; inset < insets && hi >= lo + 2 * inset; inset++)
+        {
+            unsigned int a0 = hi - inset, a1 = lo + inset;
+            float palette[8];
+            alphaPaletteBC3(a0, a1, palette);
+            float error = 0.0f;
+            unsigned char indices[16];
+            for (unsigned int i = 0; i < 16; i++)
+            {
+                float best = 1e30f;
+                for (unsigned int k = 0; k < 8; k++)
+                {
+                    float d = (px.a[i] - palette[k]) * (px.a[i] - palette[k]);
+                    if (d < best)
+                    {
+                        best = d;
+                        indices[i] = (unsigned char)k;
+                    }
+                }
+                error += best;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                bestA0 = a0;
+                bestA1 = a1;
+                memcpy(bestIndices, indices, 16);
+            }
+        }
+        out[0] = (unsigned char)bestA0;
+        out[1] = (unsigned char)bestA1;
+        unsigned long long bits = 0;
+        for (unsigned int i = 0; i < 16; i++)
+            bits |= (unsigned long long)bestIndices[i] << (3 * i);
+        for (unsigned int i = 0; i < 6; i++)
+            out[2 + i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    static void decodeAlphaBC3(const unsigned char *block, unsigned char texels[64])
+    {
+        float palette[8];
+        alphaPaletteBC3(block[0], block[1], palette);
+        unsigned long long bits = 0;
+        for (unsigned int i = 0; i < 6; i++)
+            bits |= (unsigned long long)block[2 + i] << (8 * i);
+        for (unsigned int i = 0; i < 16; i++)
+            texels[i * 4 + 3] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+    }
+
+    // BC7 mode 6 --------------------------------------------------------------------------------------------------
+
+    static void putBits(unsigned char *block, unsigned int &position, unsigned int count, unsigned int value)
+    {
+        for (unsigned int i = 0; i < count; i++, position++)
+            if ((value >> i) & 1)
+                block[position >> 3] |= (unsigned char)(1 << (position & 7));
+    }
+
+    static unsigned int getBits(const unsigned char *block, unsigned int &position, unsigned int count)
+    {
+        unsigned int value = 0;
+        for (unsigned int i = 0; i < count; i++, position++)
+            value |= (unsigned int)((block[position >> 3] >> (position & 7)) & 1) << i;
+        return value;
+    }
+
+    static const unsigned int *weightsBC7()
+    {
+        static const unsigned int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+        return weights;
+    }
+
+    // 7 bit endpoint q with p-bit p, per channel, for the float endpoint e
+    static void quantizeBC7(const float e[4], unsigned int p, unsigned int q[4])
+    {
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            int v = (int)floor((e[k] - (float)p) / 2.0f + 0.5f);
+            q[k] = (unsigned int)min(max(v, 0), 127);
+        }
+    }
+
+    static void paletteBC7(const unsigned int q0[4], unsigned int p0, const unsigned int q1[4], unsigned int p1, float palette[16][4])
+    {
+        const unsigned int *weights = weightsBC7();
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            unsigned int v0 = (q0[k] << 1) | p0, v1 = (q1[k] << 1) | p1;
+            for (unsigned int i = 0; i < 16; i++)
+                palette[i][k] = (float)(((64 - weights[i]) * v0 + weights[i] * v1 + 32) >> 6);
+        }
+    }
+
+    static void encodeBC7(const BlockPixels &px, CompressionQuality quality, unsigned char *out)
+    {
+        float weights[16];
+        for (unsigned int i = 0; i < 16; i++)
+            weights[i] = 1.0f - weightsBC7()[i] / 64.0f;
+        float e0[4], e1[4];
+        axisEndpoints(px, 4, e0, e1);
+
+        float bestError = 1e30f;
+        unsigned int best0[4] = {}, best1[4] = {}, bestP0 = 0, bestP1 = 0;
+        unsigned char bestIndices[16] = {};
+        for (unsigned int pass = 0; pass <= refinePasses(quality); pass++)
+        {
+            unsigned char passIndices[16] = {};
+            float passError = 1e30f;
+            // the fast presets take the p-bit that rounds each endpoint best, the high preset tries all four
+            for (unsigned int pbits = 0; pbits < 4; pbits++)
+            {
+                unsigned int p0 = pbits & 1, p1 = pbits >> 1;
+                unsigned int q0[4], q1[4];
+                quantizeBC7(e0, p0, q0);
+                quantizeBC7(e1, p1, q1);
+                if (quality != COMPRESSION_HIGH && pbits != bestPBits(e0, e1))
+                    continue;
+                float palette[16][4];
+                paletteBC7(q0, p0, q1, p1, palette);
+                unsigned char indices[16];
+                float error = fitIndices(px, palette, 16, true, indices);
+                if (error < passError)
+                {
+                    passError = error;
+                    memcpy(passIndices, indices, 16);
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    memcpy(best0, q0, sizeof(q0));
+                    memcpy(best1, q1, sizeof(q1));
+                    bestP0 = p0;
+                    bestP1 = p1;
+                    memcpy(bestIndices, indices, 16);
+                }
+            }
+            if (bestError == 0.0f || !refineEndpoints(px, passIndices, weights, e0, e1))
+                break;
+        }
+
+        // the anchor (first) index is stored without its top bit, so it must be below 8
+        if (bestIndices[0] >= 8)
+        {
+            swap(best0, best1);
+            swap(bestP0, bestP1);
+            for (unsigned int i = 0; i < 16; i++)
+                bestIndices[i] = (unsigned char)(15 - bestIndices[i]);
+        }
+        memset(out, 0, 16);
+        unsigned int position = 0;
+        putBits(out, position, 7, 1 << 6);
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            putBits(out, position, 7, best0[k]);
+            putBits(out, position, 7, best1[k]);
+        }
+        putBits(out, position, 1, bestP0);
+        putBits(out, position, 1, bestP1);
+        for (unsigned int i = 0; i < 16; i++)
+            putBits(out, position, i == 0 ? 3 : 4, bestIndices[i]);
+    }
+
+    // p-bits that quantize each endpoint with the smallest error, as the index into the four combinations
+    static unsigned int bestPBits(const float e0[4], const float e1[4])
+    {
+        unsigned int pbits = 0;
+        const float *e[2] = { e0, e1 };
+        for (unsigned int j = 0; j < 2; j++)
+        {
+            float error[2] = {};
+            for (unsigned int p = 0; p < 2; p++)
+            {
+                unsigned int q[4];
+                quantizeBC7(e[j], p, q);
+                for (unsigned int k = 0; k < 4; k++)
+                    error[p] += (e[j][k] - (float)((q[k] << 1) | p)) * (e[j][k] - (float)((q[k] << 1) | p));
+            }
+            if (error[1] < error[0])
+                pbits |= 1 << j;
+        }
+        return pbits;
+    }
+
+    static void decodeBC7(const unsigned char *block, unsigned char texels[64])
+    {
+        unsigned int position = 0;
+        if (getBits(block, position, 7) != (1u << 6))
+        {
+            for (unsigned int i = 0; i < 16; i++)
+            {
+                texels[i * 4 + 0] = 255;
+                texels[i * 4 + 1] = 0;
+                texels[i * 4 + 2] = 255;
+                texels[i * 4 + 3] = 255;
+            }
+            return;
+        }
+        unsigned int q0[4], q1[4];
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            q0[k] = getBits(block, position, 7);
+            q1[k] = getBits(block, position, 7);
+        }
+        unsigned int p0 = getBits(block, position, 1), p1 = getBits(block, position, 1);
+        float palette[16][4];
+        paletteBC7(q0, p0, q1, p1, palette);
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            unsigned int index = getBits(block, position, i == 0 ? 3 : 4);
+            for (unsigned int k = 0; k < 4; k++)
+                texels[i * 4 + k] = (unsigned char)palette[index][k];
+        }
+    }
+
+    // ETC2 RGB ----------------------------------------------------------------------------------------------------
+
+    static const int (*modifiersETC())[2]
+    {
+        static const int modifiers[8][2] = { { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } };
+        return modifiers;
+    }
+
+    // the modifier of a pixel index: 0 and 1 add the small and the large value of the table, 2 and 3 subtract them
+    static int modifierETC(unsigned int table, unsigned int index)
+    {
+        int value = modifiersETC()[table][index & 1];
+        return index & 2 ? -value : value;
+    }
+
+    static int clampByte(int v)
+    {
+        return min(max(v, 0), 255);
+    }
+
+    // pixels of a sub block: flipped sub blocks are 4x2 (top, bottom), the others 2x4 (left, right)
+    static void subBlockPixels(unsigned int flip, unsigned int subBlock, unsigned int pixels[8])
+    {
+        unsigned int n = 0;
+        for (unsigned int y = 0; y < 4; y++)
+            for (unsigned int x = 0; x < 4; x++)
+                if ((flip ? y / 2 : x / 2) == subBlock)
+                    pixels[n++] = y * 4 + x;
+    }
+
+    // best table and indices for a sub block with the given (expanded) base color, returns the error
+    static int fitSubBlockETC(const BlockPixels &px, const unsigned int pixels[8], const int base[3], unsigned int &table, unsigned char indices[16])
+    {
+        int bestError = 0x7fffffff;
+        for (unsigned int t = 0; t < 8; t++)
+        {
+            int error = 0;
+            unsigned char tableIndices[8];
+            for (unsigned int n = 0; n < 8 && error < bestError; n++)
+            {
+                unsigned int i = pixels[n];
+                int best = 0x7fffffff;
+                for (unsigned int index = 0; index < 4; index++)
+                {
+                    int m = modifierETC(t, index);
+                    int dr = clampByte(base[0] + m) - (int)px.r[i], dg = clampByte(base[1] + m) - (int)px.g[i], db = clampByte(base[2] + m) - (int)px.b[i];
+                    int d = dr * dr + dg * dg + db * db;
+                    if (d < best)
+                    {
+                        best = d;
+                        tableIndices[n] = (unsigned char)index;
+                    }
+                }
+                error += best;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                table = t;
+                for (unsigned int n = 0; n < 8; n++)
+                    indices[pixels[n]] = tableIndices[n];
+            }
+        }
+        return bestError;
+    }
+
+    static int expand4(int c)
+    {
+        return (c << 4) | c;
+    }
+
+    static int expand5(int c)
+    {
+        return (c << 3) | (c >> 2);
+    }
+
+    struct SubBlockFit {
+        int color[3];            // quantized base color, 4 or 5 bits per channel
+        unsigned int table;
+        int error;
+    };
+
+    // searches base colors around the sub block's average quantized to bits per channel: the normal preset also
+    // one step brighter and darker, the high preset one step along every channel as well. With a reference color
+    // the search is limited to the differential range.
+    static SubBlockFit fitSubBlock(const BlockPixels &px, const unsigned int pixels[8], unsigned int bits, CompressionQuality quality, const int *reference, unsigned char indices[16])
+    {
+        float average[3] = {};
+        for (unsigned int n = 0; n < 8; n++)
+        {
+            average[0] += px.r[pixels[n]];
+            average[1] += px.g[pixels[n]];
+            average[2] += px.b[pixels[n]];
+        }
+        int maxValue = (1 << bits) - 1;
+        int center[3];
+        for (unsigned int k = 0; k < 3; k++)
+            center[k] = (int)(average[k] / 8.0f * maxValue / 255.0f + 0.5f);
+        static const int offsets[9][3] = { { 0, 0, 0 }, { 1, 1, 1 }, { -1, -1, -1 }, { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+        unsigned int candidates = quality == COMPRESSION_FAST ? 1 : quality == COMPRESSION_NORMAL ? 3 : 9;
+
+        SubBlockFit best;
+        best.error = 0x7fffffff;
+        best.table = 0;
+        for (unsigned int k = 0; k < 3; k++)
+            best.color[k] = reference ? reference[k] : center[k];
+        for (unsigned int c = 0; c < candidates; c++)
+        {
+            int color[3];
+            bool valid = true;
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                color[k] = center[k] + offsets[c][k];
+                if (reference)
+                    color[k] = min(max(color[k], reference[k] - 4), reference[k] + 3);
+                valid = valid && color[k] >= 0 && color[k] <= maxValue;
+            }
+            if (!valid)
+                continue;
+            int base[3];
+            for (unsigned int k = 0; k < 3; k++)
+                base[k] = bits == 4 ? expand4(color[k]) : expand5(color[k]);
+            unsigned int table;
+            unsigned char fitted[16];
+            int error = fitSubBlockETC(px, pixels, base, table, fitted);
+            if (error < best.error)
+            {
+                best.error = error;
+                best.table = table;
+                memcpy(best.color, color, sizeof(color));
+                for (unsigned int n = 0; n < 8; n++)
+                    indices[pixels[n]] = fitted[pixels[n]];
+            }
+        }
+        return best;
+    }
+
+    // tries both sub block orientations in individual (4 bit colors) and differential (5 bit color and a 3 bit
+    // delta) mode. The differential delta is kept in range, so the T, H and planar modes are never selected.
+    static void encodeETC(const BlockPixels &px, CompressionQuality quality, unsigned char *out)
+    {
+        int bestError = 0x7fffffff;
+        unsigned long long bestBits = 0;
+        for (unsigned int flip = 0; flip < 2; flip++)
+        {
+            unsigned int pixels[2][8];
+            subBlockPixels(flip, 0, pixels[0]);
+            subBlockPixels(flip, 1, pixels[1]);
+            for (unsigned int differential = 0; differential < 2; differential++)
+            {
+                unsigned char indices[16];
+                SubBlockFit fit0 = fitSubBlock(px, pixels[0], differential ? 5 : 4, quality, nullptr, indices);
+                SubBlockFit fit1 = fitSubBlock(px, pixels[1], differential ? 5 : 4, quality, differential ? fit0.color : nullptr, indices);
+                if (fit0.error == 0x7fffffff || fit1.error == 0x7fffffff || fit0.error + fit1.error >= bestError)
+                    continue;
+                bestError = fit0.error + fit1.error;
+                unsigned long long bits = 0;
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    unsigned int shift = 59 - 8 * k; // R at 63..56, G at 55..48, B at 47..40
+                    if (differential)
+                        bits |= ((unsigned long long)fit0.color[k] << (shift)) | ((unsigned long long)((fit1.color[k] - fit0.color[k]) & 7) << (shift - 3));
+                    else
+                        bits |= ((unsigned long long)fit0.color[k] << (shift + 1)) | ((unsigned long long)fit1.color[k] << (shift - 3));
+                }
+                bits |= (unsigned long long)fit0.table << 37 | (unsigned long long)fit1.table << 34;
+                bits |= (unsigned long long)differential << 33 | (unsigned long long)flip << 32;
+                // index bits go down the columns: pixel (x, y) is number x * 4 + y
+                for (unsigned int y = 0; y < 4; y++)
+                    for (unsigned int x = 0; x < 4; x++)
+                    {
+                        unsigned int index = indices[y * 4 + x], n = x * 4 + y;
+                        bits |= (unsigned long long)(index >> 1) << (16 + n) | (unsigned long long)(index & 1) << n;
+                    }
+                bestBits = bits;
+            }
+        }
+        for (unsigned int i = 0; i < 8; i++)
+            out[i] = (unsigned char)(bestBits >> (56 - 8 * i));
+    }
+
+    static void decodeETC(const unsigned char *block, unsigned char texels[64])
+    {
+        unsigned long long bits = 0;
+        for (unsigned int i = 0; i < 8; i++)
+            bits = (bits << 8) | block[i];
+        unsigned int differential = (bits >> 33) & 1, flip = (bits >> 32) & 1;
+        int base[2][3];
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            unsigned int shift = 59 - 8 * k;
+            if (differential)
+            {
+                int c0 = (int)((bits >> shift) & 31);
+                int delta = (int)((bits >> (shift - 3)) & 7);
+                int c1 = c0 + (delta >= 4 ? delta - 8 : delta);
+                if (c1 < 0 || c1 > 31)
+                {
+                    // T, H or planar mode, which the encoder doesn't write
+                    for (unsigned int i = 0; i < 16; i++)
+                    {
+                        texels[i * 4 + 0] = 255;
+                        texels[i * 4 + 1] = 0;
+                        texels[i * 4 + 2] = 255;
+                        texels[i * 4 + 3] = 255;
+                    }
+                    return;
+                }
+                base[0][k] = expand5(c0);
+                base[1][k] = expand5(c1);
+            }
+            else
+            {
+                base[0][k] = expand4((int)((bits >> (shift + 1)) & 15));
+                base[1][k] = expand4((int)((bits >> (shift - 3)) & 15));
+            }
+        }
+        unsigned int tables[2] = { (unsigned int)(bits >> 37) & 7, (unsigned int)(bits >> 34) & 7 };
+        for (unsigned int y = 0; y < 4; y++)
+            for (unsigned int x = 0; x < 4; x++)
+            {
+                unsigned int n = x * 4 + y;
+                unsigned int index = (unsigned int)(((bits >> (16 + n)) & 1) << 1 | ((bits >> n) & 1));
+                unsigned int subBlock = flip ? y / 2 : x / 2;
+                int m = modifierETC(tables[subBlock], index);
+                unsigned char *texel = texels + (y * 4 + x) * 4;
+                for (unsigned int k = 0; k < 3; k++)
+                    texel[k] = (unsigned char)clampByte(base[subBlock][k] + m);
+                texel[3] = 255;
+            }
+    }
+
+    // EAC alpha ---------------------------------------------------------------------------------------------------
+
+    static const int (*modifiersEAC())[8]
+    {
+        static const int modifiers[16][8] = {
+            { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 }, { -2, -5, -8, -13, 1, 4, 7, 12 },
+            { -2, -4, -6, -13, 1, 3, 5, 12 }, { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+            { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 }, { -2, -6, -8, -10, 1, 5, 7, 9 },
+            { -2, -5, -8, -10, 1, 4, 7, 9 }, { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+            { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 }, { -4, -6, -8, -9, 3, 5, 7, 8 },
+            { -3, -5, -7, -9, 2, 4, 6, 8 }
+        };
+        return modifiers;
+    }
+
+    // base value, multiplier and one of 16 modifier tables. For every table the multiplier that stretches it over
+    // the alpha range of the block is tried, the higher presets also try its neighbours and shifted bases.
+    static void encodeAlphaEAC(const BlockPixels &px, CompressionQuality quality, unsigned char *out)
+    {
+        int lo = 255, hi = 0;
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            lo = min(lo, (int)px.a[i]);
+            hi = max(hi, (int)px.a[i]);
+        }
+        int spread = quality == COMPRESSION_FAST ? 0 : 1;
+        int shift = quality == COMPRESSION_HIGH ? 2 : 0;
+        int bestError = 0x7fffffff;
+        unsigned int bestBase = 0, bestMultiplier = 1, bestTable = 0;
+        unsigned char bestIndices[16] = {};
+        for (unsigned int t = 0; t < 16 && bestError > 0; t++)
+        {
+            const int *modifiers = modifiersEAC()[t];
+            int range = modifiers[7] - modifiers[3];
+            int multiplier = max(1, (hi - lo + range / 2) / range);
+            for (int m = max(1, multiplier - spread); m <= min(15, multiplier + spread); m++)
+                for (int s = -shift; s <= shift; s++)
+                {
+                    // center the table's range on the block's
+                    int base = clampByte((hi + lo + 1) / 2 - (modifiers[7] + modifiers[3]) * m / 2 + s);
+                    int error = 0;
+                    unsigned char indices[16];
+                    for (unsigned int i = 0; i < 16 && error < bestError; i++)
+                    {
+                        int best = 0x7fffffff;
+                        for (unsigned int index = 0; index < 8; index++)
+                        {
+                            int d = clampByte(base + modifiers[index] * m) - (int)px.a[i];
+                            if (d * d < best)
+                            {
+                                best = d * d;
+                                indices[i] = (unsigned char)index;
+                            }
+                        }
+                        error += best;
+                    }
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        bestBase = base;
+                        bestMultiplier = m;
+                        bestTable = t;
+                        memcpy(bestIndices, indices, 16);
+                    }
+                }
+        }
+        unsigned long long bits = (unsigned long long)bestBase << 56 | (unsigned long long)bestMultiplier << 52 | (unsigned long long)bestTable << 48;
+        for (unsigned int y = 0; y < 4; y++)
+            for (unsigned int x = 0; x < 4; x++)
+                bits |= (unsigned long long)bestIndices[y * 4 + x] << (45 - 3 * (x * 4 + y));
+        for (unsigned int i = 0; i < 8; i++)
+            out[i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+
+    static void decodeAlphaEAC(const unsigned char *block, unsigned char texels[64])
+    {
+        unsigned long long bits = 0;
+        for (unsigned int i = 0; i < 8; i++)
+            bits = (bits << 8) | block[i];
+        int base = (int)(bits >> 56), multiplier = (int)(bits >> 52) & 15;
+        const int *modifiers = modifiersEAC()[(bits >> 48) & 15];
+        for (unsigned int y = 0; y < 4; y++)
+            for (unsigned int x = 0; x < 4; x++)
+            {
+                unsigned int index = (unsigned int)(bits >> (45 - 3 * (x * 4 + y))) & 7;
+                texels[(y * 4 + x) * 4 + 3] = (unsigned char)clampByte(base + modifiers[index] * multiplier);
+            }
+    }
+};
+#endif
@@ -0,0 +1,135 @@
+#ifndef BONE_H
+#define BONE_H
+
+#include <assimp/anim.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "learnopengl/assimp_glm_helpers.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+struct KeyPosition {
+    glm::vec3 position;
+    float timeStamp;
+};
+
+struct KeyRotation {
+    glm::quat orientation;
+    float timeStamp;
+};
+
+struct KeyScale {
+    glm::vec3 scale;
+    float timeStamp;
+};
+
+// the keyframes of one node in one animation clip. Sampling interpolates translation and scale linearly and the
+// rotation spherically between the two keys around the requested time.
+class Bone
+{
+public:
+    string name;
+    vector<KeyPosition> positions;
+    vector<KeyRotation> rotations;
+    vector<KeyScale> scales;
+
+    // reads the keyframes from the node's channel in the assimp animation
+    Bone(const string &name, const aiNodeAnim *channel) : name(name)
+    {
+        for (unsigned int i = 0; i < channel->mNumPositionKeys; i++)
+        {
+            KeyPosition data;
+            data.position = AssimpGLMHelpers::GetGLMVec(channel->mPositionKeys[i].mValue);
+            data.timeStamp = (float)channel->mPositionKeys[i].mTime;
+            positions.push_back(data);
+        }
+        for (unsigned int i = 0; i < channel->mNumRotationKeys; i++)
+        {
+            KeyRotation data;
+            data.orientation = AssimpGLMHelpers::GetGLMQuat(channel->mRotationKeys[i].mValue);
+            data.timeStamp = (float)channel->mRotationKeys[i].mTime;
+            rotations.push_back(data);
+        }
+        for (unsigned int i = 0; i < channel->mNumScalingKeys; i++)
+        {
+            KeyScale data;
+            data.scale = AssimpGLMHelpers::GetGLMVec(channel->mScalingKeys[i].mValue);
+            data.timeStamp = (float)channel->mScalingKeys[i].mTime;
+            scales.push_back(data);
+        }
+    }
+
+    // local translation, rotation and scale at the given time in ticks
+    glm::vec3 SamplePosition(float animationTime) const
+    {
+        if (positions.empty())
+            return glm::vec3(0.0f);
+        unsigned int i = keyIndex(positions, animationTime);
+        if (i + 1 >= positions.size())
+            return positions[i].position;
+        float t = scaleFactor(positions[i].timeStamp, positions[i + 1].timeStamp, animationTime);
+        return glm::mix(positions[i].position, positions[i + 1].position, t);
+    }
+    glm::quat SampleRotation(float animationTime) const
+    {
+        if (rotations.empty())
+            return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+        unsigned int i = keyIndex(rotations, animationTime);
+        if (i + 1 >= rotations.size())
+            return glm::normalize(rotations[i].orientation);
+        float t = scaleFactor(rotations[i].timeStamp, rotations[i + 1].timeStamp, animationTime);
+        return glm::normalize(glm::slerp(rotations[i].orientation, rotations[i + 1].orientation, t));
+    }
+    glm::vec3 SampleScale(float animationTime) const
+    {
+        if (scales.empty())
+            return glm::vec3(1.0f);
+        unsigned int i = keyIndex(scales, animationTime);
+        if (i + 1 >= scales.size())
+            return scales[i].scale;
+        float t = scaleFactor(scales[i].timeStamp, scales[i + 1].timeStamp, animationTime);
+        return glm::mix(scales[i].scale, scales[i + 1].scale, t);
+    }
+
+    // local transform of the node at the given time in ticks
+    glm::mat4 LocalTransform(float animationTime) const
+    {
+        glm::mat4 translation = glm::translate(glm::mat4(1.0f), SamplePosition(animationTime));
+        glm::mat4 rotation = glm::mat4_cast(SampleRotation(animationTime));
+        glm::mat4 scale = glm::scale(glm::mat4(1.0f), SampleScale(animationTime));
+        return translation * rotation * scale;
+    }
+
+private:
+    // index of the last key at or before the time, keys are sorted by time
+    template <typename Key>
+    static unsigned int keyIndex(const vector<Key> &keys, float animationTime)
+    {
+        unsigned int low = 0, high = (unsigned int)keys.size();
+        while (high - low > 1)
+        {
+            unsigned int middle = (low + high) / 2;
+            if (keys[middle].timeStamp <= animationTime)
+                low = middle;
+            else
+                high = middle;
+        }
+        return low;
+    }
+
+    // how far the time is between two keys, 0 to 1
+    static float scaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
+    {
+        float frameDiff = nextTimeStamp - lastTimeStamp;
+        if (frameDiff <= 0.0f)
+            return 0.0f;
+        return glm::clamp((animationTime - lastTimeStamp) / frameDiff, 0.0f, 1.0f);
+    }
+};
+#endif
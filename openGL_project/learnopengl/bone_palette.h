@@ -0,0 +1,60 @@
+#ifndef BONE_PALETTE_H
+#define BONE_PALETTE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "learnopengl/animdata.h"
+#include "learnopengl/shader.h"
+
+#include <vector>
+using namespace std;
+
+// a range of a uniform buffer holding one instance's bone palette. buffer 0 means the instance isn't skinned.
+struct PaletteRange {
+    unsigned int buffer;
+    unsigned int offset;
+
+    PaletteRange(unsigned int buffer = 0, unsigned int offset = 0) : buffer(buffer), offset(offset)
+    {
+    }
+
+    // makes the palette the one the next draws are skinned with. The range always spans a whole Bones block.
+    void Bind() const
+    {
+        if (buffer != 0)
+            glBindBufferRange(GL_UNIFORM_BUFFER, BONE_UBO_BINDING, buffer, offset, MAX_BONES * sizeof(glm::mat4));
+    }
+};
+
+// uniform buffer with identity bone matrices, i.e. the bind pose, read by the Bones block of the skinning vertex
+// shaders. Posed instances get their palettes from HerdAnimator.
+// Meshes without bones have zero weights and ignore the palette, but some palette still has to be bound when
+// they are drawn with a skinning shader.
+class BonePalette
+{
+public:
+    unsigned int UBO;
+
+    BonePalette()
+    {
+        vector<glm::mat4> identity(MAX_BONES, glm::mat4(1.0f));
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, MAX_BONES * sizeof(glm::mat4), &identity[0], GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // makes this palette the one the next draws are skinned with
+    void Bind() const
+    {
+        glBindBufferBase(GL_UNIFORM_BUFFER, BONE_UBO_BINDING, UBO);
+    }
+
+    PaletteRange Range() const
+    {
+        return PaletteRange(UBO, 0);
+    }
+};
+#endif
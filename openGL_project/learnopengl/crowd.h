@@ -0,0 +1,759 @@
+#ifndef CROWD_H
+#define CROWD_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "learnopengl/model.h"
+#include "learnopengl/shader.h"
+#include "learnopengl/frustum.h"
+#include "learnopengl/job_system.h"
+#include "learnopengl/transform_kernel.h"
+#include "learnopengl/stream_ring.h"
+#include "learnopengl/occlusion_culler.h"
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+using namespace std;
+
+// horses or spectators a job works on at a time
+#define CROWD_BATCH_SIZE 1024
+// lanes of the race track, and the distance between two lanes
+#define CROWD_MAX_LANES 16
+#define CROWD_LANE_SPACING 2.5f
+// instance sizes, the scripted actors use about the same
+#define CROWD_HORSE_SCALE 0.005f
+#define CROWD_SPECTATOR_SCALE 0.05f
+// detail level marking an instance outside the view frustum
+#define CROWD_CULLED 0xff
+
+// the closed quartic Bézier curve the horses race on, p[0] == p[4]
+struct RaceTrack {
+    glm::vec3 p[5];
+    float height; // ground height of the track
+    float length; // approximate arc length
+
+    RaceTrack(const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec3 &p3, const glm::vec3 &p4, const glm::vec3 &p5, float height) : height(height), length(0.0f)
+    {
+        p[0] = p1; p[1] = p2; p[2] = p3; p[3] = p4; p[4] = p5;
+        glm::vec3 last = Position(0.0f);
+        for (unsigned int i = 1; i <= 256; i++)
+        {
+            glm::vec3 point = Position(i / 256.0f);
+            length += glm::length(point - last);
+            last = point;
+        }
+    }
+
+    glm::vec3 Position(float t) const
+    {
+        float u = 1.0f - t;
+        return u * u * u * u * p[0] + 4.0f * u * u * u * t * p[1] + 6.0f * u * u * t * t * p[2] + 4.0f * u * t * t * t * p[3] + t * t * t * t * p[4];
+    }
+};
+
+// timings and counts of the last frame
+struct CrowdStats {
+    float simulateMs; // moving the horses along the track
+    float prepareMs;  // culling, detail levels and filling the instance buffers
+    float composeMs;  // the part of prepareMs spent building the instance matrices
+    float submitMs;   // issuing the draw calls, mostly driver time
+    float gpuMs;      // GPU time of the crowd draws, two frames late
+    float streamWaitMs; // time the last frame waited for the GPU to release its part of the stream ring
+    float occlusionMs;  // the part of prepareMs spent rasterizing the occluders and testing against them
+    unsigned int horsesDrawn;
+    unsigned int spectatorsDrawn;
+    unsigned int horsesOccluded;     // inside the view frustum but hidden, see Crowd::occlusion
+    unsigned int spectatorsOccluded;
+    unsigned int drawCalls;
+
+    CrowdStats() : simulateMs(0.0f), prepareMs(0.0f), composeMs(0.0f), submitMs(0.0f), gpuMs(0.0f), streamWaitMs(0.0f), occlusionMs(0.0f), horsesDrawn(0), spectatorsDrawn(0), horsesOccluded(0), spectatorsOccluded(0), drawCalls(0)
+    {
+    }
+};
+
+// all instances of one model. Instances are bucketed by detail level in the instance buffer, so every level of
+// every mesh is one instanced draw.
+struct CrowdGroup {
+    Model *model;
+    glm::mat4 rotation;   // the rotation and scale Setup was given
+    float scale;
+    glm::mat4 base;       // turns the model upright, facing +Z, centered on the origin with its feet at y = 0
+    glm::vec3 center;     // bounding sphere center of an instance standing at the origin facing +Z
+    float radius;         // bounding sphere radius of an instance
+    vector<unsigned char> levels;       // detail level of each instance, CROWD_CULLED when it is outside the view
+    vector<unsigned int> batchOffsets;  // per batch and level, where the batch's instances go in the buffer
+    // the visible instances in instance buffer order, input of the transform kernel
+    vector<float> sortedX, sortedZ, sortedQY, sortedQW;
+    // the components that are the same for every instance
+    vector<float> heights, zeros, ones;
+    unsigned int bucketStart[MAX_LODS + 1];
+    unsigned int instanceBuffer;   // where this frame's matrices were streamed to
+    unsigned int firstInstance;    // in matrices from the start of the buffer
+    vector<float> batchNearest;    // per batch, distance of its closest visible instance
+    vector<vector<pair<float, unsigned int> > > batchOccluders; // per batch, distance and index of instances big enough to occlude
+    vector<unsigned int> batchOccluded; // per batch, instances the occlusion test culled
+    float nearest;                 // distance of the closest visible instance, infinite when none is visible
+
+    CrowdGroup() : model(nullptr), rotation(1.0f), scale(1.0f), base(1.0f), center(0.0f), radius(0.0f), instanceBuffer(0), firstInstance(0), nearest(INFINITY)
+    {
+        for (unsigned int i = 0; i <= MAX_LODS; i++)
+            bucketStart[i] = 0;
+    }
+
+    // places the model with the given rotation and scale so its bounding box stands on the origin
+    void Setup(Model *model, const glm::mat4 &rotation, float scale)
+    {
+        this->model = model;
+        this->rotation = rotation;
+        this->scale = scale;
+        Refresh();
+    }
+
+    // places the model again from its current bounds, after it was reloaded
+    void Refresh()
+    {
+        glm::mat4 orient = rotation * glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+        glm::vec3 minimum(1e30f), maximum(-1e30f);
+        for (unsigned int i = 0; i < 8; i++)
+        {
+            glm::vec3 corner((i & 1) ? model->boundsMax.x : model->boundsMin.x, (i & 2) ? model->boundsMax.y : model->boundsMin.y, (i & 4) ? model->boundsMax.z : model->boundsMin.z);
+            glm::vec3 p = glm::vec3(orient * glm::vec4(corner, 1.0f));
+            minimum = glm::min(minimum, p);
+            maximum = glm::max(maximum, p);
+        }
+        base = glm::translate(glm::mat4(1.0f), glm::vec3(-(minimum.x + maximum.x) * 0.5f, -minimum.y, -(minimum.z + maximum.z) * 0.5f)) * orient;
+        center = glm::vec3(base * glm::vec4(model->boundsCenter, 1.0f));
+        radius = model->boundsRadius * scale;
+    }
+
+    // bounding sphere center of an instance at (x, height, z) with the heading (0, qy, 0, qw)
+    glm::vec3 InstanceCenter(float x, float height, float z, float qy, float qw) const
+    {
+        // the quaternion (0, qy, 0, qw) turns by an angle with cos = qw^2 - qy^2 and sin = 2 qy qw
+        float cosYaw = qw * qw - qy * qy, sinYaw = 2.0f * qy * qw;
+        return glm::vec3(x + center.x * cosYaw + center.z * sinYaw, height + center.y, z - center.x * sinYaw + center.z * cosYaw);
+    }
+
+    // the model matrix of an instance, as the transform kernel builds it
+    glm::mat4 InstanceMatrix(float x, float height, float z, float qy, float qw) const
+    {
+        return glm::translate(glm::mat4(1.0f), glm::vec3(x, height, z)) * glm::mat4_cast(glm::quat(qw, 0.0f, qy, 0.0f)) * base;
+    }
+};
+
+// positions and headings of every crowd instance, all the renderer needs from the simulation. A heading is the
+// rotation quaternion (0, qy, 0, qw) that turns +Z into it.
+struct CrowdPose {
+    vector<float> horseX, horseZ, horseQY, horseQW;
+    vector<float> spectatorX, spectatorZ, spectatorQY, spectatorQW;
+    unsigned int layout;  // CrowdSimulation::layout the pose was written with, changes with every Spawn
+    float simulateMs;     // time the simulation step that wrote the pose took
+
+    CrowdPose() : layout(0), simulateMs(0.0f)
+    {
+    }
+
+    unsigned int HorseCount() const
+    {
+        return (unsigned int)horseX.size();
+    }
+    unsigned int SpectatorCount() const
+    {
+        return (unsigned int)spectatorX.size();
+    }
+
+    // this = mix(a, b, alpha): positions linearly, headings along the shorter arc. Across a Spawn it takes b.
+    void Interpolate(const CrowdPose &a, const CrowdPose &b, float alpha, JobSystem &jobs)
+    {
+        simulateMs = b.simulateMs;
+        // the spectators only change with the layout
+        if (layout != b.layout)
+        {
+            spectatorX = b.spectatorX;
+            spectatorZ = b.spectatorZ;
+            spectatorQY = b.spectatorQY;
+            spectatorQW = b.spectatorQW;
+            layout = b.layout;
+        }
+        if (a.layout != b.layout || alpha >= 1.0f)
+        {
+            horseX = b.horseX;
+            horseZ = b.horseZ;
+            horseQY = b.horseQY;
+            horseQW = b.horseQW;
+            return;
+        }
+        unsigned int count = b.HorseCount();
+        horseX.resize(count);
+        horseZ.resize(count);
+        horseQY.resize(count);
+        horseQW.resize(count);
+        jobs.ParallelFor(count, CROWD_BATCH_SIZE, [&](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int i = begin; i < end; i++)
+            {
+                horseX[i] = a.horseX[i] + (b.horseX[i] - a.horseX[i]) * alpha;
+                horseZ[i] = a.horseZ[i] + (b.horseZ[i] - a.horseZ[i]) * alpha;
+                // normalized lerp, the headings of two steps are close
+                float side = a.horseQY[i] * b.horseQY[i] + a.horseQW[i] * b.horseQW[i] < 0.0f ? -1.0f : 1.0f;
+                float qy = a.horseQY[i] + (side * b.horseQY[i] - a.horseQY[i]) * alpha;
+                float qw = a.horseQW[i] + (side * b.horseQW[i] - a.horseQW[i]) * alpha;
+                float inverseLength = 1.0f / sqrt(qy * qy + qw * qw + 1e-12f);
+                horseQY[i] = qy * inverseLength;
+                horseQW[i] = qw * inverseLength;
+            }
+        });
+    }
+};
+
+// Crowd mode: N horses racing on lanes of the track and M stickman spectators standing around it.
+// The simulation state is kept as structure of arrays and updated in branch free loops over batches, which the
+// compiler can vectorize and the job system spreads over threads. Headings are kept as quaternions about the Y axis,
+// so no trig is left in the per-frame loops. The simulation only touches its own state and the pose it is given, so
+// it can run on another thread than the renderer.
+class CrowdSimulation
+{
+public:
+    RaceTrack track;
+    // horses
+    vector<float> trackT;      // curve parameter, 0 to 1
+    vector<float> speed;       // units per second
+    vector<float> laneOffset;  // signed distance from the center line
+    // spectators, they don't move
+    vector<float> spectatorX, spectatorZ, spectatorQY, spectatorQW;
+    unsigned int layout;       // counts the Spawn calls
+
+    CrowdSimulation(JobSystem &jobs, const RaceTrack &track) : track(track), layout(0), jobs(jobs)
+    {
+    }
+
+    unsigned int HorseCount() const
+    {
+        return (unsigned int)trackT.size();
+    }
+    unsigned int SpectatorCount() const
+    {
+        return (unsigned int)spectatorX.size();
+    }
+
+    // replaces the crowd. The layout only depends on the counts and the seed, so benchmark runs are comparable.
+    void Spawn(unsigned int horseCount, unsigned int spectatorCount, unsigned int seed = 1)
+    {
+        unsigned int random = seed;
+        unsigned int lanes = max(1u, min((unsigned int)CROWD_MAX_LANES, horseCount / 8));
+        trackT.resize(horseCount);
+        speed.resize(horseCount);
+        laneOffset.resize(horseCount);
+        for (unsigned int i = 0; i < horseCount; i++)
+        {
+            unsigned int lane = i % lanes;
+            trackT[i] = fmod((float)(i / lanes) / (float)((horseCount + lanes - 1) / lanes) + 0.01f * nextRandom(random), 1.0f);
+            speed[i] = 8.0f + 4.0f * nextRandom(random);
+            laneOffset[i] = ((float)lane - (lanes - 1) * 0.5f) * CROWD_LANE_SPACING;
+        }
+
+        // rows of spectators on a ring around the track, looking at its center
+        glm::vec3 middle(0.0f);
+        for (unsigned int i = 0; i < 64; i++)
+            middle += track.Position(i / 64.0f) / 64.0f;
+        float ringRadius = 0.0f;
+        for (unsigned int i = 0; i < 64; i++)
+            ringRadius = max(ringRadius, glm::length(track.Position(i / 64.0f) - middle));
+        ringRadius += lanes * CROWD_LANE_SPACING * 0.5f + 6.0f;
+        spectatorX.resize(spectatorCount);
+        spectatorZ.resize(spectatorCount);
+        spectatorQY.resize(spectatorCount);
+        spectatorQW.resize(spectatorCount);
+        unsigned int placed = 0;
+        for (unsigned int row = 0; placed < spectatorCount; row++)
+        {
+            float radius = ringRadius + row * 2.0f;
+            unsigned int perRow = max(1u, (unsigned int)(2.0f * 3.14159265f * radius / 1.5f));
+            for (unsigned int k = 0; k < perRow && placed < spectatorCount; k++, placed++)
+            {
+                float angle = (k + 0.5f * (row & 1)) / perRow * 2.0f * 3.14159265f;
+                spectatorX[placed] = middle.x + radius * sin(angle);
+                spectatorZ[placed] = middle.z + radius * cos(angle);
+                // facing the center is a yaw of angle + pi
+                spectatorQY[placed] = cos(angle * 0.5f);
+                spectatorQW[placed] = -sin(angle * 0.5f);
+            }
+        }
+        layout++;
+    }
+
+    // moves the horses along their lanes and writes where everybody is into pose
+    void Update(float dt, CrowdPose &pose)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        // the spectators only change with the layout
+        if (pose.layout != layout)
+        {
+            pose.spectatorX = spectatorX;
+            pose.spectatorZ = spectatorZ;
+            pose.spectatorQY = spectatorQY;
+            pose.spectatorQW = spectatorQW;
+            pose.layout = layout;
+        }
+        pose.horseX.resize(HorseCount());
+        pose.horseZ.resize(HorseCount());
+        pose.horseQY.resize(HorseCount());
+        pose.horseQW.resize(HorseCount());
+        simulate(dt, pose);
+        pose.simulateMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+private:
+    JobSystem &jobs;
+
+    static float nextRandom(unsigned int &state)
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    }
+
+    void simulate(float dt, CrowdPose &pose)
+    {
+        float step = dt / max(track.length, 0.001f);
+        const glm::vec3 *p = track.p;
+        float *t = trackT.data();
+        const float *v = speed.data();
+        const float *lane = laneOffset.data();
+        float *x = pose.horseX.data();
+        float *z = pose.horseZ.data();
+        float *qy = pose.horseQY.data();
+        float *qw = pose.horseQW.data();
+        jobs.ParallelFor(HorseCount(), CROWD_BATCH_SIZE, [=](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int i = begin; i < end; i++)
+            {
+                float s = t[i] + v[i] * step;
+                s -= floor(s);
+                t[i] = s;
+                float u = 1.0f - s;
+                // Bernstein weights of the position and of the derivative
+                float b0 = u * u * u * u, b1 = 4.0f * u * u * u * s, b2 = 6.0f * u * u * s * s, b3 = 4.0f * u * s * s * s, b4 = s * s * s * s;
+                float d0 = u * u * u, d1 = 3.0f * u * u * s, d2 = 3.0f * u * s * s, d3 = s * s * s;
+                float px = b0 * p[0].x + b1 * p[1].x + b2 * p[2].x + b3 * p[3].x + b4 * p[4].x;
+                float pz = b0 * p[0].z + b1 * p[1].z + b2 * p[2].z + b3 * p[3].z + b4 * p[4].z;
+                float tx = d0 * (p[1].x - p[0].x) + d1 * (p[2].x - p[1].x) + d2 * (p[3].x - p[2].x) + d3 * (p[4].x - p[3].x);
+                float tz = d0 * (p[1].z - p[0].z) + d1 * (p[2].z - p[1].z) + d2 * (p[3].z - p[2].z) + d3 * (p[4].z - p[3].z);
+                float inverseLength = 1.0f / sqrt(tx * tx + tz * tz + 1e-12f);
+                float dx = tx * inverseLength, dz = tz * inverseLength;
+                // lanes are offset along the normal of the center line
+                x[i] = px + lane[i] * dz;
+                z[i] = pz - lane[i] * dx;
+                // the rotation from +Z to the direction is the one about the half vector (dx, 0, dz + 1), whose
+                // normalized components are sin and cos of half the yaw. Facing -Z it degenerates to half a turn.
+                float hz = dz + 1.0f;
+                float halfLength = dx * dx + hz * hz;
+                bool turned = halfLength < 1e-8f;
+                float inverseHalf = 1.0f / sqrt(turned ? 1.0f : halfLength);
+                qy[i] = turned ? 1.0f : dx * inverseHalf;
+                qw[i] = turned ? 0.0f : hz * inverseHalf;
+            }
+        });
+    }
+};
+
+// Draws the crowd: each model with one instanced call per mesh and detail level, after per-instance frustum
+// culling. Works on the pose it is handed, so it never touches the simulation's state.
+class Crowd
+{
+public:
+    CrowdGroup horses;
+    CrowdGroup spectators;
+    CrowdStats stats;
+    // hides the instances behind the nearest ones, off unless occlusion.settings.enabled is set
+    OcclusionCuller occlusion;
+
+    // height is the ground height of the track, the instance matrices are streamed through ring
+    Crowd(Model &horseModel, Model &spectatorModel, JobSystem &jobs, StreamRing &ring, float height) : height(height), jobs(jobs), ring(ring), queryFrame(0)
+    {
+        // the horse is modeled Z up and looks down its -Y axis, the same rotation as the scripted horses makes it stand
+        horses.Setup(&horseModel, glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f)), CROWD_HORSE_SCALE);
+        spectators.Setup(&spectatorModel, glm::mat4(1.0f), CROWD_SPECTATOR_SCALE);
+        glGenQueries(2, timerQueries);
+        queryPending[0] = queryPending[1] = false;
+    }
+
+    ~Crowd()
+    {
+        glDeleteQueries(2, timerQueries);
+    }
+
+    // the horse and spectator models were reloaded (see HotReload), their placement follows the new bounds
+    void Refresh()
+    {
+        horses.Refresh();
+        spectators.Refresh();
+    }
+
+    // culls the instances of the pose, picks their detail levels and streams the instance matrices for the given
+    // camera, they are valid until the ring's EndFrame. fovy is the vertical field of view in radians, screenHeight the viewport height in pixels.
+    void Prepare(const CrowdPose &pose, const glm::mat4 &viewProjection, const glm::vec3 &viewPos, float fovy, float screenHeight)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        Frustum frustum(viewProjection);
+        stats.simulateMs = pose.simulateMs;
+        stats.composeMs = 0.0f;
+        stats.streamWaitMs = ring.waitMs;
+        classifyGroup(horses, pose.horseX.data(), pose.horseZ.data(), pose.horseQY.data(), pose.horseQW.data(), pose.HorseCount(), frustum, viewPos, fovy, screenHeight);
+        classifyGroup(spectators, pose.spectatorX.data(), pose.spectatorZ.data(), pose.spectatorQY.data(), pose.spectatorQW.data(), pose.SpectatorCount(), frustum, viewPos, fovy, screenHeight);
+        stats.horsesOccluded = stats.spectatorsOccluded = 0;
+        stats.occlusionMs = 0.0f;
+        if (occlusion.settings.enabled)
+        {
+            chrono::high_resolution_clock::time_point occlusionStart = chrono::high_resolution_clock::now();
+            rasterizeOccluders(pose, viewProjection);
+            stats.horsesOccluded = occludeGroup(horses, pose.horseX.data(), pose.horseZ.data(), pose.horseQY.data(), pose.horseQW.data(), pose.HorseCount());
+            stats.spectatorsOccluded = occludeGroup(spectators, pose.spectatorX.data(), pose.spectatorZ.data(), pose.spectatorQY.data(), pose.spectatorQW.data(), pose.SpectatorCount());
+            occlusion.stats.culled = stats.horsesOccluded + stats.spectatorsOccluded;
+            stats.occlusionMs = msSince(occlusionStart);
+        }
+        stats.horsesDrawn = streamGroup(horses, pose.horseX.data(), pose.horseZ.data(), pose.horseQY.data(), pose.horseQW.data(), pose.HorseCount());
+        stats.spectatorsDrawn = streamGroup(spectators, pose.spectatorX.data(), pose.spectatorZ.data(), pose.spectatorQY.data(), pose.spectatorQW.data(), pose.SpectatorCount());
+        stats.prepareMs = msSince(start);
+    }
+
+    // requests the texture levels the closest visible horse and spectator need
+    void RequestTextures(TextureStreamer &streamer, float fovy, float screenHeight) const
+    {
+        const CrowdGroup *groups[2] = { &horses, &spectators };
+        for (unsigned int g = 0; g < 2; g++)
+            if (groups[g]->nearest < INFINITY)
+            {
+                float distance = max(groups[g]->nearest - groups[g]->radius, 0.001f);
+                groups[g]->model->RequestTextures(streamer, groups[g]->radius / (distance * tan(fovy * 0.5f)) * screenHeight);
+            }
+    }
+
+    // draws the visible instances with an instancing shader (model matrix in attributes 7 to 10)
+    void Draw(Shader &shader)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        unsigned int slot = queryFrame % 2;
+        if (queryPending[slot])
+        {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(timerQueries[slot], GL_QUERY_RESULT, &elapsed);
+            stats.gpuMs = (float)(elapsed / 1.0e6);
+        }
+        glBeginQuery(GL_TIME_ELAPSED, timerQueries[slot]);
+        stats.drawCalls = drawGroup(horses, shader) + drawGroup(spectators, shader);
+        glEndQuery(GL_TIME_ELAPSED);
+        queryPending[slot] = true;
+        queryFrame++;
+        stats.submitMs = msSince(start);
+    }
+
+    // draws the visible instances once more, untimed, for the depth pre-pass (see DepthPrepass). Instances are
+    // drawn by detail level, so the near ones already go first.
+    void DrawDepth(Shader &shader)
+    {
+        drawGroup(horses, shader);
+        drawGroup(spectators, shader);
+    }
+
+private:
+    float height;
+    JobSystem &jobs;
+    StreamRing &ring;
+    unsigned int timerQueries[2];
+    bool queryPending[2];
+    unsigned int queryFrame;
+    vector<pair<float, unsigned int> > occluderCandidates;
+
+    static float msSince(chrono::high_resolution_clock::time_point start)
+    {
+        return chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // culls a group against the view frustum, picks the detail levels and counts the instances of every level per
+    // batch. Instances whose bounding sphere projects to minOccluderPixels or more are collected as occluders.
+    void classifyGroup(CrowdGroup &group, const float *x, const float *z, const float *qy, const float *qw, unsigned int count, const Frustum &frustum, const glm::vec3 &viewPos, float fovy, float screenHeight)
+    {
+        for (unsigned int l = 0; l <= MAX_LODS; l++)
+            group.bucketStart[l] = 0;
+        group.nearest = INFINITY;
+        if (count == 0)
+            return;
+        unsigned int batches = (count + CROWD_BATCH_SIZE - 1) / CROWD_BATCH_SIZE;
+        group.levels.resize(count);
+        group.batchOffsets.assign(batches * MAX_LODS, 0);
+        group.batchNearest.assign(batches, INFINITY);
+        group.batchOccluders.resize(batches);
+        // farther than this, an instance is too small on screen to occlude much
+        float occluderDistance = occlusion.settings.enabled ? group.radius * screenHeight / (tan(fovy * 0.5f) * occlusion.settings.minOccluderPixels) : 0.0f;
+
+        // a level may be used from the distance where its error projects to LOD_PIXEL_ERROR pixels, see Model::SelectLod
+        unsigned int levelCount = group.model->LodCount();
+        float levelDistance[MAX_LODS];
+        for (unsigned int l = 0; l < levelCount; l++)
+        {
+            float distance = group.model->LodError(l) * group.radius * screenHeight / (tan(fovy * 0.5f) * LOD_PIXEL_ERROR) + group.radius;
+            levelDistance[l] = l > 0 ? max(distance, levelDistance[l - 1]) : distance;
+        }
+
+        // levels, and how many instances of each level every batch has
+        jobs.ParallelFor(count, CROWD_BATCH_SIZE, [&](unsigned int begin, unsigned int end)
+        {
+            unsigned int *counts = &group.batchOffsets[begin / CROWD_BATCH_SIZE * MAX_LODS];
+            float &nearest = group.batchNearest[begin / CROWD_BATCH_SIZE];
+            vector<pair<float, unsigned int> > &occluders = group.batchOccluders[begin / CROWD_BATCH_SIZE];
+            occluders.clear();
+            for (unsigned int i = begin; i < end; i++)
+            {
+                glm::vec3 center = group.InstanceCenter(x[i], height, z[i], qy[i], qw[i]);
+                if (!frustum.IntersectsSphere(center, group.radius))
+                {
+                    group.levels[i] = CROWD_CULLED;
+                    continue;
+                }
+                float distance = glm::length(center - viewPos);
+                nearest = min(nearest, distance);
+                if (distance < occluderDistance)
+                    occluders.push_back(make_pair(distance, i));
+                unsigned char level = 0;
+                while (level + 1u < levelCount && distance >= levelDistance[level + 1])
+                    level++;
+                group.levels[i] = level;
+                counts[level]++;
+            }
+        });
+
+        for (unsigned int b = 0; b < batches; b++)
+            group.nearest = min(group.nearest, group.batchNearest[b]);
+    }
+
+    // rasterizes the nearest occluders classifyGroup found in both groups, at their coarsest detail level
+    void rasterizeOccluders(const CrowdPose &pose, const glm::mat4 &viewProjection)
+    {
+        // (distance, index) with the spectators' indices offset by the horse count
+        vector<pair<float, unsigned int> > &candidates = occluderCandidates;
+        candidates.clear();
+        unsigned int horseCount = pose.HorseCount();
+        for (unsigned int b = 0; b < horses.batchOccluders.size() && horseCount > 0; b++)
+            candidates.insert(candidates.end(), horses.batchOccluders[b].begin(), horses.batchOccluders[b].end());
+        for (unsigned int b = 0; b < spectators.batchOccluders.size() && pose.SpectatorCount() > 0; b++)
+            for (unsigned int i = 0; i < spectators.batchOccluders[b].size(); i++)
+                candidates.push_back(make_pair(spectators.batchOccluders[b][i].first, horseCount + spectators.batchOccluders[b][i].second));
+        unsigned int occluders = min((unsigned int)candidates.size(), occlusion.settings.maxOccluders);
+        partial_sort(candidates.begin(), candidates.begin() + occluders, candidates.end());
+
+        occlusion.Begin(viewProjection);
+        for (unsigned int i = 0; i < occluders; i++)
+        {
+            unsigned int k = candidates[i].second;
+            if (k < horseCount)
+                occlusion.AddOccluder(*horses.model, horses.model->LodCount() - 1, horses.InstanceMatrix(pose.horseX[k], height, pose.horseZ[k], pose.horseQY[k], pose.horseQW[k]));
+            else
+            {
+                k -= horseCount;
+                occlusion.AddOccluder(*spectators.model, spectators.model->LodCount() - 1, spectators.InstanceMatrix(pose.spectatorX[k], height, pose.spectatorZ[k], pose.spectatorQY[k], pose.spectatorQW[k]));
+            }
+        }
+        occlusion.Finish();
+    }
+
+    // tests the instances in the view frustum against the occluders and culls the hidden ones, returns how many.
+    // An occluder's own sphere lies in front of its surface, it is never culled by itself.
+    unsigned int occludeGroup(CrowdGroup &group, const float *x, const float *z, const float *qy, const float *qw, unsigned int count)
+    {
+        if (count == 0)
+            return 0;
+        unsigned int batches = (count + CROWD_BATCH_SIZE - 1) / CROWD_BATCH_SIZE;
+        group.batchOccluded.assign(batches, 0);
+        for (unsigned int i = 0; i < batches * MAX_LODS; i++)
+            occlusion.stats.tested += group.batchOffsets[i];
+        jobs.ParallelFor(count, CROWD_BATCH_SIZE, [&](unsigned int begin, unsigned int end)
+        {
+            unsigned int *counts = &group.batchOffsets[begin / CROWD_BATCH_SIZE * MAX_LODS];
+            unsigned int &occluded = group.batchOccluded[begin / CROWD_BATCH_SIZE];
+            for (unsigned int i = begin; i < end; i++)
+            {
+                if (group.levels[i] == CROWD_CULLED || occlusion.Visible(group.InstanceCenter(x[i], height, z[i], qy[i], qw[i]), group.radius))
+                    continue;
+                counts[group.levels[i]]--;
+                group.levels[i] = CROWD_CULLED;
+                occluded++;
+            }
+        });
+        unsigned int occluded = 0;
+        for (unsigned int b = 0; b < batches; b++)
+            occluded += group.batchOccluded[b];
+        return occluded;
+    }
+
+    // has the transform kernel write the matrices of the instances classifyGroup and occludeGroup left visible,
+    // sorted by level, straight into their slice of the stream ring. Returns the number of visible instances.
+    unsigned int streamGroup(CrowdGroup &group, const float *x, const float *z, const float *qy, const float *qw, unsigned int count)
+    {
+        if (count == 0)
+            return 0;
+        unsigned int batches = (count + CROWD_BATCH_SIZE - 1) / CROWD_BATCH_SIZE;
+
+        // turn the counts into the position of each batch's first instance of a level, buckets ordered by level
+        unsigned int visible = 0;
+        for (unsigned int l = 0; l < MAX_LODS; l++)
+        {
+            group.bucketStart[l] = visible;
+            for (unsigned int b = 0; b < batches; b++)
+            {
+                unsigned int batchCount = group.batchOffsets[b * MAX_LODS + l];
+                group.batchOffsets[b * MAX_LODS + l] = visible;
+                visible += batchCount;
+            }
+        }
+        group.bucketStart[MAX_LODS] = visible;
+        if (visible == 0)
+            return 0;
+
+        // gather the visible instances in buffer order, so the kernel reads contiguous arrays
+        if (group.sortedX.size() < visible)
+        {
+            group.sortedX.resize(visible);
+            group.sortedZ.resize(visible);
+            group.sortedQY.resize(visible);
+            group.sortedQW.resize(visible);
+        }
+        if (group.heights.size() < visible || group.heights[0] != height)
+        {
+            group.heights.assign(visible, height);
+            group.zeros.assign(visible, 0.0f);
+            group.ones.assign(visible, 1.0f);
+        }
+        jobs.ParallelFor(count, CROWD_BATCH_SIZE, [&](unsigned int begin, unsigned int end)
+        {
+            unsigned int cursor[MAX_LODS];
+            for (unsigned int l = 0; l < MAX_LODS; l++)
+                cursor[l] = group.batchOffsets[begin / CROWD_BATCH_SIZE * MAX_LODS + l];
+            for (unsigned int i = begin; i < end; i++)
+            {
+                if (group.levels[i] == CROWD_CULLED)
+                    continue;
+                unsigned int k = cursor[group.levels[i]]++;
+                group.sortedX[k] = x[i];
+                group.sortedZ[k] = z[i];
+                group.sortedQY[k] = qy[i];
+                group.sortedQW[k] = qw[i];
+            }
+        });
+
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        // aligned to a whole matrix, so the slice starts at an instance index of the ring buffer
+        StreamAllocation allocation = ring.Allocate(visible * sizeof(glm::mat4), sizeof(glm::mat4));
+        group.instanceBuffer = allocation.buffer;
+        group.firstInstance = allocation.offset / sizeof(glm::mat4);
+        glm::mat4 *mapped = (glm::mat4*)allocation.data;
+        if (mapped)
+        {
+            jobs.ParallelFor(visible, CROWD_BATCH_SIZE, [&](unsigned int begin, unsigned int end)
+            {
+                TRSArrays in = { &group.sortedX[begin], &group.heights[begin], &group.sortedZ[begin],
+                    &group.zeros[begin], &group.sortedQY[begin], &group.zeros[begin], &group.sortedQW[begin], &group.ones[begin] };
+                TransformKernel::ComposeTRS(in, end - begin, group.base, mapped + begin);
+            });
+            ring.Unmap();
+        }
+        else
+        {
+            for (unsigned int l = 0; l <= MAX_LODS; l++)
+                group.bucketStart[l] = 0;
+            visible = 0;
+        }
+        stats.composeMs += msSince(start);
+        return visible;
+    }
+
+    unsigned int drawGroup(CrowdGroup &group, Shader &shader)
+    {
+        unsigned int calls = 0;
+        for (unsigned int l = 0; l < MAX_LODS; l++)
+        {
+            unsigned int count = group.bucketStart[l + 1] - group.bucketStart[l];
+            if (count == 0)
+                continue;
+            group.model->DrawInstanced(shader, l, group.instanceBuffer, group.firstInstance + group.bucketStart[l], count);
+            calls += (unsigned int)group.model->meshes.size();
+        }
+        return calls;
+    }
+};
+
+// steps the crowd through growing horse counts and prints where the frame time goes for each of them
+class CrowdBenchmark
+{
+public:
+    CrowdBenchmark() : step(0), frame(0)
+    {
+        sizes.push_back(10);
+        sizes.push_back(1000);
+        sizes.push_back(10000);
+        sizes.push_back(100000);
+    }
+
+    bool Done() const
+    {
+        return step >= sizes.size();
+    }
+    unsigned int Horses() const
+    {
+        return sizes[step];
+    }
+    unsigned int Spectators() const
+    {
+        return sizes[step] / 4;
+    }
+
+    // call once per frame after the crowd was drawn. Returns true when the next crowd size has to be spawned.
+    bool Record(const CrowdStats &stats, float frameMs)
+    {
+        if (step == 0 && frame == 0)
+            printf("CROWD_BENCHMARK::   horses  drawn  occluded simulate  prepare   compose   occlusion submit    gpu       stream    frame (ms, mean of %d frames), compose ns per instance\n", MEASURED_FRAMES);
+        frame++;
+        if (frame <= WARMUP_FRAMES)
+            return false;
+        total.simulateMs += stats.simulateMs;
+        total.prepareMs += stats.prepareMs;
+        total.composeMs += stats.composeMs;
+        total.occlusionMs += stats.occlusionMs;
+        total.submitMs += stats.submitMs;
+        total.gpuMs += stats.gpuMs;
+        total.streamWaitMs += stats.streamWaitMs;
+        total.horsesDrawn += stats.horsesDrawn;
+        total.spectatorsDrawn += stats.spectatorsDrawn;
+        total.horsesOccluded += stats.horsesOccluded;
+        total.spectatorsOccluded += stats.spectatorsOccluded;
+        totalFrameMs += frameMs;
+        if (frame < WARMUP_FRAMES + MEASURED_FRAMES)
+            return false;
+        float n = (float)MEASURED_FRAMES;
+        unsigned int instances = total.horsesDrawn + total.spectatorsDrawn;
+        printf("CROWD_BENCHMARK:: %8u %6u %8u %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.2f\n", sizes[step], total.horsesDrawn / MEASURED_FRAMES,
+            (total.horsesOccluded + total.spectatorsOccluded) / MEASURED_FRAMES, total.simulateMs / n, total.prepareMs / n, total.composeMs / n,
+            total.occlusionMs / n, total.submitMs / n, total.gpuMs / n, total.streamWaitMs / n, totalFrameMs / n,
+            instances > 0 ? total.composeMs * 1.0e6f / instances : 0.0f);
+        step++;
+        frame = 0;
+        total = CrowdStats();
+        totalFrameMs = 0.0f;
+        return !Done();
+    }
+
+private:
+    enum { WARMUP_FRAMES = 30, MEASURED_FRAMES = 200 };
+    vector<unsigned int> sizes;
+    unsigned int step;
+    int frame;
+    CrowdStats total;
+    float totalFrameMs = 0.0f;
+};
+#endif
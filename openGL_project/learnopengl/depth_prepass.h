@@ -0,0 +1,202 @@
+#ifndef DEPTH_PREPASS_H
+#define DEPTH_PREPASS_H
+
+#include <glad/glad.h>
+
+#include "learnopengl/shader.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+using namespace std;
+
+// frames a fragment count query gets before its result is read, so reading it never waits for the GPU
+#define DEPTH_PREPASS_QUERY_FRAMES 4
+
+// fragments the opaque passes produced, summed over the frames whose queries were read
+struct OverdrawStats {
+    unsigned int frames;
+    double pixels;          // of the viewport
+    double depthFragments;  // written by the depth pre-pass
+    double shadedFragments; // that passed the depth test in the shading pass, each ran the lit fragment shader
+
+    OverdrawStats() : frames(0), pixels(0.0), depthFragments(0.0), shadedFragments(0.0)
+    {
+    }
+};
+
+// Draws the opaque scene in up to two passes to cut overdraw. With the pre-pass on, the opaque draws first go out
+// with depth-only programs, which write the depth buffer and shade nothing, and then again with the lit programs
+// and GL_EQUAL, so the lit fragment shader runs once per pixel, for the surface that is seen. A depth-only program
+// is built from the vertex shader of its lit program and the empty shadowDepth.fs; the vertex shaders declare
+// gl_Position invariant, so both programs put every vertex at exactly the same depth.
+// The overdraw mode replaces the lit programs with ones that add a fixed color per shaded fragment: dark red is
+// one fragment, red four, yellow eight and white sixteen or more. Either way the fragments are counted with
+// occlusion queries, see PrintStats, so the pre-pass and the draw order can be compared by numbers.
+class DepthPrepass
+{
+public:
+    OverdrawStats stats;
+
+    DepthPrepass(bool enabled, bool overdraw) : enabled(enabled), overdraw(overdraw), depthPass(false), frame(0)
+    {
+        glGenQueries(DEPTH_PREPASS_QUERY_FRAMES * 2, queries);
+        for (unsigned int i = 0; i < DEPTH_PREPASS_QUERY_FRAMES; i++)
+            pending[i] = false;
+    }
+
+    ~DepthPrepass()
+    {
+        glDeleteQueries(DEPTH_PREPASS_QUERY_FRAMES * 2, queries);
+    }
+
+    bool Enabled() const
+    {
+        return enabled;
+    }
+
+    bool Overdraw() const
+    {
+        return overdraw;
+    }
+
+    // true while the depth-only pass is drawn
+    bool DepthPass() const
+    {
+        return depthPass;
+    }
+
+    // builds the depth-only and the overdraw program of a lit one, if the modes need them. Call it after the
+    // lit program's uniform blocks are set up.
+    void Add(Shader &lit)
+    {
+        Programs programs;
+        programs.lit = &lit;
+        if (enabled)
+            programs.depth = twin(lit, "resources/shader/shadowDepth.fs");
+        if (overdraw)
+            programs.overdraw = twin(lit, "resources/shader/overdraw.fs");
+        if (programs.depth || programs.overdraw)
+            added.push_back(move(programs));
+    }
+
+    // the programs Add built, to be watched by HotReload along with the lit ones
+    vector<Shader *> Built()
+    {
+        vector<Shader *> built;
+        for (unsigned int i = 0; i < added.size(); i++)
+        {
+            if (added[i].depth)
+                built.push_back(added[i].depth.get());
+            if (added[i].overdraw)
+                built.push_back(added[i].overdraw.get());
+        }
+        return built;
+    }
+
+    // the program to draw with instead of lit in the current pass
+    Shader &Select(Shader &lit)
+    {
+        for (unsigned int i = 0; i < added.size(); i++)
+            if (added[i].lit == &lit)
+            {
+                if (depthPass && added[i].depth)
+                    return *added[i].depth;
+                if (!depthPass && added[i].overdraw)
+                    return *added[i].overdraw;
+                break;
+            }
+        return lit;
+    }
+
+    // before the opaque draws: collects the counts of an earlier frame and starts the depth-only pass, if it's on
+    void BeginFrame()
+    {
+        unsigned int slot = frame % DEPTH_PREPASS_QUERY_FRAMES;
+        if (pending[slot])
+        {
+            GLuint depthFragments = 0, shadedFragments = 0;
+            if (enabled)
+                glGetQueryObjectuiv(queries[slot * 2], GL_QUERY_RESULT, &depthFragments);
+            glGetQueryObjectuiv(queries[slot * 2 + 1], GL_QUERY_RESULT, &shadedFragments);
+            stats.frames++;
+            stats.pixels += pixels[slot];
+            stats.depthFragments += depthFragments;
+            stats.shadedFragments += shadedFragments;
+            pending[slot] = false;
+        }
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        pixels[slot] = (double)viewport[2] * viewport[3];
+
+        if (!enabled)
+            return;
+        depthPass = true;
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glBeginQuery(GL_SAMPLES_PASSED, queries[slot * 2]);
+    }
+
+    // after the depth-only pass, before the same draws go out again with the programs Select picks
+    void BeginShading()
+    {
+        unsigned int slot = frame % DEPTH_PREPASS_QUERY_FRAMES;
+        if (enabled)
+        {
+            glEndQuery(GL_SAMPLES_PASSED);
+            depthPass = false;
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            // the depth buffer is complete, only the nearest surface passes and nothing has to be written
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_EQUAL);
+        }
+        if (overdraw)
+        {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
+        glBeginQuery(GL_SAMPLES_PASSED, queries[slot * 2 + 1]);
+    }
+
+    // after the opaque draws, restores the state the rest of the frame draws with
+    void EndFrame()
+    {
+        glEndQuery(GL_SAMPLES_PASSED);
+        pending[frame % DEPTH_PREPASS_QUERY_FRAMES] = true;
+        frame++;
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        if (overdraw)
+            glDisable(GL_BLEND);
+    }
+
+    void PrintStats() const
+    {
+        if (stats.frames == 0 || stats.pixels <= 0.0)
+            return;
+        printf("DEPTH_PREPASS:: pre-pass %s, %u frames: %.2f fragments shaded per pixel", enabled ? "on" : "off", stats.frames, stats.shadedFragments / stats.pixels);
+        if (enabled)
+            printf(" after %.2f depth-only fragments per pixel", stats.depthFragments / stats.pixels);
+        printf("\n");
+    }
+
+private:
+    struct Programs {
+        Shader *lit;
+        unique_ptr<Shader> depth, overdraw;
+    };
+
+    bool enabled, overdraw;
+    bool depthPass;
+    unsigned int frame;
+    vector<Programs> added;
+    unsigned int queries[DEPTH_PREPASS_QUERY_FRAMES * 2]; // depth-only and shading pass of every frame in flight
+    bool pending[DEPTH_PREPASS_QUERY_FRAMES];
+    double pixels[DEPTH_PREPASS_QUERY_FRAMES];
+
+    static unique_ptr<Shader> twin(const Shader &lit, const char *fragmentPath)
+    {
+        return unique_ptr<Shader>(new Shader(lit.vertexPath.c_str(), fragmentPath, lit.geometryPath.empty() ? nullptr : lit.geometryPath.c_str()));
+    }
+};
+#endif
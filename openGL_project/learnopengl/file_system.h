@@ -0,0 +1,154 @@
+#ifndef FILE_SYSTEM_H
+#define FILE_SYSTEM_H
+
+#include "learnopengl/mapped_file.h"
+#include "learnopengl/asset_archive.h"
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <iostream>
+#include <cstdio>
+using namespace std;
+
+struct FileSystemStats {
+    unsigned int opened;    // files opened
+    unsigned int archived;  // of those found in a mounted archive
+    size_t bytes;           // size of the opened files
+
+    FileSystemStats() : opened(0), archived(0), bytes(0)
+    {
+    }
+};
+
+// Read-only access to the assets as views of mapped memory (see MappedFile), for the shaders, the images and,
+// through AssetIOSystem, Assimp. Paths are looked up in the mounted archives first, the last mounted one wins,
+// then on disk, so an archive of resources/ (--pack, see AssetPacker) replaces the loose files with one mapping
+// and no further opens. Safe to use from any thread once the archives are mounted.
+class FileSystem
+{
+public:
+    // adds an archive made by AssetArchive::Pack, false if it can't be read
+    static bool Mount(const string &path)
+    {
+        AssetArchive archive;
+        if (!archive.Open(path))
+        {
+            std::cout << "ERROR::FILE_SYSTEM:: can't mount " << path << std::endl;
+            return false;
+        }
+        printf("FILE_SYSTEM:: mounted %s, %u files\n", path.c_str(), archive.Count());
+        archives().insert(archives().begin(), archive);
+        return true;
+    }
+
+    // the contents of the file at path, not Valid() if it doesn't exist
+    static FileView Open(const string &path)
+    {
+        string name = Normalize(path);
+        FileView view;
+        AssetEntry entry;
+        bool archived = find(name, entry, view);
+        if (!archived)
+        {
+            shared_ptr<MappedFile> file = MappedFile::Open(name);
+            if (file)
+                view = FileView(file, 0, file->Size());
+        }
+        if (view.Valid())
+        {
+            lock_guard<mutex> lock(statsMutex());
+            FileSystemStats &stats = Stats();
+            stats.opened++;
+            stats.archived += archived ? 1 : 0;
+            stats.bytes += view.size;
+        }
+        return view;
+    }
+
+    static bool Exists(const string &path)
+    {
+        long long size, modified;
+        return Stat(path, size, modified);
+    }
+
+    // size and modification time of the file at path; for an archived file those of the file it was packed from
+    static bool Stat(const string &path, long long &size, long long &modified)
+    {
+        string name = Normalize(path);
+        vector<AssetArchive> &mounted = archives();
+        AssetEntry entry;
+        for (unsigned int i = 0; i < mounted.size(); i++)
+            if (mounted[i].Find(name, entry))
+            {
+                size = (long long)entry.size;
+                modified = entry.modified;
+                return true;
+            }
+        return StatFile(name, size, modified);
+    }
+
+    // '/' separators, without "." components and with ".." resolved where possible, the form archives store
+    static string Normalize(const string &path)
+    {
+        vector<string> parts;
+        string part;
+        for (size_t i = 0; i <= path.size(); i++)
+        {
+            char c = i < path.size() ? path[i] : '/';
+            if (c != '/' && c != '\\')
+            {
+                part += c;
+                continue;
+            }
+            if (part == ".." && !parts.empty() && parts.back() != "..")
+                parts.pop_back();
+            else if (!part.empty() && part != ".")
+                parts.push_back(part);
+            part.clear();
+        }
+        string name = !path.empty() && (path[0] == '/' || path[0] == '\\') ? "/" : "";
+        for (unsigned int i = 0; i < parts.size(); i++)
+            name += (i > 0 ? "/" : "") + parts[i];
+        return name;
+    }
+
+    static FileSystemStats &Stats()
+    {
+        static FileSystemStats stats;
+        return stats;
+    }
+
+    static void PrintStats()
+    {
+        const FileSystemStats &stats = Stats();
+        printf("FILE_SYSTEM:: %u files opened, %u of them from archives, %.1f MB mapped\n", stats.opened, stats.archived, stats.bytes / (1024.0f * 1024.0f));
+    }
+
+private:
+    static vector<AssetArchive> &archives()
+    {
+        static vector<AssetArchive> mounted;
+        return mounted;
+    }
+
+    static mutex &statsMutex()
+    {
+        static mutex statsLock;
+        return statsLock;
+    }
+
+    // the entry for name in the first archive that has it, and its contents
+    static bool find(const string &name, AssetEntry &entry, FileView &view)
+    {
+        vector<AssetArchive> &mounted = archives();
+        for (unsigned int i = 0; i < mounted.size(); i++)
+            if (mounted[i].Find(name, entry))
+            {
+                view = mounted[i].View(entry);
+                return true;
+            }
+        return false;
+    }
+};
+#endif
@@ -0,0 +1,175 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include "learnopengl/mapped_file.h"
+#include "learnopengl/file_system.h"
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+using namespace std;
+
+// a change is reported once the file has been quiet this long, so a file that is still being written isn't read
+#define FILE_WATCH_SETTLE_MS 150
+// how often the portable fallback compares sizes and modification times
+#define FILE_WATCH_POLL_MS 500
+
+// Watches files on disk from a thread of its own and collects the ones that changed. On Linux it sleeps in
+// inotify on the directories of the watched files, which also sees editors that save by writing a new file and
+// renaming it over the old one; elsewhere it polls the size and modification time of every watched file.
+// Only loose files are watched: a file served from a mounted archive (see FileSystem) doesn't change.
+class FileWatcher
+{
+public:
+    FileWatcher() : running(true)
+    {
+#if defined(__linux__)
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd < 0)
+            std::cout << "ERROR::FILE_WATCHER:: inotify unavailable, polling instead" << std::endl;
+#endif
+        worker = thread([this] { run(); });
+    }
+
+    ~FileWatcher()
+    {
+        running = false;
+        worker.join();
+#if defined(__linux__)
+        if (inotifyFd >= 0)
+            close(inotifyFd);
+#endif
+    }
+
+    void Watch(const string &path)
+    {
+        string name = FileSystem::Normalize(path);
+        lock_guard<mutex> lock(watchMutex);
+        if (files.count(name))
+            return;
+        FileState state;
+        StatFile(name, state.size, state.modified);
+        files[name] = state;
+#if defined(__linux__)
+        if (inotifyFd < 0)
+            return;
+        size_t slash = name.find_last_of('/');
+        string directory = slash == string::npos ? "." : slash == 0 ? "/" : name.substr(0, slash);
+        for (map<int, string>::iterator it = directories.begin(); it != directories.end(); ++it)
+            if (it->second == directory)
+                return;
+        int descriptor = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (descriptor >= 0)
+            directories[descriptor] = directory;
+#endif
+    }
+
+    // the watched files that changed and have settled since the last call, each once
+    vector<string> Changed()
+    {
+        vector<string> changed;
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        lock_guard<mutex> lock(watchMutex);
+        for (map<string, chrono::steady_clock::time_point>::iterator it = pending.begin(); it != pending.end();)
+        {
+            if (now - it->second < chrono::milliseconds(FILE_WATCH_SETTLE_MS))
+            {
+                ++it;
+                continue;
+            }
+            changed.push_back(it->first);
+            it = pending.erase(it);
+        }
+        return changed;
+    }
+
+private:
+    struct FileState {
+        long long size, modified;
+
+        FileState() : size(-1), modified(0)
+        {
+        }
+    };
+
+    thread worker;
+    atomic<bool> running;
+    mutex watchMutex;
+    map<string, FileState> files;
+    // watched files with a change that hasn't settled or been collected yet, and when it was last seen
+    map<string, chrono::steady_clock::time_point> pending;
+#if defined(__linux__)
+    int inotifyFd;
+    map<int, string> directories;
+#endif
+
+    void run()
+    {
+        while (running)
+        {
+#if defined(__linux__)
+            if (inotifyFd >= 0)
+            {
+                pollfd descriptor = { inotifyFd, POLLIN, 0 };
+                if (poll(&descriptor, 1, 100) > 0)
+                    readEvents();
+                continue;
+            }
+#endif
+            pollFiles();
+            for (unsigned int slept = 0; slept < FILE_WATCH_POLL_MS && running; slept += 50)
+                this_thread::sleep_for(chrono::milliseconds(50));
+        }
+    }
+
+    void pollFiles()
+    {
+        lock_guard<mutex> lock(watchMutex);
+        for (map<string, FileState>::iterator it = files.begin(); it != files.end(); ++it)
+        {
+            FileState state;
+            StatFile(it->first, state.size, state.modified);
+            if (state.size != it->second.size || state.modified != it->second.modified)
+            {
+                it->second = state;
+                pending[it->first] = chrono::steady_clock::now();
+            }
+        }
+    }
+
+#if defined(__linux__)
+    void readEvents()
+    {
+        // inotify events are aligned for the struct, the buffer has to be too
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+        {
+            lock_guard<mutex> lock(watchMutex);
+            for (ssize_t offset = 0; offset < length;)
+            {
+                const inotify_event *event = (const inotify_event *)(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+                map<int, string>::iterator directory = directories.find(event->wd);
+                if (event->len == 0 || directory == directories.end())
+                    continue;
+                string name = directory->second == "." ? string(event->name) : directory->second + "/" + event->name;
+                if (files.count(name))
+                    pending[name] = chrono::steady_clock::now();
+            }
+        }
+    }
+#endif
+};
+#endif
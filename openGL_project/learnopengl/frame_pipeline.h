@@ -0,0 +1,173 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+using namespace std;
+
+// Hands packets from one producer thread to one consumer thread without locks. It is a triple buffer with one more
+// slot: the producer fills its back slot and swaps it with the shared ready slot, the consumer swaps the ready slot
+// for the older of the two packets it holds whenever a new one was published. The consumer thus always has the
+// newest packet and the one before it to interpolate between, and neither side ever waits for the other; packets
+// the consumer was too slow to pick up are overwritten.
+template <class T>
+class FrameMailbox
+{
+public:
+    FrameMailbox() : ready(1), back(0), current(2), previous(3), received(0)
+    {
+    }
+
+    // producer: the packet to fill next, it stays the producer's until Publish
+    T &Back()
+    {
+        return slots[back];
+    }
+
+    // producer: makes the back packet the newest one
+    void Publish()
+    {
+        back = ready.exchange(back | FRESH, memory_order_acq_rel) & INDEX;
+    }
+
+    // consumer: takes the newest packet if one was published since the last call, returns whether it did
+    bool Acquire()
+    {
+        if (!(ready.load(memory_order_acquire) & FRESH))
+            return false;
+        // only the consumer clears the flag, so the slot is still fresh when it is swapped out
+        unsigned int oldest = previous;
+        previous = current;
+        current = ready.exchange(oldest, memory_order_acq_rel) & INDEX;
+        received = min(received + 1, 2u);
+        return true;
+    }
+
+    // consumer: number of packets taken so far, up to 2
+    unsigned int Received() const
+    {
+        return received;
+    }
+    // consumer: the newest packet taken
+    const T &Current() const
+    {
+        return slots[current];
+    }
+    // consumer: the packet before it, the newest one again until two were taken
+    const T &Previous() const
+    {
+        return slots[received >= 2 ? previous : current];
+    }
+
+private:
+    enum { INDEX = 3, FRESH = 4 };
+    T slots[4];
+    atomic<unsigned int> ready; // slot index, plus FRESH while it holds a packet the consumer hasn't taken
+    unsigned int back;          // producer side
+    unsigned int current;       // consumer side
+    unsigned int previous;
+    unsigned int received;
+};
+
+// Runs a step function in fixed time steps on its own thread, in real time. Steps are spaced by the clock, not by
+// the render loop, so a frame waiting for vsync doesn't hold the simulation back. When the thread falls behind by
+// more than a few steps it skips the missed time instead of trying to catch up.
+class SimulationThread
+{
+public:
+    SimulationThread(float step) : step(step), running(false), epoch(chrono::steady_clock::now())
+    {
+    }
+
+    ~SimulationThread()
+    {
+        Stop();
+    }
+
+    // fn(dt, time) runs once per step, time is the simulated time at the end of the step on the Now() clock
+    void Start(const function<void(float, double)> &fn)
+    {
+        Stop();
+        stepFunction = fn;
+        running = true;
+        worker = thread(&SimulationThread::loop, this);
+    }
+
+    void Stop()
+    {
+        running = false;
+        if (worker.joinable())
+            worker.join();
+    }
+
+    float Step() const
+    {
+        return step;
+    }
+
+    // seconds since the thread object was created, the clock of the step times
+    double Now() const
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - epoch).count();
+    }
+
+private:
+    float step;
+    atomic<bool> running;
+    chrono::steady_clock::time_point epoch;
+    function<void(float, double)> stepFunction;
+    thread worker;
+
+    void loop()
+    {
+        double time = Now();
+        while (running)
+        {
+            double now = Now();
+            if (now - time > 4.0 * step)
+                time = now - step;
+            if (now < time + step)
+            {
+                this_thread::sleep_for(chrono::duration<double>(time + step - now));
+                continue;
+            }
+            time += step;
+            stepFunction(step, time);
+        }
+    }
+};
+
+// the fraction of the way from the previous to the current packet at the given time, clamped to [0, 1]
+inline float InterpolationFactor(double previousTime, double currentTime, double time)
+{
+    if (currentTime <= previousTime)
+        return 1.0f;
+    return (float)glm::clamp((time - previousTime) / (currentTime - previousTime), 0.0, 1.0);
+}
+
+// blends two affine transforms without shear: translation and scale linearly, rotation along the shorter arc
+inline glm::mat4 InterpolateTransform(const glm::mat4 &a, const glm::mat4 &b, float alpha)
+{
+    if (alpha <= 0.0f)
+        return a;
+    if (alpha >= 1.0f)
+        return b;
+    glm::vec3 scaleA(glm::length(glm::vec3(a[0])), glm::length(glm::vec3(a[1])), glm::length(glm::vec3(a[2])));
+    glm::vec3 scaleB(glm::length(glm::vec3(b[0])), glm::length(glm::vec3(b[1])), glm::length(glm::vec3(b[2])));
+    glm::quat rotationA = glm::quat_cast(glm::mat3(glm::vec3(a[0]) / scaleA.x, glm::vec3(a[1]) / scaleA.y, glm::vec3(a[2]) / scaleA.z));
+    glm::quat rotationB = glm::quat_cast(glm::mat3(glm::vec3(b[0]) / scaleB.x, glm::vec3(b[1]) / scaleB.y, glm::vec3(b[2]) / scaleB.z));
+    glm::vec3 scale = glm::mix(scaleA, scaleB, alpha);
+    glm::mat4 m = glm::mat4_cast(glm::slerp(rotationA, rotationB, alpha));
+    m[0] *= scale.x;
+    m[1] *= scale.y;
+    m[2] *= scale.z;
+    m[3] = glm::vec4(glm::mix(glm::vec3(a[3]), glm::vec3(b[3]), alpha), 1.0f);
+    return m;
+}
+#endif
@@ -0,0 +1,57 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "learnopengl/shader.h"
+#include "learnopengl/stream_ring.h"
+
+#include <cstring>
+using namespace std;
+
+// std140 layout of the Frame uniform block, the values every lit shader shares within a frame:
+//   layout (std140) uniform Frame {
+//       mat4 view;
+//       mat4 projection;
+//       vec3 viewPos;
+//       vec3 lightPosition;
+//       mat4 lightSpaceMatrices[4];
+//       vec4 cascadeSplits;
+//       int cascadeCount;
+//   };
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 viewPos;
+    float padding0;
+    glm::vec3 lightPosition;
+    float padding1;
+    glm::mat4 lightSpaceMatrices[4];  // MAX_SHADOW_CASCADES, filled by ShadowMap::Apply
+    glm::vec4 cascadeSplits;          // far view distance of every cascade
+    int cascadeCount;
+    int padding2[3];
+
+    FrameUniforms() : view(1.0f), projection(1.0f), viewPos(0.0f), padding0(0.0f), lightPosition(0.0f), padding1(0.0f), cascadeSplits(0.0f), cascadeCount(0)
+    {
+        for (unsigned int i = 0; i < 4; i++)
+            lightSpaceMatrices[i] = glm::mat4(1.0f);
+        padding2[0] = padding2[1] = padding2[2] = 0;
+    }
+
+    // streams the values through the ring and binds them for the draws of this frame, one upload instead of
+    // setting the same uniforms on every shader
+    void Upload(StreamRing &ring) const
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        StreamAllocation allocation = ring.Allocate(sizeof(FrameUniforms), alignment);
+        if (!allocation.data)
+            return;
+        memcpy(allocation.data, this, sizeof(FrameUniforms));
+        ring.Unmap();
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, allocation.buffer, allocation.offset, sizeof(FrameUniforms));
+    }
+};
+#endif
@@ -0,0 +1,49 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// view frustum as six inward facing planes, extracted from a combined projection * view matrix (Gribb/Hartmann).
+// Used to cull bounding spheres against the camera and the shadow casting lights.
+class Frustum
+{
+public:
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far. xyz: normal, w: distance
+
+    Frustum()
+    {
+        for (unsigned int i = 0; i < 6; i++)
+            planes[i] = glm::vec4(0.0f);
+    }
+
+    Frustum(const glm::mat4 &viewProjection)
+    {
+        glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+        for (unsigned int i = 0; i < 6; i++)
+        {
+            float length = glm::length(glm::vec3(planes[i]));
+            if (length > 0.0f)
+                planes[i] /= length;
+        }
+    }
+
+    // true if the sphere is at least partially inside the frustum. Shadow casters in front of the near plane
+    // still cast shadows when depth clamping is on, testNear = false skips that plane for them.
+    bool IntersectsSphere(const glm::vec3 &center, float radius, bool testNear = true) const
+    {
+        for (unsigned int i = 0; i < 6; i++)
+            if ((testNear || i != 4) && glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+                return false;
+        return true;
+    }
+};
+#endif
@@ -0,0 +1,155 @@
+#ifndef HERD_ANIMATOR_H
+#define HERD_ANIMATOR_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "learnopengl/animdata.h"
+#include "learnopengl/animation.h"
+#include "learnopengl/pose.h"
+#include "learnopengl/bone_palette.h"
+#include "learnopengl/job_system.h"
+#include "learnopengl/stream_ring.h"
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+// instances evaluated per job, enough work per batch to hide the cost of grabbing it
+#define HERD_BATCH_SIZE 8
+
+// playback state of one animated instance
+struct HerdInstance {
+    const Animation *clip;      // null keeps the instance in its bind pose
+    const Animation *blendClip; // optional second clip, mixed in with blendWeight
+    float blendWeight;
+    float time;                 // in seconds, both clips loop independently
+    float speed;                // playback rate, 1 is the authored speed
+
+    HerdInstance() : clip(nullptr), blendClip(nullptr), blendWeight(0.0f), time(0.0f), speed(1.0f)
+    {
+    }
+};
+
+// Animates many instances of one skeleton. Each frame the palette buffer is mapped once, the instances are split
+// into jobs on the job system, and every job samples, blends and converts its instances' poses and writes the
+// skinning matrices straight into the mapped buffer. The render thread then only binds each instance's range.
+class HerdAnimator
+{
+public:
+    Skeleton skeleton;
+    vector<HerdInstance> instances;
+    // time the last Update spent evaluating poses, wall clock on the calling thread
+    float cpuTimeMs;
+
+    // skeleton is the clip hierarchy of the model the instances are drawn with, the palettes are streamed
+    // through ring
+    HerdAnimator(const Skeleton &skeleton, JobSystem &jobs, StreamRing &ring) : cpuTimeMs(0.0f), jobs(jobs), ring(ring), stride(0), alignment(256), palettes(0)
+    {
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        SetSkeleton(skeleton);
+    }
+
+    // replaces the skeleton, e.g. one built again after the model was reloaded. Call it between frames, the
+    // palettes of the last Update are dropped.
+    void SetSkeleton(const Skeleton &skeleton)
+    {
+        this->skeleton = skeleton;
+        // consecutive palettes only need room for the bones the skeleton has, the bound ranges may overlap the next one
+        unsigned int paletteBytes = max(1, skeleton.paletteSize) * sizeof(glm::mat4);
+        stride = (paletteBytes + alignment - 1) / alignment * alignment;
+        palettes = 0;
+    }
+
+    unsigned int AddInstance(const Animation *clip, float startTime = 0.0f, float speed = 1.0f)
+    {
+        HerdInstance instance;
+        instance.clip = clip;
+        instance.time = startTime;
+        instance.speed = speed;
+        instances.push_back(instance);
+        return (unsigned int)instances.size() - 1;
+    }
+
+    // advances every instance by dt seconds and writes the new palettes, they are valid until the ring's EndFrame
+    void Update(float dt)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        unsigned int count = (unsigned int)instances.size();
+        if (count == 0)
+            return;
+        for (unsigned int i = 0; i < count; i++)
+            instances[i].time += dt * instances[i].speed;
+
+        // the last range still has to cover the whole Bones block
+        allocation = ring.Allocate((count - 1) * stride + MAX_BONES * sizeof(glm::mat4), alignment);
+        palettes = allocation.data ? count : 0;
+        if (allocation.data)
+        {
+            unsigned char *mapped = allocation.data;
+            const Skeleton &skeleton = this->skeleton;
+            const vector<HerdInstance> &instances = this->instances;
+            unsigned int stride = this->stride;
+            jobs.ParallelFor(count, HERD_BATCH_SIZE, [&](unsigned int begin, unsigned int end)
+            {
+                Pose pose, blendPose;
+                vector<glm::mat4> modelTransforms(skeleton.JointCount());
+                for (unsigned int i = begin; i < end; i++)
+                {
+                    glm::mat4 *palette = (glm::mat4*)(mapped + i * stride);
+                    evaluate(skeleton, instances[i], pose, blendPose, modelTransforms, palette);
+                }
+            });
+            ring.Unmap();
+        }
+        cpuTimeMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // palette of the instance, valid once Update ran
+    PaletteRange Range(unsigned int instance) const
+    {
+        if (instance >= palettes)
+            return PaletteRange();
+        return PaletteRange(allocation.buffer, allocation.offset + instance * stride);
+    }
+
+    // makes the instance's palette the one the next draws are skinned with
+    void Bind(unsigned int instance) const
+    {
+        Range(instance).Bind();
+    }
+
+private:
+    JobSystem &jobs;
+    StreamRing &ring;
+    unsigned int stride;
+    GLint alignment;
+    StreamAllocation allocation; // this frame's palettes
+    unsigned int palettes;       // number of palettes in it
+
+    static float clipTime(const Animation &clip, float seconds)
+    {
+        float ticks = seconds * clip.ticksPerSecond;
+        return clip.duration > 0.0f ? fmod(ticks, clip.duration) : ticks;
+    }
+
+    static void evaluate(const Skeleton &skeleton, const HerdInstance &instance, Pose &pose, Pose &blendPose, vector<glm::mat4> &modelTransforms, glm::mat4 *palette)
+    {
+        for (int b = 0; b < skeleton.paletteSize; b++)
+            palette[b] = glm::mat4(1.0f);
+        if (!instance.clip || skeleton.JointCount() == 0)
+            return;
+        PoseEvaluator::Sample(skeleton, *instance.clip, clipTime(*instance.clip, instance.time), pose);
+        if (instance.blendClip && instance.blendWeight > 0.0f)
+        {
+            PoseEvaluator::Sample(skeleton, *instance.blendClip, clipTime(*instance.blendClip, instance.time), blendPose);
+            PoseEvaluator::Blend(pose, blendPose, instance.blendWeight);
+        }
+        PoseEvaluator::LocalToModel(skeleton, pose, &modelTransforms[0]);
+        PoseEvaluator::WritePalette(skeleton, &modelTransforms[0], palette);
+    }
+};
+#endif
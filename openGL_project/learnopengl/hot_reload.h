@@ -0,0 +1,191 @@
+#ifndef HOT_RELOAD_H
+#define HOT_RELOAD_H
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include "learnopengl/shader.h"
+#include "learnopengl/model.h"
+#include "learnopengl/material.h"
+#include "learnopengl/file_watcher.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+using namespace std;
+
+// Rebuilds shaders and models while the program runs when the files they come from change (--hot-reload). A
+// FileWatcher notices the changes; Update, called by the render loop between frames, recompiles every program
+// built from a changed file and starts a background import of every changed model, which also optimizes its
+// meshes and builds their detail levels, once per file. Imports that finished are uploaded at the next Update,
+// into every model loaded from that file. A program that doesn't compile keeps the old one running, so a typo
+// doesn't end the session; a model that can't be imported keeps its old meshes.
+class HotReload
+{
+public:
+    HotReload(MaterialLibrary &materials) : materials(materials)
+    {
+    }
+
+    ~HotReload()
+    {
+        for (unsigned int i = 0; i < imports.size(); i++)
+            imports[i]->worker.join();
+    }
+
+    void Watch(Shader &shader)
+    {
+        shaders.push_back(&shader);
+        watcher.Watch(shader.vertexPath);
+        watcher.Watch(shader.fragmentPath);
+        if (!shader.geometryPath.empty())
+            watcher.Watch(shader.geometryPath);
+        watcher.Watch(SHADER_VERTEX_PRELUDE);
+        watcher.Watch(SHADER_FRAGMENT_PRELUDE);
+    }
+
+    // model has to have been loaded from path; its material library, textures aside, counts as part of it
+    void Watch(Model &model, const string &path)
+    {
+        WatchedModel watched;
+        watched.model = &model;
+        watched.path = FileSystem::Normalize(path);
+        models.push_back(watched);
+        watcher.Watch(watched.path);
+        for (unsigned int i = 0; i < model.files.size(); i++)
+            watcher.Watch(model.files[i]);
+    }
+
+    // on the render thread, with the GL context, while no frame is being built. Returns the number of models
+    // rebuilt, whatever depends on their bounds has to be updated.
+    unsigned int Update()
+    {
+        vector<string> changed = watcher.Changed();
+        for (unsigned int i = 0; i < changed.size(); i++)
+        {
+            for (unsigned int s = 0; s < shaders.size(); s++)
+                if (shaders[s]->Uses(changed[i]))
+                    reloadShader(*shaders[s], changed[i]);
+            for (unsigned int m = 0; m < models.size(); m++)
+                if (models[m].path == changed[i] || find(models[m].model->files.begin(), models[m].model->files.end(), changed[i]) != models[m].model->files.end())
+                    startImport(models[m].path);
+        }
+
+        unsigned int reloaded = 0;
+        for (unsigned int i = 0; i < imports.size();)
+        {
+            Import &import = *imports[i];
+            if (!import.done)
+            {
+                i++;
+                continue;
+            }
+            import.worker.join();
+            if (import.stale)
+            {
+                // the file changed again while it was imported
+                string path = import.path;
+                imports.erase(imports.begin() + i);
+                startImport(path);
+                continue;
+            }
+            reloaded += finishImport(import);
+            imports.erase(imports.begin() + i);
+        }
+        return reloaded;
+    }
+
+private:
+    struct WatchedModel {
+        Model *model;
+        string path;
+    };
+
+    // an Assimp import and the mesh preparation running on a thread of its own
+    struct Import {
+        string path;
+        Assimp::Importer importer;
+        ModelData data;
+        bool imported;
+        vector<string> files;
+        atomic<bool> done;
+        bool stale;
+        chrono::high_resolution_clock::time_point start;
+        thread worker;
+
+        Import(const string &path) : path(path), imported(false), done(false), stale(false), start(chrono::high_resolution_clock::now())
+        {
+        }
+    };
+
+    MaterialLibrary &materials;
+    FileWatcher watcher;
+    vector<Shader *> shaders;
+    vector<WatchedModel> models;
+    vector<unique_ptr<Import> > imports;
+
+    void reloadShader(Shader &shader, const string &changed)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        bool reloaded = shader.Reload();
+        float ms = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+        if (reloaded)
+            printf("HOT_RELOAD:: %s changed, program of %s + %s rebuilt in %.1f ms\n", changed.c_str(), shader.vertexPath.c_str(), shader.fragmentPath.c_str(), ms);
+        else
+            printf("HOT_RELOAD:: %s changed, program of %s + %s failed, keeping the old one\n", changed.c_str(), shader.vertexPath.c_str(), shader.fragmentPath.c_str());
+    }
+
+    void startImport(const string &path)
+    {
+        for (unsigned int i = 0; i < imports.size(); i++)
+            if (imports[i]->path == path)
+            {
+                imports[i]->stale = true;
+                return;
+            }
+        imports.push_back(unique_ptr<Import>(new Import(path)));
+        Import *import = imports.back().get();
+        import->worker = thread([import]
+        {
+            const aiScene *scene = Model::Import(import->importer, import->path, import->files);
+            if (scene)
+            {
+                Model::Prepare(scene, import->path, import->data);
+                import->importer.FreeScene();
+                import->imported = true;
+            }
+            import->done = true;
+        });
+    }
+
+    // uploads the prepared meshes and interns their materials for every model of the file, on the render thread.
+    // Returns the number of models rebuilt.
+    unsigned int finishImport(Import &import)
+    {
+        float importMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - import.start).count();
+        if (!import.imported)
+        {
+            printf("HOT_RELOAD:: %s failed to import, keeping the old meshes\n", import.path.c_str());
+            return 0;
+        }
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        unsigned int reloaded = 0;
+        for (unsigned int i = 0; i < models.size(); i++)
+            if (models[i].path == import.path && models[i].model->Reload(import.data, import.files))
+            {
+                reloaded++;
+                for (unsigned int f = 0; f < import.files.size(); f++)
+                    watcher.Watch(import.files[f]);
+            }
+        materials.Upload();
+        float swapMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+        printf("HOT_RELOAD:: %s imported and prepared in %.1f ms in the background, %u models rebuilt in %.1f ms\n", import.path.c_str(), importMs, reloaded, swapMs);
+        return reloaded;
+    }
+};
+#endif
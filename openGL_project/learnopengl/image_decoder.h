@@ -0,0 +1,187 @@
+#ifndef IMAGE_DECODER_H
+#define IMAGE_DECODER_H
+
+#include "stb_image.h"
+#include "learnopengl/file_system.h"
+// build with HAVE_TURBOJPEG and link turbojpeg to decode JPEGs with libjpeg-turbo's SIMD decoder
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+using namespace std;
+
+// RGBA8 texels of an image file
+struct DecodedImage {
+    unsigned int width, height;
+    unsigned int components;  // channels in the file, 2 and 4 have alpha
+    vector<unsigned char> pixels;
+
+    DecodedImage() : width(0), height(0), components(0)
+    {
+    }
+};
+
+// Decodes image files to RGBA8. JPEGs go to libjpeg-turbo when it is built in (HAVE_TURBOJPEG), everything else
+// and every JPEG it can't handle to stb_image. maxSize asks for a smaller image: libjpeg-turbo scales by 1/2, 1/4
+// or 1/8 while decoding, skipping most of the inverse DCT, so a low mip or a preview of a large JPEG costs a
+// fraction of the full decode; stb_image decodes the full image and halves it with a box filter.
+class ImageDecoder
+{
+public:
+    // the image at path, read through FileSystem, with its width and height at most maxSize (0 keeps the full
+    // size, the image is never scaled below 1/8). Returns false if the file can't be read or decoded.
+    static bool Load(const string &path, DecodedImage &image, unsigned int maxSize = 0)
+    {
+        FileView file = FileSystem::Open(path);
+        if (!file.Valid())
+            return false;
+        return Decode(file, image, maxSize);
+    }
+
+    // the same for an image file already in memory
+    static bool Decode(const FileView &file, DecodedImage &image, unsigned int maxSize = 0)
+    {
+#ifdef HAVE_TURBOJPEG
+        if (isJpeg(file) && decodeTurbo(file, image, maxSize))
+            return true;
+#endif
+        return decodeStb(file, image, maxSize);
+    }
+
+    static const char *JpegBackend()
+    {
+#ifdef HAVE_TURBOJPEG
+        return "libjpeg-turbo";
+#else
+        return "stb_image";
+#endif
+    }
+
+    // decodes each image repeatedly with stb_image and the JPEG backend, at full size and at 1/8, and prints the
+    // throughput in megapixels per second
+    static void Benchmark(const vector<string> &paths)
+    {
+        printf("DECODE_BENCHMARK:: JPEG backend %s\n", JpegBackend());
+        printf("DECODE_BENCHMARK:: %-60s %11s %11s %11s %11s\n", "image", "size", "stb", "backend", "1/8");
+        for (unsigned int i = 0; i < paths.size(); i++)
+        {
+            FileView file = FileSystem::Open(paths[i]);
+            DecodedImage image;
+            if (!file.Valid() || !Decode(file, image))
+            {
+                std::cout << "Image failed to load at path: " << paths[i] << std::endl;
+                continue;
+            }
+            float megapixels = image.width * image.height / 1000000.0f;
+            float stbMs = timeDecode(file, true, 0), backendMs = timeDecode(file, false, 0);
+            float previewMs = timeDecode(file, false, max(image.width, image.height) / 8);
+            printf("DECODE_BENCHMARK:: %-60s %5ux%-5u %6.1f MP/s %6.1f MP/s %6.1f MP/s\n", paths[i].c_str(), image.width, image.height,
+                megapixels / stbMs * 1000.0f, megapixels / backendMs * 1000.0f, megapixels / previewMs * 1000.0f);
+        }
+    }
+
+private:
+    static bool isJpeg(const FileView &file)
+    {
+        return file.size > 3 && file.data[0] == 0xFF && file.data[1] == 0xD8 && file.data[2] == 0xFF;
+    }
+
+    static bool decodeStb(const FileView &file, DecodedImage &image, unsigned int maxSize)
+    {
+        int width, height, components;
+        unsigned char *data = stbi_load_from_memory(file.data, (int)file.size, &width, &height, &components, 4);
+        if (!data)
+            return false;
+        image.width = width;
+        image.height = height;
+        image.components = components;
+        image.pixels.assign(data, data + (size_t)width * height * 4);
+        stbi_image_free(data);
+        for (unsigned int step = 0; step < 3 && maxSize > 0 && max(image.width, image.height) > maxSize; step++)
+            halve(image);
+        return true;
+    }
+
+    // 2x2 box filter, odd edges keep their last row or column
+    static void halve(DecodedImage &image)
+    {
+        unsigned int w = max(1u, image.width / 2), h = max(1u, image.height / 2);
+        vector<unsigned char> pixels((size_t)w * h * 4);
+        for (unsigned int y = 0; y < h; y++)
+            for (unsigned int x = 0; x < w; x++)
+            {
+                unsigned int x0 = min(2 * x, image.width - 1), x1 = min(2 * x + 1, image.width - 1);
+                unsigned int y0 = min(2 * y, image.height - 1), y1 = min(2 * y + 1, image.height - 1);
+                for (unsigned int c = 0; c < 4; c++)
+                {
+                    unsigned int sum = image.pixels[((size_t)y0 * image.width + x0) * 4 + c] + image.pixels[((size_t)y0 * image.width + x1) * 4 + c]
+                        + image.pixels[((size_t)y1 * image.width + x0) * 4 + c] + image.pixels[((size_t)y1 * image.width + x1) * 4 + c];
+                    pixels[((size_t)y * w + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        image.width = w;
+        image.height = h;
+        image.pixels.swap(pixels);
+    }
+
+#ifdef HAVE_TURBOJPEG
+    static bool decodeTurbo(const FileView &file, DecodedImage &image, unsigned int maxSize)
+    {
+        tjhandle handle = tjInitDecompress();
+        if (!handle)
+            return false;
+        int width, height, subsampling, colorspace;
+        bool ok = tjDecompressHeader3(handle, file.data, (unsigned long)file.size, &width, &height, &subsampling, &colorspace) == 0;
+        if (ok)
+        {
+            // the largest of the decoder's scaling factors that fits, down to 1/8
+            int count = 0;
+            tjscalingfactor *factors = tjGetScalingFactors(&count);
+            tjscalingfactor scale = { 1, 1 };
+            if (maxSize > 0 && (unsigned int)max(width, height) > maxSize)
+            {
+                scale.denom = 8;
+                for (int i = 0; i < count; i++)
+                    if (factors[i].num < factors[i].denom && factors[i].num * scale.denom > scale.num * factors[i].denom
+                        && (unsigned int)max(TJSCALED(width, factors[i]), TJSCALED(height, factors[i])) <= maxSize)
+                        scale = factors[i];
+            }
+            image.width = TJSCALED(width, scale);
+            image.height = TJSCALED(height, scale);
+            image.components = colorspace == TJCS_GRAY ? 1 : 3;
+            image.pixels.resize((size_t)image.width * image.height * 4);
+            ok = tjDecompress2(handle, file.data, (unsigned long)file.size, image.pixels.data(), image.width, 0, image.height, TJPF_RGBA, TJFLAG_ACCURATEDCT) == 0;
+            if (!ok)
+                std::cout << "ERROR::IMAGE_DECODER:: " << tjGetErrorStr2(handle) << std::endl;
+        }
+        tjDestroy(handle);
+        return ok;
+    }
+#endif
+
+    // milliseconds per decode of file, averaged over at least a quarter of a second
+    static float timeDecode(const FileView &file, bool stb, unsigned int maxSize)
+    {
+        DecodedImage image;
+        unsigned int runs = 0;
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        float ms;
+        do
+        {
+            if (stb)
+                decodeStb(file, image, maxSize);
+            else
+                Decode(file, image, maxSize);
+            runs++;
+            ms = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+        } while (ms < 250.0f);
+        return ms / runs;
+    }
+};
+#endif
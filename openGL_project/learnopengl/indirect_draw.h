@@ -0,0 +1,242 @@
+#ifndef INDIRECT_DRAW_H
+#define INDIRECT_DRAW_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "learnopengl/mesh.h"
+#include "learnopengl/model.h"
+#include "learnopengl/material.h"
+#include "learnopengl/mesh_arena.h"
+#include "learnopengl/stream_ring.h"
+#include "learnopengl/shader.h"
+
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+// layout glMultiDrawElementsIndirect reads its draws in
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+// how an IndirectBatch reaches the GPU, picked from what the context supports
+enum IndirectPath {
+    INDIRECT_MULTI_DRAW,     // GL 4.3 or ARB_multi_draw_indirect: one call per material
+    INDIRECT_BASE_INSTANCE,  // GL 4.2 or ARB_base_instance: one call per draw, no attribute changes in between
+    INDIRECT_PER_DRAW        // GL 3.3: one call per draw, the instance attributes are pointed at every draw's matrix
+};
+
+struct IndirectStats {
+    unsigned int draws; // meshes drawn by the last Submit
+    unsigned int calls; // GL draw calls they took
+
+    IndirectStats() : draws(0), calls(0)
+    {
+    }
+};
+
+// Collects the draws of one shader for a frame and submits them from the shared MeshArena. Every draw becomes a
+// DrawElementsIndirectCommand whose base instance selects its model matrix and material index; the matrices, the
+// material indices and the commands are streamed through the ring, and with multi-draw indirect each run of draws
+// whose materials bind the same textures goes out as a single call. Materials whose diffuse textures were packed
+// into the same texture array (see TextureArrayPacker) count as binding the same textures.
+// The shader reads the model matrix and the material index from the instance attributes, like crowd.vs.
+class IndirectBatch
+{
+public:
+    IndirectStats stats;
+
+    IndirectBatch(MeshArena &arena, MaterialLibrary &materials) : arena(arena), materials(materials)
+    {
+        path = SupportedPath();
+    }
+
+    static IndirectPath SupportedPath()
+    {
+        bool baseInstance = GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_base_instance;
+        if (baseInstance && (GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_multi_draw_indirect))
+            return INDIRECT_MULTI_DRAW;
+        return baseInstance ? INDIRECT_BASE_INSTANCE : INDIRECT_PER_DRAW;
+    }
+
+    static const char *PathName(IndirectPath path)
+    {
+        switch (path)
+        {
+        case INDIRECT_MULTI_DRAW: return "multi-draw indirect";
+        case INDIRECT_BASE_INSTANCE: return "base instance";
+        default: return "per draw";
+        }
+    }
+
+    IndirectPath Path() const
+    {
+        return path;
+    }
+
+    void Clear()
+    {
+        draws.clear();
+        transforms.clear();
+    }
+
+    // queues a detail level of the mesh placed with transform. Returns false if the mesh isn't in the arena.
+    // OrderFrontToBack takes the draw to be where transform moves the origin.
+    bool Add(const Mesh &mesh, unsigned int lod, const glm::mat4 &transform)
+    {
+        if (mesh.arena != &arena || !arena.Contains(mesh.geometry))
+            return false;
+        const MeshLod &level = mesh.Lod(lod);
+        Draw draw;
+        draw.material = mesh.materialIndex;
+        draw.transform = (unsigned int)transforms.size();
+        draw.geometry = mesh.geometry;
+        draw.firstIndex = level.indexOffset;
+        draw.count = level.indexCount;
+        draw.center = glm::vec3(transform[3]);
+        draw.distance = 0.0f;
+        draws.push_back(draw);
+        transforms.push_back(transform);
+        return true;
+    }
+
+    // queues every mesh of the model. Returns false, queueing nothing, if a mesh isn't in the arena.
+    bool Add(const Model &model, unsigned int lod, const glm::mat4 &transform)
+    {
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+            if (model.meshes[i].arena != &arena || !arena.Contains(model.meshes[i].geometry))
+                return false;
+        glm::vec3 center;
+        float radius;
+        model.WorldBounds(transform, center, radius);
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+        {
+            Add(model.meshes[i], lod, transform);
+            draws.back().center = center;
+        }
+        return true;
+    }
+
+    // orders the queued draws nearest to viewPos first. Submit keeps that order among the draws that share a call,
+    // so the depth test rejects what the near ones hide before it is shaded.
+    void OrderFrontToBack(const glm::vec3 &viewPos)
+    {
+        for (unsigned int i = 0; i < draws.size(); i++)
+            draws[i].distance = glm::length(draws[i].center - viewPos);
+        stable_sort(draws.begin(), draws.end(), [](const Draw &a, const Draw &b) { return a.distance < b.distance; });
+    }
+
+    // draws everything queued since the last Clear with the (lit or unlit) instancing shader
+    void Submit(Shader &shader, StreamRing &ring)
+    {
+        stats = IndirectStats();
+        unsigned int count = (unsigned int)draws.size();
+        if (count == 0)
+            return;
+        stats.draws = count;
+        // stable, so draws that share a call keep the order they were queued or ordered in
+        for (unsigned int i = 0; i < count; i++)
+            draws[i].binding = materials.Binding(draws[i].material);
+        stable_sort(draws.begin(), draws.end(), [](const Draw &a, const Draw &b) { return a.binding < b.binding; });
+
+        // the matrices in draw order, a command's base instance is its position in the batch
+        StreamAllocation matrices = ring.Allocate(count * sizeof(glm::mat4), sizeof(glm::mat4));
+        if (!matrices.data)
+            return;
+        glm::mat4 *matrix = (glm::mat4*)matrices.data;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            // looked up now, the arena may have moved the geometry since it was queued
+            const GeometryRange &range = arena.Range(draws[i].geometry);
+            DrawElementsIndirectCommand &command = draws[i].command;
+            command.count = draws[i].count;
+            command.instanceCount = 1;
+            command.firstIndex = range.firstIndex + draws[i].firstIndex;
+            command.baseVertex = range.baseVertex;
+            command.baseInstance = i;
+            matrix[i] = transforms[draws[i].transform];
+        }
+        ring.Unmap();
+        StreamAllocation materialIndices = ring.Allocate(count * sizeof(float), sizeof(float));
+        if (!materialIndices.data)
+            return;
+        float *materialIndex = (float*)materialIndices.data;
+        for (unsigned int i = 0; i < count; i++)
+            materialIndex[i] = (float)draws[i].material;
+        ring.Unmap();
+
+        StreamAllocation commands;
+        if (path == INDIRECT_MULTI_DRAW)
+        {
+            commands = ring.Allocate(count * sizeof(DrawElementsIndirectCommand), 16);
+            if (!commands.data)
+                return;
+            DrawElementsIndirectCommand *command = (DrawElementsIndirectCommand*)commands.data;
+            for (unsigned int i = 0; i < count; i++)
+                command[i] = draws[i].command;
+            ring.Unmap();
+        }
+
+        shader.use();
+        arena.Bind(VERTEX_FORMAT_MESH);
+        arena.SetInstanceBuffer(matrices.buffer, matrices.offset, materialIndices.buffer, materialIndices.offset);
+        if (path == INDIRECT_MULTI_DRAW)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.buffer);
+        for (unsigned int begin = 0, end = 0; begin < count; begin = end)
+        {
+            end = begin + 1;
+            while (end < count && draws[end].binding == draws[begin].binding)
+                end++;
+            materials.Bind(draws[begin].material, shader);
+            if (path == INDIRECT_MULTI_DRAW)
+            {
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(size_t)(commands.offset + begin * sizeof(DrawElementsIndirectCommand)), end - begin, 0);
+                stats.calls++;
+                continue;
+            }
+            for (unsigned int i = begin; i < end; i++)
+            {
+                const DrawElementsIndirectCommand &command = draws[i].command;
+                void *firstIndex = (void*)(size_t)(command.firstIndex * sizeof(unsigned int));
+                if (path == INDIRECT_BASE_INSTANCE)
+                    glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, firstIndex, 1, command.baseVertex, command.baseInstance);
+                else
+                {
+                    arena.SetInstanceBuffer(matrices.buffer, matrices.offset + i * sizeof(glm::mat4), materialIndices.buffer, materialIndices.offset + i * sizeof(float));
+                    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, firstIndex, 1, command.baseVertex);
+                }
+                stats.calls++;
+            }
+        }
+        if (path == INDIRECT_MULTI_DRAW)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        // later instanced draws of the arena take their material from the uniform again
+        arena.SetInstanceBuffer(matrices.buffer, matrices.offset);
+        glBindVertexArray(0);
+    }
+
+private:
+    struct Draw {
+        unsigned int material;
+        unsigned int binding;   // of the material, draws with the same binding can share a call
+        unsigned int transform; // index into transforms
+        unsigned int geometry;  // in the arena
+        unsigned int firstIndex, count; // the detail level, relative to the geometry
+        glm::vec3 center;       // in world space, see OrderFrontToBack
+        float distance;         // from the view position OrderFrontToBack was last given
+        DrawElementsIndirectCommand command;
+    };
+
+    MeshArena &arena;
+    MaterialLibrary &materials;
+    IndirectPath path;
+    vector<Draw> draws;
+    vector<glm::mat4> transforms;
+};
+#endif
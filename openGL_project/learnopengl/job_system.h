@@ -0,0 +1,463 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <cassert>
+using namespace std;
+
+// number of unfinished jobs of a group, JobSystem::Wait on it joins the group
+struct JobCounter {
+    atomic<unsigned int> pending;
+
+    JobCounter() : pending(0)
+    {
+    }
+};
+
+// Work stealing scheduler for the per-frame work. Every thread, including the one that created the system, owns a
+// deque of jobs: it pushes and pops its own jobs at the back, so a thread keeps working on what it just split off,
+// while idle threads steal from the front of the others, which is where the biggest, oldest pieces of work are.
+// Instead of blocking, a thread that waits for jobs runs other jobs until its counter drops to zero, so jobs can
+// start and join nested work without fibers and without tying up a thread. Workers sleep while every deque is empty.
+// Threads outside the system, like the simulation thread, may queue and wait for jobs too. They share the creating
+// thread's deque, so waiting on one of them may run jobs another one queued; jobs must not care which thread runs them.
+class JobSystem
+{
+public:
+    // threadCount includes the calling thread, 0 uses one thread per hardware thread
+    JobSystem(unsigned int threadCount = 0) : creator(this_thread::get_id()), queued(0), stopping(false)
+    {
+        if (threadCount == 0)
+            threadCount = max(1u, thread::hardware_concurrency());
+        for (unsigned int i = 0; i < threadCount; i++)
+            queues.push_back(unique_ptr<Queue>(new Queue()));
+        currentThread() = ThreadSlot(this, 0);
+        for (unsigned int i = 1; i < threadCount; i++)
+            workers.push_back(thread(&JobSystem::workerLoop, this, i));
+    }
+
+    ~JobSystem()
+    {
+        {
+            lock_guard<mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+        if (currentThread().system == this)
+            currentThread() = ThreadSlot();
+    }
+
+    // number of threads that run jobs, including the creating thread
+    unsigned int ThreadCount() const
+    {
+        return (unsigned int)queues.size();
+    }
+
+    // whether the calling thread is the one that created the system, the main thread
+    bool OnCreatingThread() const
+    {
+        return this_thread::get_id() == creator;
+    }
+
+    // queues fn on the calling thread's deque. counter, if any, counts the job until it has run.
+    void Run(const function<void()> &fn, JobCounter *counter = nullptr)
+    {
+        if (counter)
+            counter->pending++;
+        Queue &queue = *queues[queueIndex()];
+        {
+            lock_guard<mutex> lock(queue.m);
+            queue.jobs.push_back(Job(fn, counter));
+        }
+        queued++;
+        notify(false);
+    }
+
+    // runs queued jobs until every job counted by counter has finished
+    void Wait(JobCounter &counter)
+    {
+        while (counter.pending.load() > 0)
+            if (!RunOne())
+                this_thread::yield();
+    }
+
+    // runs one queued job, the calling thread's newest first, otherwise one stolen from another thread.
+    // Returns false when there was nothing to run.
+    bool RunOne()
+    {
+        Job job;
+        if (!pop(queueIndex(), job))
+            return false;
+        job.fn();
+        if (job.counter)
+            job.counter->pending--;
+        return true;
+    }
+
+    // calls fn(begin, end) for consecutive batches of at most batchSize items covering [0, count).
+    // Batches may run in any order and on any thread, fn must only write data owned by its batch.
+    // Returns once every batch is done, the calling thread runs batches (or other jobs) meanwhile.
+    void ParallelFor(unsigned int count, unsigned int batchSize, const function<void(unsigned int, unsigned int)> &fn)
+    {
+        if (count == 0)
+            return;
+        batchSize = max(1u, batchSize);
+        if (workers.empty() || count <= batchSize)
+        {
+            // nobody to share with, the batches run in order on the calling thread
+            for (unsigned int begin = 0; begin < count; begin += batchSize)
+                fn(begin, min(begin + batchSize, count));
+            return;
+        }
+        unsigned int batches = (count + batchSize - 1) / batchSize;
+        JobCounter counter;
+        counter.pending = batches;
+        Queue &queue = *queues[queueIndex()];
+        {
+            // pushed last to first, so the calling thread pops the batches in order and thieves take the end
+            lock_guard<mutex> lock(queue.m);
+            for (unsigned int b = batches; b-- > 0;)
+            {
+                unsigned int begin = b * batchSize;
+                unsigned int end = min(begin + batchSize, count);
+                queue.jobs.push_back(Job([&fn, begin, end] { fn(begin, end); }, &counter));
+            }
+        }
+        queued += batches;
+        notify(true);
+        Wait(counter);
+    }
+
+private:
+    struct Job {
+        function<void()> fn;
+        JobCounter *counter;
+
+        Job() : counter(nullptr)
+        {
+        }
+        Job(const function<void()> &fn, JobCounter *counter) : fn(fn), counter(counter)
+        {
+        }
+    };
+
+    struct Queue {
+        mutex m;
+        deque<Job> jobs;
+    };
+
+    // which system's deque the current thread owns
+    struct ThreadSlot {
+        JobSystem *system;
+        unsigned int index;
+
+        ThreadSlot(JobSystem *system = nullptr, unsigned int index = 0) : system(system), index(index)
+        {
+        }
+    };
+
+    thread::id creator;
+    vector<unique_ptr<Queue>> queues;
+    vector<thread> workers;
+    atomic<unsigned int> queued;  // jobs in all deques, the workers sleep while it is zero
+    mutex sleepMutex;
+    condition_variable wake;
+    bool stopping;
+
+    static ThreadSlot &currentThread()
+    {
+        static thread_local ThreadSlot slot;
+        return slot;
+    }
+
+    // threads outside the system share the creating thread's deque
+    unsigned int queueIndex() const
+    {
+        return currentThread().system == this ? currentThread().index : 0;
+    }
+
+    void notify(bool all)
+    {
+        // taking the lock orders the new job before the check of a worker that is about to sleep
+        {
+            lock_guard<mutex> lock(sleepMutex);
+        }
+        if (all)
+            wake.notify_all();
+        else
+            wake.notify_one();
+    }
+
+    bool pop(unsigned int index, Job &job)
+    {
+        if (queued.load() == 0)
+            return false;
+        {
+            Queue &own = *queues[index];
+            lock_guard<mutex> lock(own.m);
+            if (!own.jobs.empty())
+            {
+                job = move(own.jobs.back());
+                own.jobs.pop_back();
+                queued--;
+                return true;
+            }
+        }
+        for (unsigned int i = 1; i < queues.size(); i++)
+        {
+            Queue &victim = *queues[(index + i) % queues.size()];
+            lock_guard<mutex> lock(victim.m);
+            if (!victim.jobs.empty())
+            {
+                job = move(victim.jobs.front());
+                victim.jobs.pop_front();
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned int index)
+    {
+        currentThread() = ThreadSlot(this, index);
+        for (;;)
+        {
+            if (RunOne())
+                continue;
+            unique_lock<mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
+
+// where a frame graph task may run
+enum TaskAffinity {
+    TASK_ANY_THREAD,
+    TASK_MAIN_THREAD // e.g. tasks that call OpenGL, they run on the thread that calls FrameGraph::Run, which has to
+                     // be the thread that created the job system
+};
+
+// The per-frame work as a graph of tasks. The graph is built once, Run executes every task once per frame, each
+// after the tasks it depends on. Finished tasks release their successors as continuations, so independent chains
+// (e.g. animate -> cull -> build the draw lists, next to the crowd simulation) overlap on the job system.
+// A graph is always run by the same thread, but that thread can be any thread. Only a graph run by the main thread
+// may have TASK_MAIN_THREAD tasks; a graph run by another thread, like the simulation's, only has tasks that may
+// run anywhere.
+class FrameGraph
+{
+public:
+    // wall clock of the last Run
+    float frameMs;
+
+    FrameGraph() : frameMs(0.0f), mainTasks(0)
+    {
+    }
+
+    // dependencies are ids returned by earlier AddTask calls
+    unsigned int AddTask(const string &name, const function<void()> &fn, const vector<unsigned int> &dependencies = vector<unsigned int>(), TaskAffinity affinity = TASK_ANY_THREAD)
+    {
+        Task task;
+        task.name = name;
+        task.fn = fn;
+        task.affinity = affinity;
+        task.dependencyCount = (unsigned int)dependencies.size();
+        task.ms = 0.0f;
+        if (affinity == TASK_MAIN_THREAD)
+            mainTasks++;
+        unsigned int id = (unsigned int)tasks.size();
+        for (unsigned int i = 0; i < dependencies.size(); i++)
+            tasks[dependencies[i]].successors.push_back(id);
+        tasks.push_back(task);
+        return id;
+    }
+
+    // runs the whole graph and returns when every task is done. Call it from the main thread if the graph has
+    // TASK_MAIN_THREAD tasks, and always from the same thread.
+    void Run(JobSystem &jobs)
+    {
+        if (runner == thread::id())
+            runner = this_thread::get_id();
+        assert(runner == this_thread::get_id());
+        assert(mainTasks == 0 || jobs.OnCreatingThread());
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        unsigned int count = (unsigned int)tasks.size();
+        remaining.reset(new atomic<unsigned int>[count]);
+        for (unsigned int i = 0; i < count; i++)
+            remaining[i] = tasks[i].dependencyCount;
+        JobCounter unfinished;
+        unfinished.pending = count;
+        for (unsigned int i = 0; i < count; i++)
+            if (tasks[i].dependencyCount == 0)
+                schedule(i, jobs, unfinished);
+        while (unfinished.pending.load() > 0)
+        {
+            unsigned int task;
+            if (popMainTask(task))
+                execute(task, jobs, unfinished);
+            else if (!jobs.RunOne())
+                this_thread::yield();
+        }
+        frameMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    unsigned int TaskCount() const
+    {
+        return (unsigned int)tasks.size();
+    }
+    const string &TaskName(unsigned int task) const
+    {
+        return tasks[task].name;
+    }
+    // time the task took in the last Run
+    float TaskMs(unsigned int task) const
+    {
+        return tasks[task].ms;
+    }
+
+private:
+    struct Task {
+        string name;
+        function<void()> fn;
+        vector<unsigned int> successors;
+        unsigned int dependencyCount;
+        TaskAffinity affinity;
+        float ms;
+    };
+
+    vector<Task> tasks;
+    unsigned int mainTasks;  // tasks with TASK_MAIN_THREAD
+    thread::id runner;       // the thread that runs the graph
+    unique_ptr<atomic<unsigned int>[]> remaining; // unfinished dependencies of each task in the current Run
+    mutex mainMutex;
+    vector<unsigned int> mainReady;
+
+    void schedule(unsigned int task, JobSystem &jobs, JobCounter &unfinished)
+    {
+        if (tasks[task].affinity == TASK_MAIN_THREAD)
+        {
+            lock_guard<mutex> lock(mainMutex);
+            mainReady.push_back(task);
+        }
+        else
+            jobs.Run([this, task, &jobs, &unfinished] { execute(task, jobs, unfinished); });
+    }
+
+    bool popMainTask(unsigned int &task)
+    {
+        lock_guard<mutex> lock(mainMutex);
+        if (mainReady.empty())
+            return false;
+        task = mainReady.back();
+        mainReady.pop_back();
+        return true;
+    }
+
+    void execute(unsigned int task, JobSystem &jobs, JobCounter &unfinished)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        tasks[task].fn();
+        tasks[task].ms = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+        const vector<unsigned int> &successors = tasks[task].successors;
+        for (unsigned int i = 0; i < successors.size(); i++)
+            if (--remaining[successors[i]] == 0)
+                schedule(successors[i], jobs, unfinished);
+        unfinished.pending--;
+    }
+};
+
+// measures the scheduling overhead per job and the speedup of a parallel loop and of a small frame graph
+class JobBenchmark
+{
+public:
+    static void Run(JobSystem &jobs)
+    {
+        printf("JOB_BENCHMARK:: %u threads\n", jobs.ThreadCount());
+        // empty jobs, all overhead
+        const unsigned int jobCount = 100000;
+        JobCounter counter;
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        for (unsigned int i = 0; i < jobCount; i++)
+            jobs.Run([] {}, &counter);
+        jobs.Wait(counter);
+        printf("JOB_BENCHMARK:: empty jobs            %9.1f ns per job\n", msSince(start) * 1.0e6f / jobCount);
+
+        // a loop with some arithmetic per item, serial and split into batches
+        const unsigned int itemCount = 1 << 20;
+        vector<float> data(itemCount, 1.0f);
+        for (unsigned int batch = 256; batch <= 65536; batch *= 16)
+        {
+            start = chrono::high_resolution_clock::now();
+            busyWork(data, 0, itemCount);
+            float serialMs = msSince(start);
+            start = chrono::high_resolution_clock::now();
+            jobs.ParallelFor(itemCount, batch, [&](unsigned int begin, unsigned int end) { busyWork(data, begin, end); });
+            float parallelMs = msSince(start);
+            printf("JOB_BENCHMARK:: parallel for, batch %5u  serial %8.3f ms  parallel %8.3f ms  speedup %5.2f\n", batch, serialMs, parallelMs, serialMs / max(parallelMs, 1e-6f));
+        }
+
+        // animate -> cull -> build, next to a second independent chain, on all threads and on one thread
+        vector<float> chainData[2] = { vector<float>(itemCount, 1.0f), vector<float>(itemCount, 1.0f) };
+        float parallelMs = frameGraphMs(jobs, chainData);
+        JobSystem single(1);
+        float serialMs = frameGraphMs(single, chainData);
+        printf("JOB_BENCHMARK:: frame graph            one thread %8.3f ms  all threads %8.3f ms  speedup %5.2f\n", serialMs, parallelMs, serialMs / max(parallelMs, 1e-6f));
+    }
+
+private:
+    static float msSince(chrono::high_resolution_clock::time_point start)
+    {
+        return chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // mean frame time of a graph whose stages are parallel loops of their own
+    static float frameGraphMs(JobSystem &jobs, vector<float> chainData[2])
+    {
+        unsigned int count = (unsigned int)chainData[0].size();
+        FrameGraph graph;
+        vector<unsigned int> built;
+        for (unsigned int chain = 0; chain < 2; chain++)
+        {
+            vector<float> &data = chainData[chain];
+            unsigned int animate = graph.AddTask("animate", [&jobs, &data, count] { jobs.ParallelFor(count, 4096, [&data](unsigned int b, unsigned int e) { busyWork(data, b, e); }); });
+            unsigned int cull = graph.AddTask("cull", [&jobs, &data, count] { jobs.ParallelFor(count, 4096, [&data](unsigned int b, unsigned int e) { busyWork(data, b, e); }); }, { animate });
+            built.push_back(graph.AddTask("build", [&data, count] { busyWork(data, 0, count / 16); }, { cull }));
+        }
+        graph.AddTask("submit", [chainData, count] { busyWork(chainData[0], count / 16, count / 8); }, built, TASK_MAIN_THREAD);
+        const int frames = 20;
+        float total = 0.0f;
+        for (int f = 0; f < frames; f++)
+        {
+            graph.Run(jobs);
+            total += graph.frameMs;
+        }
+        return total / frames;
+    }
+
+    static void busyWork(vector<float> &data, unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; i++)
+        {
+            float x = data[i];
+            for (int k = 0; k < 16; k++)
+                x = x * 0.999f + 0.001f;
+            data[i] = x;
+        }
+    }
+};
+#endif
@@ -0,0 +1,338 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include "learnopengl/block_compress.h"
+#include "learnopengl/file_system.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+// the Vulkan formats of the images the texture loader writes
+#define VK_FORMAT_R8G8B8A8_UNORM 37
+#define VK_FORMAT_BC1_RGB_UNORM_BLOCK 131
+#define VK_FORMAT_BC3_UNORM_BLOCK 137
+#define VK_FORMAT_BC7_UNORM_BLOCK 145
+#define VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK 147
+#define VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK 151
+
+// a 2D image with its mip levels, level 0 first, and the key/value metadata of the file
+struct Ktx2Image {
+    unsigned int vkFormat;
+    unsigned int width, height;
+    vector<vector<unsigned char> > levels;
+    map<string, string> keyValues;
+
+    Ktx2Image() : vkFormat(0), width(0), height(0)
+    {
+    }
+};
+
+// Reader and writer for KTX 2.0 files (khronos.org/ktx) holding a single 2D image: no array layers, cube faces,
+// depth or supercompression. The levels are stored smallest first, each aligned to its texel block, after the
+// header, the level index, a basic data format descriptor and the key/value data, as the specification
+// lays it out. Files are read through FileSystem, from the mapping; reading stops at the first inconsistency
+// instead of trusting the offsets in the file.
+class Ktx2
+{
+public:
+    static unsigned int VkFormat(BlockFormat format)
+    {
+        switch (format)
+        {
+        case BLOCK_BC1: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        case BLOCK_BC3: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case BLOCK_BC7: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case BLOCK_ETC2_RGB: return VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;
+        default: return VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK;
+        }
+    }
+
+    // the block format of a Vulkan format, false for RGBA8 and formats the loader doesn't know
+    static bool BlockFormatOf(unsigned int vkFormat, BlockFormat &format)
+    {
+        for (unsigned int f = 0; f < BLOCK_FORMAT_COUNT; f++)
+            if (VkFormat((BlockFormat)f) == vkFormat)
+            {
+                format = (BlockFormat)f;
+                return true;
+            }
+        return false;
+    }
+
+    // bytes of a level of the image, 0 for an unknown format
+    static size_t LevelSize(unsigned int vkFormat, unsigned int width, unsigned int height)
+    {
+        BlockFormat format;
+        if (BlockFormatOf(vkFormat, format))
+            return BlockCompressor::CompressedSize(format, width, height);
+        return vkFormat == VK_FORMAT_R8G8B8A8_UNORM ? (size_t)width * height * 4 : 0;
+    }
+
+    static bool Write(const string &path, const Ktx2Image &image)
+    {
+        unsigned int levelCount = (unsigned int)image.levels.size();
+        if (levelCount == 0 || LevelSize(image.vkFormat, image.width, image.height) == 0)
+            return false;
+        vector<unsigned char> dfd = descriptor(image.vkFormat);
+        vector<unsigned char> kvd;
+        for (map<string, string>::const_iterator it = image.keyValues.begin(); it != image.keyValues.end(); ++it)
+        {
+            // key and value, both NUL terminated, padded to 4 bytes
+            unsigned int length = (unsigned int)(it->first.size() + it->second.size() + 2);
+            put32(kvd, length);
+            kvd.insert(kvd.end(), it->first.begin(), it->first.end());
+            kvd.push_back(0);
+            kvd.insert(kvd.end(), it->second.begin(), it->second.end());
+            kvd.push_back(0);
+            while (kvd.size() % 4)
+                kvd.push_back(0);
+        }
+
+        unsigned int dfdOffset = HEADER_SIZE + levelCount * 24;
+        unsigned int kvdOffset = dfdOffset + (unsigned int)dfd.size();
+        size_t alignment = levelAlignment(image.vkFormat);
+        vector<unsigned long long> offsets(levelCount);
+        size_t end = kvdOffset + kvd.size();
+        for (unsigned int l = levelCount; l-- > 0;)
+        {
+            end = (end + alignment - 1) / alignment * alignment;
+            offsets[l] = end;
+            end += image.levels[l].size();
+        }
+
+        vector<unsigned char> header;
+        header.insert(header.end(), identifier(), identifier() + 12);
+        put32(header, image.vkFormat);
+        put32(header, 1);                          // typeSize
+        put32(header, image.width);
+        put32(header, image.height);
+        put32(header, 0);                          // pixelDepth, 0 for 2D
+        put32(header, 0);                          // layerCount, 0 for no array
+        put32(header, 1);                          // faceCount
+        put32(header, levelCount);
+        put32(header, 0);                          // supercompressionScheme
+        put32(header, dfdOffset);
+        put32(header, (unsigned int)dfd.size());
+        put32(header, kvd.empty() ? 0 : kvdOffset);
+        put32(header, (unsigned int)kvd.size());
+        put64(header, 0);                          // supercompression global data
+        put64(header, 0);
+        for (unsigned int l = 0; l < levelCount; l++)
+        {
+            put64(header, offsets[l]);
+            put64(header, image.levels[l].size());
+            put64(header, image.levels[l].size()); // uncompressedByteLength
+        }
+
+        ofstream file(path.c_str(), ios::binary);
+        if (!file)
+            return false;
+        file.write((const char*)header.data(), header.size());
+        file.write((const char*)dfd.data(), dfd.size());
+        file.write((const char*)kvd.data(), kvd.size());
+        size_t position = kvdOffset + kvd.size();
+        for (unsigned int l = levelCount; l-- > 0;)
+        {
+            static const char padding[16] = {};
+            file.write(padding, offsets[l] - position);
+            file.write((const char*)image.levels[l].data(), image.levels[l].size());
+            position = offsets[l] + image.levels[l].size();
+        }
+        return !!file;
+    }
+
+    // reads the header and key/value data, the levels only if levels is set
+    static bool Read(const string &path, Ktx2Image &image, bool levels = true)
+    {
+        FileView file = FileSystem::Open(path);
+        if (!file.Valid() || file.size < HEADER_SIZE || memcmp(file.data, identifier(), 12) != 0)
+            return false;
+        const unsigned char *header = file.data;
+        image.vkFormat = get32(header + 12);
+        image.width = get32(header + 20);
+        image.height = get32(header + 24);
+        unsigned int depth = get32(header + 28), layers = get32(header + 32), faces = get32(header + 36);
+        unsigned int levelCount = max(1u, get32(header + 40)), supercompression = get32(header + 44);
+        unsigned int kvdOffset = get32(header + 56), kvdLength = get32(header + 60);
+        if (depth != 0 || layers != 0 || faces != 1 || supercompression != 0 || levelCount > 32 || image.width == 0 || image.height == 0
+            || LevelSize(image.vkFormat, image.width, image.height) == 0)
+            return false;
+
+        if (HEADER_SIZE + (size_t)levelCount * 24 > file.size || (size_t)kvdOffset + kvdLength > file.size)
+            return false;
+        const unsigned char *index = file.data + HEADER_SIZE;
+
+        image.keyValues.clear();
+        if (kvdLength > 0)
+        {
+            const unsigned char *kvd = file.data + kvdOffset;
+            for (size_t position = 0; position + 4 <= kvdLength;)
+            {
+                unsigned int length = get32(&kvd[position]);
+                position += 4;
+                if (length > kvdLength - position)
+                    return false;
+                const char *entry = (const char*)&kvd[position];
+                const char *keyEnd = (const char*)memchr(entry, 0, length);
+                size_t keyLength = keyEnd ? keyEnd - entry : length;
+                if (keyLength < length)
+                {
+                    // string values carry their own terminator
+                    size_t valueLength = length - keyLength - 1;
+                    if (valueLength > 0 && entry[length - 1] == 0)
+                        valueLength--;
+                    image.keyValues[string(entry, keyLength)] = string(entry + keyLength + 1, valueLength);
+                }
+                position = (position + length + 3) / 4 * 4;
+            }
+        }
+
+        image.levels.clear();
+        if (!levels)
+            return true;
+        image.levels.resize(levelCount);
+        for (unsigned int l = 0; l < levelCount; l++)
+        {
+            unsigned long long offset = get64(&index[l * 24]), length = get64(&index[l * 24 + 8]);
+            if (length != LevelSize(image.vkFormat, max(1u, image.width >> l), max(1u, image.height >> l)) || offset + length > file.size)
+                return false;
+            image.levels[l].assign(file.data + offset, file.data + offset + length);
+        }
+        return true;
+    }
+
+    // reads a single level of the file at path, without its key/value data, for streaming levels in one at a time
+    static bool ReadLevel(const string &path, unsigned int level, vector<unsigned char> &data)
+    {
+        FileView file = FileSystem::Open(path);
+        if (!file.Valid() || file.size < HEADER_SIZE || memcmp(file.data, identifier(), 12) != 0)
+            return false;
+        const unsigned char *header = file.data;
+        unsigned int vkFormat = get32(header + 12), width = get32(header + 20), height = get32(header + 24);
+        unsigned int levelCount = max(1u, get32(header + 40));
+        if (level >= levelCount || level >= 32 || get32(header + 44) != 0 || HEADER_SIZE + (level + 1) * 24 > file.size)
+            return false;
+        const unsigned char *entry = header + HEADER_SIZE + level * 24;
+        unsigned long long offset = get64(entry), length = get64(entry + 8);
+        if (length == 0 || length != LevelSize(vkFormat, max(1u, width >> level), max(1u, height >> level)) || offset + length > file.size)
+            return false;
+        data.assign(file.data + offset, file.data + offset + length);
+        return true;
+    }
+
+private:
+    static const unsigned int HEADER_SIZE = 80;
+
+    static const unsigned char *identifier()
+    {
+        static const unsigned char bytes[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+        return bytes;
+    }
+
+    static void put32(vector<unsigned char> &out, unsigned int value)
+    {
+        for (unsigned int i = 0; i < 4; i++)
+            out.push_back((unsigned char)(value >> (8 * i)));
+    }
+
+    static void put64(vector<unsigned char> &out, unsigned long long value)
+    {
+        put32(out, (unsigned int)value);
+        put32(out, (unsigned int)(value >> 32));
+    }
+
+    static unsigned int get32(const unsigned char *p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+    }
+
+    static unsigned long long get64(const unsigned char *p)
+    {
+        return get32(p) | ((unsigned long long)get32(p + 4) << 32);
+    }
+
+    // levels start at a multiple of the texel block size and of 4
+    static size_t levelAlignment(unsigned int vkFormat)
+    {
+        BlockFormat format;
+        return BlockFormatOf(vkFormat, format) ? BlockBytes(format) : 4;
+    }
+
+    // basic data format descriptor: color model, block size and one sample per channel (or per block part)
+    static vector<unsigned char> descriptor(unsigned int vkFormat)
+    {
+        struct Sample {
+            unsigned int bitOffset, bitLength, channel, upper;
+        };
+        unsigned int model, blockWidth = 4, bytes = 16;
+        vector<Sample> samples;
+        const Sample color64 = { 0, 64, 0, 0xffffffffu }, alpha64 = { 0, 64, 15, 0xffffffffu };
+        switch (vkFormat)
+        {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            model = 128; // KHR_DF_MODEL_BC1A
+            bytes = 8;
+            samples.push_back(color64);
+            break;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+            model = 130; // KHR_DF_MODEL_BC3
+            samples.push_back(alpha64);
+            samples.push_back(color64);
+            samples.back().bitOffset = 64;
+            break;
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+            model = 134; // KHR_DF_MODEL_BC7
+            samples.push_back(color64);
+            samples.back().bitLength = 128;
+            break;
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+            model = 161; // KHR_DF_MODEL_ETC2, color is channel 2
+            bytes = 8;
+            samples.push_back(color64);
+            samples.back().channel = 2;
+            break;
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+            model = 161;
+            samples.push_back(alpha64);
+            samples.push_back(color64);
+            samples.back().bitOffset = 64;
+            samples.back().channel = 2;
+            break;
+        default:
+            model = 1; // KHR_DF_MODEL_RGBSDA, one byte per channel
+            blockWidth = 1;
+            bytes = 4;
+            for (unsigned int c = 0; c < 4; c++)
+            {
+                Sample sample = { c * 8, 8, c == 3 ? 15u : c, 255 };
+                samples.push_back(sample);
+            }
+            break;
+        }
+
+        vector<unsigned char> out;
+        unsigned int blockSize = 24 + 16 * (unsigned int)samples.size();
+        put32(out, 4 + blockSize);                  // dfdTotalSize
+        put32(out, 0);                              // vendor and descriptor type: Khronos basic
+        put32(out, 2 | (blockSize << 16));          // version 1.3, block size
+        put32(out, model | (1 << 8) | (1 << 16));   // BT.709 primaries, linear transfer, straight alpha
+        unsigned int dimension = blockWidth - 1;
+        put32(out, dimension | (dimension << 8));   // texel block width and height minus one
+        put32(out, bytes);                          // bytes of plane 0
+        put32(out, 0);
+        for (unsigned int i = 0; i < samples.size(); i++)
+        {
+            put32(out, samples[i].bitOffset | ((samples[i].bitLength - 1) << 16) | (samples[i].channel << 24));
+            put32(out, 0);                          // sample position
+            put32(out, 0);                          // lower
+            put32(out, samples[i].upper);
+        }
+        return out;
+    }
+};
+#endif
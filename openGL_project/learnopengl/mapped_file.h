@@ -0,0 +1,203 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+using namespace std;
+
+// A whole file mapped read-only into memory. The pages are read in by the first access and shared with the page
+// cache, so nothing is copied; the mapping lasts as long as the object.
+class MappedFile
+{
+public:
+    // nullptr if the file can't be opened or mapped
+    static shared_ptr<MappedFile> Open(const string &path)
+    {
+        shared_ptr<MappedFile> file(new MappedFile());
+        if (!file->map(path))
+            return shared_ptr<MappedFile>();
+        return file;
+    }
+
+    ~MappedFile()
+    {
+#if defined(_WIN32)
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (handle != INVALID_HANDLE_VALUE)
+            CloseHandle(handle);
+#else
+        if (data)
+            munmap(data, size);
+#endif
+    }
+
+    const unsigned char *Data() const
+    {
+        return (const unsigned char *)data;
+    }
+
+    size_t Size() const
+    {
+        return size;
+    }
+
+private:
+    void *data;
+    size_t size;
+#if defined(_WIN32)
+    HANDLE handle, mapping;
+#endif
+
+    MappedFile() : data(nullptr), size(0)
+    {
+#if defined(_WIN32)
+        handle = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#endif
+    }
+
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    // an empty file has no mapping, just a size of 0
+    bool map(const string &path)
+    {
+#if defined(_WIN32)
+        handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(handle, &fileSize))
+            return false;
+        size = (size_t)fileSize.QuadPart;
+        if (size == 0)
+            return true;
+        mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+            return false;
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        return data != nullptr;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            close(fd);
+            return false;
+        }
+        size = (size_t)info.st_size;
+        if (size > 0)
+        {
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+                data = nullptr;
+        }
+        // the mapping keeps the file referenced
+        close(fd);
+        return size == 0 || data != nullptr;
+#endif
+    }
+};
+
+// Read-only bytes of a file: a whole mapped file, an entry inside a mapped archive or, for a compressed entry,
+// the memory it was decompressed into. Copies share the memory, which stays alive until the last view of it is
+// gone.
+struct FileView {
+    const unsigned char *data;
+    size_t size;
+    shared_ptr<const void> owner;
+
+    FileView() : data(nullptr), size(0)
+    {
+    }
+
+    FileView(const shared_ptr<MappedFile> &mapping, size_t offset, size_t size) : data(mapping->Data() + offset), size(size), owner(mapping)
+    {
+    }
+
+    FileView(const shared_ptr<vector<unsigned char> > &buffer) : data(buffer->data()), size(buffer->size()), owner(buffer)
+    {
+    }
+
+    // false if the file couldn't be opened
+    bool Valid() const
+    {
+        return owner != nullptr;
+    }
+};
+
+// size and modification time of a file on disk, false if it doesn't exist or isn't a regular file
+inline bool StatFile(const string &path, long long &size, long long &modified)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || (info.st_mode & S_IFMT) != S_IFREG)
+        return false;
+    size = (long long)info.st_size;
+    modified = (long long)info.st_mtime;
+    return true;
+}
+
+// appends the paths of the regular files below directory, '/' separated and relative to the working directory
+inline void ListFiles(const string &directory, vector<string> &files)
+{
+#if defined(_WIN32)
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((directory + "/*").c_str(), &entry);
+    if (find == INVALID_HANDLE_VALUE)
+        return;
+    do
+    {
+        string name = entry.cFileName;
+        if (name == "." || name == "..")
+            continue;
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            ListFiles(directory + "/" + name, files);
+        else
+            files.push_back(directory + "/" + name);
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+        return;
+    while (dirent *entry = readdir(dir))
+    {
+        string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        string path = directory + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            continue;
+        if (S_ISDIR(info.st_mode))
+            ListFiles(path, files);
+        else if (S_ISREG(info.st_mode))
+            files.push_back(path);
+    }
+    closedir(dir);
+#endif
+}
+#endif
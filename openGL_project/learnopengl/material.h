@@ -0,0 +1,249 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "learnopengl/shader.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+using namespace std;
+
+// must match the array size of the Materials uniform block in resources/shader/prelude.fs
+#define MAX_MATERIALS 64
+// texture unit of the diffuse texture array, after the material slots and the shadow map
+#define MATERIAL_ARRAY_UNIT (MATERIAL_TEXTURE_COUNT + 1)
+
+class TextureStreamer;
+
+// texture slots a material can reference. The slot doubles as the texture unit the slot is bound to.
+enum Material_Texture {
+    MATERIAL_DIFFUSE,
+    MATERIAL_SPECULAR,
+    MATERIAL_NORMAL,
+    MATERIAL_HEIGHT,
+    MATERIAL_TEXTURE_COUNT
+};
+
+// sampler names used by the shaders for each slot
+static const char* const MATERIAL_SAMPLER_NAMES[MATERIAL_TEXTURE_COUNT] = {
+    "texture_diffuse1",
+    "texture_specular1",
+    "texture_normal1",
+    "texture_height1"
+};
+
+// a material is a set of texture handles plus the lighting parameters the Phong shaders used to hard-code
+struct Material {
+    unsigned int textures[MATERIAL_TEXTURE_COUNT]; // GL texture ids, 0 when the slot is unused
+    float ambientStrength;
+    float specularStrength;
+    float shininess;
+    // where TextureArrayPacker moved the diffuse texture: a GL_TEXTURE_2D_ARRAY (0 if it wasn't packed), the layer
+    // and the rectangle of the layer it covers (offset in xy, size in zw)
+    unsigned int diffuseArray;
+    float diffuseLayer;
+    glm::vec4 diffuseRect;
+
+    Material() : ambientStrength(0.1f), specularStrength(0.8f), shininess(32.0f), diffuseArray(0), diffuseLayer(0.0f), diffuseRect(0.0f)
+    {
+        for (unsigned int i = 0; i < MATERIAL_TEXTURE_COUNT; i++)
+            textures[i] = 0;
+    }
+};
+
+// std140 layout of a single entry of the Materials uniform block
+struct MaterialParams {
+    glm::vec4 lighting;    // x: ambient strength, y: specular strength, z: shininess, w: layer of the diffuse array
+    glm::vec4 diffuseRect; // of the diffuse texture in its array layer, all 0 when it is a plain 2D texture
+};
+
+// Owns every material and texture of the scene. Materials are interned: two meshes with the same textures and
+// parameters share one entry, and meshes only keep the index of their material. The parameters of all materials
+// are uploaded to one uniform buffer so a draw only has to set the material index and bind the textures.
+class MaterialLibrary
+{
+public:
+    vector<Material> materials;
+    // models load their textures through the streamer while one is attached, see TextureStreamer
+    TextureStreamer *streamer;
+
+    MaterialLibrary() : streamer(nullptr), UBO(0), dirty(true), boundArray(0)
+    {
+        resetBindings();
+    }
+
+    // returns the index of an equal material, adding the material to the table if it isn't known yet
+    unsigned int Intern(const Material &material)
+    {
+        MaterialKey key = makeKey(material);
+        map<MaterialKey, unsigned int>::iterator it = lookup.find(key);
+        if (it != lookup.end())
+            return it->second;
+
+        if (materials.size() >= MAX_MATERIALS)
+        {
+            cout << "ERROR::MATERIAL:: material table is full, reusing material 0" << endl;
+            return 0;
+        }
+        unsigned int index = (unsigned int)materials.size();
+        materials.push_back(material);
+        lookup[key] = index;
+        dirty = true;
+        return index;
+    }
+
+    // the diffuse texture of the material was packed into a layer of a texture array, see TextureArrayPacker
+    void SetDiffuseArray(unsigned int index, unsigned int array, float layer, const glm::vec4 &rect)
+    {
+        materials[index].diffuseArray = array;
+        materials[index].diffuseLayer = layer;
+        materials[index].diffuseRect = rect;
+        dirty = true;
+    }
+
+    // texture cache shared by all models, keyed by the full path of the image, so a texture used by several
+    // models (or several instances of the same model) is only loaded once.
+    unsigned int FindTexture(const string &path) const
+    {
+        map<string, unsigned int>::const_iterator it = textureCache.find(path);
+        return it != textureCache.end() ? it->second : 0;
+    }
+    void AddTexture(const string &path, unsigned int id)
+    {
+        textureCache[path] = id;
+    }
+    void RemoveTexture(const string &path)
+    {
+        textureCache.erase(path);
+    }
+    // every texture loaded from a file, by path
+    const map<string, unsigned int> &Textures() const
+    {
+        return textureCache;
+    }
+
+    // materials that bind the same textures, and can be drawn together if the shader reads the material index per
+    // instance, have the same binding. Valid after Upload.
+    unsigned int Binding(unsigned int index) const
+    {
+        // materials added since the last Upload bind on their own
+        return index < bindings.size() ? bindings[index] : MAX_MATERIALS + index;
+    }
+
+    // points the shader's samplers at the material texture units, Shader already attached its Materials block
+    void SetupShader(Shader &shader)
+    {
+        shader.use();
+        for (unsigned int i = 0; i < MATERIAL_TEXTURE_COUNT; i++)
+            shader.setInt(MATERIAL_SAMPLER_NAMES[i], i);
+        shader.setInt("texture_diffuse_array", MATERIAL_ARRAY_UNIT);
+    }
+
+    // (re)uploads the parameter table if materials were added since the last upload
+    void Upload()
+    {
+        if (!dirty)
+            return;
+        vector<MaterialParams> params(MAX_MATERIALS);
+        map<MaterialKey, unsigned int> bindingLookup;
+        bindings.resize(materials.size());
+        for (unsigned int i = 0; i < materials.size(); i++)
+        {
+            params[i].lighting = glm::vec4(materials[i].ambientStrength, materials[i].specularStrength, materials[i].shininess, materials[i].diffuseLayer);
+            params[i].diffuseRect = materials[i].diffuseArray != 0 ? materials[i].diffuseRect : glm::vec4(0.0f);
+            // the textures with the diffuse one replaced by its array, lighting parameters left out
+            MaterialKey key = makeKey(materials[i]);
+            if (materials[i].diffuseArray != 0)
+                key.textures[MATERIAL_DIFFUSE] = materials[i].diffuseArray;
+            key.params[0] = key.params[1] = key.params[2] = 0.0f;
+            map<MaterialKey, unsigned int>::iterator it = bindingLookup.insert(make_pair(key, (unsigned int)bindingLookup.size())).first;
+            bindings[i] = it->second;
+        }
+
+        if (UBO == 0)
+            glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, params.size() * sizeof(MaterialParams), &params[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_UBO_BINDING, UBO);
+        dirty = false;
+    }
+
+    // makes the material current for the (already active) shader. Textures that are still bound from the previous
+    // material are not bound again, so consecutive draws with the same material only cost one uniform update.
+    void Bind(unsigned int index, Shader &shader)
+    {
+        const Material &material = materials[index];
+        for (unsigned int i = 0; i < MATERIAL_TEXTURE_COUNT; i++)
+        {
+            if (material.textures[i] == 0 || boundTextures[i] == material.textures[i] || (i == MATERIAL_DIFFUSE && material.diffuseArray != 0))
+                continue;
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, material.textures[i]);
+            boundTextures[i] = material.textures[i];
+        }
+        if (material.diffuseArray != 0 && boundArray != material.diffuseArray)
+        {
+            glActiveTexture(GL_TEXTURE0 + MATERIAL_ARRAY_UNIT);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, material.diffuseArray);
+            boundArray = material.diffuseArray;
+        }
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("materialIndex", (int)index);
+    }
+
+    // must be called when code outside the library changed the GL_TEXTURE_2D bindings of the material units
+    void InvalidateBindings()
+    {
+        resetBindings();
+    }
+
+private:
+    struct MaterialKey {
+        unsigned int textures[MATERIAL_TEXTURE_COUNT];
+        float params[3];
+
+        bool operator<(const MaterialKey &other) const
+        {
+            for (unsigned int i = 0; i < MATERIAL_TEXTURE_COUNT; i++)
+                if (textures[i] != other.textures[i])
+                    return textures[i] < other.textures[i];
+            for (unsigned int i = 0; i < 3; i++)
+                if (params[i] != other.params[i])
+                    return params[i] < other.params[i];
+            return false;
+        }
+    };
+
+    map<MaterialKey, unsigned int> lookup;
+    map<string, unsigned int> textureCache;
+    vector<unsigned int> bindings;
+    unsigned int boundTextures[MATERIAL_TEXTURE_COUNT];
+    unsigned int UBO;
+    bool dirty;
+    unsigned int boundArray;
+
+    static MaterialKey makeKey(const Material &material)
+    {
+        MaterialKey key;
+        for (unsigned int i = 0; i < MATERIAL_TEXTURE_COUNT; i++)
+            key.textures[i] = material.textures[i];
+        key.params[0] = material.ambientStrength;
+        key.params[1] = material.specularStrength;
+        key.params[2] = material.shininess;
+        return key;
+    }
+
+    void resetBindings()
+    {
+        for (unsigned int i = 0; i < MATERIAL_TEXTURE_COUNT; i++)
+            boundTextures[i] = 0;
+        boundArray = 0;
+    }
+};
+#endif
@@ -7,34 +7,19 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "learnopengl/shader.h"
+#include "learnopengl/vertex.h"
+#include "learnopengl/mesh_arena.h"
 
 #include <string>
 #include <vector>
+#include <algorithm>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-	//bone indexes which will influence this vertex
-	int m_BoneIDs[MAX_BONE_INFLUENCE];
-	//weights from each bone
-	float m_Weights[MAX_BONE_INFLUENCE];
-};
-
-struct Texture {
-    unsigned int id;
-    string type;
-    string path;
+// one detail level of a mesh: a range of the mesh's index buffer. All levels share the vertex buffer.
+struct MeshLod {
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    float error; // geometric deviation from level 0, relative to the mesh extent
 };
 
 class Mesh {
@@ -42,105 +27,65 @@ public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
-    vector<Texture>      textures;
-    unsigned int VAO;
-
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    unsigned int materialIndex; // index into the MaterialLibrary the mesh was loaded with
+    vector<MeshLod>      lods;  // detail levels stored in indices, level 0 is the full resolution mesh
+    // the GPU copy of vertices and indices, see MeshArena
+    MeshArena *arena;
+    unsigned int geometry;
+
+    // constructor, uploads the mesh into the arena. Without lods the whole index buffer is the only detail level.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, unsigned int materialIndex, MeshArena &arena, vector<MeshLod> lods = vector<MeshLod>())
     {
         this->vertices = vertices;
         this->indices = indices;
-        this->textures = textures;
-
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
-    }
-
-    // render the mesh
-    void Draw(Shader &shader) 
-    {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        this->materialIndex = materialIndex;
+        this->lods = lods;
+        if (this->lods.empty())
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-             else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            MeshLod lod;
+            lod.indexOffset = 0;
+            lod.indexCount = (unsigned int)indices.size();
+            lod.error = 0.0f;
+            this->lods.push_back(lod);
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        // now that we have all the required data, copy the vertices and indices into the shared buffers
+        this->arena = &arena;
+        geometry = vertices.empty() ? MESH_ARENA_NONE : arena.Add(VERTEX_FORMAT_MESH, &vertices[0], (unsigned int)vertices.size(), indices.empty() ? NULL : &indices[0], (unsigned int)indices.size());
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    // gives the mesh's space in the arena back, e.g. when a streamed-in asset is unloaded. Copies of the mesh
+    // share the geometry, only one of them may release it.
+    void Release()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+        arena->Remove(geometry);
+        geometry = MESH_ARENA_NONE;
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    // the detail level lod clamps to
+    const MeshLod &Lod(unsigned int lod) const
+    {
+        return lods[min(lod, (unsigned int)lods.size() - 1)];
+    }
 
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+    // render the mesh. The material (textures and lighting parameters) has to be bound by the caller, see MaterialLibrary::Bind
+    // lod selects the detail level, levels past the last one draw the coarsest level.
+    void Draw(unsigned int lod = 0)
+    {
+        if (geometry == MESH_ARENA_NONE)
+            return;
+        const MeshLod &level = Lod(lod);
+        arena->Draw(geometry, level.indexOffset, level.indexCount);
+    }
 
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+    // draws count instances of a detail level. The model matrices are read from instanceBuffer, one glm::mat4 per
+    // instance starting at firstInstance, see MeshArena::DrawInstanced.
+    void DrawInstanced(unsigned int lod, unsigned int instanceBuffer, unsigned int firstInstance, unsigned int count)
+    {
+        if (count == 0 || geometry == MESH_ARENA_NONE)
+            return;
+        const MeshLod &level = Lod(lod);
+        arena->DrawInstanced(geometry, level.indexOffset, level.indexCount, instanceBuffer, firstInstance, count);
     }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,398 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "learnopengl/vertex.h"
+#include "learnopengl/range_allocator.h"
+
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+// returned by MeshArena::Add when the geometry is empty
+#define MESH_ARENA_NONE RANGE_ALLOCATOR_NONE
+// initial capacities, in vertices of the mesh format and in indices. A pool doubles when it runs out.
+#define MESH_ARENA_VERTICES (1u << 16)
+#define MESH_ARENA_INDICES (1u << 18)
+
+// vertex layouts the arena keeps a vertex buffer and a vertex array for
+enum VertexFormat {
+    VERTEX_FORMAT_MESH,      // Vertex, attributes 0 to 6, plus the instance matrix in 7 to 10
+    VERTEX_FORMAT_POSITION,  // a vec3 in attribute 0, e.g. the skybox
+    VERTEX_FORMAT_COUNT
+};
+
+inline unsigned int VertexStride(VertexFormat format)
+{
+    return format == VERTEX_FORMAT_MESH ? (unsigned int)sizeof(Vertex) : (unsigned int)sizeof(glm::vec3);
+}
+
+// where a piece of geometry currently is. The values change when the arena defragments, the handle doesn't.
+struct GeometryRange {
+    VertexFormat format;
+    int baseVertex;
+    unsigned int firstIndex;
+    unsigned int vertexCount;
+    unsigned int indexCount;
+};
+
+// Shared storage for the geometry of every mesh: one vertex buffer and one vertex array per vertex format, and
+// one index buffer for all of them. Geometry is sub-allocated from the buffers with a RangeAllocator and drawn
+// with its base vertex and first index, so the scene needs a handful of buffer objects instead of three per mesh
+// and draws never have to switch vertex arrays within a format. Removed geometry leaves a hole that later
+// geometry can reuse; when a pool is too fragmented for an allocation it is compacted first, and only grown if
+// that isn't enough. Geometry is referred to by the handle Add returns, which stays valid until Remove.
+class MeshArena
+{
+public:
+    MeshArena() : identityBuffer(0)
+    {
+        for (unsigned int f = 0; f < VERTEX_FORMAT_COUNT; f++)
+        {
+            vertexPools[f].stride = VertexStride((VertexFormat)f);
+            glGenVertexArrays(1, &VAOs[f]);
+        }
+        indexPool.stride = sizeof(unsigned int);
+
+        // instance matrix of draws that don't set one
+        glm::mat4 identity(1.0f);
+        glGenBuffers(1, &identityBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, identityBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(glm::mat4), &identity, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        resize(vertexPools[VERTEX_FORMAT_MESH], MESH_ARENA_VERTICES);
+        resize(vertexPools[VERTEX_FORMAT_POSITION], MESH_ARENA_VERTICES / 64);
+        resize(indexPool, MESH_ARENA_INDICES);
+        for (unsigned int f = 0; f < VERTEX_FORMAT_COUNT; f++)
+            setupFormat((VertexFormat)f);
+        SetInstanceBuffer(identityBuffer, 0);
+        glBindVertexArray(0);
+        // read by the instancing shaders while the material attribute is disabled
+        glVertexAttrib1f(INSTANCE_MATERIAL_ATTRIBUTE, -1.0f);
+    }
+
+    ~MeshArena()
+    {
+        glDeleteVertexArrays(VERTEX_FORMAT_COUNT, VAOs);
+        for (unsigned int f = 0; f < VERTEX_FORMAT_COUNT; f++)
+            glDeleteBuffers(1, &vertexPools[f].buffer);
+        glDeleteBuffers(1, &indexPool.buffer);
+        glDeleteBuffers(1, &identityBuffer);
+    }
+
+    // copies the geometry into the arena, the indices are relative to its first vertex. Returns the handle of the
+    // geometry, MESH_ARENA_NONE if it is empty.
+    unsigned int Add(VertexFormat format, const void *vertices, unsigned int vertexCount, const unsigned int *indices, unsigned int indexCount)
+    {
+        if (vertexCount == 0 || indexCount == 0)
+            return MESH_ARENA_NONE;
+        Entry entry;
+        entry.range.format = format;
+        entry.range.vertexCount = vertexCount;
+        entry.range.indexCount = indexCount;
+        entry.vertexAllocation = allocate(vertexPools[format], vertexCount);
+        entry.indexAllocation = allocate(indexPool, indexCount);
+        entry.alive = true;
+        Pool &vertexPool = vertexPools[format];
+        entry.range.baseVertex = (int)vertexPool.allocator.Offset(entry.vertexAllocation);
+        entry.range.firstIndex = indexPool.allocator.Offset(entry.indexAllocation);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexPool.buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)entry.range.baseVertex * vertexPool.stride, (GLsizeiptr)vertexCount * vertexPool.stride, vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, indexPool.buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)entry.range.firstIndex * sizeof(unsigned int), (GLsizeiptr)indexCount * sizeof(unsigned int), indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        unsigned int geometry;
+        if (!freeEntries.empty())
+        {
+            geometry = freeEntries.back();
+            freeEntries.pop_back();
+            entries[geometry] = entry;
+        }
+        else
+        {
+            geometry = (unsigned int)entries.size();
+            entries.push_back(entry);
+        }
+        return geometry;
+    }
+
+    // frees the geometry's ranges for reuse. Draws already issued are not affected, GL finishes them first.
+    void Remove(unsigned int geometry)
+    {
+        if (!Contains(geometry))
+            return;
+        Entry &entry = entries[geometry];
+        vertexPools[entry.range.format].allocator.Free(entry.vertexAllocation);
+        indexPool.allocator.Free(entry.indexAllocation);
+        entry.alive = false;
+        freeEntries.push_back(geometry);
+    }
+
+    bool Contains(unsigned int geometry) const
+    {
+        return geometry < entries.size() && entries[geometry].alive;
+    }
+
+    const GeometryRange &Range(unsigned int geometry) const
+    {
+        return entries[geometry].range;
+    }
+
+    // binds the vertex array of a format, its element buffer is the shared index buffer
+    void Bind(VertexFormat format) const
+    {
+        glBindVertexArray(VAOs[format]);
+    }
+
+    // points the instance matrix attributes of the mesh format at buffer, the matrix of instance i (base instance
+    // included) is read from offset + i * sizeof(glm::mat4). With a materialBuffer the material index of instance
+    // i is read as a float from materialOffset + i * sizeof(float), otherwise the shaders use their uniform.
+    void SetInstanceBuffer(unsigned int buffer, unsigned int offset, unsigned int materialBuffer = 0, unsigned int materialOffset = 0)
+    {
+        glBindVertexArray(VAOs[VERTEX_FORMAT_MESH]);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (unsigned int i = 0; i < 4; i++)
+            glVertexAttribPointer(INSTANCE_MATRIX_ATTRIBUTE + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(size_t)(offset + i * sizeof(glm::vec4)));
+        if (materialBuffer != 0)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, materialBuffer);
+            glVertexAttribPointer(INSTANCE_MATERIAL_ATTRIBUTE, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)(size_t)materialOffset);
+            glEnableVertexAttribArray(INSTANCE_MATERIAL_ATTRIBUTE);
+        }
+        else
+            glDisableVertexAttribArray(INSTANCE_MATERIAL_ATTRIBUTE);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // draws indexCount indices of the geometry starting at its index firstIndex
+    void Draw(unsigned int geometry, unsigned int firstIndex, unsigned int indexCount) const
+    {
+        const GeometryRange &range = entries[geometry].range;
+        glBindVertexArray(VAOs[range.format]);
+        glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)((size_t)(range.firstIndex + firstIndex) * sizeof(unsigned int)), range.baseVertex);
+        glBindVertexArray(0);
+    }
+
+    // same for count instances, with the model matrices in instanceBuffer starting at firstInstance. GL 3.3 has no
+    // base instance, so the matrix attributes are pointed at the first instance for every draw.
+    void DrawInstanced(unsigned int geometry, unsigned int firstIndex, unsigned int indexCount, unsigned int instanceBuffer, unsigned int firstInstance, unsigned int count)
+    {
+        const GeometryRange &range = entries[geometry].range;
+        SetInstanceBuffer(instanceBuffer, firstInstance * sizeof(glm::mat4));
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)((size_t)(range.firstIndex + firstIndex) * sizeof(unsigned int)), count, range.baseVertex);
+        glBindVertexArray(0);
+    }
+
+    // moves all geometry to the start of its buffers, so the free space becomes one range at the end of each
+    void Defragment()
+    {
+        for (unsigned int f = 0; f < VERTEX_FORMAT_COUNT; f++)
+            compact(vertexPools[f]);
+        compact(indexPool);
+    }
+
+    // vertices and indices in use, over all formats
+    unsigned int VertexCount() const
+    {
+        unsigned int count = 0;
+        for (unsigned int f = 0; f < VERTEX_FORMAT_COUNT; f++)
+            count += vertexPools[f].allocator.Used();
+        return count;
+    }
+    unsigned int IndexCount() const
+    {
+        return indexPool.allocator.Used();
+    }
+    // bytes reserved by the buffers, and how many free ranges they are split into
+    size_t CapacityBytes() const
+    {
+        size_t bytes = (size_t)indexPool.allocator.Capacity() * indexPool.stride;
+        for (unsigned int f = 0; f < VERTEX_FORMAT_COUNT; f++)
+            bytes += (size_t)vertexPools[f].allocator.Capacity() * vertexPools[f].stride;
+        return bytes;
+    }
+    unsigned int FreeRanges() const
+    {
+        unsigned int ranges = indexPool.allocator.FreeBlocks();
+        for (unsigned int f = 0; f < VERTEX_FORMAT_COUNT; f++)
+            ranges += vertexPools[f].allocator.FreeBlocks();
+        return ranges;
+    }
+
+private:
+    struct Pool {
+        unsigned int buffer;
+        unsigned int stride;     // bytes per unit
+        RangeAllocator allocator;
+
+        Pool() : buffer(0), stride(0)
+        {
+        }
+    };
+    struct Entry {
+        GeometryRange range;
+        unsigned int vertexAllocation;
+        unsigned int indexAllocation;
+        bool alive;
+    };
+
+    Pool vertexPools[VERTEX_FORMAT_COUNT];
+    Pool indexPool;
+    unsigned int VAOs[VERTEX_FORMAT_COUNT];
+    unsigned int identityBuffer;
+    vector<Entry> entries;
+    vector<unsigned int> freeEntries;
+
+    // allocates count units, compacting the pool if the free space is there but split up, growing it otherwise
+    unsigned int allocate(Pool &pool, unsigned int count)
+    {
+        unsigned int allocation = pool.allocator.Allocate(count);
+        if (allocation != RANGE_ALLOCATOR_NONE)
+            return allocation;
+        if (pool.allocator.Capacity() - pool.allocator.Used() >= count)
+        {
+            compact(pool);
+            allocation = pool.allocator.Allocate(count);
+            if (allocation != RANGE_ALLOCATOR_NONE)
+                return allocation;
+        }
+        // the added space alone has to fit the allocation, the end of the pool may be in use
+        unsigned int capacity = max(pool.allocator.Capacity(), 1u) * 2;
+        while (capacity - pool.allocator.Capacity() < count)
+            capacity *= 2;
+        resize(pool, capacity);
+        return pool.allocator.Allocate(count);
+    }
+
+    bool usesPool(const Entry &entry, const Pool &pool, unsigned int &allocation) const
+    {
+        if (&pool == &indexPool)
+            allocation = entry.indexAllocation;
+        else if (&pool == &vertexPools[entry.range.format])
+            allocation = entry.vertexAllocation;
+        else
+            return false;
+        return true;
+    }
+
+    // replaces the pool's buffer with one of the given capacity, keeping the contents
+    void resize(Pool &pool, unsigned int capacity)
+    {
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)capacity * pool.stride, NULL, GL_STATIC_DRAW);
+        if (pool.buffer != 0)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, pool.buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)pool.allocator.Capacity() * pool.stride);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glDeleteBuffers(1, &pool.buffer);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        pool.buffer = buffer;
+        pool.allocator.Grow(capacity);
+        rebind(pool);
+    }
+
+    // copies the live ranges of the pool back to back into a new buffer of the same size
+    void compact(Pool &pool)
+    {
+        vector<pair<unsigned int, unsigned int> > live; // offset, entry
+        for (unsigned int e = 0; e < entries.size(); e++)
+        {
+            unsigned int allocation;
+            if (entries[e].alive && usesPool(entries[e], pool, allocation))
+                live.push_back(make_pair(pool.allocator.Offset(allocation), e));
+        }
+        sort(live.begin(), live.end());
+
+        unsigned int capacity = pool.allocator.Capacity();
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)capacity * pool.stride, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, pool.buffer);
+        pool.allocator.Reset(capacity);
+        for (unsigned int i = 0; i < live.size(); i++)
+        {
+            Entry &entry = entries[live[i].second];
+            bool indices = &pool == &indexPool;
+            unsigned int count = indices ? entry.range.indexCount : entry.range.vertexCount;
+            // allocating from a fresh allocator in offset order packs the ranges from the start
+            unsigned int allocation = pool.allocator.Allocate(count);
+            unsigned int offset = pool.allocator.Offset(allocation);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)live[i].first * pool.stride, (GLintptr)offset * pool.stride, (GLsizeiptr)count * pool.stride);
+            if (indices)
+            {
+                entry.indexAllocation = allocation;
+                entry.range.firstIndex = offset;
+            }
+            else
+            {
+                entry.vertexAllocation = allocation;
+                entry.range.baseVertex = (int)offset;
+            }
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &pool.buffer);
+        pool.buffer = buffer;
+        rebind(pool);
+    }
+
+    // points the vertex arrays that read from the pool at its current buffer
+    void rebind(Pool &pool)
+    {
+        for (unsigned int f = 0; f < VERTEX_FORMAT_COUNT; f++)
+            if (&pool == &indexPool || &pool == &vertexPools[f])
+                setupFormat((VertexFormat)f);
+    }
+
+    void setupFormat(VertexFormat format)
+    {
+        if (vertexPools[format].buffer == 0 || indexPool.buffer == 0)
+            return;
+        glBindVertexArray(VAOs[format]);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexPools[format].buffer);
+        if (format == VERTEX_FORMAT_MESH)
+        {
+            // same layout as the Vertex struct
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+            glEnableVertexAttribArray(5);
+            glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+            glEnableVertexAttribArray(6);
+            glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+            for (unsigned int i = 0; i < 4; i++)
+            {
+                glEnableVertexAttribArray(INSTANCE_MATRIX_ATTRIBUTE + i);
+                glVertexAttribDivisor(INSTANCE_MATRIX_ATTRIBUTE + i, 1);
+            }
+            glVertexAttribDivisor(INSTANCE_MATERIAL_ATTRIBUTE, 1);
+        }
+        else
+        {
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexPool.buffer);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+#endif
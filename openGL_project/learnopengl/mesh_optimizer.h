@@ -0,0 +1,281 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "learnopengl/mesh.h"
+
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+// size of the simulated post-transform vertex cache. Tipsify only needs a rough estimate, 16 is a
+// conservative value for the FIFO caches of current GPUs.
+#define VERTEX_CACHE_SIZE 16
+// how much worse than the whole mesh a cluster's ACMR may get before the overdraw pass splits it
+#define OVERDRAW_THRESHOLD 1.05f
+
+// Import-time index and vertex buffer optimization:
+// 1. triangles are reordered for post-transform vertex cache locality (Tipsify, Sander et al. 2007),
+// 2. the resulting clusters are reordered outside-in to reduce overdraw, without losing much cache efficiency,
+// 3. vertices are reordered in the order the index buffer first references them, for vertex fetch locality.
+class MeshOptimizer
+{
+public:
+    // average cache miss ratio: transformed vertices per triangle with a FIFO cache of the given size.
+    // 3.0 means every vertex is transformed for every triangle, 0.5 is the optimum for large regular grids.
+    static float ACMR(const vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+    {
+        if (indices.size() < 3)
+            return 0.0f;
+        vector<unsigned int> timestamps(vertexCount, 0);
+        unsigned int time = cacheSize + 1;
+        unsigned int misses = 0;
+        for (unsigned int i = 0; i < indices.size(); i++)
+        {
+            unsigned int v = indices[i];
+            if (time - timestamps[v] > cacheSize)
+            {
+                timestamps[v] = time++;
+                misses++;
+            }
+        }
+        return (float)misses / (float)(indices.size() / 3);
+    }
+
+    // runs the full pipeline on the mesh data in place
+    static void Optimize(vector<Vertex> &vertices, vector<unsigned int> &indices)
+    {
+        if (indices.size() < 3 || vertices.empty())
+            return;
+        vector<unsigned int> clusters;
+        indices = OptimizeVertexCache(indices, (unsigned int)vertices.size(), VERTEX_CACHE_SIZE, &clusters);
+        indices = OptimizeOverdraw(indices, vertices, clusters, OVERDRAW_THRESHOLD);
+        OptimizeVertexFetch(vertices, indices);
+    }
+
+    // Tipsify: fans around the most recently used vertices that are still "live", and jumps to a dead-end vertex
+    // or the next vertex in index order when the fan runs out. If clusters is given, it receives the index (in
+    // triangles) where each such non-local jump starts a new cluster.
+    static vector<unsigned int> OptimizeVertexCache(const vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE, vector<unsigned int> *clusters = nullptr)
+    {
+        unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+
+        // vertex -> triangle adjacency, stored as offsets into one array
+        vector<unsigned int> liveCount(vertexCount, 0);
+        for (unsigned int i = 0; i < triangleCount * 3; i++)
+            liveCount[indices[i]]++;
+        vector<unsigned int> offsets(vertexCount + 1, 0);
+        for (unsigned int v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + liveCount[v];
+        vector<unsigned int> adjacency(triangleCount * 3);
+        vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (unsigned int t = 0; t < triangleCount; t++)
+            for (unsigned int k = 0; k < 3; k++)
+                adjacency[fill[indices[t * 3 + k]]++] = t;
+
+        vector<unsigned int> timestamps(vertexCount, 0);
+        vector<bool> emitted(triangleCount, false);
+        vector<unsigned int> deadEnds;
+        vector<unsigned int> candidates;
+        vector<unsigned int> result;
+        result.reserve(triangleCount * 3);
+        if (clusters)
+            clusters->clear();
+
+        unsigned int time = cacheSize + 1;
+        unsigned int cursor = 0;
+        int fanning = vertexCount > 0 ? 0 : -1;
+        if (clusters && triangleCount > 0)
+            clusters->push_back(0);
+
+        while (fanning >= 0)
+        {
+            candidates.clear();
+            for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+            {
+                unsigned int t = adjacency[a];
+                if (emitted[t])
+                    continue;
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    unsigned int v = indices[t * 3 + k];
+                    result.push_back(v);
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    liveCount[v]--;
+                    if (time - timestamps[v] > cacheSize)
+                        timestamps[v] = time++;
+                }
+                emitted[t] = true;
+            }
+
+            // pick the candidate that will still be in the cache after its remaining triangles are emitted, preferring the oldest one
+            int next = -1;
+            int best = -1;
+            for (unsigned int c = 0; c < candidates.size(); c++)
+            {
+                unsigned int v = candidates[c];
+                if (liveCount[v] == 0)
+                    continue;
+                int priority = 0;
+                if (time - timestamps[v] + 2 * liveCount[v] <= cacheSize)
+                    priority = (int)(time - timestamps[v]);
+                if (priority > best)
+                {
+                    best = priority;
+                    next = (int)v;
+                }
+            }
+            if (next == -1)
+            {
+                // dead end: go back to a recently used vertex that still has triangles
+                while (!deadEnds.empty() && next == -1)
+                {
+                    unsigned int v = deadEnds.back();
+                    deadEnds.pop_back();
+                    if (liveCount[v] > 0)
+                        next = (int)v;
+                }
+                // none left: continue with the first unfinished vertex in input order, this starts a new cluster
+                while (next == -1 && cursor < vertexCount)
+                {
+                    if (liveCount[cursor] > 0)
+                    {
+                        next = (int)cursor;
+                        unsigned int start = (unsigned int)(result.size() / 3);
+                        if (clusters && start < triangleCount && clusters->back() != start)
+                            clusters->push_back(start);
+                    }
+                    cursor++;
+                }
+            }
+            fanning = next;
+        }
+        return result;
+    }
+
+    // Sander's linear-speed overdraw reduction: the clusters from Tipsify are split further wherever the running
+    // cluster is already cache efficient enough, then drawn in order of how much they face away from the mesh
+    // center. Outward facing clusters on the rim are likely to occlude the rest of the mesh, so they go first.
+    static vector<unsigned int> OptimizeOverdraw(const vector<unsigned int> &indices, const vector<Vertex> &vertices, const vector<unsigned int> &hardClusters, float threshold = OVERDRAW_THRESHOLD)
+    {
+        unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+        if (triangleCount == 0 || hardClusters.empty())
+            return indices;
+
+        vector<unsigned int> clusters = softBoundaries(indices, (unsigned int)vertices.size(), hardClusters, threshold);
+
+        // area weighted centroid of the mesh
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (unsigned int t = 0; t < triangleCount; t++)
+        {
+            glm::vec3 a = vertices[indices[t * 3]].Position, b = vertices[indices[t * 3 + 1]].Position, c = vertices[indices[t * 3 + 2]].Position;
+            float area = glm::length(glm::cross(b - a, c - a));
+            meshCentroid += (a + b + c) * (area / 3.0f);
+            meshArea += area;
+        }
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        vector<pair<float, unsigned int> > order(clusters.size());
+        for (unsigned int c = 0; c < clusters.size(); c++)
+        {
+            unsigned int begin = clusters[c];
+            unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (unsigned int t = begin; t < end; t++)
+            {
+                glm::vec3 a = vertices[indices[t * 3]].Position, b = vertices[indices[t * 3 + 1]].Position, c2 = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 n = glm::cross(b - a, c2 - a); // length is twice the area, so the sum is area weighted
+                float triangleArea = glm::length(n);
+                centroid += (a + b + c2) * (triangleArea / 3.0f);
+                normal += n;
+                area += triangleArea;
+            }
+            if (area > 0.0f)
+                centroid /= area;
+            float normalLength = glm::length(normal);
+            if (normalLength > 0.0f)
+                normal /= normalLength;
+            order[c] = make_pair(-glm::dot(centroid - meshCentroid, normal), c);
+        }
+        stable_sort(order.begin(), order.end());
+
+        vector<unsigned int> result;
+        result.reserve(indices.size());
+        for (unsigned int o = 0; o < order.size(); o++)
+        {
+            unsigned int c = order[o].second;
+            unsigned int begin = clusters[c];
+            unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            result.insert(result.end(), indices.begin() + begin * 3, indices.begin() + end * 3);
+        }
+        return result;
+    }
+
+    // renumbers the vertices in the order the index buffer first uses them and drops unreferenced ones
+    static void OptimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+    {
+        const unsigned int unused = 0xffffffffu;
+        vector<unsigned int> remap(vertices.size(), unused);
+        vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+        for (unsigned int i = 0; i < indices.size(); i++)
+        {
+            unsigned int &target = remap[indices[i]];
+            if (target == unused)
+            {
+                target = (unsigned int)reordered.size();
+                reordered.push_back(vertices[indices[i]]);
+            }
+            indices[i] = target;
+        }
+        vertices.swap(reordered);
+    }
+
+private:
+    // splits the hard clusters wherever the ACMR of the cluster so far drops below threshold times the ACMR of the
+    // whole mesh. Every split restarts with a cold cache, which is what the cluster will see after reordering.
+    static vector<unsigned int> softBoundaries(const vector<unsigned int> &indices, unsigned int vertexCount, const vector<unsigned int> &hardClusters, float threshold)
+    {
+        unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+        float limit = ACMR(indices, vertexCount) * threshold;
+
+        vector<unsigned int> timestamps(vertexCount, 0);
+        unsigned int time = VERTEX_CACHE_SIZE + 1;
+        vector<unsigned int> result;
+        for (unsigned int c = 0; c < hardClusters.size(); c++)
+        {
+            unsigned int begin = hardClusters[c];
+            unsigned int end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : triangleCount;
+            result.push_back(begin);
+            time += VERTEX_CACHE_SIZE + 1; // flush
+            unsigned int misses = 0, start = begin;
+            for (unsigned int t = begin; t < end; t++)
+            {
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    unsigned int v = indices[t * 3 + k];
+                    if (time - timestamps[v] > VERTEX_CACHE_SIZE)
+                    {
+                        timestamps[v] = time++;
+                        misses++;
+                    }
+                }
+                // only split off reasonably large pieces, tiny clusters would just add cache misses at their seams
+                if (t + 1 < end && t + 1 - start >= 32 && (float)misses / (float)(t + 1 - start) <= limit)
+                {
+                    result.push_back(t + 1);
+                    start = t + 1;
+                    misses = 0;
+                    time += VERTEX_CACHE_SIZE + 1;
+                }
+            }
+        }
+        return result;
+    }
+};
+#endif
@@ -0,0 +1,345 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <glm/glm.hpp>
+
+#include "learnopengl/mesh.h"
+#include "learnopengl/mesh_optimizer.h"
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+// number of detail levels generated per mesh, including the full resolution level 0
+#define MAX_LODS 4
+// triangle count of each level relative to level 0
+static const float LOD_RATIOS[MAX_LODS] = { 1.0f, 0.5f, 0.25f, 0.1f };
+// largest simplification error allowed for any level, relative to the mesh extent
+#define LOD_MAX_ERROR 0.05f
+// a level is used while its error projects to at most this many pixels on screen
+#define LOD_PIXEL_ERROR 1.0f
+// switching to a coarser level additionally requires the error to be this fraction of LOD_PIXEL_ERROR below it,
+// i.e. at most LOD_PIXEL_ERROR * (1 - LOD_HYSTERESIS), so objects right at a threshold distance don't flicker
+// between two levels
+#define LOD_HYSTERESIS 0.25f
+
+// Quadric error metric simplification (Garland & Heckbert 1997) using half-edge collapses: a vertex always
+// collapses onto one of its neighbours, so simplified levels only need a new index list and can share the
+// vertex buffer of the full resolution mesh.
+// Vertices on open borders, on attribute seams (several vertices at one position) and on non-manifold edges
+// are locked, which keeps silhouettes and texture seams intact at the cost of some reduction.
+class MeshSimplifier
+{
+public:
+    // simplifies the triangle list down to about targetIndexCount indices, without exceeding targetError
+    // (relative to the mesh extent). resultError receives the error of the returned list.
+    static vector<unsigned int> Simplify(const vector<Vertex> &vertices, const vector<unsigned int> &indices, unsigned int targetIndexCount, float targetError, float *resultError = nullptr)
+    {
+        unsigned int vertexCount = (unsigned int)vertices.size();
+        vector<unsigned int> result = indices;
+        if (resultError)
+            *resultError = 0.0f;
+        if (vertexCount == 0 || indices.size() <= targetIndexCount)
+            return result;
+
+        float extent = meshExtent(vertices);
+        double maxError = (double)targetError * extent;
+        double maxCost = maxError * maxError;
+
+        vector<bool> locked = classifyLocked(vertices, indices);
+        vector<Quadric> quadrics(vertexCount);
+        for (unsigned int t = 0; t + 2 < indices.size(); t += 3)
+        {
+            glm::dvec3 p0 = glm::dvec3(vertices[indices[t]].Position), p1 = glm::dvec3(vertices[indices[t + 1]].Position), p2 = glm::dvec3(vertices[indices[t + 2]].Position);
+            glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+            double area = glm::length(normal);
+            if (area <= 0.0)
+                continue;
+            normal /= area;
+            Quadric q = Quadric::FromPlane(normal, -glm::dot(normal, p0), area);
+            for (unsigned int k = 0; k < 3; k++)
+                quadrics[indices[t + k]].Add(q);
+        }
+
+        vector<unsigned int> remap(vertexCount);
+        vector<unsigned char> touched(vertexCount);
+        vector<Collapse> candidates;
+        double appliedCost = 0.0;
+
+        while (result.size() > targetIndexCount)
+        {
+            // vertex -> triangle adjacency of the current triangle list
+            unsigned int triangleCount = (unsigned int)(result.size() / 3);
+            vector<unsigned int> offsets(vertexCount + 1, 0);
+            for (unsigned int i = 0; i < result.size(); i++)
+                offsets[result[i] + 1]++;
+            for (unsigned int v = 0; v < vertexCount; v++)
+                offsets[v + 1] += offsets[v];
+            vector<unsigned int> adjacency(result.size());
+            vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+            for (unsigned int t = 0; t < triangleCount; t++)
+                for (unsigned int k = 0; k < 3; k++)
+                    adjacency[fill[result[t * 3 + k]]++] = t;
+
+            // cheapest direction of every edge
+            candidates.clear();
+            for (unsigned int t = 0; t < triangleCount; t++)
+            {
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    unsigned int a = result[t * 3 + k], b = result[t * 3 + (k + 1) % 3];
+                    if (locked[a] && locked[b])
+                        continue;
+                    Collapse collapse;
+                    collapse.cost = -1.0;
+                    if (!locked[a])
+                        consider(collapse, a, b, quadrics, vertices);
+                    if (!locked[b])
+                        consider(collapse, b, a, quadrics, vertices);
+                    if (collapse.cost >= 0.0 && collapse.cost <= maxCost)
+                        candidates.push_back(collapse);
+                }
+            }
+            if (candidates.empty())
+                break;
+            sort(candidates.begin(), candidates.end());
+
+            // every collapse removes about two triangles. vertices around a collapse are not touched again in
+            // the same pass, so the flip test of every collapse sees up to date triangles.
+            unsigned int needed = (unsigned int)((result.size() - targetIndexCount) / 6) + 1;
+            unsigned int applied = 0;
+            for (unsigned int v = 0; v < vertexCount; v++)
+            {
+                remap[v] = v;
+                touched[v] = 0;
+            }
+            for (unsigned int c = 0; c < candidates.size() && applied < needed; c++)
+            {
+                const Collapse &collapse = candidates[c];
+                unsigned int from = collapse.from, to = collapse.to;
+                if (touched[from] || touched[to])
+                    continue;
+                if (flips(result, adjacency, offsets, vertices, from, to))
+                    continue;
+
+                remap[from] = to;
+                quadrics[to].Add(quadrics[from]);
+                touched[from] = touched[to] = 1;
+                for (unsigned int a = offsets[from]; a < offsets[from + 1]; a++)
+                    for (unsigned int k = 0; k < 3; k++)
+                        touched[result[adjacency[a] * 3 + k]] = 1;
+                appliedCost = max(appliedCost, collapse.cost);
+                applied++;
+            }
+            if (applied == 0)
+                break;
+
+            // apply the collapses and drop the triangles that became degenerate
+            unsigned int write = 0;
+            for (unsigned int t = 0; t < triangleCount; t++)
+            {
+                unsigned int a = remap[result[t * 3]], b = remap[result[t * 3 + 1]], c = remap[result[t * 3 + 2]];
+                if (a == b || b == c || c == a)
+                    continue;
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        if (resultError)
+            *resultError = extent > 0.0f ? (float)(sqrt(appliedCost) / extent) : 0.0f;
+        return result;
+    }
+
+    // appends levels 1..MAX_LODS-1 to the index buffer and returns the ranges of all levels. Level 0 is the
+    // index buffer as passed in. Each level is simplified from the previous one and reordered for the vertex
+    // cache; generation stops early when a level cannot be reduced meaningfully any more.
+    static vector<MeshLod> GenerateLods(const vector<Vertex> &vertices, vector<unsigned int> &indices)
+    {
+        vector<MeshLod> lods;
+        MeshLod base;
+        base.indexOffset = 0;
+        base.indexCount = (unsigned int)indices.size();
+        base.error = 0.0f;
+        lods.push_back(base);
+
+        vector<unsigned int> previous = indices;
+        float previousError = 0.0f;
+        for (unsigned int level = 1; level < MAX_LODS; level++)
+        {
+            unsigned int target = (unsigned int)(base.indexCount * LOD_RATIOS[level]) / 3 * 3;
+            float error = 0.0f;
+            vector<unsigned int> simplified = Simplify(vertices, previous, target, LOD_MAX_ERROR, &error);
+            if (simplified.size() < 3 || simplified.size() > previous.size() * 9 / 10)
+                break;
+            simplified = MeshOptimizer::OptimizeVertexCache(simplified, (unsigned int)vertices.size());
+
+            MeshLod lod;
+            lod.indexOffset = (unsigned int)indices.size();
+            lod.indexCount = (unsigned int)simplified.size();
+            // errors of successive simplifications add up at most
+            lod.error = previousError + error;
+            lods.push_back(lod);
+            indices.insert(indices.end(), simplified.begin(), simplified.end());
+            previous.swap(simplified);
+            previousError = lod.error;
+        }
+        return lods;
+    }
+
+private:
+    // symmetric 4x4 matrix of the plane equations, plus the accumulated weight to normalize the error
+    struct Quadric {
+        double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+        double weight;
+
+        Quadric() : a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0), a22(0), a23(0), a33(0), weight(0)
+        {
+        }
+
+        static Quadric FromPlane(const glm::dvec3 &n, double d, double w)
+        {
+            Quadric q;
+            q.a00 = w * n.x * n.x; q.a01 = w * n.x * n.y; q.a02 = w * n.x * n.z; q.a03 = w * n.x * d;
+            q.a11 = w * n.y * n.y; q.a12 = w * n.y * n.z; q.a13 = w * n.y * d;
+            q.a22 = w * n.z * n.z; q.a23 = w * n.z * d;
+            q.a33 = w * d * d;
+            q.weight = w;
+            return q;
+        }
+
+        void Add(const Quadric &q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+            a11 += q.a11; a12 += q.a12; a13 += q.a13;
+            a22 += q.a22; a23 += q.a23;
+            a33 += q.a33;
+            weight += q.weight;
+        }
+
+        // weighted mean squared distance of p to the planes
+        double Error(const glm::dvec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                     + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                     + a22 * z * z + 2 * a23 * z
+                     + a33;
+            return weight > 0.0 ? fabs(e) / weight : 0.0;
+        }
+    };
+
+    struct Collapse {
+        unsigned int from, to;
+        double cost;
+
+        bool operator<(const Collapse &other) const
+        {
+            return cost < other.cost;
+        }
+    };
+
+    static void consider(Collapse &collapse, unsigned int from, unsigned int to, const vector<Quadric> &quadrics, const vector<Vertex> &vertices)
+    {
+        Quadric q = quadrics[from];
+        q.Add(quadrics[to]);
+        double cost = q.Error(glm::dvec3(vertices[to].Position));
+        if (collapse.cost < 0.0 || cost < collapse.cost)
+        {
+            collapse.from = from;
+            collapse.to = to;
+            collapse.cost = cost;
+        }
+    }
+
+    // true if moving 'from' onto 'to' would flip or collapse one of the triangles that survive the collapse
+    static bool flips(const vector<unsigned int> &indices, const vector<unsigned int> &adjacency, const vector<unsigned int> &offsets, const vector<Vertex> &vertices, unsigned int from, unsigned int to)
+    {
+        for (unsigned int a = offsets[from]; a < offsets[from + 1]; a++)
+        {
+            unsigned int t = adjacency[a];
+            unsigned int v[3] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+            if (v[0] == to || v[1] == to || v[2] == to)
+                continue; // this triangle disappears
+            glm::vec3 p[3], q[3];
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                p[k] = vertices[v[k]].Position;
+                q[k] = v[k] == from ? vertices[to].Position : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+
+    static float meshExtent(const vector<Vertex> &vertices)
+    {
+        glm::vec3 minimum = vertices[0].Position, maximum = vertices[0].Position;
+        for (unsigned int i = 1; i < vertices.size(); i++)
+        {
+            minimum = glm::min(minimum, vertices[i].Position);
+            maximum = glm::max(maximum, vertices[i].Position);
+        }
+        glm::vec3 size = maximum - minimum;
+        return max(size.x, max(size.y, size.z));
+    }
+
+    // locks vertices on open borders, non-manifold edges and attribute seams. Topology is evaluated on
+    // positions, so the two sides of a texture seam count as connected.
+    static vector<bool> classifyLocked(const vector<Vertex> &vertices, const vector<unsigned int> &indices)
+    {
+        unsigned int vertexCount = (unsigned int)vertices.size();
+        vector<bool> locked(vertexCount, false);
+
+        // weld by position
+        map<glm::vec3, unsigned int, Vec3Less> firstAtPosition;
+        vector<unsigned int> position(vertexCount);
+        vector<unsigned int> wedges(vertexCount, 0);
+        for (unsigned int v = 0; v < vertexCount; v++)
+        {
+            map<glm::vec3, unsigned int, Vec3Less>::iterator it = firstAtPosition.insert(make_pair(vertices[v].Position, v)).first;
+            position[v] = it->second;
+            wedges[it->second]++;
+        }
+
+        // count triangles per undirected position edge
+        map<pair<unsigned int, unsigned int>, unsigned int> edges;
+        for (unsigned int t = 0; t + 2 < indices.size(); t += 3)
+        {
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                unsigned int a = position[indices[t + k]], b = position[indices[t + (k + 1) % 3]];
+                edges[make_pair(min(a, b), max(a, b))]++;
+            }
+        }
+        vector<bool> lockedPosition(vertexCount, false);
+        for (map<pair<unsigned int, unsigned int>, unsigned int>::iterator it = edges.begin(); it != edges.end(); ++it)
+        {
+            if (it->second != 2)
+            {
+                lockedPosition[it->first.first] = true;
+                lockedPosition[it->first.second] = true;
+            }
+        }
+        for (unsigned int v = 0; v < vertexCount; v++)
+            locked[v] = lockedPosition[position[v]] || wedges[position[v]] > 1;
+        return locked;
+    }
+
+    struct Vec3Less {
+        bool operator()(const glm::vec3 &a, const glm::vec3 &b) const
+        {
+            if (a.x != b.x) return a.x < b.x;
+            if (a.y != b.y) return a.y < b.y;
+            return a.z < b.z;
+        }
+    };
+};
+#endif
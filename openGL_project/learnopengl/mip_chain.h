@@ -0,0 +1,184 @@
+#ifndef MIP_CHAIN_H
+#define MIP_CHAIN_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+// filter the mip levels are resampled with
+enum MipFilter {
+    MIP_FILTER_BOX,      // 2x2 average, what glGenerateMipmap does
+    MIP_FILTER_KAISER,   // sinc windowed by a Kaiser window (width 3, alpha 4), sharp without much ringing
+    MIP_FILTER_LANCZOS   // Lanczos 3, a little sharper, a little more ringing
+};
+
+inline const char *MipFilterName(MipFilter filter)
+{
+    switch (filter)
+    {
+    case MIP_FILTER_BOX: return "box";
+    case MIP_FILTER_KAISER: return "kaiser";
+    default: return "lanczos";
+    }
+}
+
+// Builds the mip chain of an RGBA8 image offline. The color channels are sRGB encoded, so they are converted to
+// linear light before filtering and back afterwards, otherwise every level comes out darker than the one before
+// it; alpha is filtered as it is. Each level is resampled from the previous one in floating point with a
+// separable windowed sinc, so there is no rounding between the levels.
+class MipChain
+{
+public:
+    // levels receives level 0 (a copy of rgba) down to 1x1, or just level 0 if full isn't set
+    static void Build(const unsigned char *rgba, unsigned int width, unsigned int height, MipFilter filter, bool full, vector<vector<unsigned char> > &levels)
+    {
+        levels.clear();
+        levels.push_back(vector<unsigned char>(rgba, rgba + (size_t)width * height * 4));
+        if (!full || (width == 1 && height == 1))
+            return;
+
+        const float *toLinear = srgbToLinear();
+        vector<float> image((size_t)width * height * 4), next, temp;
+        for (size_t i = 0; i < image.size(); i++)
+            image[i] = i % 4 == 3 ? rgba[i] / 255.0f : toLinear[rgba[i]];
+        for (unsigned int w = width, h = height; w > 1 || h > 1; )
+        {
+            unsigned int nw = max(1u, w / 2), nh = max(1u, h / 2);
+            // horizontal then vertical, each pass only touches one axis
+            resample(image, w, h, nw, true, filter, temp);
+            resample(temp, nw, h, nh, false, filter, next);
+            image.swap(next);
+            w = nw;
+            h = nh;
+
+            vector<unsigned char> level((size_t)w * h * 4);
+            for (size_t i = 0; i < level.size(); i++)
+            {
+                float v = min(max(image[i], 0.0f), 1.0f);
+                level[i] = (unsigned char)((i % 4 == 3 ? v : linearToSrgb(v)) * 255.0f + 0.5f);
+            }
+            levels.push_back(level);
+        }
+    }
+
+private:
+    struct SrgbTable {
+        float linear[256];
+
+        SrgbTable()
+        {
+            for (unsigned int i = 0; i < 256; i++)
+            {
+                float c = i / 255.0f;
+                linear[i] = c <= 0.04045f ? c / 12.92f : pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+        }
+    };
+
+    // initialized once, thread safe
+    static const float *srgbToLinear()
+    {
+        static const SrgbTable table;
+        return table.linear;
+    }
+
+    static float linearToSrgb(float c)
+    {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    static float sinc(float x)
+    {
+        if (fabs(x) < 1e-5f)
+            return 1.0f;
+        x *= 3.14159265f;
+        return sin(x) / x;
+    }
+
+    // modified Bessel function of the first kind, order 0, for the Kaiser window
+    static float bessel0(float x)
+    {
+        float sum = 1.0f, term = 1.0f;
+        for (unsigned int k = 1; k < 32 && term > sum * 1e-8f; k++)
+        {
+            term *= (x / (2.0f * k)) * (x / (2.0f * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // half width of the kernel in destination pixels
+    static float support(MipFilter filter)
+    {
+        return filter == MIP_FILTER_BOX ? 0.5f : 3.0f;
+    }
+
+    static float kernel(MipFilter filter, float x)
+    {
+        x = fabs(x);
+        switch (filter)
+        {
+        case MIP_FILTER_BOX:
+            return x <= 0.5f ? 1.0f : 0.0f;
+        case MIP_FILTER_KAISER:
+        {
+            if (x >= 3.0f)
+                return 0.0f;
+            const float alpha = 4.0f;
+            float t = x / 3.0f;
+            return sinc(x) * bessel0(alpha * sqrt(1.0f - t * t)) / bessel0(alpha);
+        }
+        default:
+            return x < 3.0f ? sinc(x) * sinc(x / 3.0f) : 0.0f;
+        }
+    }
+
+    // resamples an RGBA float image along one axis from size to newSize pixels. The kernel is stretched by the
+    // scale factor, so it low-passes exactly what the smaller level can't represent; edges clamp.
+    static void resample(const vector<float> &src, unsigned int width, unsigned int height, unsigned int newSize, bool horizontal, MipFilter filter, vector<float> &dst)
+    {
+        unsigned int size = horizontal ? width : height;
+        unsigned int outWidth = horizontal ? newSize : width, outHeight = horizontal ? height : newSize;
+        dst.assign((size_t)outWidth * outHeight * 4, 0.0f);
+        float scale = (float)size / newSize;
+        float radius = support(filter) * scale;
+
+        // the taps of every destination pixel are the same for all rows (or columns), computed once
+        vector<int> first(newSize);
+        vector<vector<float> > weights(newSize);
+        for (unsigned int i = 0; i < newSize; i++)
+        {
+            float center = (i + 0.5f) * scale - 0.5f;
+            int begin = (int)ceil(center - radius), end = (int)floor(center + radius);
+            float total = 0.0f;
+            for (int j = begin; j <= end; j++)
+            {
+                float w = kernel(filter, (j - center) / scale);
+                weights[i].push_back(w);
+                total += w;
+            }
+            for (unsigned int k = 0; k < weights[i].size(); k++)
+                weights[i][k] /= total;
+            first[i] = begin;
+        }
+
+        unsigned int lines = horizontal ? height : width;
+        for (unsigned int line = 0; line < lines; line++)
+            for (unsigned int i = 0; i < newSize; i++)
+            {
+                float sum[4] = {};
+                for (unsigned int k = 0; k < weights[i].size(); k++)
+                {
+                    int j = min(max(first[i] + (int)k, 0), (int)size - 1);
+                    const float *p = horizontal ? &src[((size_t)line * width + j) * 4] : &src[((size_t)j * width + line) * 4];
+                    for (unsigned int c = 0; c < 4; c++)
+                        sum[c] += p[c] * weights[i][k];
+                }
+                float *q = horizontal ? &dst[((size_t)line * outWidth + i) * 4] : &dst[((size_t)i * outWidth + line) * 4];
+                for (unsigned int c = 0; c < 4; c++)
+                    q[c] = sum[c];
+            }
+    }
+};
+#endif
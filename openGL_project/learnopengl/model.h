@@ -5,13 +5,23 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "learnopengl/texture.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include "learnopengl/asset_io_system.h"
 
 #include "learnopengl/mesh.h"
+#include "learnopengl/mesh_arena.h"
+#include "learnopengl/material.h"
+#include "learnopengl/texture_streamer.h"
+#include "learnopengl/mesh_optimizer.h"
+#include "learnopengl/mesh_simplify.h"
+#include "learnopengl/animdata.h"
+#include "learnopengl/animation.h"
+#include "learnopengl/assimp_glm_helpers.h"
 #include "learnopengl/shader.h"
 
 #include <string>
@@ -20,30 +30,231 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <algorithm>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// per-instance level of detail state, remembers the level chosen last frame for the hysteresis
+struct LodState {
+    unsigned int level;
+
+    LodState() : level(0)
+    {
+    }
+};
+
+// a mesh as read from the model file and optimized, all of it that doesn't need the GL context
+struct MeshData {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<MeshLod> lods;
+    string textures[MATERIAL_TEXTURE_COUNT]; // file names relative to the model directory, empty for unused slots
+};
+
+// the meshes and bones of a model file, see Model::Prepare. Bone ids count from 0 in the order the meshes use
+// them; every model built from the data maps them to palette entries of its own.
+struct ModelData {
+    string directory;
+    vector<MeshData> meshes;
+    map<string, BoneInfo> boneInfoMap;
+    int boneCounter;
+
+    ModelData() : boneCounter(0)
+    {
+    }
+};
+
 class Model 
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    MaterialLibrary &materials;	// shared material table, also caches textures so they aren't loaded more than once.
+    MeshArena &arena;	// shared vertex and index buffers the meshes are uploaded to
     string directory;
     bool gammaCorrection;
+    // bounding sphere and box of the model in model space
+    glm::vec3 boundsCenter;
+    float boundsRadius;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // skeleton: palette entry of every bone that has vertices bound to it, and the clips stored in the model file
+    map<string, BoneInfo> boneInfoMap;
+    int boneCounter;
+    vector<Animation> animations;
+    // the model file and every file Assimp read for it, like OBJ material libraries
+    vector<string> files;
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // constructor, expects a filepath to a 3D model, the material library its materials are interned into and the
+    // arena its geometry goes to.
+    Model(string const &path, MaterialLibrary &materials, MeshArena &arena, bool gamma = false) : materials(materials), arena(arena), gammaCorrection(gamma), boundsCenter(0.0f), boundsRadius(0.0f), boundsMin(0.0f), boundsMax(0.0f), boneCounter(0)
     {
         loadModel(path);
+        computeBounds();
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // draws the model, and thus all its meshes. Meshes are kept sorted by material so a material is only bound once.
+    // lod selects the detail level, see SelectLod.
+    void Draw(Shader &shader, unsigned int lod = 0)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        {
+            if (i == 0 || meshes[i].materialIndex != meshes[i - 1].materialIndex)
+                materials.Bind(meshes[i].materialIndex, shader);
+            meshes[i].Draw(lod);
+        }
+    }
+
+    // draws only the geometry, without binding materials. Used by depth-only passes such as the shadow map.
+    void DrawGeometry(unsigned int lod = 0)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Draw(lod);
+    }
+
+    // draws count instances with the model matrices in instanceBuffer, see Mesh::DrawInstanced
+    void DrawInstanced(Shader &shader, unsigned int lod, unsigned int instanceBuffer, unsigned int firstInstance, unsigned int count)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (i == 0 || meshes[i].materialIndex != meshes[i - 1].materialIndex)
+                materials.Bind(meshes[i].materialIndex, shader);
+            meshes[i].DrawInstanced(lod, instanceBuffer, firstInstance, count);
+        }
+    }
+
+    // reads and post-processes a model file with Assimp, the part of loading that doesn't need the GL context, so
+    // it may run on any thread. The scene belongs to importer; nullptr if the file can't be read. The paths of the
+    // files read go to files.
+    static const aiScene *Import(Assimp::Importer &importer, string const &path, vector<string> &files)
+    {
+        // the model and its material library come through the asset file system, mapped or from an archive
+        importer.SetIOHandler(new AssetIOSystem(&files));
+        // identical vertices are joined so faces share them, otherwise there is nothing for the vertex cache to reuse
+        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_LimitBoneWeights);
+        // check for errors
+        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        {
+            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            return nullptr;
+        }
+        return scene;
+    }
+
+    // the rest of loading that doesn't need the GL context: extracts the meshes of a scene imported from path,
+    // optimizes them for the vertex cache and builds their detail levels. May run on any thread; the data can
+    // build any number of models loaded from path.
+    static void Prepare(const aiScene *scene, string const &path, ModelData &data)
+    {
+        data.directory = path.substr(0, path.find_last_of('/'));
+        processNode(scene->mRootNode, scene, data);
+    }
+
+    // replaces the meshes with those of the model file imported and prepared again (see Import and Prepare), for
+    // hot reloading. Bones keep their palette entries and take the new offsets, which the animation clips are
+    // updated with; the clips stay the ones first loaded, animators point at them. Skeletons built from the clips
+    // have to be built again. Returns false and keeps the old meshes if the data has none, or bones the model
+    // doesn't have, which the clips couldn't pose.
+    bool Reload(const ModelData &data, const vector<string> &sceneFiles)
+    {
+        if (data.meshes.empty())
+            return false;
+        for (map<string, BoneInfo>::const_iterator it = data.boneInfoMap.begin(); it != data.boneInfoMap.end(); ++it)
+            if (boneInfoMap.find(it->first) == boneInfoMap.end())
+            {
+                cout << "ERROR::MODEL:: " << directory << " gained the bone " << it->first << ", restart to load it" << endl;
+                return false;
+            }
+        vector<Mesh> previous;
+        previous.swap(meshes);
+        build(data);
+        for (unsigned int i = 0; i < previous.size(); i++)
+            previous[i].Release();
+        for (unsigned int i = 0; i < animations.size(); i++)
+            animations[i].UpdateBones(boneInfoMap);
+        files = sceneFiles;
+        computeBounds();
+        return true;
+    }
+
+    // frees the geometry of all meshes in the arena, the model can't be drawn afterwards
+    void Release()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Release();
+    }
+
+    // bounding sphere of the model placed with the given transform
+    void WorldBounds(const glm::mat4 &model, glm::vec3 &center, float &radius) const
+    {
+        center = glm::vec3(model * glm::vec4(boundsCenter, 1.0f));
+        float scale = max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        radius = boundsRadius * scale;
+    }
+
+    bool HasSkeleton() const
+    {
+        return boneCounter > 0;
+    }
+
+    // number of detail levels every mesh of the model provides
+    unsigned int LodCount() const
+    {
+        unsigned int count = MAX_LODS;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            count = min(count, (unsigned int)meshes[i].lods.size());
+        return meshes.empty() ? 1 : count;
+    }
+
+    // simplification error of a level relative to the model extent, the worst of all meshes
+    float LodError(unsigned int lod) const
+    {
+        float error = 0.0f;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            error = max(error, meshes[i].lods[min(lod, (unsigned int)meshes[i].lods.size() - 1)].error);
+        return error;
+    }
+
+    // projected diameter of the bounding sphere in pixels, placed with model and seen from viewPos
+    float ProjectedSize(const glm::mat4 &model, const glm::vec3 &viewPos, float fovy, float screenHeight) const
+    {
+        glm::vec3 center;
+        float radius;
+        WorldBounds(model, center, radius);
+        float distance = max(glm::length(center - viewPos) - radius, 0.001f);
+        return radius / (distance * tan(fovy * 0.5f)) * screenHeight;
+    }
+
+    // tells the streamer the model is drawn at projectedSize pixels this frame, so its textures get the levels
+    // they need
+    void RequestTextures(TextureStreamer &streamer, float projectedSize) const
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            streamer.Request(meshes[i].materialIndex, projectedSize);
+    }
+
+    // picks the coarsest detail level whose error stays below LOD_PIXEL_ERROR pixels at the projected size of the
+    // model. fovy is the vertical field of view in radians and screenHeight the viewport height in pixels.
+    unsigned int SelectLod(const glm::mat4 &model, const glm::vec3 &viewPos, float fovy, float screenHeight, LodState &state) const
+    {
+        float projectedSize = ProjectedSize(model, viewPos, fovy, screenHeight);
+        unsigned int count = LodCount();
+        if (state.level >= count)
+            state.level = count - 1;
+        if (LodError(state.level) * projectedSize > LOD_PIXEL_ERROR)
+        {
+            // the current level got too coarse, go finer right away
+            while (state.level > 0 && LodError(state.level) * projectedSize > LOD_PIXEL_ERROR)
+                state.level--;
+        }
+        else
+        {
+            // only go coarser once the coarser level is LOD_HYSTERESIS below the threshold
+            while (state.level + 1 < count && LodError(state.level + 1) * projectedSize <= LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS))
+                state.level++;
+        }
+        return state.level;
     }
     
 private:
@@ -52,22 +263,115 @@ private:
     {
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        const aiScene* scene = Import(importer, path, files);
+        if (!scene)
             return;
-        }
+        ModelData data;
+        Prepare(scene, path, data);
         // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        directory = data.directory;
+        build(data);
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // animation clips stored with the mesh
+        for (unsigned int i = 0; i < scene->mNumAnimations; i++)
+            animations.push_back(Animation(scene, i, boneInfoMap));
+    }
+
+    // the GL part of loading: uploads the prepared meshes to the arena and interns their materials, loading the
+    // textures the library doesn't have yet
+    void build(const ModelData &data)
+    {
+        vector<int> boneIds = mapBones(data);
+        for (unsigned int i = 0; i < data.meshes.size(); i++)
+        {
+            const MeshData &mesh = data.meshes[i];
+            vector<Vertex> vertices = mesh.vertices;
+            remapBones(vertices, boneIds);
+            // every texture type maps to a fixed slot of the material, and the shaders sample each slot through the
+            // sampler named after it (see MATERIAL_SAMPLER_NAMES)
+            Material mat;
+            for (unsigned int t = 0; t < MATERIAL_TEXTURE_COUNT; t++)
+                mat.textures[t] = loadMaterialTexture(mesh.textures[t]);
+            meshes.push_back(Mesh(vertices, mesh.indices, materials.Intern(mat), arena, mesh.lods));
+        }
+        // group the meshes by material so drawing the model switches materials as rarely as possible
+        stable_sort(meshes.begin(), meshes.end(), [](const Mesh &a, const Mesh &b) { return a.materialIndex < b.materialIndex; });
+    }
+
+    // the palette entry of every bone of data, taken from boneInfoMap, whose offset is updated, or added to it; -1
+    // for bones past MAX_BONES. Bones are added in the order of their ids in data, so the first model built from
+    // it gets the same ids.
+    vector<int> mapBones(const ModelData &data)
+    {
+        vector<map<string, BoneInfo>::const_iterator> bones(data.boneCounter);
+        for (map<string, BoneInfo>::const_iterator it = data.boneInfoMap.begin(); it != data.boneInfoMap.end(); ++it)
+            bones[it->second.id] = it;
+        vector<int> ids(data.boneCounter, -1);
+        for (int i = 0; i < data.boneCounter; i++)
+        {
+            map<string, BoneInfo>::iterator it = boneInfoMap.find(bones[i]->first);
+            if (it != boneInfoMap.end())
+            {
+                ids[i] = it->second.id;
+                it->second.offset = bones[i]->second.offset;
+            }
+            else if (boneCounter < MAX_BONES)
+            {
+                BoneInfo newBoneInfo;
+                newBoneInfo.id = boneCounter;
+                newBoneInfo.offset = bones[i]->second.offset;
+                boneInfoMap[bones[i]->first] = newBoneInfo;
+                ids[i] = boneCounter;
+                boneCounter++;
+            }
+            else
+                cout << "ERROR::MODEL:: " << directory << " has more than " << MAX_BONES << " bones, " << bones[i]->first << " is ignored" << endl;
+        }
+        return ids;
+    }
+
+    // moves the bone ids of the vertices from those of the data to the palette entries of this model
+    static void remapBones(vector<Vertex> &vertices, const vector<int> &ids)
+    {
+        bool dropped = false;
+        for (unsigned int i = 0; i < vertices.size(); i++)
+            for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                if (vertices[i].m_BoneIDs[j] >= 0)
+                {
+                    vertices[i].m_BoneIDs[j] = ids[vertices[i].m_BoneIDs[j]];
+                    if (vertices[i].m_BoneIDs[j] < 0)
+                    {
+                        vertices[i].m_Weights[j] = 0.0f;
+                        dropped = true;
+                    }
+                }
+        if (dropped)
+            normalizeBoneWeights(vertices);
+    }
+
+    // bounding sphere around the centre of the bounding box of all vertices
+    void computeBounds()
+    {
+        if (meshes.empty() || meshes[0].vertices.empty())
+            return;
+        glm::vec3 minimum = meshes[0].vertices[0].Position, maximum = minimum;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            for (unsigned int j = 0; j < meshes[i].vertices.size(); j++)
+            {
+                minimum = glm::min(minimum, meshes[i].vertices[j].Position);
+                maximum = glm::max(maximum, meshes[i].vertices[j].Position);
+            }
+        boundsMin = minimum;
+        boundsMax = maximum;
+        boundsCenter = (minimum + maximum) * 0.5f;
+        boundsRadius = 0.0f;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            for (unsigned int j = 0; j < meshes[i].vertices.size(); j++)
+                boundsRadius = max(boundsRadius, glm::length(meshes[i].vertices[j].Position - boundsCenter));
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    static void processNode(aiNode *node, const aiScene *scene, ModelData &data)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -75,22 +379,22 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            data.meshes.push_back(processMesh(mesh, scene, data));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, data);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    static MeshData processMesh(aiMesh *mesh, const aiScene *scene, ModelData &data)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData result;
+        vector<Vertex> &vertices = result.vertices;
+        vector<unsigned int> &indices = result.indices;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -132,6 +436,7 @@ private:
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            setVertexBoneDataToDefault(vertex);
 
             vertices.push_back(vertex);
         }
@@ -143,104 +448,135 @@ private:
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);        
         }
+        // bone weights have to be in place before the optimizer reorders the vertices
+        extractBoneWeightForVertices(vertices, mesh, data);
+        // reorder triangles for the post-transform vertex cache and overdraw, and vertices for fetch locality
+        float acmrBefore = MeshOptimizer::ACMR(indices, (unsigned int)vertices.size());
+        MeshOptimizer::Optimize(vertices, indices);
+        cout << "MESH_OPTIMIZER:: " << data.directory << "/" << mesh->mName.C_Str() << " ACMR " << acmrBefore << " -> " << MeshOptimizer::ACMR(indices, (unsigned int)vertices.size()) << endl;
+        // simplified detail levels are appended to the same index buffer
+        result.lods = MeshSimplifier::GenerateLods(vertices, indices);
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
-        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-        // Same applies to other texture as the following list summarizes:
-        // diffuse: texture_diffuseN
-        // specular: texture_specularN
-        // normal: texture_normalN
-
-        // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-        
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
-    }
-
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
-    {
-        vector<Texture> textures;
-        for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
-        {
-            aiString str;
-            mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        // the texture of each slot, the shaders sample them as
+        // diffuse: texture_diffuse1
+        // specular: texture_specular1
+        // normal: texture_normal1
+        // height: texture_height1
+        result.textures[MATERIAL_DIFFUSE] = materialTexture(material, aiTextureType_DIFFUSE);
+        result.textures[MATERIAL_SPECULAR] = materialTexture(material, aiTextureType_SPECULAR);
+        result.textures[MATERIAL_NORMAL] = materialTexture(material, aiTextureType_HEIGHT);
+        result.textures[MATERIAL_HEIGHT] = materialTexture(material, aiTextureType_AMBIENT);
+        return result;
+    }
+
+    // vertices without bones keep all weights at 0, the skinning shaders leave them in place
+    static void setVertexBoneDataToDefault(Vertex &vertex)
+    {
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        {
+            vertex.m_BoneIDs[i] = -1;
+            vertex.m_Weights[i] = 0.0f;
+        }
+    }
+
+    static void setVertexBoneData(Vertex &vertex, int boneID, float weight)
+    {
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        {
+            if (vertex.m_BoneIDs[i] < 0)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                vertex.m_BoneIDs[i] = boneID;
+                vertex.m_Weights[i] = weight;
+                return;
+            }
+        }
+    }
+
+    // assigns every bone of the mesh a palette entry (bones shared by several meshes get one entry) and stores the
+    // bone weights in the vertices. aiProcess_LimitBoneWeights already dropped all but the strongest influences.
+    static void extractBoneWeightForVertices(vector<Vertex> &vertices, aiMesh *mesh, ModelData &data)
+    {
+        for (unsigned int boneIndex = 0; boneIndex < mesh->mNumBones; boneIndex++)
+        {
+            const aiBone *bone = mesh->mBones[boneIndex];
+            string boneName = bone->mName.C_Str();
+            int boneID;
+            map<string, BoneInfo>::iterator it = data.boneInfoMap.find(boneName);
+            if (it == data.boneInfoMap.end())
+            {
+                if (data.boneCounter >= MAX_BONES)
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
+                    cout << "ERROR::MODEL:: " << data.directory << " has more than " << MAX_BONES << " bones, " << boneName << " is ignored" << endl;
+                    continue;
                 }
+                BoneInfo newBoneInfo;
+                newBoneInfo.id = data.boneCounter;
+                newBoneInfo.offset = AssimpGLMHelpers::ConvertMatrixToGLMFormat(bone->mOffsetMatrix);
+                data.boneInfoMap[boneName] = newBoneInfo;
+                boneID = data.boneCounter;
+                data.boneCounter++;
             }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+            else
+                boneID = it->second.id;
+
+            for (unsigned int weightIndex = 0; weightIndex < bone->mNumWeights; weightIndex++)
+            {
+                unsigned int vertexId = bone->mWeights[weightIndex].mVertexId;
+                if (vertexId < vertices.size())
+                    setVertexBoneData(vertices[vertexId], boneID, bone->mWeights[weightIndex].mWeight);
             }
         }
-        return textures;
+        normalizeBoneWeights(vertices);
     }
-};
-
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
-{
-    string filename = string(path);
-    filename = directory + '/' + filename;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    // the shader blends the bone matrices, so the weights of a vertex must add up to 1
+    static void normalizeBoneWeights(vector<Vertex> &vertices)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        for (unsigned int i = 0; i < vertices.size(); i++)
+        {
+            float total = 0.0f;
+            for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                total += vertices[i].m_Weights[j];
+            if (total > 0.0f)
+                for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                    vertices[i].m_Weights[j] /= total;
+        }
+    }
 
-        stbi_image_free(data);
+    // file name of the first texture of the given type of a material, empty when it has none
+    static string materialTexture(aiMaterial *mat, aiTextureType type)
+    {
+        if (mat->GetTextureCount(type) == 0)
+            return string();
+        aiString str;
+        mat->GetTexture(type, 0, &str);
+        return string(str.C_Str());
     }
-    else
+
+    // loads a texture of the model directory, unless the library already has it.
+    // returns the texture id, or 0 for an empty file name.
+    unsigned int loadMaterialTexture(const string &name)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        if (name.empty())
+            return 0;
+        string path = directory + '/' + name;
+        // check if texture was loaded before, by this or any other model
+        unsigned int id = materials.FindTexture(path);
+        if (id == 0)
+        {
+            // mip levels streamed in as the model comes closer, if the library has a streamer attached
+            id = materials.streamer ? materials.streamer->Load(path) : TextureFromFile(name.c_str(), this->directory, gammaCorrection);
+            materials.AddTexture(path, id);
+        }
+        return id;
     }
+};
+
 
-    return textureID;
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+{
+    // block compressed and cached by the texture loader when the driver allows it
+    return LoadTexture2D(directory + '/' + string(path));
 }
 #endif
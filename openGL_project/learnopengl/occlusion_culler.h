@@ -0,0 +1,311 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "learnopengl/model.h"
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+using namespace std;
+
+// knobs of the software occlusion buffer
+struct OcclusionSettings {
+    bool enabled;
+    unsigned int width, height;  // of the depth buffer the occluders are rasterized into
+    unsigned int maxOccluders;   // nearest instances rasterized per frame
+    float minOccluderPixels;     // instances whose bounding sphere projects smaller (radius, screen pixels) don't occlude
+
+    OcclusionSettings() : enabled(false), width(320), height(180), maxOccluders(64), minOccluderPixels(24.0f)
+    {
+    }
+};
+
+// counts and timings of the last frame
+struct OcclusionStats {
+    unsigned int occluders;  // instances rasterized
+    unsigned int triangles;  // occluder triangles that reached the rasterizer
+    unsigned int tested;     // bounding spheres tested against the pyramid, counted by the caller
+    unsigned int culled;     // of those, hidden behind the occluders
+    float rasterizeMs;       // clearing, rasterizing and building the pyramid
+
+    OcclusionStats() : occluders(0), triangles(0), tested(0), culled(0), rasterizeMs(0.0f)
+    {
+    }
+};
+
+// Hierarchical-Z occlusion culling on the CPU. The nearest, largest instances are rasterized as occluders into a
+// small depth buffer, which is reduced into a pyramid whose every texel holds the farthest depth of the four
+// below it. A bounding sphere is hidden when its nearest depth lies behind the farthest depth of the at most 2x2
+// pyramid texels its screen rectangle covers, so a test costs the same whatever the size of the sphere.
+// Occluders cover the pixels whose centers they cover and write the farthest depth they reach inside a pixel;
+// triangles that cross the near plane are left out. Nothing needs the GPU, so it works headless, see
+// OcclusionBenchmark. Visible only reads, it may be called from any number of threads once Finish returned.
+class OcclusionCuller
+{
+public:
+    OcclusionSettings settings;
+    OcclusionStats stats;
+
+    OcclusionCuller() : viewProjection(1.0f), width(1), height(1), levelCount(0)
+    {
+    }
+
+    // clears the depth buffer for a new frame seen through viewProjection
+    void Begin(const glm::mat4 &viewProjection)
+    {
+        start = chrono::high_resolution_clock::now();
+        this->viewProjection = viewProjection;
+        stats = OcclusionStats();
+        width = max(settings.width, 1u);
+        height = max(settings.height, 1u);
+        levelCount = 1;
+        if (levels.empty())
+            levels.resize(1);
+        levels[0].width = width;
+        levels[0].height = height;
+        levels[0].depth.assign((size_t)width * height, 1.0f);
+    }
+
+    // rasterizes a detail level of the model placed with transform
+    void AddOccluder(const Model &model, unsigned int lod, const glm::mat4 &transform)
+    {
+        glm::mat4 mvp = viewProjection * transform;
+        for (unsigned int m = 0; m < model.meshes.size(); m++)
+        {
+            const Mesh &mesh = model.meshes[m];
+            const MeshLod &level = mesh.Lod(lod);
+            for (unsigned int i = level.indexOffset; i + 2 < level.indexOffset + level.indexCount; i += 3)
+            {
+                glm::vec4 clip[3];
+                for (unsigned int k = 0; k < 3; k++)
+                    clip[k] = mvp * glm::vec4(mesh.vertices[mesh.indices[i + k]].Position, 1.0f);
+                rasterize(clip);
+            }
+        }
+        stats.occluders++;
+    }
+
+    // rasterizes a triangle given in world space
+    void AddTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+    {
+        glm::vec4 clip[3] = { viewProjection * glm::vec4(a, 1.0f), viewProjection * glm::vec4(b, 1.0f), viewProjection * glm::vec4(c, 1.0f) };
+        rasterize(clip);
+    }
+
+    // builds the pyramid over the occluders added since Begin
+    void Finish()
+    {
+        // the levels are kept from frame to frame, only their contents are rebuilt
+        while (levels[levelCount - 1].width > 1 || levels[levelCount - 1].height > 1)
+        {
+            if (levels.size() == levelCount)
+                levels.push_back(Level());
+            const Level &below = levels[levelCount - 1];
+            Level &level = levels[levelCount];
+            level.width = (below.width + 1) / 2;
+            level.height = (below.height + 1) / 2;
+            level.depth.resize((size_t)level.width * level.height);
+            for (unsigned int y = 0; y < level.height; y++)
+                for (unsigned int x = 0; x < level.width; x++)
+                {
+                    // an odd row or column is folded into the last texel
+                    unsigned int x0 = x * 2, y0 = y * 2;
+                    unsigned int x1 = min(x0 + 1, below.width - 1), y1 = min(y0 + 1, below.height - 1);
+                    level.depth[(size_t)y * level.width + x] = max(max(below.At(x0, y0), below.At(x1, y0)), max(below.At(x0, y1), below.At(x1, y1)));
+                }
+            levelCount++;
+        }
+        stats.rasterizeMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // false if the sphere is hidden behind the occluders. Spheres reaching the near plane or beyond the sides of
+    // the view count as visible, frustum culling is left to the caller.
+    bool Visible(const glm::vec3 &center, float radius) const
+    {
+        if (levelCount == 0)
+            return true;
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1e30f;
+        for (unsigned int i = 0; i < 8; i++)
+        {
+            glm::vec3 corner = center + glm::vec3((i & 1) ? radius : -radius, (i & 2) ? radius : -radius, (i & 4) ? radius : -radius);
+            glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+            if (clip.w <= 1e-5f || clip.z < -clip.w)
+                return true;
+            float invW = 1.0f / clip.w;
+            float x = (clip.x * invW * 0.5f + 0.5f) * width, y = (clip.y * invW * 0.5f + 0.5f) * height;
+            minX = min(minX, x);
+            maxX = max(maxX, x);
+            minY = min(minY, y);
+            maxY = max(maxY, y);
+            nearest = min(nearest, clip.z * invW * 0.5f + 0.5f);
+        }
+        if (minX < 0.0f || minY < 0.0f || maxX >= (float)width || maxY >= (float)height)
+            return true;
+
+        // the level where the rectangle spans at most two texels either way
+        unsigned int x0 = (unsigned int)minX, y0 = (unsigned int)minY, x1 = (unsigned int)maxX, y1 = (unsigned int)maxY;
+        unsigned int level = 0;
+        while (level + 1 < levelCount && (x1 - x0 > 1 || y1 - y0 > 1))
+        {
+            x0 >>= 1; y0 >>= 1; x1 >>= 1; y1 >>= 1;
+            level++;
+        }
+        const Level &pyramid = levels[level];
+        float farthest = 0.0f;
+        for (unsigned int y = y0; y <= y1; y++)
+            for (unsigned int x = x0; x <= x1; x++)
+                farthest = max(farthest, pyramid.At(x, y));
+        return nearest <= farthest;
+    }
+
+private:
+    struct Level {
+        unsigned int width, height;
+        vector<float> depth; // row major, 0 near to 1 far
+
+        float At(unsigned int x, unsigned int y) const
+        {
+            return depth[(size_t)y * width + x];
+        }
+    };
+
+    glm::mat4 viewProjection;
+    unsigned int width, height;
+    vector<Level> levels; // level 0 is the depth buffer, every further level halves it
+    unsigned int levelCount; // of levels, built for the current frame
+    chrono::high_resolution_clock::time_point start;
+
+    void rasterize(const glm::vec4 clip[3])
+    {
+        // what crosses the near plane is dropped, leaving a hole is safe
+        for (unsigned int k = 0; k < 3; k++)
+            if (clip[k].w <= 1e-5f || clip[k].z < -clip[k].w)
+                return;
+        glm::vec3 p[3];
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            float invW = 1.0f / clip[k].w;
+            p[k] = glm::vec3((clip[k].x * invW * 0.5f + 0.5f) * width, (clip[k].y * invW * 0.5f + 0.5f) * height, clip[k].z * invW * 0.5f + 0.5f);
+        }
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        if (fabs(area) < 1e-8f)
+            return;
+        // both windings occlude, the models aren't guaranteed to be consistent
+        if (area < 0.0f)
+        {
+            swap(p[1], p[2]);
+            area = -area;
+        }
+        int minX = max((int)floor(min(p[0].x, min(p[1].x, p[2].x))), 0);
+        int maxX = min((int)ceil(max(p[0].x, max(p[1].x, p[2].x))), (int)width - 1);
+        int minY = max((int)floor(min(p[0].y, min(p[1].y, p[2].y))), 0);
+        int maxY = min((int)ceil(max(p[0].y, max(p[1].y, p[2].y))), (int)height - 1);
+        if (minX > maxX || minY > maxY)
+            return;
+        stats.triangles++;
+
+        // edge functions and the depth plane, stepped per pixel; a pixel takes the farthest depth the plane has
+        // inside it, never closer than the triangle's nearest vertex allows
+        float e0x = p[1].y - p[2].y, e0y = p[2].x - p[1].x;
+        float e1x = p[2].y - p[0].y, e1y = p[0].x - p[2].x;
+        float e2x = p[0].y - p[1].y, e2y = p[1].x - p[0].x;
+        float zx = (e0x * p[0].z + e1x * p[1].z + e2x * p[2].z) / area;
+        float zy = (e0y * p[0].z + e1y * p[1].z + e2y * p[2].z) / area;
+        float zSlack = 0.5f * (fabs(zx) + fabs(zy));
+        float zMax = max(p[0].z, max(p[1].z, p[2].z));
+        vector<float> &depth = levels[0].depth;
+        for (int y = minY; y <= maxY; y++)
+        {
+            float py = y + 0.5f;
+            float px = minX + 0.5f;
+            float w0 = (px - p[1].x) * e0x + (py - p[1].y) * e0y;
+            float w1 = (px - p[2].x) * e1x + (py - p[2].y) * e1y;
+            float w2 = (px - p[0].x) * e2x + (py - p[0].y) * e2y;
+            float z = p[0].z + (px - p[0].x) * zx + (py - p[0].y) * zy + zSlack;
+            float *row = &depth[(size_t)y * width];
+            for (int x = minX; x <= maxX; x++, w0 += e0x, w1 += e1x, w2 += e2x, z += zx)
+            {
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+                row[x] = min(row[x], min(z, zMax));
+            }
+        }
+    }
+};
+
+// Rasterizes a wall of quads in front of a field of spheres and checks the culler against the exact answer: a
+// sphere whose screen rectangle lies inside the wall's and which is behind it must be culled to count as found,
+// a culled sphere in front of the wall or beside it is an error. Prints the rates and the time per test.
+class OcclusionBenchmark
+{
+public:
+    static void Run()
+    {
+        OcclusionCuller culler;
+        culler.settings.enabled = true;
+        glm::vec3 eye(0.0f, 2.0f, 20.0f);
+        glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f) * view;
+
+        const int runs = 20;
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < runs; r++)
+        {
+            culler.Begin(viewProjection);
+            // the wall, x -6..6 and y -2..6 at z = 10, as a grid of quads like a row of occluders
+            for (int y = -2; y < 6; y++)
+                for (int x = -6; x < 6; x++)
+                {
+                    glm::vec3 a(x, y, 10.0f), b(x + 1, y, 10.0f), c(x + 1, y + 1, 10.0f), d(x, y + 1, 10.0f);
+                    culler.AddTriangle(a, b, c);
+                    culler.AddTriangle(a, c, d);
+                }
+            culler.Finish();
+        }
+        float rasterizeMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count() / runs;
+
+        unsigned int spheres = 0, hidden = 0, culled = 0, wrong = 0;
+        start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < runs; r++)
+            for (int z = -40; z < 18; z++)
+                for (int x = -40; x <= 40; x++)
+                {
+                    glm::vec3 center(x * 0.5f, 2.0f, z * 0.5f);
+                    float radius = 0.2f;
+                    bool visible = culler.Visible(center, radius);
+                    if (r > 0)
+                        continue;
+                    spheres++;
+                    bool behind = center.z + radius < 10.0f && hiddenByWall(eye, center, radius);
+                    hidden += behind;
+                    culled += !visible;
+                    wrong += !visible && !behind;
+                }
+        float testNs = chrono::duration<float, nano>(chrono::high_resolution_clock::now() - start).count() / (runs * spheres);
+        printf("OCCLUSION:: %ux%u buffer, %u triangles rasterized and reduced in %.3f ms, %.1f ns per sphere test\n",
+            culler.settings.width, culler.settings.height, culler.stats.triangles, rasterizeMs, testNs);
+        printf("OCCLUSION:: %u spheres, %u hidden behind the wall, %u culled (%.1f%% found), %u culled wrongly\n",
+            spheres, hidden, culled, hidden > 0 ? 100.0f * (culled - wrong) / hidden : 100.0f, wrong);
+    }
+
+private:
+    // true if every ray from the eye to the sphere's bounding box hits the wall
+    static bool hiddenByWall(const glm::vec3 &eye, const glm::vec3 &center, float radius)
+    {
+        for (unsigned int i = 0; i < 8; i++)
+        {
+            glm::vec3 corner = center + glm::vec3((i & 1) ? radius : -radius, (i & 2) ? radius : -radius, (i & 4) ? radius : -radius);
+            float t = (10.0f - eye.z) / (corner.z - eye.z);
+            glm::vec3 hit = eye + t * (corner - eye);
+            if (hit.x < -6.0f || hit.x > 6.0f || hit.y < -2.0f || hit.y > 6.0f)
+                return false;
+        }
+        return true;
+    }
+};
+#endif
@@ -0,0 +1,140 @@
+#ifndef POSE_H
+#define POSE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "learnopengl/animdata.h"
+#include "learnopengl/animation.h"
+
+#include <vector>
+#include <cmath>
+using namespace std;
+
+// Structure of arrays form of a skeleton and its poses, for evaluating many instances at once. Every array is
+// indexed by joint, joints are stored parents first (the order of Animation::nodes).
+struct Skeleton {
+    vector<int> parents;          // -1 for the root
+    vector<int> boneIds;          // palette entry, -1 for joints no vertex is bound to
+    vector<glm::mat4> offsets;    // BoneInfo::offset of the palette entry
+    vector<glm::vec3> bindTranslations; // local bind pose, used for joints a clip has no keys for
+    vector<glm::quat> bindRotations;
+    vector<glm::vec3> bindScales;
+    glm::mat4 globalInverseTransform;
+    int paletteSize;              // highest boneId + 1
+
+    Skeleton() : globalInverseTransform(1.0f), paletteSize(0)
+    {
+    }
+
+    // takes the hierarchy of a clip. Clips read from the same file share it.
+    explicit Skeleton(const Animation &animation) : globalInverseTransform(animation.globalInverseTransform), paletteSize(0)
+    {
+        for (unsigned int i = 0; i < animation.nodes.size(); i++)
+        {
+            const AnimationNode &node = animation.nodes[i];
+            parents.push_back(node.parent);
+            boneIds.push_back(node.boneId < MAX_BONES ? node.boneId : -1);
+            offsets.push_back(node.offset);
+            paletteSize = max(paletteSize, boneIds.back() + 1);
+            // split the bind transform into translation, rotation and scale, the nodes don't carry shear
+            glm::mat4 m = node.transformation;
+            glm::vec3 scale(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2])));
+            glm::mat3 rotation(glm::vec3(m[0]) / scale.x, glm::vec3(m[1]) / scale.y, glm::vec3(m[2]) / scale.z);
+            bindTranslations.push_back(glm::vec3(m[3]));
+            bindRotations.push_back(glm::normalize(glm::quat_cast(rotation)));
+            bindScales.push_back(scale);
+        }
+    }
+
+    unsigned int JointCount() const
+    {
+        return (unsigned int)parents.size();
+    }
+};
+
+// local joint transforms of one instance
+struct Pose {
+    vector<glm::vec3> translations;
+    vector<glm::quat> rotations;
+    vector<glm::vec3> scales;
+
+    void Resize(unsigned int jointCount)
+    {
+        translations.resize(jointCount);
+        rotations.resize(jointCount);
+        scales.resize(jointCount);
+    }
+};
+
+// the stages of pose evaluation. Each one loops over the joint arrays of a single instance, so instances can be
+// spread over threads without any sharing.
+class PoseEvaluator
+{
+public:
+    // samples a clip at the given time in ticks. The clip must come from the file the skeleton was built from.
+    static void Sample(const Skeleton &skeleton, const Animation &animation, float animationTime, Pose &pose)
+    {
+        unsigned int count = skeleton.JointCount();
+        pose.Resize(count);
+        bool sameHierarchy = animation.nodes.size() == count;
+        for (unsigned int j = 0; j < count; j++)
+        {
+            int bone = sameHierarchy ? animation.nodes[j].bone : -1;
+            if (bone >= 0)
+            {
+                const Bone &channel = animation.bones[bone];
+                pose.translations[j] = channel.SamplePosition(animationTime);
+                pose.rotations[j] = channel.SampleRotation(animationTime);
+                pose.scales[j] = channel.SampleScale(animationTime);
+            }
+            else
+            {
+                pose.translations[j] = skeleton.bindTranslations[j];
+                pose.rotations[j] = skeleton.bindRotations[j];
+                pose.scales[j] = skeleton.bindScales[j];
+            }
+        }
+    }
+
+    // pose = mix(pose, other, weight). Rotations are blended along the shorter arc and renormalized (nlerp).
+    static void Blend(Pose &pose, const Pose &other, float weight)
+    {
+        for (unsigned int j = 0; j < pose.translations.size(); j++)
+        {
+            pose.translations[j] = glm::mix(pose.translations[j], other.translations[j], weight);
+            pose.scales[j] = glm::mix(pose.scales[j], other.scales[j], weight);
+            glm::quat a = pose.rotations[j], b = other.rotations[j];
+            if (glm::dot(a, b) < 0.0f)
+                b = -b;
+            pose.rotations[j] = glm::normalize(a * (1.0f - weight) + b * weight);
+        }
+    }
+
+    // converts the local pose to model space transforms, one per joint
+    static void LocalToModel(const Skeleton &skeleton, const Pose &pose, glm::mat4 *modelTransforms)
+    {
+        for (unsigned int j = 0; j < skeleton.JointCount(); j++)
+        {
+            glm::mat4 local = glm::mat4_cast(pose.rotations[j]);
+            local[0] *= pose.scales[j].x;
+            local[1] *= pose.scales[j].y;
+            local[2] *= pose.scales[j].z;
+            local[3] = glm::vec4(pose.translations[j], 1.0f);
+            int parent = skeleton.parents[j];
+            modelTransforms[j] = parent >= 0 ? modelTransforms[parent] * local : local;
+        }
+    }
+
+    // writes the skinning matrices of the bound joints into a palette of skeleton.paletteSize matrices
+    static void WritePalette(const Skeleton &skeleton, const glm::mat4 *modelTransforms, glm::mat4 *palette)
+    {
+        for (unsigned int j = 0; j < skeleton.JointCount(); j++)
+        {
+            int boneId = skeleton.boneIds[j];
+            if (boneId >= 0)
+                palette[boneId] = skeleton.globalInverseTransform * modelTransforms[j] * skeleton.offsets[j];
+        }
+    }
+};
+#endif
@@ -0,0 +1,383 @@
+#ifndef RANGE_ALLOCATOR_H
+#define RANGE_ALLOCATOR_H
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+using namespace std;
+
+// returned by RangeAllocator::Allocate when no free range is big enough
+#define RANGE_ALLOCATOR_NONE 0xffffffffu
+
+// Two-level segregated fit (TLSF) allocator of ranges in [0, capacity). It only does the bookkeeping, the
+// units are whatever the caller stores: vertices of a vertex buffer, indices of an index buffer. Free ranges
+// are kept in lists by size class, 16 classes per power of two, with a bitmap of the non-empty lists, so
+// allocating and freeing take constant time no matter how many ranges there are. Freed ranges merge with free
+// neighbours right away. An allocation is identified by the id Allocate returns until it is freed.
+class RangeAllocator
+{
+public:
+    RangeAllocator(unsigned int capacity = 0)
+    {
+        Reset(capacity);
+    }
+
+    // forgets every allocation, the whole capacity becomes one free range
+    void Reset(unsigned int capacity)
+    {
+        blocks.clear();
+        unusedBlocks.clear();
+        flBitmap = 0;
+        for (unsigned int fl = 0; fl < FL_COUNT; fl++)
+        {
+            slBitmap[fl] = 0;
+            for (unsigned int sl = 0; sl < SL_COUNT; sl++)
+                heads[fl][sl] = RANGE_ALLOCATOR_NONE;
+        }
+        this->capacity = 0;
+        used = 0;
+        freeBlocks = 0;
+        last = RANGE_ALLOCATOR_NONE;
+        Grow(capacity);
+    }
+
+    // reserves size units, returns the id of the allocation or RANGE_ALLOCATOR_NONE
+    unsigned int Allocate(unsigned int size)
+    {
+        size = max(size, 1u);
+        unsigned int block = RANGE_ALLOCATOR_NONE;
+        // round the size up to the next class, so the head of any list at or above it is big enough
+        unsigned int search = size;
+        if (search >= SL_COUNT)
+        {
+            unsigned int round = (1u << (log2(search) - SL_BITS)) - 1;
+            search = search <= 0xffffffffu - round ? search + round : 0;
+        }
+        if (search != 0)
+        {
+            unsigned int fl, sl;
+            mapping(search, fl, sl);
+            block = findSuitable(fl, sl);
+        }
+        if (block == RANGE_ALLOCATOR_NONE)
+        {
+            // the class of the exact size may still hold a range that fits, e.g. the last one left
+            unsigned int fl, sl;
+            mapping(size, fl, sl);
+            for (unsigned int b = heads[fl][sl]; b != RANGE_ALLOCATOR_NONE; b = blocks[b].nextFree)
+                if (blocks[b].size >= size)
+                {
+                    block = b;
+                    break;
+                }
+            if (block == RANGE_ALLOCATOR_NONE)
+                return RANGE_ALLOCATOR_NONE;
+        }
+
+        removeFree(block);
+        if (blocks[block].size > size)
+        {
+            // the rest of the range stays free
+            unsigned int rest = newBlock();
+            blocks[rest].offset = blocks[block].offset + size;
+            blocks[rest].size = blocks[block].size - size;
+            blocks[rest].prevPhys = block;
+            blocks[rest].nextPhys = blocks[block].nextPhys;
+            if (blocks[rest].nextPhys != RANGE_ALLOCATOR_NONE)
+                blocks[blocks[rest].nextPhys].prevPhys = rest;
+            else
+                last = rest;
+            blocks[block].nextPhys = rest;
+            blocks[block].size = size;
+            insertFree(rest);
+        }
+        used += size;
+        return block;
+    }
+
+    // gives the allocation back, the id becomes invalid
+    void Free(unsigned int allocation)
+    {
+        if (allocation >= blocks.size() || blocks[allocation].free || !blocks[allocation].alive)
+            return;
+        unsigned int block = allocation;
+        used -= blocks[block].size;
+        unsigned int next = blocks[block].nextPhys;
+        if (next != RANGE_ALLOCATOR_NONE && blocks[next].free)
+        {
+            removeFree(next);
+            blocks[block].size += blocks[next].size;
+            unlink(next);
+        }
+        unsigned int prev = blocks[block].prevPhys;
+        if (prev != RANGE_ALLOCATOR_NONE && blocks[prev].free)
+        {
+            removeFree(prev);
+            blocks[prev].size += blocks[block].size;
+            unlink(block);
+            block = prev;
+        }
+        insertFree(block);
+    }
+
+    // adds room at the end, existing allocations keep their offsets
+    void Grow(unsigned int newCapacity)
+    {
+        if (newCapacity <= capacity)
+            return;
+        unsigned int extra = newCapacity - capacity;
+        if (last != RANGE_ALLOCATOR_NONE && blocks[last].free)
+        {
+            removeFree(last);
+            blocks[last].size += extra;
+            insertFree(last);
+        }
+        else
+        {
+            unsigned int block = newBlock();
+            blocks[block].offset = capacity;
+            blocks[block].size = extra;
+            blocks[block].prevPhys = last;
+            if (last != RANGE_ALLOCATOR_NONE)
+                blocks[last].nextPhys = block;
+            last = block;
+            insertFree(block);
+        }
+        capacity = newCapacity;
+    }
+
+    unsigned int Offset(unsigned int allocation) const
+    {
+        return blocks[allocation].offset;
+    }
+    unsigned int Size(unsigned int allocation) const
+    {
+        return blocks[allocation].size;
+    }
+    unsigned int Capacity() const
+    {
+        return capacity;
+    }
+    unsigned int Used() const
+    {
+        return used;
+    }
+    unsigned int FreeBlocks() const
+    {
+        return freeBlocks;
+    }
+
+    // size of the biggest free range, what the next allocation can get without growing
+    unsigned int LargestFree() const
+    {
+        if (flBitmap == 0)
+            return 0;
+        // only the highest non-empty class can hold it
+        unsigned int fl = log2(flBitmap);
+        unsigned int sl = log2(slBitmap[fl]);
+        unsigned int largest = 0;
+        for (unsigned int b = heads[fl][sl]; b != RANGE_ALLOCATOR_NONE; b = blocks[b].nextFree)
+            largest = max(largest, blocks[b].size);
+        return largest;
+    }
+
+private:
+    enum { SL_BITS = 4, SL_COUNT = 1 << SL_BITS, FL_COUNT = 32 - SL_BITS + 1 };
+
+    struct Block {
+        unsigned int offset;
+        unsigned int size;
+        unsigned int prevPhys, nextPhys; // neighbours in the range, free or not
+        unsigned int prevFree, nextFree; // neighbours in the free list of the size class
+        bool free;
+        bool alive;                      // false while the entry is on unusedBlocks
+    };
+
+    vector<Block> blocks;
+    vector<unsigned int> unusedBlocks;
+    unsigned int heads[FL_COUNT][SL_COUNT];
+    unsigned int flBitmap;
+    unsigned int slBitmap[FL_COUNT];
+    unsigned int capacity;
+    unsigned int used;
+    unsigned int freeBlocks;
+    unsigned int last; // the block at the end of the range
+
+    static unsigned int log2(unsigned int x)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse(&index, x);
+        return (unsigned int)index;
+#else
+        return 31u - (unsigned int)__builtin_clz(x);
+#endif
+    }
+    static unsigned int lowestBit(unsigned int x)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, x);
+        return (unsigned int)index;
+#else
+        return (unsigned int)__builtin_ctz(x);
+#endif
+    }
+
+    // size class of a size: sizes below SL_COUNT have a list each, above that every power of two is split
+    // into SL_COUNT lists
+    static void mapping(unsigned int size, unsigned int &fl, unsigned int &sl)
+    {
+        if (size < SL_COUNT)
+        {
+            fl = 0;
+            sl = size;
+            return;
+        }
+        unsigned int t = log2(size);
+        fl = t - SL_BITS + 1;
+        sl = (size >> (t - SL_BITS)) - SL_COUNT;
+    }
+
+    // the head of the first non-empty list at or above the class, RANGE_ALLOCATOR_NONE if there is none
+    unsigned int findSuitable(unsigned int fl, unsigned int sl) const
+    {
+        unsigned int slMap = slBitmap[fl] & (~0u << sl);
+        if (slMap == 0)
+        {
+            unsigned int flMap = fl + 1 < 32 ? flBitmap & (~0u << (fl + 1)) : 0;
+            if (flMap == 0)
+                return RANGE_ALLOCATOR_NONE;
+            fl = lowestBit(flMap);
+            slMap = slBitmap[fl];
+        }
+        return heads[fl][lowestBit(slMap)];
+    }
+
+    void insertFree(unsigned int block)
+    {
+        unsigned int fl, sl;
+        mapping(blocks[block].size, fl, sl);
+        blocks[block].free = true;
+        blocks[block].prevFree = RANGE_ALLOCATOR_NONE;
+        blocks[block].nextFree = heads[fl][sl];
+        if (heads[fl][sl] != RANGE_ALLOCATOR_NONE)
+            blocks[heads[fl][sl]].prevFree = block;
+        heads[fl][sl] = block;
+        slBitmap[fl] |= 1u << sl;
+        flBitmap |= 1u << fl;
+        freeBlocks++;
+    }
+
+    void removeFree(unsigned int block)
+    {
+        unsigned int fl, sl;
+        mapping(blocks[block].size, fl, sl);
+        Block &b = blocks[block];
+        if (b.prevFree != RANGE_ALLOCATOR_NONE)
+            blocks[b.prevFree].nextFree = b.nextFree;
+        else
+            heads[fl][sl] = b.nextFree;
+        if (b.nextFree != RANGE_ALLOCATOR_NONE)
+            blocks[b.nextFree].prevFree = b.prevFree;
+        if (heads[fl][sl] == RANGE_ALLOCATOR_NONE)
+        {
+            slBitmap[fl] &= ~(1u << sl);
+            if (slBitmap[fl] == 0)
+                flBitmap &= ~(1u << fl);
+        }
+        b.free = false;
+        freeBlocks--;
+    }
+
+    unsigned int newBlock()
+    {
+        unsigned int block;
+        if (!unusedBlocks.empty())
+        {
+            block = unusedBlocks.back();
+            unusedBlocks.pop_back();
+        }
+        else
+        {
+            block = (unsigned int)blocks.size();
+            blocks.push_back(Block());
+        }
+        Block &b = blocks[block];
+        b.offset = b.size = 0;
+        b.prevPhys = b.nextPhys = b.prevFree = b.nextFree = RANGE_ALLOCATOR_NONE;
+        b.free = false;
+        b.alive = true;
+        return block;
+    }
+
+    // takes a block that was merged into its previous neighbour out of the range
+    void unlink(unsigned int block)
+    {
+        Block &b = blocks[block];
+        if (b.prevPhys != RANGE_ALLOCATOR_NONE)
+            blocks[b.prevPhys].nextPhys = b.nextPhys;
+        if (b.nextPhys != RANGE_ALLOCATOR_NONE)
+            blocks[b.nextPhys].prevPhys = b.prevPhys;
+        else
+            last = b.prevPhys;
+        b.alive = false;
+        b.free = false;
+        unusedBlocks.push_back(block);
+    }
+};
+
+// churns a RangeAllocator with random mesh sized allocations and frees, and prints the cost per operation and how
+// fragmented the free space gets
+class RangeAllocatorBenchmark
+{
+public:
+    static void Run()
+    {
+        const unsigned int capacity = 1u << 26;
+        const unsigned int operations = 2000000;
+        RangeAllocator allocator(capacity);
+        vector<unsigned int> live;
+        mt19937 random(7);
+        // mesh sizes spread over several orders of magnitude, like a mix of props and characters
+        uniform_real_distribution<float> logSize(4.0f, 16.0f);
+        unsigned int failed = 0;
+        unsigned int allocations = 0, frees = 0;
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        for (unsigned int i = 0; i < operations; i++)
+        {
+            // keep the allocator around 70% full, so it has to reuse freed ranges
+            bool allocate = live.empty() || (allocator.Used() < capacity / 10 * 7 && (random() & 3) != 0);
+            if (allocate)
+            {
+                unsigned int id = allocator.Allocate((unsigned int)exp2(logSize(random)));
+                if (id == RANGE_ALLOCATOR_NONE)
+                    failed++;
+                else
+                    live.push_back(id);
+                allocations++;
+            }
+            else
+            {
+                unsigned int k = random() % live.size();
+                allocator.Free(live[k]);
+                live[k] = live.back();
+                live.pop_back();
+                frees++;
+            }
+        }
+        float ms = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+        unsigned int freeUnits = allocator.Capacity() - allocator.Used();
+        printf("RANGE_ALLOCATOR:: %u allocations, %u frees, %.1f ns per operation, %u failed\n", allocations, frees, ms * 1.0e6f / operations, failed);
+        printf("RANGE_ALLOCATOR:: %u live ranges, %.1f%% used, %u free ranges, largest free range %.1f%% of the free space\n",
+            (unsigned int)live.size(), 100.0f * allocator.Used() / allocator.Capacity(), allocator.FreeBlocks(),
+            freeUnits > 0 ? 100.0f * allocator.LargestFree() / freeUnits : 100.0f);
+    }
+};
+#endif
@@ -4,97 +4,56 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "learnopengl/file_system.h"
+
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
 
+// declarations every vertex and fragment shader shares, like the Frame and Bones blocks and the skinning and
+// shadow functions. build inserts them after the #version line of each stage.
+#define SHADER_VERTEX_PRELUDE "resources/shader/prelude.vs"
+#define SHADER_FRAGMENT_PRELUDE "resources/shader/prelude.fs"
+// uniform buffer binding points of the prelude's blocks. Every program has all three blocks, so build binds
+// them whether the shader reads them or not.
+#define MATERIAL_UBO_BINDING 0
+#define BONE_UBO_BINDING 1
+#define FRAME_UBO_BINDING 2
+
 class Shader
 {
 public:
     unsigned int ID;
+    // the source files, kept so the program can be built again, see Reload. geometryPath is empty without one.
+    std::string vertexPath, fragmentPath, geometryPath;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) : vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath ? geometryPath : "")
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
-        {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
-        }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        // a program that failed is still created, drawing with it just draws nothing
+        ID = build(true);
+    }
+    // builds the program from its files again. If that succeeds the new program takes over the values of the old
+    // one's uniforms and its uniform block bindings and replaces it, so whatever was set up once stays set up;
+    // if a stage doesn't compile or link, the old program stays and false is returned.
+    // ------------------------------------------------------------------------
+    bool Reload()
+    {
+        unsigned int program = build(false);
+        if (program == 0)
+            return false;
+        takeOverState(ID, program);
+        glDeleteProgram(ID);
+        ID = program;
+        return true;
+    }
+    // true if the program is built from the file at path, the preludes included
+    // ------------------------------------------------------------------------
+    bool Uses(const std::string &path) const
+    {
+        std::string name = FileSystem::Normalize(path);
+        return FileSystem::Normalize(vertexPath) == name || FileSystem::Normalize(fragmentPath) == name
+            || (!geometryPath.empty() && FileSystem::Normalize(geometryPath) == name)
+            || FileSystem::Normalize(SHADER_VERTEX_PRELUDE) == name || FileSystem::Normalize(SHADER_FRAGMENT_PRELUDE) == name;
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -162,9 +121,165 @@ public:
     }
 
 private:
+    // compiles and links the stages; 0 if a file is missing or a stage fails, unless keepFailed is set
+    // ------------------------------------------------------------------------
+    unsigned int build(bool keepFailed)
+    {
+        // 1. map the vertex/fragment source code from filePath, the views go to the driver without a copy
+        bool geometryStage = !geometryPath.empty();
+        FileView vertexCode = FileSystem::Open(vertexPath);
+        FileView fragmentCode = FileSystem::Open(fragmentPath);
+        FileView vertexPrelude = FileSystem::Open(SHADER_VERTEX_PRELUDE);
+        FileView fragmentPrelude = FileSystem::Open(SHADER_FRAGMENT_PRELUDE);
+        FileView geometryCode;
+        if(geometryStage)
+            geometryCode = FileSystem::Open(geometryPath);
+        bool success = vertexCode.Valid() && fragmentCode.Valid() && (!geometryStage || geometryCode.Valid())
+            && vertexPrelude.Valid() && fragmentPrelude.Valid();
+        if(!success)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            if(!keepFailed)
+                return 0;
+        }
+        // 2. compile shaders
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = compile(GL_VERTEX_SHADER, vertexCode, vertexPrelude);
+        success = checkCompileErrors(vertex, "VERTEX") && success;
+        // fragment Shader
+        fragment = compile(GL_FRAGMENT_SHADER, fragmentCode, fragmentPrelude);
+        success = checkCompileErrors(fragment, "FRAGMENT") && success;
+        // if geometry shader is given, compile geometry shader
+        unsigned int geometry = 0;
+        if(geometryStage)
+        {
+            geometry = compile(GL_GEOMETRY_SHADER, geometryCode, FileView());
+            success = checkCompileErrors(geometry, "GEOMETRY") && success;
+        }
+        // shader Program
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        if(geometryStage)
+            glAttachShader(program, geometry);
+        glLinkProgram(program);
+        success = checkCompileErrors(program, "PROGRAM") && success;
+        // delete the shaders as they're linked into our program now and no longer necessery
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        if(geometryStage)
+            glDeleteShader(geometry);
+        if(!success && !keepFailed)
+        {
+            glDeleteProgram(program);
+            return 0;
+        }
+        bindBlock(program, "Materials", MATERIAL_UBO_BINDING);
+        bindBlock(program, "Bones", BONE_UBO_BINDING);
+        bindBlock(program, "Frame", FRAME_UBO_BINDING);
+        return program;
+    }
+    // attaches the uniform block with the given name to a binding point, if the program has it
+    // ------------------------------------------------------------------------
+    static void bindBlock(unsigned int program, const char *name, unsigned int binding)
+    {
+        GLuint block = glGetUniformBlockIndex(program, name);
+        if(block != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, block, binding);
+    }
+    // copies the default block uniforms both programs have, samplers included, and the uniform block bindings
+    // from one program to another. Uniforms are matched by name, arrays element by element.
+    // ------------------------------------------------------------------------
+    static void takeOverState(unsigned int from, unsigned int to)
+    {
+        GLint current;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+        glUseProgram(to);
+        GLint count = 0;
+        glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &count);
+        for(GLint i = 0; i < count; i++)
+        {
+            GLchar name[256];
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(from, i, sizeof(name), NULL, &size, &type, name);
+            std::string base = name;
+            if(base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+                base.resize(base.size() - 3);
+            for(GLint element = 0; element < size; element++)
+            {
+                std::string elementName = size > 1 ? base + "[" + std::to_string(element) + "]" : base;
+                GLint source = glGetUniformLocation(from, elementName.c_str());
+                GLint target = glGetUniformLocation(to, elementName.c_str());
+                // block members have no location, their values live in buffers
+                if(source < 0 || target < 0)
+                    continue;
+                copyUniform(from, source, target, type);
+            }
+        }
+        glGetProgramiv(from, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        for(GLint i = 0; i < count; i++)
+        {
+            GLchar name[256];
+            GLint binding;
+            glGetActiveUniformBlockName(from, i, sizeof(name), NULL, name);
+            glGetActiveUniformBlockiv(from, i, GL_UNIFORM_BLOCK_BINDING, &binding);
+            GLuint block = glGetUniformBlockIndex(to, name);
+            if(block != GL_INVALID_INDEX)
+                glUniformBlockBinding(to, block, binding);
+        }
+        glUseProgram(current == (GLint)from ? to : current);
+    }
+    // the value at location source of program into location target of the program in use
+    // ------------------------------------------------------------------------
+    static void copyUniform(unsigned int program, GLint source, GLint target, GLenum type)
+    {
+        GLfloat f[16];
+        GLint v[4];
+        switch(type)
+        {
+        case GL_FLOAT: glGetUniformfv(program, source, f); glUniform1fv(target, 1, f); break;
+        case GL_FLOAT_VEC2: glGetUniformfv(program, source, f); glUniform2fv(target, 1, f); break;
+        case GL_FLOAT_VEC3: glGetUniformfv(program, source, f); glUniform3fv(target, 1, f); break;
+        case GL_FLOAT_VEC4: glGetUniformfv(program, source, f); glUniform4fv(target, 1, f); break;
+        case GL_FLOAT_MAT2: glGetUniformfv(program, source, f); glUniformMatrix2fv(target, 1, GL_FALSE, f); break;
+        case GL_FLOAT_MAT3: glGetUniformfv(program, source, f); glUniformMatrix3fv(target, 1, GL_FALSE, f); break;
+        case GL_FLOAT_MAT4: glGetUniformfv(program, source, f); glUniformMatrix4fv(target, 1, GL_FALSE, f); break;
+        case GL_INT_VEC2: case GL_BOOL_VEC2: glGetUniformiv(program, source, v); glUniform2iv(target, 1, v); break;
+        case GL_INT_VEC3: case GL_BOOL_VEC3: glGetUniformiv(program, source, v); glUniform3iv(target, 1, v); break;
+        case GL_INT_VEC4: case GL_BOOL_VEC4: glGetUniformiv(program, source, v); glUniform4iv(target, 1, v); break;
+        case GL_UNSIGNED_INT: { GLuint u; glGetUniformuiv(program, source, &u); glUniform1ui(target, u); break; }
+        // int, bool and every sampler type hold a single int
+        default: glGetUniformiv(program, source, v); glUniform1i(target, v[0]); break;
+        }
+    }
+    // creates and compiles a shader from a mapped source with the prelude after its #version line; the lengths
+    // are passed, the views aren't null terminated. #line keeps the line numbers of errors those of the file.
+    // ------------------------------------------------------------------------
+    unsigned int compile(GLenum type, const FileView &source, const FileView &prelude)
+    {
+        unsigned int shader = glCreateShader(type);
+        const char *code = source.data ? (const char *)source.data : "";
+        size_t size = source.data ? source.size : 0;
+        size_t version = 0;
+        if(size >= 8 && std::string(code, 8) == "#version")
+        {
+            while(version < size && code[version] != '\n')
+                version++;
+            if(version < size)
+                version++;
+        }
+        const char *line = version > 0 ? "\n#line 2\n" : "\n#line 1\n";
+        const char *parts[4] = { code, prelude.data ? (const char *)prelude.data : "", line, code + version };
+        GLint lengths[4] = { (GLint)version, prelude.data ? (GLint)prelude.size : 0, -1, (GLint)(size - version) };
+        glShaderSource(shader, 4, parts, lengths);
+        glCompileShader(shader);
+        return shader;
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -186,6 +301,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
\ No newline at end of file
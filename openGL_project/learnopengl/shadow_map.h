@@ -0,0 +1,284 @@
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "learnopengl/model.h"
+#include "learnopengl/shader.h"
+#include "learnopengl/frustum.h"
+#include "learnopengl/bone_palette.h"
+#include "learnopengl/frame_uniforms.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+// texture unit the shadow map is bound to, right after the material units
+#define SHADOW_MAP_UNIT MATERIAL_TEXTURE_COUNT
+// size of the cascade uniform arrays in the lit shaders
+#define MAX_SHADOW_CASCADES 4
+
+// knobs to keep the depth pass inside its frame budget
+struct ShadowSettings {
+    unsigned int resolution;  // width and height of every cascade layer
+    unsigned int cascadeCount; // 1 to MAX_SHADOW_CASCADES
+    float splitLambda;        // practical split scheme: 0 = uniform splits, 1 = logarithmic splits
+    float shadowDistance;     // no shadows beyond this view distance, even if the camera sees further
+    float minCasterPixels;    // casters whose bounding sphere covers fewer texels of a cascade are skipped in it
+    unsigned int casterLodBias; // casters are drawn this many detail levels coarser than in the main view
+
+    ShadowSettings() : resolution(1024), cascadeCount(4), splitLambda(0.75f), shadowDistance(100.0f), minCasterPixels(2.0f), casterLodBias(1)
+    {
+    }
+};
+
+// a model instance that casts a shadow
+struct ShadowCaster {
+    Model *model;
+    glm::mat4 transform;
+    unsigned int lod; // detail level used in the main view
+    PaletteRange palette; // pose of a skinned caster, empty for rigid models
+
+    ShadowCaster(Model *model, const glm::mat4 &transform, unsigned int lod, const PaletteRange &palette = PaletteRange()) : model(model), transform(transform), lod(lod), palette(palette)
+    {
+    }
+};
+
+// Cascaded shadow map of the scene light. The view frustum is split along its depth with the practical split scheme
+// (a blend of logarithmic and uniform splits) and every slice gets its own orthographic light projection in one
+// layer of a depth texture array, so the texel density follows the distance to the camera and the cost only grows
+// with the cascade count, not with the size of the track.
+// Over the track the scene light is treated as directional, shining from its position towards the track center;
+// cascades are bounded by spheres and snapped to whole texels, so they don't shimmer when the camera moves or turns.
+class ShadowMap
+{
+public:
+    ShadowSettings settings;
+    glm::mat4 lightView;      // rotation into light space, shared by all cascades
+    glm::mat4 lightSpaceMatrices[MAX_SHADOW_CASCADES];
+    float cascadeSplits[MAX_SHADOW_CASCADES]; // far view distance of every cascade
+    glm::vec3 lightDirection;
+    unsigned int depthMap;
+    // statistics of the last rendered frame, summed over the cascades
+    unsigned int castersDrawn;
+    unsigned int castersCulled;
+    float gpuTimeMs;
+
+    ShadowMap(const ShadowSettings &settings = ShadowSettings()) : settings(settings), lightView(1.0f), lightDirection(0.0f, -1.0f, 0.0f), depthMap(0),
+        castersDrawn(0), castersCulled(0), gpuTimeMs(0.0f), FBO(0), allocatedResolution(0), allocatedCascades(0), queryFrame(0)
+    {
+        for (unsigned int i = 0; i < MAX_SHADOW_CASCADES; i++)
+        {
+            lightSpaceMatrices[i] = glm::mat4(1.0f);
+            cascadeSplits[i] = 0.0f;
+            cascadeRadius[i] = 0.0f;
+        }
+        glGenQueries(2, timerQueries);
+        queryPending[0] = queryPending[1] = false;
+        allocate();
+    }
+
+    // sets the shadow sampler unit of a lit shader, call once after creating it
+    void SetupShader(Shader &shader)
+    {
+        shader.use();
+        shader.setInt("shadowMap", SHADOW_MAP_UNIT);
+    }
+
+    // splits the camera frustum and fits one light projection around every slice
+    void Fit(const glm::mat4 &view, float fovy, float aspect, float nearPlane, float farPlane, const glm::vec3 &lightPosition, const glm::vec3 &sceneCenter)
+    {
+        unsigned int count = cascadeCount();
+        lightDirection = sceneCenter - lightPosition;
+        if (glm::length(lightDirection) < 0.001f)
+            lightDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+        lightDirection = glm::normalize(lightDirection);
+        glm::vec3 up = fabs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        lightView = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+
+        farPlane = min(farPlane, settings.shadowDistance);
+        glm::mat4 inverseView = glm::inverse(view);
+        float tanY = tan(fovy * 0.5f);
+        float tanX = tanY * aspect;
+        float splitNear = nearPlane;
+        for (unsigned int c = 0; c < count; c++)
+        {
+            float p = (float)(c + 1) / (float)count;
+            float logSplit = nearPlane * pow(farPlane / nearPlane, p);
+            float uniformSplit = nearPlane + (farPlane - nearPlane) * p;
+            float splitFar = settings.splitLambda * logSplit + (1.0f - settings.splitLambda) * uniformSplit;
+            cascadeSplits[c] = splitFar;
+
+            // bounding sphere of the slice. Its size only depends on the split distances, not on the camera
+            // orientation, so the texel size of a cascade never changes.
+            glm::vec3 corners[8];
+            for (unsigned int i = 0; i < 8; i++)
+            {
+                float depth = (i & 4) ? splitFar : splitNear;
+                glm::vec4 corner((i & 1 ? 1.0f : -1.0f) * tanX * depth, (i & 2 ? 1.0f : -1.0f) * tanY * depth, -depth, 1.0f);
+                corners[i] = glm::vec3(inverseView * corner);
+            }
+            float farHalfDiagonal2 = (tanX * tanX + tanY * tanY) * splitFar * splitFar;
+            float nearHalfDiagonal2 = (tanX * tanX + tanY * tanY) * splitNear * splitNear;
+            // distance of the sphere center along the view axis that makes it pass through all eight corners
+            float centerDepth = 0.5f * (splitNear + splitFar) + (farHalfDiagonal2 - nearHalfDiagonal2) / (2.0f * (splitFar - splitNear));
+            centerDepth = min(centerDepth, splitFar);
+            glm::vec3 center = glm::vec3(inverseView * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+            float radius = 0.0f;
+            for (unsigned int i = 0; i < 8; i++)
+                radius = max(radius, glm::length(corners[i] - center));
+            radius = ceil(radius * 16.0f) / 16.0f;
+            cascadeRadius[c] = radius;
+
+            // move the center in whole texels of the light space grid
+            float texelSize = 2.0f * radius / (float)settings.resolution;
+            glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+            lightCenter.x = floor(lightCenter.x / texelSize) * texelSize;
+            lightCenter.y = floor(lightCenter.y / texelSize) * texelSize;
+            // casters between the light and the slice are flattened onto the near plane by depth clamping
+            glm::mat4 projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius,
+                -lightCenter.z - radius, -lightCenter.z + radius);
+            lightSpaceMatrices[c] = projection * lightView;
+            splitNear = splitFar;
+        }
+    }
+
+    // renders the casters into every cascade. Casters are culled per cascade against its light frustum and by the
+    // number of texels they would cover in it.
+    void Render(Shader &depthShader, const vector<ShadowCaster> &casters)
+    {
+        if (allocatedResolution != settings.resolution || allocatedCascades != cascadeCount())
+            allocate();
+
+        // read the timer of the frame before last, which is done by now, so the query never stalls
+        unsigned int slot = queryFrame % 2;
+        if (queryPending[slot])
+        {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(timerQueries[slot], GL_QUERY_RESULT, &elapsed);
+            gpuTimeMs = (float)(elapsed / 1.0e6);
+        }
+        glBeginQuery(GL_TIME_ELAPSED, timerQueries[slot]);
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glViewport(0, 0, settings.resolution, settings.resolution);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        // slope scaled bias against shadow acne
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        // casters between the light and the near plane are flattened onto it instead of being clipped
+        glEnable(GL_DEPTH_CLAMP);
+
+        depthShader.use();
+        // world bounds are the same for every cascade
+        vector<glm::vec4> bounds(casters.size());
+        for (unsigned int i = 0; i < casters.size(); i++)
+        {
+            glm::vec3 center;
+            float radius;
+            casters[i].model->WorldBounds(casters[i].transform, center, radius);
+            bounds[i] = glm::vec4(center, radius);
+        }
+        castersDrawn = castersCulled = 0;
+        for (unsigned int c = 0; c < cascadeCount(); c++)
+        {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMap, 0, c);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            depthShader.setMat4("lightSpaceMatrix", lightSpaceMatrices[c]);
+            Frustum lightFrustum(lightSpaceMatrices[c]);
+            float texelsPerUnit = (float)settings.resolution / (2.0f * cascadeRadius[c]);
+            for (unsigned int i = 0; i < casters.size(); i++)
+            {
+                glm::vec3 center(bounds[i]);
+                float radius = bounds[i].w;
+                if (!lightFrustum.IntersectsSphere(center, radius, false) || 2.0f * radius * texelsPerUnit < settings.minCasterPixels)
+                {
+                    castersCulled++;
+                    continue;
+                }
+                depthShader.setMat4("model", casters[i].transform);
+                casters[i].palette.Bind();
+                casters[i].model->DrawGeometry(casters[i].lod + settings.casterLodBias);
+                castersDrawn++;
+            }
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glDisable(GL_DEPTH_CLAMP);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+        glEndQuery(GL_TIME_ELAPSED);
+        queryPending[slot] = true;
+        queryFrame++;
+    }
+
+    // hands the cascade transforms and split distances to the lit shaders through the Frame block
+    void Apply(FrameUniforms &frame) const
+    {
+        frame.cascadeCount = (int)cascadeCount();
+        for (unsigned int c = 0; c < cascadeCount(); c++)
+        {
+            frame.lightSpaceMatrices[c] = lightSpaceMatrices[c];
+            frame.cascadeSplits[c] = cascadeSplits[c];
+        }
+    }
+    void BindTexture()
+    {
+        glActiveTexture(GL_TEXTURE0 + SHADOW_MAP_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthMap);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    unsigned int cascadeCount() const
+    {
+        return max(1u, min(settings.cascadeCount, (unsigned int)MAX_SHADOW_CASCADES));
+    }
+
+private:
+    unsigned int FBO;
+    unsigned int allocatedResolution;
+    unsigned int allocatedCascades;
+    float cascadeRadius[MAX_SHADOW_CASCADES];
+    unsigned int timerQueries[2];
+    bool queryPending[2];
+    unsigned int queryFrame;
+
+    // (re)creates the depth texture array at the configured resolution, one layer per cascade
+    void allocate()
+    {
+        if (FBO == 0)
+            glGenFramebuffers(1, &FBO);
+        if (depthMap != 0)
+            glDeleteTextures(1, &depthMap);
+        glGenTextures(1, &depthMap);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthMap);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, settings.resolution, settings.resolution, cascadeCount(), 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        // hardware depth comparison, filtered with GL_LINEAR this already gives 2x2 PCF per tap
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        // everything outside the light frustum is lit
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMap, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::SHADOW_MAP:: framebuffer is not complete" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        allocatedResolution = settings.resolution;
+        allocatedCascades = cascadeCount();
+    }
+};
+#endif
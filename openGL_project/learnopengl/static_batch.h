@@ -0,0 +1,110 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "learnopengl/mesh.h"
+#include "learnopengl/mesh_arena.h"
+#include "learnopengl/model.h"
+#include "learnopengl/material.h"
+#include "learnopengl/shader.h"
+
+#include <vector>
+#include <map>
+using namespace std;
+
+// Merges static scenery into one vertex/index buffer per material at load time. The world transform of every
+// added mesh is baked into its vertices, so the whole batch is drawn with an identity model matrix and costs one
+// draw call per material, no matter how many meshes or model instances were added.
+class StaticBatch
+{
+public:
+    vector<Mesh> meshes;	// one merged mesh per material, only valid after Build()
+    MaterialLibrary &materials;
+    MeshArena &arena;
+
+    StaticBatch(MaterialLibrary &materials, MeshArena &arena) : materials(materials), arena(arena)
+    {
+    }
+
+    // queues every mesh of the model, placed with the given world transform
+    void Add(const Model &model, const glm::mat4 &transform)
+    {
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+        {
+            // only the full resolution level is merged
+            const Mesh &mesh = model.meshes[i];
+            vector<unsigned int> indices(mesh.indices.begin() + mesh.lods[0].indexOffset, mesh.indices.begin() + mesh.lods[0].indexOffset + mesh.lods[0].indexCount);
+            Add(mesh.vertices, indices, mesh.materialIndex, transform);
+        }
+    }
+
+    // queues raw geometry, placed with the given world transform
+    void Add(const vector<Vertex> &vertices, const vector<unsigned int> &indices, unsigned int materialIndex, const glm::mat4 &transform)
+    {
+        Geometry &geometry = pending[materialIndex];
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+        glm::mat3 tangentMatrix = glm::mat3(transform);
+        // flip the winding if the transform mirrors the geometry, otherwise back faces would become front faces
+        bool mirrored = glm::determinant(tangentMatrix) < 0.0f;
+
+        unsigned int baseVertex = (unsigned int)geometry.vertices.size();
+        for (unsigned int i = 0; i < vertices.size(); i++)
+        {
+            Vertex vertex = vertices[i];
+            vertex.Position = glm::vec3(transform * glm::vec4(vertex.Position, 1.0f));
+            vertex.Normal = safeNormalize(normalMatrix * vertex.Normal);
+            vertex.Tangent = safeNormalize(tangentMatrix * vertex.Tangent);
+            vertex.Bitangent = safeNormalize(tangentMatrix * vertex.Bitangent);
+            geometry.vertices.push_back(vertex);
+        }
+        for (unsigned int i = 0; i + 2 < indices.size(); i += 3)
+        {
+            geometry.indices.push_back(baseVertex + indices[i]);
+            geometry.indices.push_back(baseVertex + indices[mirrored ? i + 2 : i + 1]);
+            geometry.indices.push_back(baseVertex + indices[mirrored ? i + 1 : i + 2]);
+        }
+        sourceMeshes++;
+    }
+
+    // uploads the merged geometry. Nothing can be added afterwards.
+    void Build()
+    {
+        for (map<unsigned int, Geometry>::iterator it = pending.begin(); it != pending.end(); ++it)
+        {
+            if (it->second.indices.empty())
+                continue;
+            meshes.push_back(Mesh(it->second.vertices, it->second.indices, it->first, arena));
+        }
+        cout << "STATIC_BATCH:: merged " << sourceMeshes << " meshes into " << meshes.size() << " draw calls" << endl;
+        pending.clear();
+    }
+
+    // draws all merged meshes. The shader's model matrix has to be the identity, the transforms are in the vertices.
+    void Draw(Shader &shader)
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            materials.Bind(meshes[i].materialIndex, shader);
+            meshes[i].Draw();
+        }
+    }
+
+private:
+    struct Geometry {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+    };
+    map<unsigned int, Geometry> pending;	// keyed by material index, so the draws come out sorted by material
+    unsigned int sourceMeshes = 0;
+
+    static glm::vec3 safeNormalize(const glm::vec3 &v)
+    {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : v;
+    }
+};
+#endif
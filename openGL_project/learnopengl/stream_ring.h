@@ -0,0 +1,199 @@
+#ifndef STREAM_RING_H
+#define STREAM_RING_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+using namespace std;
+
+// frames the CPU may run ahead of the GPU, each one writes its own section of the ring
+#define STREAM_RING_FRAMES 3
+// initial size of a section, sections double when a frame needs more
+#define STREAM_RING_SECTION_SIZE (4u << 20)
+
+// where a StreamRing allocation went. data is null when the allocation failed.
+struct StreamAllocation {
+    unsigned char *data;
+    unsigned int buffer;
+    unsigned int offset;
+
+    StreamAllocation() : data(nullptr), buffer(0), offset(0)
+    {
+    }
+};
+
+// Ring allocator for data written once per frame and read by the GPU in the same frame: uniform blocks, instance
+// matrices, skinning palettes. With GL 4.4 or ARB_buffer_storage the buffer is mapped once, persistently and
+// coherently, and split into STREAM_RING_FRAMES sections. A frame sub-allocates from its section, and EndFrame
+// fences it and moves on to the next one, waiting only if the GPU still reads that section from STREAM_RING_FRAMES
+// frames ago. Without buffer storage (plain 3.3) every allocation maps its range unsynchronized and EndFrame
+// orphans the buffer, so the driver hands out fresh memory instead of stalling on the draws still using the old.
+// Allocate, Unmap and EndFrame must be called from the thread that owns the GL context.
+class StreamRing
+{
+public:
+    // time the last EndFrame waited for the GPU, and how often any frame had to wait
+    float waitMs;
+    unsigned int stalls;
+
+    StreamRing(unsigned int sectionSize = STREAM_RING_SECTION_SIZE) : waitMs(0.0f), stalls(0), buffer(0), mapped(nullptr), sectionSize(sectionSize), section(0), head(0), mappedRange(false)
+    {
+        persistent = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+        for (unsigned int i = 0; i < STREAM_RING_FRAMES; i++)
+            fences[i] = 0;
+        create();
+    }
+
+    ~StreamRing()
+    {
+        Unmap();
+        for (unsigned int i = 0; i < STREAM_RING_FRAMES; i++)
+            if (fences[i])
+                glDeleteSync(fences[i]);
+        retire();
+        for (unsigned int i = 0; i < retired.size(); i++)
+            glDeleteBuffers(1, &retired[i]);
+    }
+
+    bool Persistent() const
+    {
+        return persistent;
+    }
+
+    // reserves size bytes in this frame's part of the ring. The memory can be written until the next Allocate or
+    // Unmap, and read by GL commands issued after that until EndFrame. alignment must be a power of two, e.g.
+    // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT for uniform blocks or the vertex stride for instance data.
+    StreamAllocation Allocate(unsigned int size, unsigned int alignment = 16)
+    {
+        Unmap();
+        unsigned int offset = (head + alignment - 1) & ~(alignment - 1);
+        if (offset + size > sectionSize)
+        {
+            // doesn't fit, start over with bigger sections. Earlier allocations stay valid: the old buffer is only
+            // deleted at EndFrame, and GL keeps its storage alive until the draws that read it are done.
+            retire();
+            while (sectionSize < size + alignment)
+                sectionSize *= 2;
+            sectionSize *= 2;
+            create();
+            offset = 0;
+        }
+        head = offset + size;
+
+        StreamAllocation allocation;
+        allocation.buffer = buffer;
+        allocation.offset = section * sectionSize + offset;
+        if (persistent)
+            allocation.data = mapped + allocation.offset;
+        else
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            allocation.data = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, allocation.offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            mappedRange = allocation.data != nullptr;
+        }
+        return allocation;
+    }
+
+    // hands the last allocation to GL, needed before drawing with it when the buffer isn't persistently mapped
+    void Unmap()
+    {
+        if (!mappedRange)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        mappedRange = false;
+    }
+
+    // call once per frame after the last draw that reads this frame's allocations
+    void EndFrame()
+    {
+        Unmap();
+        waitMs = 0.0f;
+        if (persistent)
+        {
+            if (fences[section])
+                glDeleteSync(fences[section]);
+            fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            section = (section + 1) % STREAM_RING_FRAMES;
+            wait(fences[section]);
+            fences[section] = 0;
+        }
+        else
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, sectionSize, NULL, GL_STREAM_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        head = 0;
+        for (unsigned int i = 0; i < retired.size(); i++)
+            glDeleteBuffers(1, &retired[i]);
+        retired.clear();
+    }
+
+private:
+    bool persistent;
+    unsigned int buffer;
+    unsigned char *mapped;    // the whole buffer, persistent mode only
+    unsigned int sectionSize;
+    unsigned int section;     // the section this frame allocates from
+    unsigned int head;        // next free byte in the section
+    bool mappedRange;         // an allocation is mapped, fallback mode only
+    GLsync fences[STREAM_RING_FRAMES];
+    vector<unsigned int> retired;
+
+    void create()
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        if (persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, STREAM_RING_FRAMES * sectionSize, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, STREAM_RING_FRAMES * sectionSize, flags);
+        }
+        else
+            glBufferData(GL_COPY_WRITE_BUFFER, sectionSize, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        // a new buffer has no frames in flight, and in the fallback there is only one section
+        for (unsigned int i = 0; i < STREAM_RING_FRAMES; i++)
+        {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        if (!persistent)
+            section = 0;
+    }
+
+    // the buffer is deleted at the end of the frame, after the last command that uses it was issued
+    void retire()
+    {
+        Unmap();
+        if (buffer != 0)
+            retired.push_back(buffer);
+        buffer = 0;
+        mapped = nullptr;
+    }
+
+    void wait(GLsync fence)
+    {
+        if (!fence)
+            return;
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            stalls++;
+            do
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            while (result == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        waitMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+};
+#endif
@@ -0,0 +1,456 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <glad/glad.h>
+
+#include "learnopengl/image_decoder.h"
+#include "learnopengl/block_compress.h"
+#include "learnopengl/mip_chain.h"
+#include "learnopengl/ktx2.h"
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+using namespace std;
+
+// bump when the encoders or the mip filters change, so stale cache files are built again
+#define TEXTURE_CACHE_VERSION 2
+
+struct TextureSettings {
+    bool compress;               // false uploads RGBA8 levels, like before
+    CompressionQuality quality;  // the high preset prefers BC7 over BC1/BC3
+    MipFilter mipFilter;
+
+    TextureSettings() : compress(true), quality(COMPRESSION_NORMAL), mipFilter(MIP_FILTER_KAISER)
+    {
+    }
+};
+
+struct TextureStats {
+    unsigned int textures;     // images loaded, a cubemap counts six
+    unsigned int compressed;   // of those uploaded block compressed
+    unsigned int cached;       // of those read from a KTX2 cache instead of being built from the image
+    unsigned int decoded;      // cached blocks the driver couldn't take, decoded to RGBA8
+    size_t bytes;              // texture memory of all mip levels as uploaded
+    size_t uncompressedBytes;  // the same mip levels as RGBA8
+    float imageMs;             // spent decoding image files
+
+    TextureStats() : textures(0), compressed(0), cached(0), decoded(0), bytes(0), uncompressedBytes(0), imageMs(0.0f)
+    {
+    }
+};
+
+// mip chain of an image, either blocks of format or RGBA8 texels
+struct TextureLevels {
+    bool compressed;
+    BlockFormat format;
+    bool alpha;                // RGBA8 levels with meaningful alpha
+    unsigned int width, height;
+    vector<vector<unsigned char> > levels;
+
+    TextureLevels() : compressed(false), format(BLOCK_BC1), alpha(false), width(0), height(0)
+    {
+    }
+};
+
+// Loads images into textures with precomputed mip chains, block compressed when the driver has a suitable
+// format. The first load decodes the image, builds its mip levels with a gamma-correct windowed sinc (MipChain),
+// encodes them and writes the result to a KTX2 file next to the image (<image>.<format>.cache.ktx2, or
+// .rgba8.cache.ktx2 uncompressed). Later loads read the levels straight from that file into immutable texture
+// storage, without decoding the image or calling glGenerateMipmap. The cache remembers the size and time of the
+// image it was built from and is rebuilt when either changes. A cache in a format the driver can't use is
+// decoded to RGBA8, which keeps textures working when only the KTX2 files are shipped. --compress-textures
+// fills the cache ahead of time.
+class TextureLoader
+{
+public:
+    static TextureSettings &Settings()
+    {
+        static TextureSettings settings;
+        return settings;
+    }
+
+    static TextureStats &Stats()
+    {
+        static TextureStats stats;
+        return stats;
+    }
+
+    static bool Supported(BlockFormat format)
+    {
+        switch (format)
+        {
+        case BLOCK_BC1:
+        case BLOCK_BC3:
+            return GLAD_GL_EXT_texture_compression_s3tc != 0;
+        case BLOCK_BC7:
+            return GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_compression_bptc;
+        default:
+            // desktop drivers that expose ETC2 often decode it in software, so it is the last choice
+            return GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_ES3_compatibility;
+        }
+    }
+
+    // glTexStorage2D, otherwise every level is specified with glTexImage2D
+    static bool ImmutableStorage()
+    {
+        return GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_storage;
+    }
+
+    // the levels of the image at path, all of them down to 1x1 when mipmaps is set, else at least level 0.
+    // Returns false if neither the image nor a cache of it could be read.
+    static bool Read(const string &path, bool mipmaps, TextureLevels &image)
+    {
+        TextureSettings &settings = Settings();
+        vector<BlockFormat> candidates = candidateFormats(settings.quality);
+        bool anySupported = false;
+        if (settings.compress)
+            for (unsigned int i = 0; i < candidates.size(); i++)
+                if (Supported(candidates[i]))
+                {
+                    anySupported = true;
+                    if (readCache(path, cachePath(path, candidates[i]), mipmaps, true, image))
+                    {
+                        Stats().cached++;
+                        return true;
+                    }
+                }
+        if (!anySupported && readCache(path, cachePath(path), mipmaps, true, image))
+        {
+            Stats().cached++;
+            return true;
+        }
+
+        DecodedImage decoded;
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        if (ImageDecoder::Load(path, decoded))
+        {
+            Stats().imageMs += chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+            bool alpha = decoded.components == 2 || decoded.components == 4;
+            BuildLevels(decoded.pixels.data(), decoded.width, decoded.height, alpha, mipmaps, image);
+            for (unsigned int i = 0; i < candidates.size() && anySupported; i++)
+                if (Supported(candidates[i]) && (alpha == BlockHasAlpha(candidates[i]) || candidates[i] == BLOCK_BC7))
+                {
+                    Encode(image, candidates[i], settings.quality);
+                    break;
+                }
+            writeCache(path, image);
+            return true;
+        }
+
+        // no image to build from: any cache will do, decoded if the driver can't take it
+        for (unsigned int i = 0; i <= candidates.size(); i++)
+        {
+            string cache = i < candidates.size() ? cachePath(path, candidates[i]) : cachePath(path);
+            if (readCache(path, cache, mipmaps, false, image))
+            {
+                if (image.compressed && !Supported(image.format))
+                {
+                    Decode(image);
+                    Stats().decoded++;
+                }
+                else
+                    Stats().cached++;
+                return true;
+            }
+        }
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+        return false;
+    }
+
+    // RGBA8 mip chain of an image, filtered with the configured mip filter
+    static void BuildLevels(const unsigned char *rgba, unsigned int width, unsigned int height, bool alpha, bool mipmaps, TextureLevels &image)
+    {
+        image.compressed = false;
+        image.alpha = alpha;
+        image.width = width;
+        image.height = height;
+        MipChain::Build(rgba, width, height, Settings().mipFilter, mipmaps, image.levels);
+    }
+
+    // encodes RGBA8 levels to format
+    static void Encode(TextureLevels &image, BlockFormat format, CompressionQuality quality)
+    {
+        if (image.compressed)
+            return;
+        for (unsigned int l = 0; l < image.levels.size(); l++)
+        {
+            unsigned int w = max(1u, image.width >> l), h = max(1u, image.height >> l);
+            vector<unsigned char> blocks(BlockCompressor::CompressedSize(format, w, h));
+            BlockCompressor::Compress(format, quality, image.levels[l].data(), w, h, blocks.data());
+            image.levels[l].swap(blocks);
+        }
+        image.compressed = true;
+        image.format = format;
+    }
+
+    // turns compressed levels into RGBA8 ones
+    static void Decode(TextureLevels &image)
+    {
+        if (!image.compressed)
+            return;
+        for (unsigned int l = 0; l < image.levels.size(); l++)
+        {
+            unsigned int w = max(1u, image.width >> l), h = max(1u, image.height >> l);
+            vector<unsigned char> texels((size_t)w * h * 4);
+            BlockCompressor::Decompress(image.format, image.levels[l].data(), w, h, texels.data());
+            image.levels[l].swap(texels);
+        }
+        image.compressed = false;
+        image.alpha = BlockHasAlpha(image.format);
+    }
+
+    // storage for levels levels of the image's size and format on target (GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP)
+    // of the bound texture
+    static void Allocate(GLenum target, const TextureLevels &image, unsigned int levels)
+    {
+        if (ImmutableStorage())
+            glTexStorage2D(target, levels, InternalFormat(image), image.width, image.height);
+        else
+            glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+
+    // uploads the first levels levels into target (GL_TEXTURE_2D or a cube map face) allocated by Allocate
+    static void Upload(GLenum target, const TextureLevels &image, unsigned int levels)
+    {
+        TextureStats &stats = Stats();
+        stats.textures++;
+        bool immutable = ImmutableStorage();
+        for (unsigned int l = 0; l < levels; l++)
+        {
+            unsigned int w = max(1u, image.width >> l), h = max(1u, image.height >> l);
+            const unsigned char *data = image.levels[l].data();
+            GLsizei size = (GLsizei)image.levels[l].size();
+            if (image.compressed && immutable)
+                glCompressedTexSubImage2D(target, l, 0, 0, w, h, InternalFormat(image), size, data);
+            else if (image.compressed)
+                glCompressedTexImage2D(target, l, InternalFormat(image), w, h, 0, size, data);
+            else if (immutable)
+                glTexSubImage2D(target, l, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            else
+                glTexImage2D(target, l, InternalFormat(image), w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            stats.bytes += size;
+            stats.uncompressedBytes += (size_t)w * h * 4;
+        }
+        if (image.compressed)
+            stats.compressed++;
+    }
+
+    // offline: builds the mip chain of each image, writes the KTX2 cache of every format and prints how long
+    // that took and how close level 0 stays to the image
+    static void Precompress(const vector<string> &paths, CompressionQuality quality)
+    {
+        for (unsigned int i = 0; i < paths.size(); i++)
+        {
+            DecodedImage source;
+            if (!ImageDecoder::Load(paths[i], source))
+            {
+                std::cout << "Texture failed to load at path: " << paths[i] << std::endl;
+                continue;
+            }
+            chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+            TextureLevels levels;
+            unsigned int width = source.width, height = source.height;
+            BuildLevels(source.pixels.data(), width, height, source.components == 2 || source.components == 4, true, levels);
+            float mipMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+            writeCache(paths[i], levels);
+            printf("TEXTURE_COMPRESS:: %s %ux%u, %u levels, %s mip filter %.1f ms\n", paths[i].c_str(), width, height, (unsigned int)levels.levels.size(), MipFilterName(Settings().mipFilter), mipMs);
+            for (unsigned int f = 0; f < BLOCK_FORMAT_COUNT; f++)
+            {
+                TextureLevels image = levels;
+                start = chrono::high_resolution_clock::now();
+                Encode(image, (BlockFormat)f, quality);
+                float ms = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+                writeCache(paths[i], image, quality);
+
+                vector<unsigned char> decoded((size_t)width * height * 4);
+                BlockCompressor::Decompress((BlockFormat)f, image.levels[0].data(), width, height, decoded.data());
+                size_t bytes = 0;
+                for (unsigned int l = 0; l < image.levels.size(); l++)
+                    bytes += image.levels[l].size();
+                printf("TEXTURE_COMPRESS::   %-5s %8.1f ms  %5.2f dB  %6.2f MB\n", BlockFormatName((BlockFormat)f), ms, psnr(source.pixels.data(), decoded.data(), (size_t)width * height, BlockHasAlpha((BlockFormat)f)), bytes / (1024.0f * 1024.0f));
+            }
+        }
+    }
+
+    static void PrintStats()
+    {
+        const TextureStats &stats = Stats();
+        printf("TEXTURES:: %u images, %u block compressed, %u from the cache (%u decoded), %.1f MB instead of %.1f MB, %.1f ms decoding images (%s)\n", stats.textures, stats.compressed, stats.cached, stats.decoded, stats.bytes / (1024.0f * 1024.0f), stats.uncompressedBytes / (1024.0f * 1024.0f), stats.imageMs, ImageDecoder::JpegBackend());
+    }
+
+    // GL internal format of the levels
+    static GLenum InternalFormat(const TextureLevels &image)
+    {
+        if (image.compressed)
+            return BlockInternalFormat(image.format);
+        return image.alpha ? GL_RGBA8 : GL_RGB8;
+    }
+
+    // the KTX2 cache holding the levels of image, as returned by Read for path. It only exists if the cache could
+    // be written, and only has these levels if image wasn't decoded from another format.
+    static string CacheFile(const string &path, const TextureLevels &image)
+    {
+        return image.compressed ? cachePath(path, image.format) : cachePath(path);
+    }
+
+private:
+    // formats to try, best first. Opaque and alpha variants are both listed, the image decides which one fits.
+    static vector<BlockFormat> candidateFormats(CompressionQuality quality)
+    {
+        vector<BlockFormat> formats;
+        if (quality == COMPRESSION_HIGH)
+            formats.push_back(BLOCK_BC7);
+        formats.push_back(BLOCK_BC1);
+        formats.push_back(BLOCK_BC3);
+        if (quality != COMPRESSION_HIGH)
+            formats.push_back(BLOCK_BC7);
+        formats.push_back(BLOCK_ETC2_RGB);
+        formats.push_back(BLOCK_ETC2_RGBA);
+        return formats;
+    }
+
+    static string cachePath(const string &path, BlockFormat format)
+    {
+        return path + "." + BlockFormatName(format) + ".cache.ktx2";
+    }
+
+    static string cachePath(const string &path)
+    {
+        return path + ".rgba8.cache.ktx2";
+    }
+
+    // size and modification time identify the version of the source image, empty when it is missing
+    static string sourceIdentity(const string &path)
+    {
+        long long size, modified;
+        if (!FileSystem::Stat(path, size, modified))
+            return string();
+        ostringstream identity;
+        identity << size << " " << modified;
+        return identity.str();
+    }
+
+    // reads a cache with enough levels. A strict read also requires it to match the source image (unless that is
+    // missing), the mip filter and at least the configured encoder quality.
+    static bool readCache(const string &path, const string &cache, bool mipmaps, bool strict, TextureLevels &image)
+    {
+        Ktx2Image file;
+        if (!Ktx2::Read(cache, file, false))
+            return false;
+        TextureSettings &settings = Settings();
+        string source = sourceIdentity(path);
+        unsigned int fullLevels = 1;
+        for (unsigned int size = max(file.width, file.height); size > 1; size /= 2)
+            fullLevels++;
+        if (atoi(file.keyValues["TextureCacheVersion"].c_str()) != TEXTURE_CACHE_VERSION)
+            return false;
+        if (strict && ((!source.empty() && file.keyValues["TextureSource"] != source) || file.keyValues["TextureMipFilter"] != MipFilterName(settings.mipFilter)
+            || atoi(file.keyValues["TextureQuality"].c_str()) < (int)settings.quality))
+            return false;
+        if (!Ktx2::Read(cache, file) || (mipmaps && file.levels.size() < fullLevels))
+            return false;
+        image.compressed = Ktx2::BlockFormatOf(file.vkFormat, image.format);
+        image.alpha = file.keyValues["TextureAlpha"] == "1";
+        image.width = file.width;
+        image.height = file.height;
+        image.levels.swap(file.levels);
+        return true;
+    }
+
+    static void writeCache(const string &path, const TextureLevels &image, CompressionQuality quality = Settings().quality)
+    {
+        Ktx2Image file;
+        file.vkFormat = image.compressed ? Ktx2::VkFormat(image.format) : VK_FORMAT_R8G8B8A8_UNORM;
+        file.width = image.width;
+        file.height = image.height;
+        file.levels = image.levels;
+        ostringstream version, encoding;
+        version << TEXTURE_CACHE_VERSION;
+        file.keyValues["KTXwriter"] = "openGL_project TextureLoader";
+        file.keyValues["TextureCacheVersion"] = version.str();
+        file.keyValues["TextureSource"] = sourceIdentity(path);
+        file.keyValues["TextureMipFilter"] = MipFilterName(Settings().mipFilter);
+        file.keyValues["TextureAlpha"] = image.alpha ? "1" : "0";
+        if (image.compressed)
+        {
+            encoding << (int)quality;
+            file.keyValues["TextureQuality"] = encoding.str();
+        }
+        Ktx2::Write(CacheFile(path, image), file);
+    }
+
+    static float psnr(const unsigned char *a, const unsigned char *b, size_t pixels, bool alpha)
+    {
+        double error = 0.0;
+        unsigned int channels = alpha ? 4 : 3;
+        for (size_t i = 0; i < pixels; i++)
+            for (unsigned int k = 0; k < channels; k++)
+            {
+                double d = (double)a[i * 4 + k] - (double)b[i * 4 + k];
+                error += d * d;
+            }
+        error /= (double)pixels * channels;
+        return error == 0.0 ? 99.0f : (float)(10.0 * log10(255.0 * 255.0 / error));
+    }
+};
+
+// 2D texture from an image file with the repeat wrap and trilinear filtering the models use
+inline unsigned int LoadTexture2D(const string &path)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    TextureLevels image;
+    if (TextureLoader::Read(path, true, image))
+    {
+        TextureLoader::Allocate(GL_TEXTURE_2D, image, (unsigned int)image.levels.size());
+        TextureLoader::Upload(GL_TEXTURE_2D, image, (unsigned int)image.levels.size());
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
+
+// cube map from six images in the order +X, -X, +Y, -Y, +Z, -Z. Only the base level is loaded, the sky is
+// always sampled at full resolution.
+inline unsigned int LoadTextureCube(const vector<string> &faces)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    vector<TextureLevels> images(faces.size());
+    bool complete = faces.size() == 6;
+    for (unsigned int i = 0; i < faces.size(); i++)
+        complete = TextureLoader::Read(faces[i], false, images[i]) && complete;
+    if (complete)
+    {
+        // all faces share one storage, so they need the same format
+        bool sameFormat = true;
+        for (unsigned int i = 1; i < 6; i++)
+            sameFormat = sameFormat && images[i].compressed == images[0].compressed && images[i].format == images[0].format && images[i].alpha == images[0].alpha;
+        for (unsigned int i = 0; i < 6 && !sameFormat; i++)
+        {
+            TextureLoader::Decode(images[i]);
+            images[i].alpha = true;
+        }
+        TextureLoader::Allocate(GL_TEXTURE_CUBE_MAP, images[0], 1);
+        for (unsigned int i = 0; i < 6; i++)
+            TextureLoader::Upload(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, images[i], 1);
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    return textureID;
+}
+#endif
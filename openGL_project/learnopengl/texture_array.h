@@ -0,0 +1,273 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "learnopengl/texture.h"
+#include "learnopengl/material.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+using namespace std;
+
+// width and height of the atlas layers
+#define TEXTURE_ATLAS_SIZE 1024
+// textures up to this size that don't share their size and format with another one are packed into atlas layers
+// instead of getting an array of their own
+#define TEXTURE_ATLAS_MAX 256
+
+struct TextureArrayStats {
+    unsigned int textures;  // diffuse textures packed
+    unsigned int arrays;    // texture arrays made for them, atlas included
+    unsigned int layers;    // layers of those arrays
+    unsigned int atlased;   // of the textures, those packed into atlas layers
+    size_t bytes;           // texture memory of the arrays
+
+    TextureArrayStats() : textures(0), arrays(0), layers(0), atlased(0), bytes(0)
+    {
+    }
+};
+
+// Moves the diffuse textures of the materials into GL_TEXTURE_2D_ARRAYs, so materials that only differ in their
+// diffuse texture bind the same textures and their meshes can share a draw call (see IndirectBatch). Textures of
+// the same size and format become the layers of one array. A small texture without such a partner is packed into
+// an RGBA8 atlas layer: every texture gets a power of two cell aligned to its size, so each of its mip levels
+// stays on whole texels of the atlas level; the shaders map the texture coordinates into its rectangle. The
+// atlas only has as many levels as its smallest texture, and bilinear filtering at the edge of a rectangle
+// reads half a texel of the neighbour.
+// Run it once every model is loaded, with texture streaming off: it deletes the 2D textures it packed, so
+// materials interned afterwards don't share textures with the packed ones.
+class TextureArrayPacker
+{
+public:
+    static TextureArrayStats Pack(MaterialLibrary &materials)
+    {
+        TextureArrayStats stats;
+        if (materials.streamer)
+        {
+            cout << "ERROR::TEXTURE_ARRAY:: streamed textures can't be packed into arrays" << endl;
+            return stats;
+        }
+
+        // the diffuse textures of the materials that were loaded from files
+        map<unsigned int, string> paths;
+        const map<string, unsigned int> &textures = materials.Textures();
+        for (map<string, unsigned int>::const_iterator it = textures.begin(); it != textures.end(); ++it)
+            paths[it->second] = it->first;
+        vector<unsigned int> ids;
+        vector<TextureLevels> images;
+        for (unsigned int m = 0; m < materials.materials.size(); m++)
+        {
+            unsigned int id = materials.materials[m].textures[MATERIAL_DIFFUSE];
+            if (paths.count(id) == 0 || find(ids.begin(), ids.end(), id) != ids.end())
+                continue;
+            TextureLevels image;
+            if (!TextureLoader::Read(paths[id], true, image))
+                continue;
+            ids.push_back(id);
+            images.push_back(image);
+        }
+
+        // group them by size and format
+        map<LayerFormat, vector<unsigned int> > groups;
+        for (unsigned int i = 0; i < images.size(); i++)
+        {
+            LayerFormat format;
+            format.internalFormat = TextureLoader::InternalFormat(images[i]);
+            format.width = images[i].width;
+            format.height = images[i].height;
+            format.levels = (unsigned int)images[i].levels.size();
+            groups[format].push_back(i);
+        }
+
+        vector<Placement> placements(images.size());
+        vector<unsigned int> atlased;
+        for (map<LayerFormat, vector<unsigned int> >::iterator it = groups.begin(); it != groups.end(); ++it)
+        {
+            const vector<unsigned int> &group = it->second;
+            if (group.size() == 1 && max(it->first.width, it->first.height) <= TEXTURE_ATLAS_MAX)
+            {
+                atlased.push_back(group[0]);
+                continue;
+            }
+            const TextureLevels &first = images[group[0]];
+            unsigned int array = createArray(first, first.width, first.height, it->first.levels, (unsigned int)group.size(), GL_REPEAT);
+            for (unsigned int layer = 0; layer < group.size(); layer++)
+            {
+                const TextureLevels &image = images[group[layer]];
+                for (unsigned int l = 0; l < image.levels.size(); l++)
+                {
+                    upload(image, l, 0, 0, layer);
+                    stats.bytes += image.levels[l].size();
+                }
+                placements[group[layer]] = Placement(array, layer, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+            }
+            stats.arrays++;
+            stats.layers += (unsigned int)group.size();
+        }
+        if (!atlased.empty())
+            packAtlas(images, atlased, placements, stats);
+
+        // point the materials at the arrays, the 2D textures aren't needed any more
+        for (unsigned int m = 0; m < materials.materials.size(); m++)
+        {
+            vector<unsigned int>::iterator it = find(ids.begin(), ids.end(), materials.materials[m].textures[MATERIAL_DIFFUSE]);
+            if (it == ids.end())
+                continue;
+            const Placement &placement = placements[it - ids.begin()];
+            materials.SetDiffuseArray(m, placement.array, (float)placement.layer, placement.rect);
+        }
+        for (unsigned int i = 0; i < ids.size(); i++)
+        {
+            glDeleteTextures(1, &ids[i]);
+            materials.RemoveTexture(paths[ids[i]]);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        materials.InvalidateBindings();
+        stats.textures = (unsigned int)ids.size();
+        stats.atlased = (unsigned int)atlased.size();
+        return stats;
+    }
+
+    static void PrintStats(const TextureArrayStats &stats)
+    {
+        printf("TEXTURE_ARRAYS:: %u diffuse textures in %u arrays with %u layers, %u of them in atlas layers, %.1f MB\n",
+            stats.textures, stats.arrays, stats.layers, stats.atlased, stats.bytes / (1024.0f * 1024.0f));
+    }
+
+private:
+    struct LayerFormat {
+        GLenum internalFormat;
+        unsigned int width, height, levels;
+
+        bool operator<(const LayerFormat &other) const
+        {
+            if (internalFormat != other.internalFormat)
+                return internalFormat < other.internalFormat;
+            if (width != other.width)
+                return width < other.width;
+            if (height != other.height)
+                return height < other.height;
+            return levels < other.levels;
+        }
+    };
+
+    struct Placement {
+        unsigned int array;
+        unsigned int layer;
+        glm::vec4 rect;
+
+        Placement(unsigned int array = 0, unsigned int layer = 0, const glm::vec4 &rect = glm::vec4(0.0f)) : array(array), layer(layer), rect(rect)
+        {
+        }
+    };
+
+    // storage for layers layers of the image's format, bound to GL_TEXTURE_2D_ARRAY
+    static unsigned int createArray(const TextureLevels &format, unsigned int width, unsigned int height, unsigned int levels, unsigned int layers, GLint wrap)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+        GLenum internalFormat = TextureLoader::InternalFormat(format);
+        if (TextureLoader::ImmutableStorage())
+            glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, internalFormat, width, height, layers);
+        else
+        {
+            for (unsigned int l = 0; l < levels; l++)
+            {
+                unsigned int w = max(1u, width >> l), h = max(1u, height >> l);
+                if (format.compressed)
+                    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, l, internalFormat, w, h, layers, 0, (GLsizei)(BlockCompressor::CompressedSize(format.format, w, h) * layers), nullptr);
+                else
+                    glTexImage3D(GL_TEXTURE_2D_ARRAY, l, internalFormat, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return textureID;
+    }
+
+    // level l of image into the bound array at (x, y) of that level's layer
+    static void upload(const TextureLevels &image, unsigned int l, unsigned int x, unsigned int y, unsigned int layer)
+    {
+        unsigned int w = max(1u, image.width >> l), h = max(1u, image.height >> l);
+        if (image.compressed)
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, x, y, layer, w, h, 1, TextureLoader::InternalFormat(image), (GLsizei)image.levels[l].size(), image.levels[l].data());
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, x, y, layer, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.levels[l].data());
+    }
+
+    static unsigned int cellSize(const TextureLevels &image)
+    {
+        unsigned int size = 1;
+        while (size < max(image.width, image.height))
+            size *= 2;
+        return size;
+    }
+
+    // every other bit of value, the x (or y, shifted) of a position along the Z order curve
+    static unsigned int compactBits(unsigned int value)
+    {
+        unsigned int result = 0;
+        for (unsigned int bit = 0; bit < 16; bit++)
+            result |= ((value >> (2 * bit)) & 1) << bit;
+        return result;
+    }
+
+    // Cells are handed out largest first along the Z order curve of each layer. All cells are powers of two and
+    // never grow, so the used part of a layer is always a whole number of the current cells and every cell lands
+    // aligned to its size, without gaps.
+    static void packAtlas(vector<TextureLevels> &images, vector<unsigned int> &entries, vector<Placement> &placements, TextureArrayStats &stats)
+    {
+        sort(entries.begin(), entries.end(), [&images](unsigned int a, unsigned int b) { return cellSize(images[a]) > cellSize(images[b]); });
+        unsigned int levels = 32;
+        for (unsigned int i = 0; i < entries.size(); i++)
+        {
+            TextureLoader::Decode(images[entries[i]]);
+            images[entries[i]].alpha = true;
+            levels = min(levels, (unsigned int)images[entries[i]].levels.size());
+        }
+
+        vector<unsigned int> x(entries.size()), y(entries.size()), layer(entries.size());
+        unsigned int layers = 1;
+        size_t used = 0;
+        for (unsigned int i = 0; i < entries.size(); i++)
+        {
+            size_t cell = cellSize(images[entries[i]]);
+            if (used + cell * cell > (size_t)TEXTURE_ATLAS_SIZE * TEXTURE_ATLAS_SIZE)
+            {
+                layers++;
+                used = 0;
+            }
+            unsigned int position = (unsigned int)(used / (cell * cell));
+            x[i] = compactBits(position) * (unsigned int)cell;
+            y[i] = compactBits(position >> 1) * (unsigned int)cell;
+            layer[i] = layers - 1;
+            used += cell * cell;
+        }
+
+        unsigned int array = createArray(images[entries[0]], TEXTURE_ATLAS_SIZE, TEXTURE_ATLAS_SIZE, levels, layers, GL_CLAMP_TO_EDGE);
+        for (unsigned int i = 0; i < entries.size(); i++)
+        {
+            const TextureLevels &image = images[entries[i]];
+            for (unsigned int l = 0; l < levels; l++)
+                upload(image, l, x[i] >> l, y[i] >> l, layer[i]);
+            glm::vec4 rect(x[i], y[i], image.width, image.height);
+            placements[entries[i]] = Placement(array, layer[i], rect / (float)TEXTURE_ATLAS_SIZE);
+        }
+        for (unsigned int l = 0; l < levels; l++)
+            stats.bytes += (size_t)(TEXTURE_ATLAS_SIZE >> l) * (TEXTURE_ATLAS_SIZE >> l) * 4 * layers;
+        stats.arrays++;
+        stats.layers += layers;
+    }
+};
+#endif
@@ -0,0 +1,361 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include "learnopengl/texture.h"
+#include "learnopengl/ktx2.h"
+#include "learnopengl/material.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cmath>
+#include <cstdio>
+using namespace std;
+
+// levels this size and smaller stay resident from the first load on, so a texture can always be sampled
+#define STREAM_RESIDENT_SIZE 64
+// level loads queued or in progress at once, bounds what the loader threads upload in a single frame
+#define STREAM_MAX_LOADS 4
+
+struct TextureStreamStats {
+    unsigned int textures;   // textures the streamer manages
+    unsigned int partial;    // of those missing levels they were asked for
+    unsigned int loading;    // level loads queued or in progress
+    unsigned int loaded;     // levels streamed in since the start
+    unsigned int evicted;    // levels dropped to stay in the budget since the start
+    size_t residentBytes;    // levels in texture memory
+    size_t budgetBytes;
+    size_t fullBytes;        // what every level of every texture would take
+
+    TextureStreamStats() : textures(0), partial(0), loading(0), loaded(0), evicted(0), residentBytes(0), budgetBytes(0), fullBytes(0)
+    {
+    }
+};
+
+// Streams the mip levels of the material textures under a fixed memory budget. A texture starts with only its
+// levels up to STREAM_RESIDENT_SIZE texels. Every frame the renderer reports the projected size of what it draws
+// (Request), which gives the finest level each texture needs at about one texel per pixel; the missing levels are
+// read from the texture's KTX2 cache by loader threads, one level at a time from coarse to fine, and uploaded by
+// Update on the GL thread. When the next level doesn't fit in the budget, levels are dropped from the least
+// recently used textures first, and from textures that hold more than they were asked for, never from ones
+// that need them this frame.
+// The textures use mutable storage, a level is dropped by respecifying it empty and moving the base level past
+// it, so the memory really goes back to the driver and the GL name the materials hold never changes.
+// Creating a streamer with a budget attaches it to the library, models then load their textures through it.
+class TextureStreamer
+{
+public:
+    TextureStreamStats stats;
+
+    // budget in bytes, 0 leaves the library alone and every texture fully resident
+    TextureStreamer(MaterialLibrary &materials, size_t budget, unsigned int threads = 2) : materials(materials), budget(budget), reserved(0), frame(1), stopping(false)
+    {
+        stats.budgetBytes = budget;
+        if (budget == 0)
+            return;
+        materials.streamer = this;
+        for (unsigned int i = 0; i < threads; i++)
+            loaders.push_back(thread(&TextureStreamer::loaderLoop, this));
+    }
+
+    ~TextureStreamer()
+    {
+        if (materials.streamer == this)
+            materials.streamer = nullptr;
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (unsigned int i = 0; i < loaders.size(); i++)
+            loaders[i].join();
+    }
+
+    // 2D texture from an image file, like LoadTexture2D, with only the small levels resident. Textures whose
+    // levels can't be read back from a cache file are uploaded completely and never streamed.
+    unsigned int Load(const string &path)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        TextureLevels image;
+        if (!TextureLoader::Read(path, true, image))
+            return textureID;
+
+        StreamedTexture texture;
+        texture.id = textureID;
+        texture.file = TextureLoader::CacheFile(path, image);
+        texture.levelCount = (unsigned int)image.levels.size();
+        Ktx2Image header;
+        bool streamable = Ktx2::Read(texture.file, header, false) && header.width == image.width && header.height == image.height
+            && header.vkFormat == (image.compressed ? Ktx2::VkFormat(image.format) : VK_FORMAT_R8G8B8A8_UNORM);
+        texture.pinned = 0;
+        while (streamable && texture.pinned + 1 < texture.levelCount && max(image.width >> texture.pinned, image.height >> texture.pinned) > STREAM_RESIDENT_SIZE)
+            texture.pinned++;
+        texture.resident = texture.requested = texture.wanted = texture.pinned;
+        for (unsigned int l = 0; l < texture.levelCount; l++)
+        {
+            texture.levelBytes.push_back(image.levels[l].size());
+            stats.fullBytes += image.levels[l].size();
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.pinned);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levelCount - 1);
+        texture.image = image;
+        texture.image.levels.clear();
+        TextureStats &loaderStats = TextureLoader::Stats();
+        for (unsigned int l = texture.pinned; l < texture.levelCount; l++)
+        {
+            specify(texture, l, image.levels[l].data());
+            stats.residentBytes += texture.levelBytes[l];
+            loaderStats.bytes += texture.levelBytes[l];
+            loaderStats.uncompressedBytes += (size_t)max(1u, image.width >> l) * max(1u, image.height >> l) * 4;
+        }
+        loaderStats.textures++;
+        if (image.compressed)
+            loaderStats.compressed++;
+        lookup[textureID] = (unsigned int)textures.size();
+        textures.push_back(texture);
+        stats.textures++;
+        return textureID;
+    }
+
+    // the textures of the material are drawn at projectedSize pixels across this frame. The texture is assumed
+    // to be mapped once over that size, so it needs the level where a texel covers about a pixel.
+    void Request(unsigned int materialIndex, float projectedSize)
+    {
+        if (materialIndex >= materials.materials.size())
+            return;
+        const Material &material = materials.materials[materialIndex];
+        for (unsigned int i = 0; i < MATERIAL_TEXTURE_COUNT; i++)
+        {
+            map<unsigned int, unsigned int>::iterator it = lookup.find(material.textures[i]);
+            if (it == lookup.end())
+                continue;
+            StreamedTexture &texture = textures[it->second];
+            float texels = (float)max(texture.image.width, texture.image.height);
+            float ratio = texels / max(projectedSize, 1.0f);
+            unsigned int level = ratio > 1.0f ? (unsigned int)floor(log2(ratio)) : 0;
+            if (texture.lastUsed != frame)
+                texture.requested = texture.levelCount - 1;
+            texture.requested = min(texture.requested, min(level, texture.levelCount - 1));
+            texture.lastUsed = frame;
+        }
+    }
+
+    // once per frame on the GL thread, after the frame's requests: uploads the levels the loaders finished, makes
+    // room in the budget and queues the next loads. Leaves GL_TEXTURE_2D of the active unit unbound if it bound
+    // anything, and tells the material library so.
+    void Update()
+    {
+        bool bound = false;
+        vector<StreamLoad> finished;
+        {
+            lock_guard<mutex> lock(queueMutex);
+            finished.swap(done);
+        }
+        for (unsigned int i = 0; i < finished.size(); i++)
+        {
+            StreamedTexture &texture = textures[finished[i].texture];
+            unsigned int level = finished[i].level;
+            texture.loading = false;
+            reserved -= texture.levelBytes[level];
+            if (finished[i].data.size() != texture.levelBytes[level])
+            {
+                // the cache file went away or is damaged, keep what is resident
+                texture.failed = true;
+                continue;
+            }
+            glBindTexture(GL_TEXTURE_2D, texture.id);
+            bound = true;
+            specify(texture, level, finished[i].data.data());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+            texture.resident = level;
+            stats.residentBytes += texture.levelBytes[level];
+            stats.loaded++;
+        }
+
+        // what this frame asked for; textures it didn't draw keep what they have until the budget needs it
+        vector<unsigned int> candidates;
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            StreamedTexture &texture = textures[i];
+            texture.wanted = texture.lastUsed == frame ? texture.requested : texture.resident;
+            if (texture.wanted < texture.resident && !texture.loading && !texture.failed)
+                candidates.push_back(i);
+        }
+        // the blurriest first
+        sort(candidates.begin(), candidates.end(), [this](unsigned int a, unsigned int b)
+            {
+                return textures[a].resident - textures[a].wanted > textures[b].resident - textures[b].wanted;
+            });
+
+        unsigned int loading = 0;
+        for (unsigned int i = 0; i < textures.size(); i++)
+            loading += textures[i].loading ? 1 : 0;
+        for (unsigned int c = 0; c < candidates.size() && loading < STREAM_MAX_LOADS; c++)
+        {
+            StreamedTexture &texture = textures[candidates[c]];
+            unsigned int level = texture.resident - 1;
+            size_t bytes = texture.levelBytes[level];
+            bool fits = true;
+            while (fits && stats.residentBytes + reserved + bytes > budget)
+            {
+                int victim = leastRecentlyUsed(candidates[c]);
+                if (victim < 0)
+                    fits = false;
+                else
+                {
+                    evict(textures[victim]);
+                    bound = true;
+                }
+            }
+            if (!fits)
+                break;
+            texture.loading = true;
+            reserved += bytes;
+            loading++;
+            StreamLoad load;
+            load.texture = candidates[c];
+            load.level = level;
+            load.file = texture.file;
+            {
+                lock_guard<mutex> lock(queueMutex);
+                queue.push_back(load);
+            }
+            wake.notify_one();
+        }
+
+        stats.loading = loading;
+        stats.partial = 0;
+        for (unsigned int i = 0; i < textures.size(); i++)
+            stats.partial += textures[i].resident > textures[i].wanted ? 1 : 0;
+        if (bound)
+        {
+            glBindTexture(GL_TEXTURE_2D, 0);
+            materials.InvalidateBindings();
+        }
+        frame++;
+    }
+
+    void PrintStats() const
+    {
+        printf("TEXTURE_STREAM:: %u textures, %u missing levels, %.1f MB resident of a %.1f MB budget (%.1f MB with every level), %u levels loaded, %u evicted\n",
+            stats.textures, stats.partial, stats.residentBytes / (1024.0f * 1024.0f), stats.budgetBytes / (1024.0f * 1024.0f), stats.fullBytes / (1024.0f * 1024.0f), stats.loaded, stats.evicted);
+    }
+
+private:
+    struct StreamedTexture {
+        unsigned int id;
+        string file;              // KTX2 cache the levels are streamed from
+        TextureLevels image;      // format and size, the levels themselves aren't kept
+        vector<size_t> levelBytes;
+        unsigned int levelCount;
+        unsigned int pinned;      // levels from this one on are always resident
+        unsigned int resident;    // finest resident level
+        unsigned int requested;   // finest level asked for in the frame lastUsed
+        unsigned int wanted;      // finest level the texture should have
+        unsigned int lastUsed;    // frame of the last request
+        bool loading;             // level resident - 1 is on its way
+        bool failed;              // the cache can't be read any more
+
+        StreamedTexture() : id(0), levelCount(0), pinned(0), resident(0), requested(0), wanted(0), lastUsed(0), loading(false), failed(false)
+        {
+        }
+    };
+
+    struct StreamLoad {
+        unsigned int texture;     // index into textures
+        unsigned int level;
+        string file;
+        vector<unsigned char> data; // empty if the level couldn't be read
+    };
+
+    MaterialLibrary &materials;
+    size_t budget;
+    size_t reserved;              // bytes of the loads in flight
+    unsigned int frame;
+    vector<StreamedTexture> textures;
+    map<unsigned int, unsigned int> lookup; // GL name -> index into textures
+
+    // loader threads
+    vector<thread> loaders;
+    mutex queueMutex;
+    condition_variable wake;
+    deque<StreamLoad> queue;
+    vector<StreamLoad> done;
+    bool stopping;
+
+    void loaderLoop()
+    {
+        for (;;)
+        {
+            StreamLoad load;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping)
+                    return;
+                load = queue.front();
+                queue.pop_front();
+            }
+            if (!Ktx2::ReadLevel(load.file, load.level, load.data))
+                load.data.clear();
+            lock_guard<mutex> lock(queueMutex);
+            done.push_back(load);
+        }
+    }
+
+    // the texture to take a level from to make room for texture keep: the one used longest ago, among those
+    // with levels above their pinned ones that either weren't drawn this frame or hold more than they need.
+    // -1 if there is none.
+    int leastRecentlyUsed(unsigned int keep) const
+    {
+        int victim = -1;
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            const StreamedTexture &texture = textures[i];
+            if (i == keep || texture.loading || texture.resident >= texture.pinned || (texture.lastUsed == frame && texture.resident >= texture.wanted))
+                continue;
+            if (victim < 0 || texture.lastUsed < textures[victim].lastUsed
+                || (texture.lastUsed == textures[victim].lastUsed && texture.wanted - texture.resident > textures[victim].wanted - textures[victim].resident))
+                victim = (int)i;
+        }
+        return victim;
+    }
+
+    // drops the finest resident level of the texture
+    void evict(StreamedTexture &texture)
+    {
+        unsigned int level = texture.resident;
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+        specify(texture, level, nullptr);
+        texture.resident = level + 1;
+        stats.residentBytes -= texture.levelBytes[level];
+        stats.evicted++;
+    }
+
+    // (re)specifies a level of the bound texture, an empty one if data is null
+    static void specify(const StreamedTexture &texture, unsigned int level, const unsigned char *data)
+    {
+        unsigned int w = data ? max(1u, texture.image.width >> level) : 0, h = data ? max(1u, texture.image.height >> level) : 0;
+        GLenum internalFormat = TextureLoader::InternalFormat(texture.image);
+        if (texture.image.compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, w, h, 0, data ? (GLsizei)texture.levelBytes[level] : 0, data);
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, internalFormat, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    }
+};
+#endif
@@ -0,0 +1,213 @@
+#ifndef TRANSFORM_KERNEL_H
+#define TRANSFORM_KERNEL_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+using namespace std;
+
+// The instruction set is picked at compile time: AVX when the compiler targets it (/arch:AVX or -mavx), SSE on
+// every x64 build, scalar code everywhere else. Define TRANSFORM_KERNEL_SCALAR to force the scalar path.
+#if !defined(TRANSFORM_KERNEL_SCALAR) && defined(__AVX__)
+#define TRANSFORM_KERNEL_AVX
+#include <immintrin.h>
+#elif !defined(TRANSFORM_KERNEL_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define TRANSFORM_KERNEL_SSE
+#include <xmmintrin.h>
+#endif
+
+// structure of arrays input of TransformKernel::ComposeTRS, every array holds one value per instance
+struct TRSArrays {
+    const float *tx, *ty, *tz;      // translation
+    const float *qx, *qy, *qz, *qw; // rotation, unit quaternion
+    const float *scale;             // uniform scale
+};
+
+// Builds model matrices out[i] = T(t[i]) * R(q[i]) * S(scale[i]) * post for arrays of instances, 4 (SSE) or
+// 8 (AVX) instances at a time. Each lane holds the same matrix element of a different instance, so the whole
+// composition is a fixed sequence of multiply-adds without trig and without 4x4 products. The matrices are
+// transposed back to glm's column major layout on the way out and written in order, which suits mapped
+// (write combined) buffer memory.
+class TransformKernel
+{
+public:
+    static const char *Name()
+    {
+#if defined(TRANSFORM_KERNEL_AVX)
+        return "AVX";
+#elif defined(TRANSFORM_KERNEL_SSE)
+        return "SSE";
+#else
+        return "scalar";
+#endif
+    }
+
+    // post is an affine matrix applied before the instance transform, e.g. the rotation that makes a model stand
+    static void ComposeTRS(const TRSArrays &in, unsigned int count, const glm::mat4 &post, glm::mat4 *out)
+    {
+        unsigned int i = 0;
+#if defined(TRANSFORM_KERNEL_AVX)
+        for (; i + 8 <= count; i += 8)
+            composeBlock<AVXLanes>(in, i, post, out);
+#endif
+#if defined(TRANSFORM_KERNEL_AVX) || defined(TRANSFORM_KERNEL_SSE)
+        for (; i + 4 <= count; i += 4)
+            composeBlock<SSELanes>(in, i, post, out);
+#endif
+        for (; i < count; i++)
+            composeBlock<ScalarLanes>(in, i, post, out);
+    }
+
+    // compares the kernel with chaining glm::translate/rotate/scale per instance and prints the cost per instance
+    static void Benchmark(unsigned int count)
+    {
+        vector<float> tx(count), ty(count), tz(count), qx(count), qy(count), qz(count), qw(count), scale(count), angle(count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            tx[i] = (float)(i % 100);
+            ty[i] = 0.5f;
+            tz[i] = (float)(i / 100);
+            angle[i] = i * 0.001f;
+            qx[i] = qz[i] = 0.0f;
+            qy[i] = sin(angle[i] * 0.5f);
+            qw[i] = cos(angle[i] * 0.5f);
+            scale[i] = 1.0f + (i % 7) * 0.1f;
+        }
+        glm::mat4 post = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+        TRSArrays in = { &tx[0], &ty[0], &tz[0], &qx[0], &qy[0], &qz[0], &qw[0], &scale[0] };
+        vector<glm::mat4> kernel(count), reference(count);
+
+        const int runs = 20;
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < runs; r++)
+            ComposeTRS(in, count, post, &kernel[0]);
+        double kernelNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / runs / count;
+
+        start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < runs; r++)
+            for (unsigned int i = 0; i < count; i++)
+            {
+                glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(tx[i], ty[i], tz[i]));
+                m = glm::rotate(m, angle[i], glm::vec3(0.0f, 1.0f, 0.0f));
+                m = glm::scale(m, glm::vec3(scale[i]));
+                reference[i] = m * post;
+            }
+        double referenceNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / runs / count;
+
+        float maxError = 0.0f;
+        for (unsigned int i = 0; i < count; i++)
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    maxError = max(maxError, fabs(kernel[i][c][r] - reference[i][c][r]));
+        printf("TRANSFORM_KERNEL:: %u instances, %s kernel %.2f ns, glm chain %.2f ns per instance, max difference %g\n", count, Name(), kernelNs, referenceNs, maxError);
+    }
+
+private:
+    // one instance per "lane", the reference for the vector versions and the tail of every array
+    struct ScalarLanes {
+        typedef float V;
+        enum { Width = 1 };
+        static V load(const float *p) { return *p; }
+        static V set1(float f) { return f; }
+        static V add(V a, V b) { return a + b; }
+        static V sub(V a, V b) { return a - b; }
+        static V mul(V a, V b) { return a * b; }
+        static void store(const V m[16], glm::mat4 *out)
+        {
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    (*out)[c][r] = m[c * 4 + r];
+        }
+    };
+
+#if defined(TRANSFORM_KERNEL_AVX) || defined(TRANSFORM_KERNEL_SSE)
+    struct SSELanes {
+        typedef __m128 V;
+        enum { Width = 4 };
+        static V load(const float *p) { return _mm_loadu_ps(p); }
+        static V set1(float f) { return _mm_set1_ps(f); }
+        static V add(V a, V b) { return _mm_add_ps(a, b); }
+        static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+        static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+        // m[c * 4 + r] holds element (c, r) of four instances, a 4x4 transpose per column turns that into columns
+        static void store(const V m[16], glm::mat4 *out)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                __m128 r0 = m[c * 4], r1 = m[c * 4 + 1], r2 = m[c * 4 + 2], r3 = m[c * 4 + 3];
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps(&out[0][c][0], r0);
+                _mm_storeu_ps(&out[1][c][0], r1);
+                _mm_storeu_ps(&out[2][c][0], r2);
+                _mm_storeu_ps(&out[3][c][0], r3);
+            }
+        }
+    };
+#endif
+
+#if defined(TRANSFORM_KERNEL_AVX)
+    struct AVXLanes {
+        typedef __m256 V;
+        enum { Width = 8 };
+        static V load(const float *p) { return _mm256_loadu_ps(p); }
+        static V set1(float f) { return _mm256_set1_ps(f); }
+        static V add(V a, V b) { return _mm256_add_ps(a, b); }
+        static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+        static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+        // the low and high halves are two groups of four instances, each transposed like the SSE version
+        static void store(const V m[16], glm::mat4 *out)
+        {
+            __m128 low[16], high[16];
+            for (int k = 0; k < 16; k++)
+            {
+                low[k] = _mm256_castps256_ps128(m[k]);
+                high[k] = _mm256_extractf128_ps(m[k], 1);
+            }
+            SSELanes::store(low, out);
+            SSELanes::store(high, out + 4);
+        }
+    };
+#endif
+
+    template <class L>
+    static void composeBlock(const TRSArrays &in, unsigned int i, const glm::mat4 &post, glm::mat4 *out)
+    {
+        typedef typename L::V V;
+        V x = L::load(in.qx + i), y = L::load(in.qy + i), z = L::load(in.qz + i), w = L::load(in.qw + i);
+        V s = L::load(in.scale + i);
+        V one = L::set1(1.0f), two = L::set1(2.0f);
+
+        // rotation matrix of the quaternion times the scale, a[row][column]
+        V xx = L::mul(x, x), yy = L::mul(y, y), zz = L::mul(z, z);
+        V xy = L::mul(x, y), xz = L::mul(x, z), yz = L::mul(y, z);
+        V wx = L::mul(w, x), wy = L::mul(w, y), wz = L::mul(w, z);
+        V s2 = L::mul(s, two);
+        V a[3][3];
+        a[0][0] = L::mul(s, L::sub(one, L::mul(two, L::add(yy, zz))));
+        a[0][1] = L::mul(s2, L::sub(xy, wz));
+        a[0][2] = L::mul(s2, L::add(xz, wy));
+        a[1][0] = L::mul(s2, L::add(xy, wz));
+        a[1][1] = L::mul(s, L::sub(one, L::mul(two, L::add(xx, zz))));
+        a[1][2] = L::mul(s2, L::sub(yz, wx));
+        a[2][0] = L::mul(s2, L::sub(xz, wy));
+        a[2][1] = L::mul(s2, L::add(yz, wx));
+        a[2][2] = L::mul(s, L::sub(one, L::mul(two, L::add(xx, yy))));
+        V t[3] = { L::load(in.tx + i), L::load(in.ty + i), L::load(in.tz + i) };
+
+        // [a t; 0 1] * post, element (column c, row r) at m[c * 4 + r]
+        V m[16];
+        for (int c = 0; c < 4; c++)
+        {
+            V b0 = L::set1(post[c][0]), b1 = L::set1(post[c][1]), b2 = L::set1(post[c][2]), b3 = L::set1(post[c][3]);
+            for (int r = 0; r < 3; r++)
+                m[c * 4 + r] = L::add(L::add(L::mul(a[r][0], b0), L::mul(a[r][1], b1)), L::add(L::mul(a[r][2], b2), L::mul(t[r], b3)));
+            m[c * 4 + 3] = b3;
+        }
+        L::store(m, out + i);
+    }
+};
+#endif
@@ -0,0 +1,28 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <glm/glm.hpp>
+
+#define MAX_BONE_INFLUENCE 4
+// first vertex attribute of the per-instance model matrix (a mat4 takes four attributes, 7 to 10)
+#define INSTANCE_MATRIX_ATTRIBUTE 7
+// per-instance material index of draws that merge several materials, -1 (use the materialIndex uniform) when unset
+#define INSTANCE_MATERIAL_ATTRIBUTE 11
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+	//bone indexes which will influence this vertex
+	int m_BoneIDs[MAX_BONE_INFLUENCE];
+	//weights from each bone
+	float m_Weights[MAX_BONE_INFLUENCE];
+};
+#endif
@@ -9,9 +9,26 @@
 #include "learnopengl/shader.h"
 #include "learnopengl/camera.h"
 #include "learnopengl/model.h"
+#include "learnopengl/static_batch.h"
+#include "learnopengl/shadow_map.h"
+#include "learnopengl/herd_animator.h"
+#include "learnopengl/crowd.h"
+#include "learnopengl/transform_kernel.h"
+#include "learnopengl/job_system.h"
+#include "learnopengl/frame_pipeline.h"
+#include "learnopengl/stream_ring.h"
+#include "learnopengl/frame_uniforms.h"
+#include "learnopengl/mesh_arena.h"
+#include "learnopengl/indirect_draw.h"
+#include "learnopengl/texture_array.h"
+#include "learnopengl/asset_packer.h"
+#include "learnopengl/hot_reload.h"
+#include "learnopengl/depth_prepass.h"
 
 #include <iostream>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define PI 3.1415926
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -35,8 +52,150 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-int main()
+// one step of the simulation thread, everything the render loop draws from
+struct ScenePacket {
+    double time; // end of the step on the SimulationThread clock
+    glm::mat4 model, man1model, man2model, man3model, modelk, horse1model;
+    CrowdPose crowd;
+
+    ScenePacket() : time(0.0), model(1.0f), man1model(1.0f), man2model(1.0f), man3model(1.0f), modelk(1.0f), horse1model(1.0f)
+    {
+    }
+};
+
+int main(int argc, char** argv)
 {
+    // command line: --crowd <horses> <spectators> replaces the scripted actors with a crowd on the race track,
+    // --occlusion hides the crowd instances behind the nearest ones with a software Hi-Z buffer (see OcclusionCuller),
+    // --crowd-benchmark runs the crowd with 10 to 100k horses, prints where the frame time goes and exits,
+    // --transform-benchmark times the instance transform kernel against glm for 10 to 100k instances and exits,
+    // --job-benchmark measures the job system's overhead and speedup and exits,
+    // --arena-benchmark times the geometry arena's range allocator against a first-fit free list and exits,
+    // --occlusion-benchmark checks the software occlusion culler against a known scene without a window and exits,
+    // --texture-quality fast|normal|high picks the block compression preset (high prefers BC7),
+    // --raw-textures uploads textures uncompressed,
+    // --mip-filter box|kaiser|lanczos picks the filter the mip levels are built with (default kaiser),
+    // --texture-budget <MB> is the texture memory the streamed model textures may take (default 128, 0 loads
+    // every level up front),
+    // --texture-arrays packs the diffuse textures into texture arrays and atlases so materials share draws (turns
+    // texture streaming off),
+    // --compress-textures [images] encodes the images (default: the scene's) to every block format, fills the
+    // texture cache, prints encoding time and error and exits,
+    // --decode-benchmark [images] compares the decode throughput of stb_image and the JPEG backend (libjpeg-turbo
+    // when built with HAVE_TURBOJPEG) on the images (default: the scene's) and exits,
+    // --pack <archive> cooks the assets below resources/ (texture caches with the texture settings given before it,
+    // shaders without comments) into one archive and exits, LZ4 compressed when built with HAVE_LZ4,
+    // --archive <archive> reads the assets from such an archive, files missing from it still come from disk,
+    // --hot-reload rebuilds the shaders and models whose files change on disk while the scene runs,
+    // --depth-prepass draws the opaque scene depth-only first, then shades it with GL_EQUAL,
+    // --overdraw shows how often every pixel was shaded instead of the lit scene (see DepthPrepass)
+    bool crowdMode = false;
+    bool crowdBenchmark = false;
+    unsigned int crowdHorses = 1000;
+    unsigned int crowdSpectators = 250;
+    size_t textureBudget = 128;
+    bool textureArrays = false;
+    bool hotReload = false;
+    bool depthPrepass = false;
+    bool overdraw = false;
+    bool occlusionCulling = false;
+    const vector<string> sceneImages = {
+        "resources/Horse/Horse_v01.jpg",
+        "resources/grass/10450_Rectangular_Grass_Patch_v1_Diffuse.jpg",
+        "resources/textures/texture.jpeg",
+        "resources/textures/skybox/right.jpg",
+        "resources/textures/skybox/left.jpg",
+        "resources/textures/skybox/top.jpg",
+        "resources/textures/skybox/bottom.jpg",
+        "resources/textures/skybox/front.jpg",
+        "resources/textures/skybox/back.jpg"
+    };
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--crowd") == 0)
+        {
+            crowdMode = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                crowdHorses = (unsigned int)atoi(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                crowdSpectators = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--crowd-benchmark") == 0)
+            crowdMode = crowdBenchmark = true;
+        else if (strcmp(argv[i], "--transform-benchmark") == 0)
+        {
+            for (unsigned int count = 10; count <= 100000; count *= 10)
+                TransformKernel::Benchmark(count);
+            return 0;
+        }
+        else if (strcmp(argv[i], "--job-benchmark") == 0)
+        {
+            JobSystem jobs;
+            JobBenchmark::Run(jobs);
+            return 0;
+        }
+        else if (strcmp(argv[i], "--arena-benchmark") == 0)
+        {
+            RangeAllocatorBenchmark::Run();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--occlusion-benchmark") == 0)
+        {
+            OcclusionBenchmark::Run();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--occlusion") == 0)
+            occlusionCulling = true;
+        else if (strcmp(argv[i], "--texture-quality") == 0 && i + 1 < argc)
+        {
+            i++;
+            TextureLoader::Settings().quality = strcmp(argv[i], "fast") == 0 ? COMPRESSION_FAST : strcmp(argv[i], "high") == 0 ? COMPRESSION_HIGH : COMPRESSION_NORMAL;
+        }
+        else if (strcmp(argv[i], "--raw-textures") == 0)
+            TextureLoader::Settings().compress = false;
+        else if (strcmp(argv[i], "--mip-filter") == 0 && i + 1 < argc)
+        {
+            i++;
+            TextureLoader::Settings().mipFilter = strcmp(argv[i], "box") == 0 ? MIP_FILTER_BOX : strcmp(argv[i], "lanczos") == 0 ? MIP_FILTER_LANCZOS : MIP_FILTER_KAISER;
+        }
+        else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+            textureBudget = (size_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--texture-arrays") == 0)
+            textureArrays = true;
+        else if (strcmp(argv[i], "--compress-textures") == 0)
+        {
+            vector<string> images;
+            while (i + 1 < argc && argv[i + 1][0] != '-')
+                images.push_back(argv[++i]);
+            if (images.empty())
+                images = sceneImages;
+            TextureLoader::Precompress(images, TextureLoader::Settings().quality);
+            return 0;
+        }
+        else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+        {
+            return AssetPacker::Pack(argv[++i], "resources") ? 0 : -1;
+        }
+        else if (strcmp(argv[i], "--archive") == 0 && i + 1 < argc)
+            FileSystem::Mount(argv[++i]);
+        else if (strcmp(argv[i], "--hot-reload") == 0)
+            hotReload = true;
+        else if (strcmp(argv[i], "--depth-prepass") == 0)
+            depthPrepass = true;
+        else if (strcmp(argv[i], "--overdraw") == 0)
+            overdraw = true;
+        else if (strcmp(argv[i], "--decode-benchmark") == 0)
+        {
+            vector<string> images;
+            while (i + 1 < argc && argv[i + 1][0] != '-')
+                images.push_back(argv[++i]);
+            if (images.empty())
+                images = sceneImages;
+            ImageDecoder::Benchmark(images);
+            return 0;
+        }
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -58,6 +217,9 @@ int main()
         return -1;
     }
     glfwMakeContextCurrent(window);
+    // the benchmark measures frame times, so it must not wait for the display
+    if (crowdBenchmark)
+        glfwSwapInterval(0);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
@@ -87,6 +249,8 @@ int main()
     Shader man1Shader("resources/shader/man1.vs","resources/shader/man1.fs");
     Shader man2Shader("resources/shader/man2.vs", "resources/shader/man2.fs");
     Shader man3Shader("resources/shader/man3.vs", "resources/shader/man3.fs");
+    Shader shadowDepthShader("resources/shader/shadowDepth.vs", "resources/shader/shadowDepth.fs");
+    Shader crowdShader("resources/shader/crowd.vs", "resources/shader/horse1.fs");
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -179,39 +343,75 @@ int main()
          1.0f, -1.0f,  1.0f
     };
 
-    Model ourModel("resources/Horse/10026_Horse_v01_it2.obj");
-    Model horse1Model("resources/Horse/10026_Horse_v01_it2.obj");
-    //Model ourModel("resources/stickman/stickman.OBJ");
-    Model grassGroundModel("resources/grass/10450_Rectangular_Grass_Patch_v1_iterations-2.obj");
-    Model man1Model("resources/stickman/stickman.OBJ");
-    Model man2Model("resources/stickman/stickman.OBJ");
-    Model man3Model("resources/stickman/stickman.OBJ");
-
-    // cube VAO
-    unsigned int cubeVAO, cubeVBO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &cubeVBO);
-    glBindVertexArray(cubeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-
-    // skybox VAO
-    unsigned int skyboxVAO, skyboxVBO;
-    glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    // all models share one material table, so the textures of the horse and the stickman are only loaded once,
+    // and one geometry arena: a vertex buffer per vertex format and one index buffer for every mesh of the scene
+    MaterialLibrary materials;
+    MeshArena arena;
+    // the models load their textures with only the small mip levels, the rest is streamed in by distance
+    TextureStreamer streamer(materials, textureArrays ? 0 : textureBudget << 20);
+    Model ourModel("resources/Horse/10026_Horse_v01_it2.obj", materials, arena);
+    Model horse1Model("resources/Horse/10026_Horse_v01_it2.obj", materials, arena);
+    //Model ourModel("resources/stickman/stickman.OBJ", materials, arena);
+    Model grassGroundModel("resources/grass/10450_Rectangular_Grass_Patch_v1_iterations-2.obj", materials, arena);
+    Model man1Model("resources/stickman/stickman.OBJ", materials, arena);
+    Model man2Model("resources/stickman/stickman.OBJ", materials, arena);
+    Model man3Model("resources/stickman/stickman.OBJ", materials, arena);
+
+    // static scenery is merged into one buffer per material with its world transform baked in.
+    // the spinning cube is animated every frame, so it stays a separate object with its own model matrix.
+    StaticBatch staticScenery(materials, arena);
+    glm::mat4 grassmodel = glm::mat4(1.0f);
+    grassmodel = glm::translate(grassmodel, glm::vec3(0.0f, -10.0f, 0.0f));
+    grassmodel = glm::rotate(grassmodel, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+    staticScenery.Add(grassGroundModel, grassmodel);
+    staticScenery.Build();
+    // the grass patch was only needed as a source for the batch
+    grassGroundModel.Release();
+
+    // skybox cube, in the arena's position-only format
+    unsigned int skyboxIndices[36];
+    for (unsigned int i = 0; i < 36; i++)
+        skyboxIndices[i] = i;
+    unsigned int skyboxGeometry = arena.Add(VERTEX_FORMAT_POSITION, skyboxVertices, 36, skyboxIndices, 36);
 
     // load textures
     // -------------
     unsigned int cubeTexture = loadTexture("resources/textures/texture.jpeg");
+    Material cubeMaterial;
+    cubeMaterial.textures[MATERIAL_DIFFUSE] = cubeTexture;
+    unsigned int cubeMaterialIndex = materials.Intern(cubeMaterial);
+
+    // the cube as a mesh, so it can be drawn from the mesh arena like the rest of the scene
+    vector<Vertex> cubeMeshVertices;
+    vector<unsigned int> cubeMeshIndices;
+    for (unsigned int i = 0; i < 36; i++)
+    {
+        Vertex vertex;
+        vertex.Position = glm::vec3(cubeVertices[i * 5], cubeVertices[i * 5 + 1], cubeVertices[i * 5 + 2]);
+        vertex.Normal = glm::vec3(0.0f);
+        vertex.TexCoords = glm::vec2(cubeVertices[i * 5 + 3], cubeVertices[i * 5 + 4]);
+        vertex.Tangent = glm::vec3(0.0f);
+        vertex.Bitangent = glm::vec3(0.0f);
+        for (unsigned int j = 0; j < MAX_BONE_INFLUENCE; j++)
+        {
+            vertex.m_BoneIDs[j] = -1;
+            vertex.m_Weights[j] = 0.0f;
+        }
+        cubeMeshVertices.push_back(vertex);
+        cubeMeshIndices.push_back(i);
+    }
+    Mesh cubeMesh(cubeMeshVertices, cubeMeshIndices, cubeMaterialIndex, arena);
+
+    // rigid meshes are drawn from the arena in indirect batches, one call per material; only skinned meshes and
+    // the skybox still take a call each.
+    IndirectBatch sceneryBatch(arena, materials);
+    for (unsigned int i = 0; i < staticScenery.meshes.size(); i++)
+        sceneryBatch.Add(staticScenery.meshes[i], 0, glm::mat4(1.0f));
+    IndirectBatch cubeBatch(arena, materials);
+    IndirectBatch actorBatch(arena, materials);
+    // the released grass patch left holes, move everything together before the frame loop starts
+    arena.Defragment();
+    cout << "INDIRECT_DRAW:: " << IndirectBatch::PathName(IndirectBatch::SupportedPath()) << ", arena holds " << arena.VertexCount() << " vertices and " << arena.IndexCount() << " indices in " << (arena.CapacityBytes() >> 20) << " MB, " << arena.FreeRanges() << " free ranges" << endl;
 
     vector<std::string> faces
     {
@@ -223,6 +423,10 @@ int main()
         "resources/textures/skybox/back.jpg"
     };
     unsigned int cubemapTexture = loadCubemap(faces);
+    TextureLoader::PrintStats();
+    FileSystem::PrintStats();
+    if (textureArrays)
+        TextureArrayPacker::PrintStats(TextureArrayPacker::Pack(materials));
 
     // shader configuration
     // --------------------
@@ -232,6 +436,71 @@ int main()
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
 
+    materials.SetupShader(grassShader);
+    materials.SetupShader(ourShader);
+    materials.SetupShader(horse1Shader);
+    materials.SetupShader(man1Shader);
+    materials.SetupShader(man2Shader);
+    materials.SetupShader(man3Shader);
+    materials.SetupShader(crowdShader);
+    materials.Upload();
+
+    // per-frame data (the Frame block, skinning palettes, crowd instances) is streamed through one ring buffer,
+    // persistently mapped where the driver supports it
+    StreamRing ring;
+    FrameUniforms frameUniforms;
+
+    // skeletal animation: the horses play the first clip of their model file, posed in parallel on the worker pool
+    // and skinned on the GPU. Both horses load the same file, so they share the skeleton. Rigid models (no bones,
+    // all weights 0) are drawn by the same skinning shaders and ignore whatever palette is bound.
+    JobSystem jobs;
+    const Animation *gallop = horse1Model.animations.empty() ? nullptr : &horse1Model.animations[0];
+    HerdAnimator horses(gallop ? Skeleton(*gallop) : Skeleton(), jobs, ring);
+    unsigned int ourHorse = horses.AddInstance(gallop);
+    unsigned int horse1 = horses.AddInstance(gallop, 0.3f); // out of step with the first horse
+    BonePalette restPalette;
+    restPalette.Bind();
+
+    // cascaded shadow map of the scene light, see ShadowSettings for the resolution, cascade and caster culling knobs
+    ShadowMap shadowMap;
+    shadowMap.SetupShader(grassShader);
+    shadowMap.SetupShader(ourShader);
+    shadowMap.SetupShader(horse1Shader);
+    shadowMap.SetupShader(man1Shader);
+    shadowMap.SetupShader(man2Shader);
+    shadowMap.SetupShader(man3Shader);
+    shadowMap.SetupShader(crowdShader);
+
+    // the opaque scene: the cube, the actors or the crowd and the scenery, optionally after a depth-only pass
+    DepthPrepass prepass(depthPrepass, overdraw);
+    prepass.Add(shader);
+    prepass.Add(grassShader);
+    prepass.Add(ourShader);
+    prepass.Add(horse1Shader);
+    prepass.Add(man1Shader);
+    prepass.Add(man2Shader);
+    prepass.Add(man3Shader);
+    prepass.Add(crowdShader);
+
+    // shaders and models are swapped between frames, the state set up above carries over to a rebuilt program.
+    // The grass patch only lives on in the static batch, it isn't watched.
+    unique_ptr<HotReload> reloader;
+    if (hotReload)
+    {
+        reloader.reset(new HotReload(materials));
+        Shader *watchedShaders[] = { &grassShader, &ourShader, &shader, &skyboxShader, &horse1Shader, &man1Shader, &man2Shader, &man3Shader, &shadowDepthShader, &crowdShader };
+        for (unsigned int i = 0; i < sizeof(watchedShaders) / sizeof(watchedShaders[0]); i++)
+            reloader->Watch(*watchedShaders[i]);
+        // the depth-only programs share the vertex shaders, they have to follow every change of them
+        vector<Shader *> prepassShaders = prepass.Built();
+        for (unsigned int i = 0; i < prepassShaders.size(); i++)
+            reloader->Watch(*prepassShaders[i]);
+        reloader->Watch(ourModel, "resources/Horse/10026_Horse_v01_it2.obj");
+        reloader->Watch(horse1Model, "resources/Horse/10026_Horse_v01_it2.obj");
+        reloader->Watch(man1Model, "resources/stickman/stickman.OBJ");
+        reloader->Watch(man2Model, "resources/stickman/stickman.OBJ");
+        reloader->Watch(man3Model, "resources/stickman/stickman.OBJ");
+    }
 
     glm::vec3 p1 = glm::vec3(-40.0f, 0.0f, -40.0f);
     glm::vec3 p2 = glm::vec3(-40.0f, 0.0f, 40.0f);
@@ -249,8 +518,285 @@ int main()
     float lastz = p1.z;
 
     glm::vec3 lightPosition = glm::vec3(1.0f,15.0f,0.0f);
+    // the shadows fall from the light towards the middle of the track, on the grass ground
+    glm::vec3 trackCenter = glm::vec3(0.0f, -10.0f, 0.0f);
+    // crowd mode: horses on lanes of the track the scripted horse follows, stickman spectators around it
+    CrowdSimulation crowdSimulation(jobs, RaceTrack(p1, p2, p3, p4, p5, trackCenter.y));
+    Crowd crowd(horse1Model, man1Model, jobs, ring, trackCenter.y);
+    crowd.occlusion.settings.enabled = occlusionCulling;
+    CrowdBenchmark benchmark;
+    if (crowdBenchmark)
+    {
+        // look at the whole track from above its far end
+        camera = Camera(glm::vec3(0.0f, 30.0f, 80.0f), glm::vec3(0.0f, 1.0f, 0.0f), -90.0f, -25.0f);
+        crowdSimulation.Spawn(benchmark.Horses(), benchmark.Spectators());
+    }
+    else if (crowdMode)
+        crowdSimulation.Spawn(crowdHorses, crowdSpectators);
+    // the benchmark asks the simulation thread for the next crowd size through these
+    atomic<bool> respawnRequested(false);
+    atomic<unsigned int> respawnHorses(0), respawnSpectators(0);
+    // detail level state of every actor
+    LodState ourLod, horse1Lod, man1Lod, man2Lod, man3Lod;
     float tFrame = 0.0f;
 
+    // The simulation runs on its own thread in fixed steps: a frame graph animates the scripted actors next to the
+    // crowd and writes the result into the back packet of a mailbox. The render loop takes the newest packet without
+    // waiting, draws the state between the last two packets, and with vsync on the simulation keeps stepping while
+    // the render thread waits for the swap. Input and camera stay with the render loop, which owns the window.
+    // The simulation graph is run by the simulation thread, so none of its tasks may be TASK_MAIN_THREAD.
+    SimulationThread simulationThread(1.0f / 60.0f);
+    FrameMailbox<ScenePacket> packets;
+    FrameGraph simulation;
+    simulation.AddTask("animate actors", [&]
+        {
+            float dt = simulationThread.Step();
+            tFrame += dt;
+            firstTime += dt;
+            if (firstTime > stopTime) {
+                firstTime = firstTime - stopTime;
+            }
+            finaltime = firstTime / stopTime;
+        
+
+            //glm::vec3 posi = (1 - tFrame) * (1 - tFrame) * p1 + 2 * (tFrame) * (1 - tFrame) * p2 + tFrame * tFrame * p3;
+            //glm::vec3 deltaPosi = posi - lastPosi;
+            //lastPosi = posi;
+            float posix = pow((1 - finaltime),4) * p1.x + 4 * pow((1 - finaltime), 3) * finaltime * p2.x + 6 * pow((finaltime), 2) * pow((1 - finaltime),2) * p3.x + 4 * pow((finaltime), 3) * (1 - finaltime) * p4.x + pow((finaltime), 4) * p5.x;
+            float posiy = pow((1 - finaltime),4) * p1.y + 4 * pow((1 - finaltime), 3) * finaltime * p2.y + 6 * pow((finaltime), 2) * pow((1 - finaltime),2) * p3.y + 4 * pow((finaltime), 3) * (1 - finaltime) * p4.y + pow((finaltime), 4) * p5.y;
+            float posiz = pow((1 - finaltime),4) * p1.z + 4 * pow((1 - finaltime), 3) * finaltime * p2.z + 6 * pow((finaltime), 2) * pow((1 - finaltime),2) * p3.z + 4 * pow((finaltime), 3) * (1 - finaltime) * p4.z + pow((finaltime), 4) * p5.z;
+            float deltax = posix - lastx;
+            float deltay = posiy - lasty;
+            float deltaz = posiz - lastz;
+            glm::mat4 model = glm::mat4(1.0f);
+           // model = glm::translate(model, deltaPosi);
+           // model = glm::translate(model, glm::vec3(deltax, deltay, deltaz));
+            model = glm::translate(model, glm::vec3(5.0f, -0.5f, 0.5f));
+            model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(0.0f, 0.0f, 1.0f));
+
+            glm::mat4 man1model = glm::mat4(1.0f);
+            man1model = glm::translate(man1model, glm::vec3(-2.0f, -1.5f, -10.0f)); // translate it down so it's at the center of the scene
+            //man1model = glm::rotate(man1model, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+            man1model = glm::scale(man1model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
+
+            glm::mat4 man2model = glm::mat4(1.0f);
+            if (tFrame > 16.0f && tFrame < 18.0f) {
+                man2model = glm::translate(man2model, glm::vec3(0.0f, -3.5f, -10.0f)); // translate it down so it's at the center of the scene
+                man2model = glm::scale(man2model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
+            }
+            else if (tFrame > 24.0f && tFrame < 26.0f) {
+                man2model = glm::translate(man2model, glm::vec3(0.0f, 3.5f, -10.0f)); // translate it down so it's at the center of the scene
+                man2model = glm::scale(man2model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
+            }
+            else if (tFrame > 32.0f && tFrame < 34.0f) {
+                man2model = glm::translate(man2model, glm::vec3(0.0f, 3.5f, -10.0f)); // translate it down so it's at the center of the scene
+                man2model = glm::scale(man2model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
+            }
+            else {
+                man2model = glm::translate(man2model, glm::vec3(0.0f, -0.5f, -10.0f)); // translate it down so it's at the center of the scene
+                man2model = glm::scale(man2model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
+            }
+
+            glm::mat4 man3model = glm::mat4(1.0f);
+            if (tFrame > 16.0f && tFrame < 18.0f) {
+                man3model = glm::translate(man3model, glm::vec3(3.0f, 3.3f, -10.0f)); // translate it down so it's at the center of the scene
+                man3model = glm::scale(man3model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
+            }
+            else if (tFrame > 24.0f && tFrame < 26.0f) {
+                man3model = glm::translate(man3model, glm::vec3(3.0f, -1.3f, -10.0f)); // translate it down so it's at the center of the scene
+                man3model = glm::scale(man3model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
+            }
+            else if (tFrame > 32.0f && tFrame < 34.0f) {
+                man3model = glm::translate(man3model, glm::vec3(3.0f, -1.3f, -10.0f)); // translate it down so it's at the center of the scene
+                man3model = glm::scale(man3model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
+            }
+            else {
+                man3model = glm::translate(man3model, glm::vec3(3.0f, -0.3f, -10.0f)); // translate it down so it's at the center of the scene
+                man3model = glm::scale(man3model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
+            }
+
+            glm::mat4 modelk = glm::mat4(1.0f);
+            //float ABlength = sqrt(deltax * deltax + deltaz * deltaz);
+            float angle = finaltime * 2 * PI;
+            modelk = glm::translate(modelk, glm::vec3(deltax, deltay, deltaz));
+            modelk = glm::rotate(modelk, (angle), glm::vec3(0.0f, 1.0f, 0.0f));
+            if (tFrame < 16.0f) {
+                modelk = glm::translate(modelk, glm::vec3(0.0f, -2.4f, 0.0f)); // translate it down so it's at the center of the scene
+                modelk = glm::rotate(modelk, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+                modelk = glm::scale(modelk, glm::vec3(0.003f, 0.003f, 0.003f));	// it's a bit too big for our scene, so scale it down
+            }
+            else if (tFrame < 24.0f) {
+                modelk = glm::translate(modelk, glm::vec3(0.0f, -0.4f, 0.0f)); // translate it down so it's at the center of the scene
+                modelk = glm::rotate(modelk, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+                modelk = glm::scale(modelk, glm::vec3(0.006f, 0.006f, 0.006f));	// it's a bit too big for our scene, so scale it down
+            }
+            else if (tFrame < 32.0f) {
+                modelk = glm::translate(modelk, glm::vec3(0.0f, -0.4f, 0.0f)); // translate it down so it's at the center of the scene
+                modelk = glm::rotate(modelk, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+                modelk = glm::scale(modelk, glm::vec3(0.004f, 0.004f, 0.004f));	// it's a bit too big for our scene, so scale it down
+            }
+            else {
+                modelk = glm::translate(modelk, glm::vec3(0.0f, -0.4f, 0.0f)); // translate it down so it's at the center of the scene
+                modelk = glm::rotate(modelk, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+                modelk = glm::scale(modelk, glm::vec3(0.004f, 0.004f, 0.004f));	// it's a bit too big for our scene, so scale it down
+            }
+
+            glm::mat4 horse1model = glm::mat4(1.0f);
+            float horse1angle = finaltime * 2 * PI;
+            horse1model = glm::translate(horse1model, glm::vec3(deltax, deltay, deltaz));
+            horse1model = glm::rotate(horse1model, (horse1angle), glm::vec3(0.0f, 1.0f, 0.0f));
+            if (tFrame < 16.0f) {
+                horse1model = glm::translate(horse1model, glm::vec3(0.0f, -0.4f, 10.0f)); // translate it down so it's at the center of the scene
+                horse1model = glm::rotate(horse1model, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+                horse1model = glm::scale(horse1model, glm::vec3(0.009f, 0.009f, 0.009f));	// it's a bit too big for our scene, so scale it down
+            }
+            else if (tFrame < 24.0f) {
+                horse1model = glm::translate(horse1model, glm::vec3(0.0f, -2.4f, 10.0f)); // translate it down so it's at the center of the scene
+                horse1model = glm::rotate(horse1model, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+                horse1model = glm::scale(horse1model, glm::vec3(0.008f, 0.008f, 0.008f));	// it's a bit too big for our scene, so scale it down
+            }
+            else if (tFrame < 32.0f) {
+                horse1model = glm::translate(horse1model, glm::vec3(0.0f, -2.4f, 10.0f)); // translate it down so it's at the center of the scene
+                horse1model = glm::rotate(horse1model, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+                horse1model = glm::scale(horse1model, glm::vec3(0.005f, 0.005f, 0.005f));	// it's a bit too big for our scene, so scale it down
+            }
+            else {
+                horse1model = glm::translate(horse1model, glm::vec3(0.0f, -2.4f, 10.0f)); // translate it down so it's at the center of the scene
+                horse1model = glm::rotate(horse1model, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+                horse1model = glm::scale(horse1model, glm::vec3(0.005f, 0.005f, 0.005f));	// it's a bit too big for our scene, so scale it down
+            }
+
+            ScenePacket &packet = packets.Back();
+            packet.model = model;
+            packet.man1model = man1model;
+            packet.man2model = man2model;
+            packet.man3model = man3model;
+            packet.modelk = modelk;
+            packet.horse1model = horse1model;
+        });
+    simulation.AddTask("crowd simulate", [&]
+        {
+            if (!crowdMode)
+                return;
+            if (respawnRequested.exchange(false))
+                crowdSimulation.Spawn(respawnHorses, respawnSpectators);
+            crowdSimulation.Update(simulationThread.Step(), packets.Back().crowd);
+        });
+
+    // The render loop's work up to the draw calls is a second frame graph: the detail levels of the interpolated
+    // actors and their shadow casters, the skinning palettes, the shadow cascades and the crowd instance buffers.
+    // Tasks that map buffers run on the main thread, which owns the GL context, the rest anywhere on the job system.
+    // Every task writes its own part of the frame state below.
+    glm::mat4 model, view, projection, man1model, man2model, man3model, modelk, horse1model;
+    unsigned int man1Level = 0, man2Level = 0, man3Level = 0, ourLevel = 0, horse1Level = 0;
+    vector<ShadowCaster> casters;
+    const ScenePacket *previousPacket = nullptr, *currentPacket = nullptr;
+    float alpha = 1.0f;  // how far the frame is from the previous to the current packet
+    CrowdPose crowdPose;
+    FrameGraph frame;
+    unsigned int lodTask = frame.AddTask("select lods", [&]
+        {
+            // detail levels, shared by the shadow and the main pass
+            man1Level = man1Model.SelectLod(man1model, camera.Position, glm::radians(camera.Zoom), (float)SCR_HEIGHT, man1Lod);
+            man2Level = man2Model.SelectLod(man2model, camera.Position, glm::radians(camera.Zoom), (float)SCR_HEIGHT, man2Lod);
+            man3Level = man3Model.SelectLod(man3model, camera.Position, glm::radians(camera.Zoom), (float)SCR_HEIGHT, man3Lod);
+            ourLevel = ourModel.SelectLod(modelk, camera.Position, glm::radians(camera.Zoom), (float)SCR_HEIGHT, ourLod);
+            horse1Level = horse1Model.SelectLod(horse1model, camera.Position, glm::radians(camera.Zoom), (float)SCR_HEIGHT, horse1Lod);
+        });
+    unsigned int herdTask = frame.AddTask("herd palettes", [&] { horses.Update(deltaTime); }, {}, TASK_MAIN_THREAD);
+    frame.AddTask("shadow casters", [&]
+        {
+            // The crowd only receives shadows, casting them would repeat its whole draw for every cascade.
+            casters.clear();
+            if (!crowdMode)
+            {
+                casters.push_back(ShadowCaster(&man1Model, man1model, man1Level));
+                casters.push_back(ShadowCaster(&man2Model, man2model, man2Level));
+                casters.push_back(ShadowCaster(&man3Model, man3model, man3Level));
+                casters.push_back(ShadowCaster(&ourModel, modelk, ourLevel, horses.Range(ourHorse)));
+                casters.push_back(ShadowCaster(&horse1Model, horse1model, horse1Level, horses.Range(horse1)));
+            }
+        }, { lodTask, herdTask });
+    // split the view frustum into shadow cascades
+    frame.AddTask("shadow fit", [&] { shadowMap.Fit(view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f, lightPosition, trackCenter); });
+    unsigned int crowdPoseTask = frame.AddTask("crowd interpolate", [&]
+        {
+            if (crowdMode)
+                crowdPose.Interpolate(previousPacket->crowd, currentPacket->crowd, alpha, jobs);
+        });
+    frame.AddTask("crowd prepare", [&]
+        {
+            if (crowdMode)
+                crowd.Prepare(crowdPose, projection * view, camera.Position, glm::radians(camera.Zoom), (float)SCR_HEIGHT);
+        }, { crowdPoseTask }, TASK_MAIN_THREAD);
+
+    simulationThread.Start([&](float, double time)
+        {
+            simulation.Run(jobs);
+            packets.Back().time = time;
+            packets.Publish();
+        });
+    while (!packets.Acquire())
+        this_thread::yield();
+
+    // rigid actors are queued into the indirect batch, skinned ones are drawn right away with their own shader and
+    // the palette bound by the caller
+    auto drawActor = [&](Model &actor, Shader &actorShader, unsigned int level, const glm::mat4 &transform)
+    {
+        if (!actor.HasSkeleton() && actorBatch.Add(actor, level, transform))
+            return;
+        actorShader.use();
+        actorShader.setMat4("model", transform);
+        actor.Draw(actorShader, level);
+    };
+
+    // the scripted actors, drawn nearest to the camera first; only the horses have a pose to bind
+    struct ActorDraw {
+        Model *model;
+        Shader *shader;
+        const unsigned int *level;
+        const glm::mat4 *transform;
+        const PaletteRange *palette;
+        float distance;
+    };
+    PaletteRange ourPalette, horse1Palette;
+    vector<ActorDraw> actors = {
+        { &man1Model, &man1Shader, &man1Level, &man1model, nullptr, 0.0f },
+        { &man2Model, &man2Shader, &man2Level, &man2model, nullptr, 0.0f },
+        { &man3Model, &man3Shader, &man3Level, &man3model, nullptr, 0.0f },
+        { &ourModel, &ourShader, &ourLevel, &modelk, &ourPalette, 0.0f },
+        { &horse1Model, &horse1Shader, &horse1Level, &horse1model, &horse1Palette, 0.0f }
+    };
+    // the opaque draws of a pass, with the programs the pre-pass picks for it
+    auto drawOpaque = [&]()
+    {
+        cubeBatch.Submit(prepass.Select(shader), ring);
+        if (crowdMode)
+        {
+            Shader &program = prepass.Select(crowdShader);
+            program.use();
+            if (prepass.DepthPass())
+                crowd.DrawDepth(program);
+            else
+                crowd.Draw(program);
+        }
+        else
+        {
+            actorBatch.Clear();
+            for (unsigned int i = 0; i < actors.size(); i++)
+            {
+                if (actors[i].palette)
+                    actors[i].palette->Bind();
+                drawActor(*actors[i].model, prepass.Select(*actors[i].shader), *actors[i].level, *actors[i].transform);
+            }
+            actorBatch.OrderFrontToBack(camera.Position);
+            // the rigid ones, lit by the crowd's instancing shader
+            actorBatch.Submit(prepass.Select(crowdShader), ring);
+        }
+        // the scenery transforms are baked into the static batch, its draws were queued once at load time
+        sceneryBatch.Submit(prepass.Select(grassShader), ring);
+    };
+
     while (!glfwWindowShouldClose(window))
     {
         // per-frame time logic
@@ -258,15 +804,27 @@ int main()
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
-        tFrame = tFrame + deltaTime;
 
         // input
         // -----
         processInput(window);
 
+        // files that changed since the last frame; nothing is drawing now, so programs and meshes can be swapped.
+        // The crowd places its models by their bounds and the herd poses with a copy of the clip's skeleton, both
+        // have to follow a rebuilt model.
+        if (reloader && reloader->Update() > 0)
+        {
+            crowd.Refresh();
+            if (gallop)
+                horses.SetSkeleton(Skeleton(*gallop));
+        }
+
         // render
         // ------
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        if (prepass.Overdraw())
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        else
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         //glm::mat4 transform = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
@@ -283,221 +841,118 @@ int main()
 
         //horse1Shader.use();
         
-        firstTime += deltaTime;
-        if (firstTime > stopTime) {
-            firstTime = firstTime - stopTime;
+        view = camera.GetViewMatrix();
+        projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+
+        // the state between the last two simulation steps, one step behind the simulation
+        packets.Acquire();
+        previousPacket = &packets.Previous();
+        currentPacket = &packets.Current();
+        alpha = InterpolationFactor(previousPacket->time, currentPacket->time, simulationThread.Now() - simulationThread.Step());
+        model = InterpolateTransform(previousPacket->model, currentPacket->model, alpha);
+        man1model = InterpolateTransform(previousPacket->man1model, currentPacket->man1model, alpha);
+        man2model = InterpolateTransform(previousPacket->man2model, currentPacket->man2model, alpha);
+        man3model = InterpolateTransform(previousPacket->man3model, currentPacket->man3model, alpha);
+        modelk = InterpolateTransform(previousPacket->modelk, currentPacket->modelk, alpha);
+        horse1model = InterpolateTransform(previousPacket->horse1model, currentPacket->horse1model, alpha);
+
+        // culling and everything else up to the draw calls, see the frame graph above
+        frame.Run(jobs);
+
+        // texture levels for what is drawn this frame; the camera stands on the scenery, it gets every level
+        float fovy = glm::radians(camera.Zoom);
+        if (crowdMode)
+            crowd.RequestTextures(streamer, fovy, (float)SCR_HEIGHT);
+        else
+        {
+            man1Model.RequestTextures(streamer, man1Model.ProjectedSize(man1model, camera.Position, fovy, (float)SCR_HEIGHT));
+            man2Model.RequestTextures(streamer, man2Model.ProjectedSize(man2model, camera.Position, fovy, (float)SCR_HEIGHT));
+            man3Model.RequestTextures(streamer, man3Model.ProjectedSize(man3model, camera.Position, fovy, (float)SCR_HEIGHT));
+            ourModel.RequestTextures(streamer, ourModel.ProjectedSize(modelk, camera.Position, fovy, (float)SCR_HEIGHT));
+            horse1Model.RequestTextures(streamer, horse1Model.ProjectedSize(horse1model, camera.Position, fovy, (float)SCR_HEIGHT));
         }
-        finaltime = firstTime / stopTime;
-        
+        for (unsigned int i = 0; i < staticScenery.meshes.size(); i++)
+            streamer.Request(staticScenery.meshes[i].materialIndex, INFINITY);
+        streamer.Update();
+
+        // the values every shader shares, uploaded once instead of per shader. Before the shadow pass, every
+        // program has the Frame block and it has to be backed by a buffer even where it isn't read.
+        frameUniforms.view = view;
+        frameUniforms.projection = projection;
+        frameUniforms.viewPos = camera.Position;
+        frameUniforms.lightPosition = lightPosition;
+        shadowMap.Apply(frameUniforms);
+        frameUniforms.Upload(ring);
+
+        // shadow pass: render every caster into the cascades it touches
+        shadowMap.Render(shadowDepthShader, casters);
+        shadowMap.BindTexture();
 
-        //glm::vec3 posi = (1 - tFrame) * (1 - tFrame) * p1 + 2 * (tFrame) * (1 - tFrame) * p2 + tFrame * tFrame * p3;
-        //glm::vec3 deltaPosi = posi - lastPosi;
-        //lastPosi = posi;
-        float posix = pow((1 - finaltime),4) * p1.x + 4 * pow((1 - finaltime), 3) * finaltime * p2.x + 6 * pow((finaltime), 2) * pow((1 - finaltime),2) * p3.x + 4 * pow((finaltime), 3) * (1 - finaltime) * p4.x + pow((finaltime), 4) * p5.x;
-        float posiy = pow((1 - finaltime),4) * p1.y + 4 * pow((1 - finaltime), 3) * finaltime * p2.y + 6 * pow((finaltime), 2) * pow((1 - finaltime),2) * p3.y + 4 * pow((finaltime), 3) * (1 - finaltime) * p4.y + pow((finaltime), 4) * p5.y;
-        float posiz = pow((1 - finaltime),4) * p1.z + 4 * pow((1 - finaltime), 3) * finaltime * p2.z + 6 * pow((finaltime), 2) * pow((1 - finaltime),2) * p3.z + 4 * pow((finaltime), 3) * (1 - finaltime) * p4.z + pow((finaltime), 4) * p5.z;
-        float deltax = posix - lastx;
-        float deltay = posiy - lasty;
-        float deltaz = posiz - lastz;
-        shader.use();
-        glm::mat4 model = glm::mat4(1.0f);
-       // model = glm::translate(model, deltaPosi);
-       // model = glm::translate(model, glm::vec3(deltax, deltay, deltaz));
-        model = glm::translate(model, glm::vec3(5.0f, -0.5f, 0.5f));
-        model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(0.0f, 0.0f, 1.0f));
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        shader.setMat4("model", model);
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
         // cubes
-        glBindVertexArray(cubeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cubeTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-
-        man1Shader.use();
-        glm::mat4 man1model = glm::mat4(1.0f);
-        glm::mat4 man1view = camera.GetViewMatrix();
-        glm::mat4 man1projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        man1model = glm::translate(man1model, glm::vec3(-2.0f, -1.5f, -10.0f)); // translate it down so it's at the center of the scene
-        //man1model = glm::rotate(man1model, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-        man1model = glm::scale(man1model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
-        man1Shader.setMat4("view", man1view);
-        man1Shader.setMat4("projection", man1projection);
-        man1Shader.setVec3("lightPosition", lightPosition);
-        man1Shader.setVec3("viewPos", camera.Position);
-        man1Shader.setMat4("model", man1model);
-        man1Model.Draw(man1Shader);
-
-        man2Shader.use();
-        glm::mat4 man2model = glm::mat4(1.0f);
-        glm::mat4 man2view = camera.GetViewMatrix();
-        glm::mat4 man2projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        if (tFrame > 16.0f && tFrame < 18.0f) {
-            man2model = glm::translate(man2model, glm::vec3(0.0f, -3.5f, -10.0f)); // translate it down so it's at the center of the scene
-            man2model = glm::scale(man2model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
-        }
-        else if (tFrame > 24.0f && tFrame < 26.0f) {
-            man2model = glm::translate(man2model, glm::vec3(0.0f, 3.5f, -10.0f)); // translate it down so it's at the center of the scene
-            man2model = glm::scale(man2model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
-        }
-        else if (tFrame > 32.0f && tFrame < 34.0f) {
-            man2model = glm::translate(man2model, glm::vec3(0.0f, 3.5f, -10.0f)); // translate it down so it's at the center of the scene
-            man2model = glm::scale(man2model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
-        }
-        else {
-            man2model = glm::translate(man2model, glm::vec3(0.0f, -0.5f, -10.0f)); // translate it down so it's at the center of the scene
-            man2model = glm::scale(man2model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
-        }
-
-        man2Shader.setMat4("view", man2view);
-        man2Shader.setMat4("projection", man2projection);
-        man2Shader.setVec3("lightPosition", lightPosition);
-        man2Shader.setVec3("viewPos", camera.Position);
-        man2Shader.setMat4("model", man2model);
-        man2Model.Draw(man2Shader);
-
-        man3Shader.use();
-        glm::mat4 man3model = glm::mat4(1.0f);
-        glm::mat4 man3view = camera.GetViewMatrix();
-        glm::mat4 man3projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        if (tFrame > 16.0f && tFrame < 18.0f) {
-            man3model = glm::translate(man3model, glm::vec3(3.0f, 3.3f, -10.0f)); // translate it down so it's at the center of the scene
-            man3model = glm::scale(man3model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
-        }
-        else if (tFrame > 24.0f && tFrame < 26.0f) {
-            man3model = glm::translate(man3model, glm::vec3(3.0f, -1.3f, -10.0f)); // translate it down so it's at the center of the scene
-            man3model = glm::scale(man3model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
-        }
-        else if (tFrame > 32.0f && tFrame < 34.0f) {
-            man3model = glm::translate(man3model, glm::vec3(3.0f, -1.3f, -10.0f)); // translate it down so it's at the center of the scene
-            man3model = glm::scale(man3model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
-        }
-        else {
-            man3model = glm::translate(man3model, glm::vec3(3.0f, -0.3f, -10.0f)); // translate it down so it's at the center of the scene
-            man3model = glm::scale(man3model, glm::vec3(0.05f, 0.05f, 0.05f));	// it's a bit too big for our scene, so scale it down
-        }
-
-        man3Shader.setMat4("view", man3view);
-        man3Shader.setMat4("projection", man3projection);
-        man3Shader.setVec3("lightPosition", lightPosition);
-        man3Shader.setVec3("viewPos", camera.Position);
-        man3Shader.setMat4("model", man3model);
-        man3Model.Draw(man3Shader);
-
-        ourShader.use();
-        glm::mat4 modelk = glm::mat4(1.0f);
-        //float ABlength = sqrt(deltax * deltax + deltaz * deltaz);
-        float angle = finaltime * 2 * PI;
-        glm::mat4 ourview = camera.GetViewMatrix();
-        glm::mat4 ourprojection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        modelk = glm::translate(modelk, glm::vec3(deltax, deltay, deltaz));
-        modelk = glm::rotate(modelk, (angle), glm::vec3(0.0f, 1.0f, 0.0f));
-        if (tFrame < 16.0f) {
-            modelk = glm::translate(modelk, glm::vec3(0.0f, -2.4f, 0.0f)); // translate it down so it's at the center of the scene
-            modelk = glm::rotate(modelk, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-            modelk = glm::scale(modelk, glm::vec3(0.003f, 0.003f, 0.003f));	// it's a bit too big for our scene, so scale it down
-        }
-        else if (tFrame < 24.0f) {
-            modelk = glm::translate(modelk, glm::vec3(0.0f, -0.4f, 0.0f)); // translate it down so it's at the center of the scene
-            modelk = glm::rotate(modelk, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-            modelk = glm::scale(modelk, glm::vec3(0.006f, 0.006f, 0.006f));	// it's a bit too big for our scene, so scale it down
-        }
-        else if (tFrame < 32.0f) {
-            modelk = glm::translate(modelk, glm::vec3(0.0f, -0.4f, 0.0f)); // translate it down so it's at the center of the scene
-            modelk = glm::rotate(modelk, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-            modelk = glm::scale(modelk, glm::vec3(0.004f, 0.004f, 0.004f));	// it's a bit too big for our scene, so scale it down
-        }
-        else {
-            modelk = glm::translate(modelk, glm::vec3(0.0f, -0.4f, 0.0f)); // translate it down so it's at the center of the scene
-            modelk = glm::rotate(modelk, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-            modelk = glm::scale(modelk, glm::vec3(0.004f, 0.004f, 0.004f));	// it's a bit too big for our scene, so scale it down
-        }
-
-        ourShader.setMat4("view", ourview);
-        ourShader.setMat4("projection", ourprojection);
-        ourShader.setVec3("lightPosition", lightPosition);
-        ourShader.setVec3("viewPos", camera.Position);
-        ourShader.setMat4("model", modelk);
-        ourModel.Draw(ourShader);
-
-        horse1Shader.use();
-        glm::mat4 horse1model = glm::mat4(1.0f);
-        glm::mat4 horse1view = camera.GetViewMatrix();
-        glm::mat4 horse1projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        float horse1angle = finaltime * 2 * PI;
-        horse1model = glm::translate(horse1model, glm::vec3(deltax, deltay, deltaz));
-        horse1model = glm::rotate(horse1model, (horse1angle), glm::vec3(0.0f, 1.0f, 0.0f));
-        if (tFrame < 16.0f) {
-            horse1model = glm::translate(horse1model, glm::vec3(0.0f, -0.4f, 10.0f)); // translate it down so it's at the center of the scene
-            horse1model = glm::rotate(horse1model, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-            horse1model = glm::scale(horse1model, glm::vec3(0.009f, 0.009f, 0.009f));	// it's a bit too big for our scene, so scale it down
-        }
-        else if (tFrame < 24.0f) {
-            horse1model = glm::translate(horse1model, glm::vec3(0.0f, -2.4f, 10.0f)); // translate it down so it's at the center of the scene
-            horse1model = glm::rotate(horse1model, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-            horse1model = glm::scale(horse1model, glm::vec3(0.008f, 0.008f, 0.008f));	// it's a bit too big for our scene, so scale it down
-        }
-        else if (tFrame < 32.0f) {
-            horse1model = glm::translate(horse1model, glm::vec3(0.0f, -2.4f, 10.0f)); // translate it down so it's at the center of the scene
-            horse1model = glm::rotate(horse1model, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-            horse1model = glm::scale(horse1model, glm::vec3(0.005f, 0.005f, 0.005f));	// it's a bit too big for our scene, so scale it down
+        cubeBatch.Clear();
+        cubeBatch.Add(cubeMesh, 0, model);
+
+        // near to far, so the depth test rejects hidden fragments before they are shaded: the actors among
+        // themselves, then the scenery they stand on
+        ourPalette = horses.Range(ourHorse);
+        horse1Palette = horses.Range(horse1);
+        for (unsigned int i = 0; i < actors.size(); i++)
+        {
+            glm::vec3 center;
+            float radius;
+            actors[i].model->WorldBounds(*actors[i].transform, center, radius);
+            actors[i].distance = glm::length(center - camera.Position);
         }
-        else {
-            horse1model = glm::translate(horse1model, glm::vec3(0.0f, -2.4f, 10.0f)); // translate it down so it's at the center of the scene
-            horse1model = glm::rotate(horse1model, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-            horse1model = glm::scale(horse1model, glm::vec3(0.005f, 0.005f, 0.005f));	// it's a bit too big for our scene, so scale it down
+        sort(actors.begin(), actors.end(), [](const ActorDraw &a, const ActorDraw &b) { return a.distance < b.distance; });
+        sceneryBatch.OrderFrontToBack(camera.Position);
+
+        prepass.BeginFrame();
+        if (prepass.Enabled())
+            drawOpaque();
+        prepass.BeginShading();
+        drawOpaque();
+        prepass.EndFrame();
+
+        // draw skybox as last, the overdraw view only counts the opaque scene
+        if (!prepass.Overdraw())
+        {
+            glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+            skyboxShader.use();
+            // skybox cube
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            arena.Draw(skyboxGeometry, 0, 36);
+            glDepthFunc(GL_LESS); // set depth function back to default
         }
 
-        horse1Shader.setMat4("view", horse1view);
-        horse1Shader.setMat4("projection", horse1projection);
-        horse1Shader.setVec3("lightPosition", lightPosition);
-        horse1Shader.setVec3("viewPos", camera.Position);
-        horse1Shader.setMat4("model", horse1model);
-        horse1Model.Draw(horse1Shader);
-
-
-        grassShader.use();
-        glm::mat4 grassview = camera.GetViewMatrix();
-        glm::mat4 grassprojection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 grassmodel = glm::mat4(1.0f);
-        grassmodel = glm::translate(grassmodel, glm::vec3(0.0f, -10.0f, 0.0f));
-        grassmodel = glm::rotate(grassmodel, glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-        //grassmodel = glm::rotate(grassmodel, glm::vec3(0.0f, 0.0f, 1.0f));
-        //grassmodel = glm::translate(grassmodel, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
-        //grassmodel = glm::scale(grassmodel, glm::vec3(4.0f, 4.0f, 4.0f));	// it's a bit too big for our scene, so scale it down
-        grassShader.setMat4("model", grassmodel);
-        grassShader.setMat4("view", grassview);
-        grassShader.setMat4("projection", grassprojection);
-        grassGroundModel.Draw(grassShader);
-        // draw skybox as last
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
+        // fence this frame's part of the stream ring, and make sure the GPU is done with the part the next one writes
+        ring.EndFrame();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (crowdBenchmark)
+        {
+            if (benchmark.Record(crowd.stats, deltaTime * 1000.0f))
+            {
+                respawnHorses = benchmark.Horses();
+                respawnSpectators = benchmark.Spectators();
+                respawnRequested = true;
+            }
+            else if (benchmark.Done())
+                glfwSetWindowShouldClose(window, true);
+        }
     }
 
-    // optional: de-allocate all resources once they've outlived their purpose:
-    // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteBuffers(1, &cubeVBO);
-    glDeleteBuffers(1, &skyboxVBO);
+    simulationThread.Stop();
+    streamer.PrintStats();
+    prepass.PrintStats();
+    if (crowdMode && occlusionCulling)
+        printf("OCCLUSION:: last frame: %u of %u instances in the view hidden (%u horses, %u spectators) behind %u occluders, %u triangles rasterized in %.3f ms, %.3f ms in all\n",
+            crowd.occlusion.stats.culled, crowd.occlusion.stats.tested, crowd.stats.horsesOccluded, crowd.stats.spectatorsOccluded,
+            crowd.occlusion.stats.occluders, crowd.occlusion.stats.triangles, crowd.occlusion.stats.rasterizeMs, crowd.stats.occlusionMs);
 
     glfwTerminate();
     return 0;
@@ -560,39 +1015,7 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 // ---------------------------------------------------
 unsigned int loadTexture(char const* path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return LoadTexture2D(path);
 }
 
 // loads a cubemap texture from 6 individual texture faces
@@ -606,30 +1029,5 @@ unsigned int loadTexture(char const* path)
 // -------------------------------------------------------
 unsigned int loadCubemap(vector<std::string> faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    return LoadTextureCube(faces);
 }
\ No newline at end of file
@@ -1,15 +1,15 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoords;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in mat4 instanceModel; // model matrix of the draw, see IndirectBatch in learnopengl/indirect_draw.h
 
-out vec2 TexCoords;
+// the depth-only programs of DepthPrepass run this shader too and must land on the same depth
+invariant gl_Position;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+out vec2 TexCoords;
 
 void main()
 {
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * instanceModel * vec4(aPos, 1.0);
 }
\ No newline at end of file
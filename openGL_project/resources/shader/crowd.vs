@@ -0,0 +1,30 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in mat4 instanceModel; // one model matrix per instance, see Mesh::DrawInstanced and IndirectBatch
+// material of the draw, -1 unless IndirectBatch merged several materials into one call
+layout (location = 11) in float instanceMaterial;
+
+// the depth-only programs of DepthPrepass run this shader too and must land on the same depth
+invariant gl_Position;
+
+out vec2 TexCoords;
+out vec3 fsNormal;
+out vec3 FragPos;  
+out float ViewDepth;
+flat out int MaterialIndex;
+
+uniform int materialIndex;
+
+void main()
+{
+    MaterialIndex = instanceMaterial >= 0.0 ? int(instanceMaterial) : materialIndex;
+    TexCoords = aTexCoords;    
+    FragPos = vec3(instanceModel * vec4(aPos, 1.0));
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    // instances face every direction, so the normal has to turn with them. The scale is uniform, the fragment
+    // shader renormalizes.
+    fsNormal = mat3(instanceModel) * aNormal;
+    ViewDepth = -(view * vec4(FragPos, 1.0)).z;
+}
\ No newline at end of file
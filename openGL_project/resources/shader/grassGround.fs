@@ -2,10 +2,14 @@
 out vec4 FragColor;
 
 in vec2 TexCoords;
-
-uniform sampler2D texture_diffuse1;
+in vec3 FragPos;
+in float ViewDepth;
+flat in int MaterialIndex;
 
 void main()
 {    
-    FragColor = texture(texture_diffuse1, TexCoords);
+    // the ground is unlit, shadowed parts are only darkened
+    float shadow = ShadowFactor(FragPos, ViewDepth, 0.0005);
+    vec4 color = DiffuseColor(MaterialIndex, TexCoords);
+    FragColor = vec4(color.rgb * (1.0 - 0.6 * shadow), color.a);
 }
\ No newline at end of file
@@ -2,15 +2,25 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in mat4 instanceModel; // model matrix of the draw, see IndirectBatch in learnopengl/indirect_draw.h
+// material of the draw, -1 unless IndirectBatch merged several materials into one call
+layout (location = 11) in float instanceMaterial;
+
+// the depth-only programs of DepthPrepass run this shader too and must land on the same depth
+invariant gl_Position;
 
 out vec2 TexCoords;
+out vec3 FragPos;
+out float ViewDepth;
+flat out int MaterialIndex;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform int materialIndex;
 
 void main()
 {
+    MaterialIndex = instanceMaterial >= 0.0 ? int(instanceMaterial) : materialIndex;
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * instanceModel * vec4(aPos, 1.0);
+    FragPos = vec3(instanceModel * vec4(aPos, 1.0));
+    ViewDepth = -(view * vec4(FragPos, 1.0)).z;
 }
\ No newline at end of file
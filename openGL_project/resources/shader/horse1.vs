@@ -2,19 +2,29 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in ivec4 boneIds;
+layout (location = 6) in vec4 weights;
+
+// the depth-only programs of DepthPrepass run this shader too and must land on the same depth
+invariant gl_Position;
 
 out vec2 TexCoords;
 out vec3 fsNormal;
 out vec3 FragPos;  
+out float ViewDepth;
+flat out int MaterialIndex;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform int materialIndex;
 
 void main()
 {
+    MaterialIndex = materialIndex;
+    mat4 skin = SkinMatrix(boneIds, weights);
+    vec4 skinnedPos = skin * vec4(aPos, 1.0);
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    fsNormal = aNormal;
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    gl_Position = projection * view * model * skinnedPos;
+    fsNormal = mat3(skin) * aNormal;
+    FragPos = vec3(model * skinnedPos);
+    ViewDepth = -(view * vec4(FragPos, 1.0)).z;
 }
\ No newline at end of file
@@ -4,28 +4,29 @@ out vec4 FragColor;
 in vec2 TexCoords;
 in vec3 fsNormal;
 in vec3 FragPos;
+in float ViewDepth;
 
-uniform sampler2D texture_diffuse1;
-uniform vec3 lightPosition;
-uniform vec3 viewPos;
+uniform int materialIndex;
 
 void main()
 {    
+    vec4 lighting = materials[materialIndex].lighting;
     vec3 norm = normalize(fsNormal);
     vec3 lightDir = normalize(lightPosition - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
     vec3 lightColor = vec3(1.0f,1.0f,1.0f);
     vec3 diffuse = diff * lightColor;
-    float ambientStrength = 0.1;
+    float ambientStrength = lighting.x;
     vec3 ambient = ambientStrength * lightColor;
-    float specularStrength = 0.8;
+    float specularStrength = lighting.y;
     vec3 viewDir = normalize(viewPos - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), lighting.z);
     vec3 specular = specularStrength * spec * lightColor;
-    vec3 objectColor = vec3(texture(texture_diffuse1, TexCoords).xyz);
+    vec3 objectColor = DiffuseColor(materialIndex, TexCoords).rgb;
     //vec3 result = (ambient + diffuse) * objectColor;
-    vec3 result = (ambient + diffuse + specular) * objectColor;
+    float shadow = ShadowFactor(FragPos, ViewDepth, norm, lightDir);
+    vec3 result = (ambient + (1.0 - shadow) * (diffuse + specular)) * objectColor;
     //vec3 result = vec3(0.0, 0.0, 1.0);
     FragColor =  vec4(result, 1.0);
 }
\ No newline at end of file
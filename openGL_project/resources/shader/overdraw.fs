@@ -0,0 +1,9 @@
+#version 330 core
+out vec4 FragColor;
+
+// every shaded fragment adds the same color, additively blended: the more often a pixel was shaded, the brighter.
+// Red saturates at four fragments, green at eight and blue at sixteen, see DepthPrepass in learnopengl/depth_prepass.h
+void main()
+{
+    FragColor = vec4(0.25, 0.125, 0.0625, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+// Shared by every fragment shader, Shader inserts it after the #version line. Only what a shader uses ends up in
+// its program.
+
+// per-material lighting parameters, see MaterialLibrary in learnopengl/material.h
+struct MaterialParams {
+    vec4 lighting;    // x: ambient strength, y: specular strength, z: shininess, w: layer of the diffuse array
+    vec4 diffuseRect; // of the diffuse texture in its layer of texture_diffuse_array, all 0 when it isn't packed
+};
+layout (std140) uniform Materials {
+    MaterialParams materials[64]; // MAX_MATERIALS
+};
+
+uniform sampler2D texture_diffuse1;
+uniform sampler2DArray texture_diffuse_array;
+uniform sampler2DArrayShadow shadowMap;
+
+// per-frame values shared by every lit shader, see FrameUniforms in learnopengl/frame_uniforms.h
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    vec3 lightPosition;
+    mat4 lightSpaceMatrices[4]; // MAX_SHADOW_CASCADES, cascaded shadow map, see ShadowMap in learnopengl/shadow_map.h
+    vec4 cascadeSplits;         // far view distance of every cascade
+    int cascadeCount;
+};
+
+// the diffuse texture of a material, from its rectangle of a texture_diffuse_array layer if it was packed, see
+// TextureArrayPacker in learnopengl/texture_array.h
+vec4 DiffuseColor(int material, vec2 uv)
+{
+    // outside the branch, the neighbouring pixels may belong to a draw of another material
+    vec2 dx = dFdx(uv), dy = dFdy(uv);
+    vec4 rect = materials[material].diffuseRect;
+    if (rect.z == 0.0)
+        return textureGrad(texture_diffuse1, uv, dx, dy);
+    // the coordinates wrap inside the rectangle; the gradients come from the unwrapped ones, so the wrap doesn't
+    // select the smallest level
+    return textureGrad(texture_diffuse_array, vec3(rect.xy + fract(uv) * rect.zw, materials[material].lighting.w), dx * rect.zw, dy * rect.zw);
+}
+
+// fraction of the light that is blocked, 3x3 taps of the hardware 2x2 comparison filter in the cascade covering
+// the fragment's view distance. bias is subtracted from the fragment's depth in the light.
+float ShadowFactor(vec3 fragPos, float viewDepth, float bias)
+{
+    int cascade = -1;
+    for (int i = cascadeCount - 1; i >= 0; --i)
+        if (viewDepth < cascadeSplits[i])
+            cascade = i;
+    if (cascade < 0)
+        return 0.0;
+    vec3 projCoords = (lightSpaceMatrices[cascade] * vec4(fragPos, 1.0)).xyz;
+    projCoords = projCoords * 0.5 + 0.5;
+    if (projCoords.z > 1.0)
+        return 0.0;
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; ++x)
+        for (int y = -1; y <= 1; ++y)
+            lit += texture(shadowMap, vec4(projCoords.xy + vec2(x, y) * texelSize, float(cascade), projCoords.z - bias));
+    return 1.0 - lit / 9.0;
+}
+
+// the same with a bias that grows as the surface turns away from the light, for lit surfaces
+float ShadowFactor(vec3 fragPos, float viewDepth, vec3 norm, vec3 lightDir)
+{
+    return ShadowFactor(fragPos, viewDepth, max(0.0005 * (1.0 - dot(norm, lightDir)), 0.0001));
+}
\ No newline at end of file
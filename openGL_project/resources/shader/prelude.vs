@@ -0,0 +1,31 @@
+// Shared by every vertex shader, Shader inserts it after the #version line. Only what a shader uses ends up in
+// its program.
+
+// per-frame values shared by every lit shader, see FrameUniforms in learnopengl/frame_uniforms.h
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    vec3 lightPosition;
+    mat4 lightSpaceMatrices[4]; // MAX_SHADOW_CASCADES, cascaded shadow map, see ShadowMap in learnopengl/shadow_map.h
+    vec4 cascadeSplits;         // far view distance of every cascade
+    int cascadeCount;
+};
+
+// final bone matrices of the instance, see BonePalette in learnopengl/bone_palette.h
+layout (std140) uniform Bones {
+    mat4 finalBonesMatrices[100]; // MAX_BONES
+};
+
+// linear blend skinning. Vertices without bones have no weights and stay where they are.
+mat4 SkinMatrix(ivec4 boneIds, vec4 weights)
+{
+    float total = weights.x + weights.y + weights.z + weights.w;
+    if (total <= 0.0)
+        return mat4(1.0);
+    mat4 skin = mat4(0.0);
+    for (int i = 0; i < 4; ++i)
+        if (boneIds[i] >= 0)
+            skin += finalBonesMatrices[boneIds[i]] * weights[i];
+    return skin;
+}
\ No newline at end of file
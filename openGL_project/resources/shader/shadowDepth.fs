@@ -0,0 +1,6 @@
+#version 330 core
+
+void main()
+{
+    // depth only, the depth buffer is written by the fixed function stage
+}
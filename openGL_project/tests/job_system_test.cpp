@@ -0,0 +1,199 @@
+// Headless checks of the job system and the frame graph, no window or GL context needed.
+// Runs every check and exits with 0, a failing assert aborts. The asserts stay on in release builds.
+#undef NDEBUG
+#include <cassert>
+
+#include "learnopengl/job_system.h"
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+using namespace std;
+
+// every index of [0, count) is handed to exactly one batch, batches are non-empty and at most batchSize long
+static void testParallelForCoverage(JobSystem &jobs, unsigned int count, unsigned int batchSize)
+{
+    vector<atomic<unsigned int>> hits(count);
+    for (unsigned int i = 0; i < count; i++)
+        hits[i] = 0;
+    atomic<unsigned int> calls(0);
+    jobs.ParallelFor(count, batchSize, [&](unsigned int begin, unsigned int end)
+    {
+        assert(begin < end);
+        assert(end <= count);
+        assert(end - begin <= max(1u, batchSize));
+        for (unsigned int i = begin; i < end; i++)
+            hits[i]++;
+        calls++;
+    });
+    for (unsigned int i = 0; i < count; i++)
+        assert(hits[i] == 1);
+    if (count == 0)
+        assert(calls == 0);
+}
+
+static void testParallelFor(JobSystem &jobs)
+{
+    const unsigned int batchSize = 16;
+    unsigned int counts[] = { 0, 1, batchSize - 1, batchSize, batchSize + 1, batchSize * 2, batchSize * 5 + 3, 1001 };
+    for (unsigned int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+        testParallelForCoverage(jobs, counts[i], batchSize);
+    // a batch size of 0 counts as 1, one that covers everything runs on the calling thread
+    testParallelForCoverage(jobs, 7, 0);
+    testParallelForCoverage(jobs, 7, 3);
+    testParallelForCoverage(jobs, 7, 100);
+}
+
+// jobs that start nested work and wait for it, on a worker or on the waiting thread, still finish
+static void testNestedWait(JobSystem &jobs)
+{
+    const unsigned int outer = 8, inner = 32;
+    atomic<unsigned int> leaves(0);
+    JobCounter counter;
+    for (unsigned int i = 0; i < outer; i++)
+        jobs.Run([&jobs, &leaves]
+        {
+            JobCounter nested;
+            for (unsigned int j = 0; j < inner; j++)
+                jobs.Run([&leaves] { leaves++; }, &nested);
+            jobs.Wait(nested);
+            assert(nested.pending == 0);
+        }, &counter);
+    jobs.Wait(counter);
+    assert(counter.pending == 0);
+    assert(leaves == outer * inner);
+
+    // a parallel loop inside the batches of another one
+    atomic<unsigned int> items(0);
+    jobs.ParallelFor(64, 4, [&jobs, &items](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; i++)
+            jobs.ParallelFor(50, 8, [&items](unsigned int b, unsigned int e) { items += e - b; });
+    });
+    assert(items == 64 * 50);
+}
+
+// jobs queued by a thread that then blocks without running any of them are stolen and run by the workers
+static void testStealing(JobSystem &jobs)
+{
+    assert(jobs.ThreadCount() > 1);
+    const unsigned int count = 64;
+    thread::id owner = this_thread::get_id();
+    atomic<unsigned int> ran(0), onOwner(0);
+    JobCounter counter;
+    for (unsigned int i = 0; i < count; i++)
+        jobs.Run([&ran, &onOwner, owner]
+        {
+            if (this_thread::get_id() == owner)
+                onOwner++;
+            ran++;
+        }, &counter);
+    // blocked: neither Wait nor RunOne, only the other threads can empty this thread's deque
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(10);
+    while (counter.pending.load() > 0 && chrono::steady_clock::now() < deadline)
+        this_thread::sleep_for(chrono::milliseconds(1));
+    assert(counter.pending == 0);
+    assert(ran == count);
+    assert(onOwner == 0);
+}
+
+// every task runs once per Run, after all of its dependencies, and main thread tasks run on the calling thread
+static void testFrameGraph(JobSystem &jobs)
+{
+    FrameGraph graph;
+    vector<vector<unsigned int>> dependencies;
+    vector<TaskAffinity> affinities;
+    const unsigned int taskCount = 12;
+    vector<atomic<unsigned int>> order(taskCount), runs(taskCount);
+    vector<thread::id> threads(taskCount);
+    atomic<unsigned int> sequence(0);
+
+    // two chains of three that fan into a main thread task, a diamond below it, and two independent roots
+    unsigned int deps[taskCount][3] = {
+        { ~0u }, { 0, ~0u }, { 1, ~0u },          // chain a
+        { ~0u }, { 3, ~0u }, { 4, ~0u },          // chain b
+        { 2, 5, ~0u },                            // join, main thread
+        { 6, ~0u }, { 6, ~0u }, { 7, 8, ~0u },    // diamond, its join on the main thread
+        { ~0u }, { ~0u },                         // roots, the second on the main thread
+    };
+    for (unsigned int t = 0; t < taskCount; t++)
+    {
+        vector<unsigned int> taskDependencies;
+        for (unsigned int d = 0; deps[t][d] != ~0u; d++)
+            taskDependencies.push_back(deps[t][d]);
+        TaskAffinity affinity = (t == 6 || t == 9 || t == 11) ? TASK_MAIN_THREAD : TASK_ANY_THREAD;
+        unsigned int id = graph.AddTask("task", [t, &order, &runs, &threads, &sequence]
+        {
+            // a little work, so tasks overlap
+            this_thread::sleep_for(chrono::microseconds(200));
+            threads[t] = this_thread::get_id();
+            runs[t]++;
+            order[t] = sequence++;
+        }, taskDependencies, affinity);
+        assert(id == t);
+        dependencies.push_back(taskDependencies);
+        affinities.push_back(affinity);
+    }
+    assert(graph.TaskCount() == taskCount);
+
+    for (unsigned int frame = 0; frame < 20; frame++)
+    {
+        for (unsigned int t = 0; t < taskCount; t++)
+            runs[t] = 0;
+        sequence = 0;
+        graph.Run(jobs);
+        for (unsigned int t = 0; t < taskCount; t++)
+        {
+            assert(runs[t] == 1);
+            for (unsigned int d = 0; d < dependencies[t].size(); d++)
+                assert(order[dependencies[t][d]] < order[t]);
+            if (affinities[t] == TASK_MAIN_THREAD)
+                assert(threads[t] == this_thread::get_id());
+        }
+    }
+}
+
+// a graph without main thread tasks may be run by a thread outside the system, here next to a loop on the main thread
+static void testFrameGraphOffMainThread(JobSystem &jobs)
+{
+    FrameGraph graph;
+    atomic<unsigned int> runs(0);
+    unsigned int first = graph.AddTask("first", [&runs] { runs++; });
+    unsigned int second = graph.AddTask("second", [&jobs, &runs] { jobs.ParallelFor(100, 10, [&runs](unsigned int, unsigned int) { runs++; }); }, { first });
+    graph.AddTask("third", [&runs] { runs++; }, { second });
+    thread other([&graph, &jobs]
+    {
+        for (unsigned int frame = 0; frame < 20; frame++)
+            graph.Run(jobs);
+    });
+    atomic<unsigned int> items(0);
+    for (unsigned int frame = 0; frame < 20; frame++)
+        jobs.ParallelFor(1000, 50, [&items](unsigned int b, unsigned int e) { items += e - b; });
+    other.join();
+    assert(runs == 20 * 12);
+    assert(items == 20 * 1000);
+}
+
+int main()
+{
+    {
+        JobSystem jobs(4);
+        testParallelFor(jobs);
+        testNestedWait(jobs);
+        testStealing(jobs);
+        testFrameGraph(jobs);
+        testFrameGraphOffMainThread(jobs);
+    }
+    {
+        // without workers everything runs on the calling thread
+        JobSystem single(1);
+        testParallelFor(single);
+        testNestedWait(single);
+        testFrameGraph(single);
+        testFrameGraphOffMainThread(single);
+    }
+    printf("JOB_SYSTEM_TEST:: all checks passed\n");
+    return 0;
+}